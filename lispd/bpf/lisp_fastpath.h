@@ -0,0 +1,121 @@
+/*
+ * lisp_fastpath.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Maps shared by the tc eBPF fast path and lispd.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISP_FASTPATH_H_
+#define LISP_FASTPATH_H_
+
+#include <linux/types.h>
+
+/*
+ * The maps are created and pinned by tc when the programs are attached and are
+ * filled by lispd from the local database and the map cache.
+ */
+#define FP_PIN_PATH                 "/sys/fs/bpf/tc/globals"
+
+/* Names of the maps. They must match the name of the map definitions of lisp_fastpath_kern.c */
+#define FP_MAP_LCL_V4               "lisp_fp_lcl_v4"    /* Local EID prefixes */
+#define FP_MAP_LCL_V6               "lisp_fp_lcl_v6"
+#define FP_MAP_RMT_V4               "lisp_fp_rmt_v4"    /* Map cache */
+#define FP_MAP_RMT_V6               "lisp_fp_rmt_v6"
+#define FP_MAP_RLOCS                "lisp_fp_rlocs"     /* Addresses of the local RLOCs */
+#define FP_MAP_CONF                 "lisp_fp_conf"
+
+#define FP_SEC_ENCAP                "lisp_encap"        /* Egress of the tun interface */
+#define FP_SEC_DECAP                "lisp_decap"        /* Ingress of the RLOC interfaces */
+
+#define FP_MAX_LCL_PREFIXES         256
+#define FP_MAX_RMT_PREFIXES         65536
+#define FP_MAX_RLOCS                64                  /* Max length of a balancing vector */
+#define FP_MAX_LCL_RLOCS            32
+
+#define FP_ACT_ENCAP                0
+#define FP_ACT_DROP                 1
+
+#define FP_LISP_DATA_PORT           4341
+
+/*
+ * Keys of the LPM trie maps
+ */
+struct fp_key_v4 {
+    __u32   prefixlen;
+    __u8    addr[4];
+};
+
+struct fp_key_v6 {
+    __u32   prefixlen;
+    __u8    addr[16];
+};
+
+/*
+ * Key of the local RLOC addresses map. The address is padded with zeros
+ */
+struct fp_rloc_key {
+    __u32   family;
+    __u8    addr[16];
+};
+
+/*
+ * Local locator usable by the fast path (only IPv4 RLOCs are encapsulated by the fast path)
+ */
+struct fp_lcl_rloc {
+    __be32  addr;
+    __u32   ifindex;
+    __u32   mtu;
+};
+
+/*
+ * Value of a local EID prefix: IPv4 balancing vector of the source locators
+ */
+struct fp_lcl_entry {
+    __u32               rloc_count;
+    struct fp_lcl_rloc  rlocs[FP_MAX_LCL_RLOCS];
+};
+
+/*
+ * Value of a map cache entry: IPv4 balancing vector of the destination locators
+ */
+struct fp_rmt_entry {
+    __u32   action;
+    __u32   rloc_count;
+    __be32  rlocs[FP_MAX_RLOCS];
+};
+
+/*
+ * Value of the entry 0 of the configuration map
+ */
+struct fp_conf {
+    __u32   tun_ifindex;
+};
+
+#endif /* LISP_FASTPATH_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
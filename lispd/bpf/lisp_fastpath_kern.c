@@ -0,0 +1,394 @@
+/*
+ * lisp_fastpath_kern.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * tc eBPF fast path: LISP encapsulation of the packets sent to the tun interface
+ * and decapsulation of the packets received in the RLOC interfaces.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+/*
+ * Build:   clang -O2 -target bpf -c lisp_fastpath_kern.c -o lisp_fastpath_kern.o
+ *
+ * The programs are attached by lispd with tc (fast-path option). Every packet that
+ * can not be handled here (map cache miss, negative entry, IPv6 RLOCs, packets bigger
+ * than the MTU, fragments, ...) continues its normal path and is processed by lispd.
+ * The map definitions use the iproute2 format so no library is required to load them.
+ */
+
+#include <stddef.h>
+#include <linux/bpf.h>
+#include <linux/pkt_cls.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+#include "lisp_fastpath.h"
+
+#define __section(NAME)         __attribute__((section(NAME), used))
+#define __inline                inline __attribute__((always_inline))
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define fp_htons(x)             __builtin_bswap16(x)
+#else
+#define fp_htons(x)             (x)
+#endif
+
+#define FP_AF_INET              2
+#define FP_AF_INET6             10
+#define FP_IP_DF                0x4000
+#define FP_IP_FRAG_MASK         0x3fff
+#define FP_LISP_HDR_LEN         8
+
+/* Flags of bpf_skb_adjust_room to change the family of the packet when decapsulating (linux >= 6.3) */
+#define FP_ADJ_ROOM_DECAP_L3_IPV4   (1ULL << 7)
+#define FP_ADJ_ROOM_DECAP_L3_IPV6   (1ULL << 8)
+
+/*
+ * Outer headers added by the fast path. Same headers than encapsulate_packet()
+ */
+struct fp_encap_hdr {
+    struct iphdr    ip;
+    struct udphdr   udp;
+    __u8            lisp[FP_LISP_HDR_LEN];
+};
+
+/*
+ * Map definition of iproute2
+ */
+struct bpf_elf_map {
+    __u32   type;
+    __u32   size_key;
+    __u32   size_value;
+    __u32   max_elem;
+    __u32   flags;
+    __u32   id;
+    __u32   pinning;
+    __u32   inner_id;
+    __u32   inner_idx;
+};
+
+#define PIN_GLOBAL_NS           2
+
+/*
+ * Helpers
+ */
+static void *(*bpf_map_lookup_elem)(void *map, const void *key) =
+        (void *) BPF_FUNC_map_lookup_elem;
+static int (*bpf_skb_load_bytes)(const struct __sk_buff *skb, __u32 offset, void *to, __u32 len) =
+        (void *) BPF_FUNC_skb_load_bytes;
+static int (*bpf_skb_store_bytes)(struct __sk_buff *skb, __u32 offset, const void *from, __u32 len, __u64 flags) =
+        (void *) BPF_FUNC_skb_store_bytes;
+static int (*bpf_skb_adjust_room)(struct __sk_buff *skb, __s32 len_diff, __u32 mode, __u64 flags) =
+        (void *) BPF_FUNC_skb_adjust_room;
+static __u32 (*bpf_get_hash_recalc)(struct __sk_buff *skb) =
+        (void *) BPF_FUNC_get_hash_recalc;
+static int (*bpf_redirect)(__u32 ifindex, __u64 flags) =
+        (void *) BPF_FUNC_redirect;
+static int (*bpf_redirect_neigh)(__u32 ifindex, void *params, int plen, __u64 flags) =
+        (void *) BPF_FUNC_redirect_neigh;
+
+/*
+ * Maps
+ */
+struct bpf_elf_map __section("maps") lisp_fp_lcl_v4 = {
+    .type           = BPF_MAP_TYPE_LPM_TRIE,
+    .size_key       = sizeof(struct fp_key_v4),
+    .size_value     = sizeof(struct fp_lcl_entry),
+    .max_elem       = FP_MAX_LCL_PREFIXES,
+    .flags          = BPF_F_NO_PREALLOC,
+    .pinning        = PIN_GLOBAL_NS,
+};
+
+struct bpf_elf_map __section("maps") lisp_fp_lcl_v6 = {
+    .type           = BPF_MAP_TYPE_LPM_TRIE,
+    .size_key       = sizeof(struct fp_key_v6),
+    .size_value     = sizeof(struct fp_lcl_entry),
+    .max_elem       = FP_MAX_LCL_PREFIXES,
+    .flags          = BPF_F_NO_PREALLOC,
+    .pinning        = PIN_GLOBAL_NS,
+};
+
+struct bpf_elf_map __section("maps") lisp_fp_rmt_v4 = {
+    .type           = BPF_MAP_TYPE_LPM_TRIE,
+    .size_key       = sizeof(struct fp_key_v4),
+    .size_value     = sizeof(struct fp_rmt_entry),
+    .max_elem       = FP_MAX_RMT_PREFIXES,
+    .flags          = BPF_F_NO_PREALLOC,
+    .pinning        = PIN_GLOBAL_NS,
+};
+
+struct bpf_elf_map __section("maps") lisp_fp_rmt_v6 = {
+    .type           = BPF_MAP_TYPE_LPM_TRIE,
+    .size_key       = sizeof(struct fp_key_v6),
+    .size_value     = sizeof(struct fp_rmt_entry),
+    .max_elem       = FP_MAX_RMT_PREFIXES,
+    .flags          = BPF_F_NO_PREALLOC,
+    .pinning        = PIN_GLOBAL_NS,
+};
+
+struct bpf_elf_map __section("maps") lisp_fp_rlocs = {
+    .type           = BPF_MAP_TYPE_HASH,
+    .size_key       = sizeof(struct fp_rloc_key),
+    .size_value     = sizeof(__u32),
+    .max_elem       = FP_MAX_LCL_RLOCS,
+    .pinning        = PIN_GLOBAL_NS,
+};
+
+struct bpf_elf_map __section("maps") lisp_fp_conf = {
+    .type           = BPF_MAP_TYPE_ARRAY,
+    .size_key       = sizeof(__u32),
+    .size_value     = sizeof(struct fp_conf),
+    .max_elem       = 1,
+    .pinning        = PIN_GLOBAL_NS,
+};
+
+
+static __inline __u16 fp_ip_checksum(struct iphdr *iph)
+{
+    __u16   *buf    = (__u16 *)iph;
+    __u32   sum     = 0;
+    int     ctr     = 0;
+
+#pragma unroll
+    for (ctr = 0 ; ctr < sizeof(struct iphdr) / 2 ; ctr++){
+        sum += buf[ctr];
+    }
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return ((__u16)~sum);
+}
+
+
+/*
+ * Encapsulate the packets sent to the tun interface whose source is a local EID and whose
+ * destination has an IPv4 locator in the map cache. The packet is sent directly through
+ * the interface of the selected source locator.
+ */
+__section(FP_SEC_ENCAP)
+int lisp_encap(struct __sk_buff *skb)
+{
+    struct fp_key_v4        key_v4;
+    struct fp_key_v6        key_v6;
+    struct fp_lcl_entry     *lcl        = NULL;
+    struct fp_rmt_entry     *rmt        = NULL;
+    struct fp_lcl_rloc      *src_rloc   = NULL;
+    struct fp_encap_hdr     hdr;
+    __u8                    tos         = 0;
+    __u8                    ttl         = 0;
+    __u32                   hash        = 0;
+    __u32                   pos         = 0;
+    __u32                   len         = 0;
+
+    if (skb->protocol == fp_htons(ETH_P_IP)){
+        struct iphdr iph;
+
+        if (bpf_skb_load_bytes(skb, 0, &iph, sizeof(iph)) < 0){
+            return (TC_ACT_OK);
+        }
+        key_v4.prefixlen = 32;
+        __builtin_memcpy(key_v4.addr, &iph.saddr, 4);
+        lcl = bpf_map_lookup_elem(&lisp_fp_lcl_v4, &key_v4);
+        __builtin_memcpy(key_v4.addr, &iph.daddr, 4);
+        rmt = bpf_map_lookup_elem(&lisp_fp_rmt_v4, &key_v4);
+        tos = iph.tos;
+        ttl = iph.ttl;
+    }else if (skb->protocol == fp_htons(ETH_P_IPV6)){
+        struct ipv6hdr ip6h;
+
+        if (bpf_skb_load_bytes(skb, 0, &ip6h, sizeof(ip6h)) < 0){
+            return (TC_ACT_OK);
+        }
+        key_v6.prefixlen = 128;
+        __builtin_memcpy(key_v6.addr, &ip6h.saddr, 16);
+        lcl = bpf_map_lookup_elem(&lisp_fp_lcl_v6, &key_v6);
+        __builtin_memcpy(key_v6.addr, &ip6h.daddr, 16);
+        rmt = bpf_map_lookup_elem(&lisp_fp_rmt_v6, &key_v6);
+        tos = (ip6h.priority << 4) | (ip6h.flow_lbl[0] >> 4);
+        ttl = ip6h.hop_limit;
+    }else{
+        return (TC_ACT_OK);
+    }
+
+    if (lcl == NULL || rmt == NULL){
+        return (TC_ACT_OK);
+    }
+    if (rmt->action == FP_ACT_DROP){
+        return (TC_ACT_SHOT);
+    }
+    if (lcl->rloc_count == 0 || rmt->rloc_count == 0){
+        return (TC_ACT_OK);
+    }
+
+    /* Select the locators according to the balancing vectors */
+    hash = bpf_get_hash_recalc(skb);
+    pos = hash % lcl->rloc_count;
+    if (pos >= FP_MAX_LCL_RLOCS){
+        return (TC_ACT_OK);
+    }
+    src_rloc = &(lcl->rlocs[pos]);
+    pos = hash % rmt->rloc_count;
+    if (pos >= FP_MAX_RLOCS){
+        return (TC_ACT_OK);
+    }
+
+    /* Packets that need fragmentation are processed by lispd */
+    if (skb->len + sizeof(struct fp_encap_hdr) > src_rloc->mtu){
+        return (TC_ACT_OK);
+    }
+
+    len = skb->len + sizeof(struct fp_encap_hdr);
+    __builtin_memset(&hdr, 0, sizeof(hdr));
+    hdr.ip.version  = 4;
+    hdr.ip.ihl      = 5;
+    hdr.ip.tos      = tos;
+    hdr.ip.tot_len  = fp_htons(len);
+    hdr.ip.frag_off = fp_htons(FP_IP_DF);
+    hdr.ip.ttl      = ttl;
+    hdr.ip.protocol = IPPROTO_UDP;
+    hdr.ip.saddr    = src_rloc->addr;
+    hdr.ip.daddr    = rmt->rlocs[pos];
+    hdr.ip.check    = fp_ip_checksum(&hdr.ip);
+    hdr.udp.source  = fp_htons(FP_LISP_DATA_PORT);
+    hdr.udp.dest    = fp_htons(FP_LISP_DATA_PORT);
+    hdr.udp.len     = fp_htons(len - sizeof(struct iphdr));
+
+    if (bpf_skb_adjust_room(skb, sizeof(struct fp_encap_hdr), BPF_ADJ_ROOM_MAC,
+            BPF_F_ADJ_ROOM_ENCAP_L3_IPV4 | BPF_F_ADJ_ROOM_ENCAP_L4_UDP) < 0){
+        return (TC_ACT_OK);
+    }
+    if (bpf_skb_store_bytes(skb, 0, &hdr, sizeof(hdr), 0) < 0){
+        return (TC_ACT_SHOT);
+    }
+
+    return (bpf_redirect_neigh(src_rloc->ifindex, 0, 0, 0));
+}
+
+
+/*
+ * Decapsulate the LISP data packets sent to a local RLOC whose inner destination is a local EID.
+ * The inner packet is injected in the tun interface as lispd does.
+ */
+__section(FP_SEC_DECAP)
+int lisp_decap(struct __sk_buff *skb)
+{
+    struct fp_rloc_key      rloc_key;
+    struct fp_key_v4        key_v4;
+    struct fp_key_v6        key_v6;
+    struct udphdr           udph;
+    struct fp_conf          *conf       = NULL;
+    void                    *lcl        = NULL;
+    __u32                   outer_len   = 0;
+    __u32                   zero        = 0;
+    __u64                   flags       = 0;
+    __u8                    version     = 0;
+
+    __builtin_memset(&rloc_key, 0, sizeof(rloc_key));
+
+    if (skb->protocol == fp_htons(ETH_P_IP)){
+        struct iphdr iph;
+
+        if (bpf_skb_load_bytes(skb, ETH_HLEN, &iph, sizeof(iph)) < 0){
+            return (TC_ACT_OK);
+        }
+        /* Fragments are reassembled by the kernel before reaching lispd */
+        if (iph.ihl != 5 || iph.protocol != IPPROTO_UDP || (iph.frag_off & fp_htons(FP_IP_FRAG_MASK)) != 0){
+            return (TC_ACT_OK);
+        }
+        rloc_key.family = FP_AF_INET;
+        __builtin_memcpy(rloc_key.addr, &iph.daddr, 4);
+        outer_len = sizeof(struct iphdr);
+    }else if (skb->protocol == fp_htons(ETH_P_IPV6)){
+        struct ipv6hdr ip6h;
+
+        if (bpf_skb_load_bytes(skb, ETH_HLEN, &ip6h, sizeof(ip6h)) < 0){
+            return (TC_ACT_OK);
+        }
+        if (ip6h.nexthdr != IPPROTO_UDP){
+            return (TC_ACT_OK);
+        }
+        rloc_key.family = FP_AF_INET6;
+        __builtin_memcpy(rloc_key.addr, &ip6h.daddr, 16);
+        outer_len = sizeof(struct ipv6hdr);
+    }else{
+        return (TC_ACT_OK);
+    }
+
+    if (bpf_map_lookup_elem(&lisp_fp_rlocs, &rloc_key) == NULL){
+        return (TC_ACT_OK);
+    }
+    if (bpf_skb_load_bytes(skb, ETH_HLEN + outer_len, &udph, sizeof(udph)) < 0){
+        return (TC_ACT_OK);
+    }
+    if (udph.dest != fp_htons(FP_LISP_DATA_PORT)){
+        return (TC_ACT_OK);
+    }
+    outer_len += sizeof(struct udphdr) + FP_LISP_HDR_LEN;
+
+    if (bpf_skb_load_bytes(skb, ETH_HLEN + outer_len, &version, 1) < 0){
+        return (TC_ACT_OK);
+    }
+    version = version >> 4;
+    if (version == 4){
+        key_v4.prefixlen = 32;
+        if (bpf_skb_load_bytes(skb, ETH_HLEN + outer_len + 16, key_v4.addr, 4) < 0){
+            return (TC_ACT_OK);
+        }
+        lcl = bpf_map_lookup_elem(&lisp_fp_lcl_v4, &key_v4);
+        if (rloc_key.family != FP_AF_INET){
+            flags = FP_ADJ_ROOM_DECAP_L3_IPV4;
+        }
+    }else if (version == 6){
+        key_v6.prefixlen = 128;
+        if (bpf_skb_load_bytes(skb, ETH_HLEN + outer_len + 24, key_v6.addr, 16) < 0){
+            return (TC_ACT_OK);
+        }
+        lcl = bpf_map_lookup_elem(&lisp_fp_lcl_v6, &key_v6);
+        if (rloc_key.family != FP_AF_INET6){
+            flags = FP_ADJ_ROOM_DECAP_L3_IPV6;
+        }
+    }
+    if (lcl == NULL){
+        return (TC_ACT_OK);
+    }
+
+    conf = bpf_map_lookup_elem(&lisp_fp_conf, &zero);
+    if (conf == NULL || conf->tun_ifindex == 0){
+        return (TC_ACT_OK);
+    }
+    /* Old kernels can not change the family of the packet: lispd decapsulates it */
+    if (bpf_skb_adjust_room(skb, -(__s32)outer_len, BPF_ADJ_ROOM_MAC, flags) < 0){
+        return (TC_ACT_OK);
+    }
+
+    return (bpf_redirect(conf->tun_ifindex, BPF_F_INGRESS));
+}
+
+char __license[] __section("license") = "GPL";
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -196,6 +196,36 @@ uint16_t udp_checksum (
 }
 
 
+/*
+ *	cksum_update
+ *
+ *	Incremental update of a checksum: HC' = ~(~HC + ~m + m') (RFC 1624)
+ *
+ */
+
+uint16_t cksum_update (
+        uint16_t    cksum,
+        void        *old_data,
+        void        *new_data,
+        int         length)
+{
+    uint16_t    *old_buf    = old_data;
+    uint16_t    *new_buf    = new_data;
+    uint32_t    sum         = (uint16_t)~cksum;
+
+    while (length > 1) {
+        sum += (uint16_t)~(*old_buf++);
+        sum += *new_buf++;
+        length -= 2;
+    }
+
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return ((uint16_t)(~sum));
+}
+
+
 /*
  * Returns the length of the auth data field based on the key_id value
  */
@@ -46,6 +46,17 @@ uint16_t udp_checksum (
      void      *iphdr,
      int       afi);
 
+/*
+ *  Update the checksum of a packet when length bytes of it (even number) change from old_data
+ *  to new_data (RFC 1624)
+ */
+
+uint16_t cksum_update (
+     uint16_t  cksum,
+     void      *old_data,
+     void      *new_data,
+     int       length);
+
 uint16_t get_auth_data_len(int key_id);
 
 int complete_auth_fields(int key_id,
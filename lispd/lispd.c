@@ -52,6 +52,8 @@
 #include <net/if.h>
 #include "lispd.h"
 #include "lispd_config.h"
+#include "lispd_control_socket.h"
+#include "lispd_fastpath.h"
 #include "lispd_iface_list.h"
 #include "lispd_iface_mgmt.h"
 #include "lispd_input.h"
@@ -89,6 +91,7 @@ uint8_t                      router_mode;
 
 lispd_addr_list_t            *map_resolvers;
 int                          ddt_client;
+int                          ddt_parallel_requests;
 lispd_addr_list_t            *proxy_itrs;
 lispd_map_cache_entry        *proxy_etrs;
 lispd_map_server_list_t      *map_servers;
@@ -98,6 +101,18 @@ int                          ctrl_supported_afi;
 int                          default_rloc_afi;
 int                          daemonize;
 int                          map_request_retries;
+int                          map_request_hedging;
+int                          dns_snooping;
+int                          rtr_load_sharing;
+int                          fast_handover;
+int                          tun_policy_routing;
+int                          fast_path;
+char                         *fast_path_object;
+int                          underlay_mtu;
+int                          tun_mtu;
+int                          max_ip_packet;
+int                          async_log;
+char                         *control_socket_path;
 /* RLOC probing parameters */
 int                          rloc_probe_interval;
 int                          rloc_probe_retries;
@@ -121,6 +136,7 @@ int                         ipv6_data_input_fd;
 int                         ipv4_control_input_fd;
 int                         ipv6_control_input_fd;
 int                         netlink_fd;
+int                         control_fd;
 fd_set                      readfds;
 struct                      sockaddr_nl dst_addr;
 struct                      sockaddr_nl src_addr;
@@ -132,10 +148,6 @@ int                         nat_aware;
 int                         nat_status;
 lispd_site_ID               site_ID;
 lispd_xTR_ID                xTR_ID;
-// Global variables used to store nonces of encapsulated map register and info request.
-// To be removed when NAT with multihoming supported.
-nonces_list                 *nat_emr_nonce;
-nonces_list                 *nat_ir_nonce;
 
 
 /*
@@ -288,13 +300,24 @@ int main(int argc, char **argv)
 
     set_default_ctrl_ifaces();
 
+    init_dscp_policies();
+
+    /*
+     * Start the writer of the log once daemonized: the thread would not survive the fork
+     */
+    if (async_log == TRUE){
+        init_async_log();
+    }
+
     /*
      * Create tun interface
      */
 
+    calculate_mtus();
+
     create_tun(tun_dev_name,
-            TUN_RECEIVE_SIZE,
-            TUN_MTU,
+            OUTPUT_BATCH_BUF_SIZE(tun_mtu),
+            tun_mtu,
             &tun_receive_fd,
             &tun_ifindex,
             &tun_receive_buf);
@@ -322,14 +345,30 @@ int main(int argc, char **argv)
         tun_v6_addr = get_main_eid(AF_INET6);
     }
 
+    /*
+     * In router mode, only the traffic sourced from the local EID prefixes can be sent to the tun
+     * interface. In mobile node mode, the routes via the tun are what make the EID the source
+     * address of the host.
+     */
+    if (tun_policy_routing == TRUE && router_mode == FALSE){
+        lispd_log_msg(LISP_LOG_WARNING, "tun-policy-routing is only supported in router mode. Ignored");
+        tun_policy_routing = FALSE;
+    }
+
     tun_bring_up_iface(tun_dev_name);
     if (tun_v4_addr != NULL){
         tun_add_eid_to_iface(*tun_v4_addr,tun_dev_name);
         set_tun_default_route_v4();
+        if (tun_policy_routing == TRUE){
+            add_tun_policy_rules(AF_INET);
+        }
     }
     if (tun_v6_addr != NULL){
         tun_add_eid_to_iface(*tun_v6_addr,tun_dev_name);
         set_tun_default_route_v6();
+        if (tun_policy_routing == TRUE){
+            add_tun_policy_rules(AF_INET6);
+        }
     }
     if (router_mode == TRUE){
         if (tun_v4_addr != NULL){
@@ -374,6 +413,23 @@ int main(int argc, char **argv)
     request_route_table(RT_TABLE_MAIN, AF_INET6);
     process_netlink_msg(netlink_fd);
 
+    /*
+     * Kernel fast path of the data plane
+     */
+    if (fast_path == TRUE){
+        if (fastpath_init() != GOOD){
+            lispd_log_msg(LISP_LOG_WARNING, "Couldn't enable the fast path. Using only lispd to forward packets");
+            fast_path = FALSE;
+        }
+    }
+
+    /*
+     * Local socket to query the statistics of lispd
+     */
+    if (control_socket_path != NULL){
+        control_fd = open_control_socket(control_socket_path);
+    }
+
     /*
      *  Register to the Map-Server(s)
      */
@@ -407,7 +463,9 @@ int main(int argc, char **argv)
 void event_loop()
 {
     int    max_fd;
+    int    loop_max_fd;
     fd_set readfds;
+    fd_set writefds;
     int    retval;
 
     /*
@@ -421,9 +479,11 @@ void event_loop()
     max_fd = (max_fd > tun_receive_fd)          ? max_fd : tun_receive_fd;
     max_fd = (max_fd > timers_fd)               ? max_fd : timers_fd;
     max_fd = (max_fd > netlink_fd)              ? max_fd : netlink_fd;
+    max_fd = (max_fd > control_fd)              ? max_fd : control_fd;
 
     for (;;) {
         FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
         FD_SET(tun_receive_fd, &readfds);
         FD_SET(ipv4_data_input_fd, &readfds);
         FD_SET(ipv6_data_input_fd, &readfds);
@@ -431,8 +491,13 @@ void event_loop()
         FD_SET(ipv6_control_input_fd, &readfds);
         FD_SET(timers_fd, &readfds);
         FD_SET(netlink_fd, &readfds);
+        loop_max_fd = max_fd;
+        if (control_fd != -1){
+            FD_SET(control_fd, &readfds);
+            loop_max_fd = control_clients_fd_set(&readfds, &writefds, max_fd);
+        }
 
-        retval = have_input(max_fd, &readfds);
+        retval = have_input(loop_max_fd, &readfds, &writefds);
 
         if (retval != GOOD) {
             continue;        /* interrupted */
@@ -456,7 +521,7 @@ void event_loop()
         }
         if (FD_ISSET(tun_receive_fd, &readfds)) {
             lispd_log_msg(LISP_LOG_DEBUG_3,"Received packet in the tun buffer");
-            process_output_packet(tun_receive_fd, tun_receive_buf, TUN_RECEIVE_SIZE);
+            process_output_packet(tun_receive_fd, tun_receive_buf, OUTPUT_BATCH_BUF_SIZE(tun_mtu));
         }
         if (FD_ISSET(timers_fd,&readfds)){
             //lispd_log_msg(LISP_LOG_DEBUG_3,"Received something in the timer fd");
@@ -466,6 +531,12 @@ void event_loop()
             lispd_log_msg(LISP_LOG_DEBUG_3,"Received notification from net link");
             process_netlink_msg(netlink_fd);
         }
+        if (control_fd != -1){
+            process_control_clients(&readfds, &writefds);
+            if (FD_ISSET(control_fd,&readfds)){
+                process_control_socket(control_fd);
+            }
+        }
     }
 }
 
@@ -565,6 +636,13 @@ int check_capabilities()
 void exit_cleanup(void) {
     /* Remove source routing tables */
     remove_created_rules();
+    if (tun_policy_routing == TRUE){
+        del_tun_policy_rules();
+    }
+    remove_native_forward_rules();
+    if (fast_path == TRUE){
+        fastpath_cleanup();
+    }
     /* Close timer file descriptors */
     close(timers_fd);
     /* Close receive sockets */
@@ -577,6 +655,9 @@ void exit_cleanup(void) {
     close_output_sockets();
     /* Close netlink socket */
     close(netlink_fd);
+    /* Close the control socket */
+    close_control_socket(control_fd, control_socket_path);
+    close_async_log();
     lispd_log_msg(LISP_LOG_INFO,"Exiting ...");
 #ifdef ANDROID
     close_log_file();
@@ -194,7 +194,12 @@ int err;
 #define FULL_NAT            2
 
 
-#define MAX_IP_PACKET       4096
+/*
+ * The receive buffers have max_ip_packet bytes, derived from the underlay and tun MTUs.
+ * They are never smaller than MIN_PACKET_BUF_SIZE. The data input buffer has IP_MAXPACKET
+ * bytes: it receives the packets reassembled by the kernel
+ */
+#define MIN_PACKET_BUF_SIZE 4096
 
 
 #define DEFAULT_MAP_REQUEST_RETRIES             3
@@ -356,6 +361,7 @@ typedef struct packet_tuple_ {
     uint16_t                        src_port;
     uint16_t                        dst_port;
     uint8_t                         protocol;
+    uint8_t                         dscp;
 } packet_tuple;
 
 typedef struct lispd_site_ID_
@@ -41,13 +41,16 @@
 #endif
 #include "lispd_afi.h"
 #include "lispd_config.h"
+#include "lispd_ddt_node.h"
 #include "lispd_external.h"
+#include "lispd_fastpath.h"
 #include "lispd_iface_list.h"
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_map_cache.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_mapping.h"
+#include "lispd_output.h"
 #include "lispd_referral_cache_db.h"
 #include "lispd_rloc_probing.h"
 
@@ -103,6 +106,11 @@ void validate_rloc_probing_parameters (
         int probe_retries,
         int probe_retries_interval);
 
+int add_dscp_policy(
+        char    *dscp,
+        char    *rloc_selection,
+        char    *iface_name);
+
 /*
  * Validates the information obtained from the configuration file
  */
@@ -177,6 +185,22 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
     struct uci_element  *e                              = NULL;
     int                 uci_debug                       = 0;
     int                 uci_retries                     = 0;
+    const char          *uci_hedging                    = NULL;
+    const char          *uci_dns_snooping               = NULL;
+    const char          *uci_fast_handover              = NULL;
+    const char          *uci_tun_policy_routing         = NULL;
+    const char          *uci_fast_path                  = NULL;
+    const char          *uci_fast_path_object           = NULL;
+    const char          *uci_underlay_mtu               = NULL;
+    const char          *uci_tun_mtu                    = NULL;
+    const char          *uci_async_log                  = NULL;
+    const char          *uci_control_socket             = NULL;
+    const char          *uci_dscp                       = NULL;
+    const char          *uci_rloc_selection             = NULL;
+    char                *dscp_list                      = NULL;
+    char                *dscp_token                     = NULL;
+    char                *dscp_saveptr                   = NULL;
+    const char          *uci_ddt_parallel_requests      = NULL;
     int                 uci_rloc_probe_int              = 0;
     int                 uci_rloc_probe_retries          = 0;
     int                 uci_rloc_probe_retries_interval = 0;
@@ -284,6 +308,68 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
                         LISPD_MAX_RETRANSMITS, LISPD_MAX_RETRANSMITS);
             }
 
+            uci_hedging = uci_lookup_option_string(ctx, s, "map_request_hedging");
+            if (uci_hedging != NULL && strcmp(uci_hedging, "on") == 0){
+                map_request_hedging = TRUE;
+            }else{
+                map_request_hedging = FALSE;
+            }
+
+            uci_dns_snooping = uci_lookup_option_string(ctx, s, "dns_snooping");
+            if (uci_dns_snooping != NULL && strcmp(uci_dns_snooping, "on") == 0){
+                dns_snooping = TRUE;
+            }else{
+                dns_snooping = FALSE;
+            }
+
+            uci_fast_handover = uci_lookup_option_string(ctx, s, "fast_handover");
+            if (uci_fast_handover != NULL && strcmp(uci_fast_handover, "on") == 0){
+                fast_handover = TRUE;
+            }else{
+                fast_handover = FALSE;
+            }
+
+            uci_async_log = uci_lookup_option_string(ctx, s, "async_log");
+            if (uci_async_log != NULL && strcmp(uci_async_log, "on") == 0){
+                async_log = TRUE;
+            }else{
+                async_log = FALSE;
+            }
+
+            uci_control_socket = uci_lookup_option_string(ctx, s, "control_socket");
+            if (uci_control_socket != NULL && strlen(uci_control_socket) != 0){
+                control_socket_path = strdup(uci_control_socket);
+            }
+
+            uci_tun_policy_routing = uci_lookup_option_string(ctx, s, "tun_policy_routing");
+            if (uci_tun_policy_routing != NULL && strcmp(uci_tun_policy_routing, "on") == 0){
+                tun_policy_routing = TRUE;
+            }else{
+                tun_policy_routing = FALSE;
+            }
+
+            uci_fast_path = uci_lookup_option_string(ctx, s, "fast_path");
+            if (uci_fast_path != NULL && strcmp(uci_fast_path, "on") == 0){
+                fast_path = TRUE;
+            }else{
+                fast_path = FALSE;
+            }
+
+            uci_fast_path_object = uci_lookup_option_string(ctx, s, "fast_path_object");
+            if (uci_fast_path_object == NULL){
+                uci_fast_path_object = FAST_PATH_DEFAULT_OBJECT;
+            }
+            fast_path_object = strdup(uci_fast_path_object);
+
+            uci_underlay_mtu = uci_lookup_option_string(ctx, s, "underlay_mtu");
+            if (uci_underlay_mtu != NULL){
+                underlay_mtu = strtol(uci_underlay_mtu,NULL,10);
+            }
+
+            uci_tun_mtu = uci_lookup_option_string(ctx, s, "tun_mtu");
+            if (uci_tun_mtu != NULL){
+                tun_mtu = strtol(uci_tun_mtu,NULL,10);
+            }
 
 
             continue;
@@ -295,6 +381,15 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
             }else{
                 ddt_client = FALSE;
             }
+            uci_ddt_parallel_requests = uci_lookup_option_string(ctx, s, "parallel_requests");
+            if (uci_ddt_parallel_requests != NULL){
+                ddt_parallel_requests = strtol(uci_ddt_parallel_requests,NULL,10);
+                if (ddt_parallel_requests < 1 || ddt_parallel_requests > LISPD_MAX_DDT_PARALLEL_REQUESTS){
+                    ddt_parallel_requests = ddt_parallel_requests < 1 ? 1 : LISPD_MAX_DDT_PARALLEL_REQUESTS;
+                    lispd_log_msg(LISP_LOG_WARNING, "DDT parallel requests should be between 1 and %d. Using %d",
+                            LISPD_MAX_DDT_PARALLEL_REQUESTS, ddt_parallel_requests);
+                }
+            }
             continue;
         }
 
@@ -327,6 +422,12 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
             }
             uci_site_id = uci_lookup_option_string(ctx, s, "site_ID");
             uci_xtr_id = uci_lookup_option_string(ctx, s, "xTR_ID");
+            if (uci_lookup_option_string(ctx, s, "rtr_load_sharing") != NULL &&
+                    strcmp(uci_lookup_option_string(ctx, s, "rtr_load_sharing"), "on") == 0){
+                rtr_load_sharing = TRUE;
+            }else{
+                rtr_load_sharing = FALSE;
+            }
 
             if (nat_aware == TRUE){
                 if ((convert_hex_string_to_bytes(uci_site_id,site_ID.byte,8)) != GOOD){
@@ -446,6 +547,30 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
         }
 
 
+        if (strcmp(s->type, "dscp-policy") == 0){
+            uci_dscp = uci_lookup_option_string(ctx, s, "dscp");
+            uci_rloc_selection = uci_lookup_option_string(ctx, s, "rloc_selection");
+            uci_interface = uci_lookup_option_string(ctx, s, "interface");
+
+            if (uci_dscp == NULL || (dscp_list = strdup(uci_dscp)) == NULL){
+                lispd_log_msg(LISP_LOG_ERR, "Can't add dscp-policy. No DSCP specified");
+                continue;
+            }
+            /* Space separated list of DSCP values or names */
+            dscp_token = strtok_r(dscp_list, " ", &dscp_saveptr);
+            while (dscp_token != NULL){
+                if (add_dscp_policy(dscp_token,
+                        (char *)uci_rloc_selection,
+                        (char *)uci_interface) != GOOD){
+                    lispd_log_msg(LISP_LOG_WARNING, "Can't add dscp-policy for DSCP %s. Discarded ...", dscp_token);
+                }
+                dscp_token = strtok_r(NULL, " ", &dscp_saveptr);
+            }
+            free(dscp_list);
+            continue;
+        }
+
+
         if (strcmp(s->type, "proxy-itr") == 0){
             uci_address = uci_lookup_option_string(ctx, s, "address");
 
@@ -514,7 +639,9 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
 
     cfg_t                   *cfg                    = 0;
     int                     i                       = 0;
+    int                     j                       = 0;
     int                     n                       = 0;
+    int                     m                       = 0;
     int                     ret                     = 0;
     char                    *map_resolver           = NULL;
     char                    *proxy_itr              = NULL;
@@ -523,7 +650,6 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
     int                     probe_int               = 0;
     int                     probe_retries           = 0;
     int                     probe_retries_interval  = 0;
-    int                     ctr                     = 0;
 
     static cfg_opt_t map_server_opts[] = {
             CFG_STR("address",              0, CFGF_NONE),
@@ -569,11 +695,19 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
 
     static cfg_opt_t nat_traversal_opts[] = {
             CFG_BOOL("nat_aware",   cfg_false, CFGF_NONE),
+            CFG_BOOL("rtr_load_sharing", cfg_false, CFGF_NONE),
             CFG_STR("site_ID",              0, CFGF_NONE),
             CFG_STR("xTR_ID",               0, CFGF_NONE),
             CFG_END()
     };
 
+    static cfg_opt_t dscp_policy_opts[] = {
+            CFG_STR_LIST("dscp",            0, CFGF_NONE),
+            CFG_STR("rloc-selection",       "balanced", CFGF_NONE),
+            CFG_STR("interface",            0, CFGF_NONE),
+            CFG_END()
+    };
+
     static cfg_opt_t rloc_probing_opts[] = {
             CFG_INT("rloc-probe-interval",           0, CFGF_NONE),
             CFG_INT("rloc-probe-retries",            0, CFGF_NONE),
@@ -587,12 +721,24 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
             CFG_SEC("map-server",           map_server_opts, CFGF_MULTI),
             CFG_SEC("proxy-etr",            petr_mapping_opts, CFGF_MULTI),
             CFG_BOOL("ddt-client",          cfg_false, CFGF_NONE),
+            CFG_INT("ddt-parallel-requests",0, CFGF_NONE),
             CFG_SEC("ddt-root-node",        ddt_root_node_opts, CFGF_MULTI),
             CFG_SEC("nat-traversal",        nat_traversal_opts, CFGF_MULTI),
             CFG_SEC("rloc-probing",         rloc_probing_opts, CFGF_MULTI),
+            CFG_SEC("dscp-policy",          dscp_policy_opts, CFGF_MULTI),
             CFG_INT("map-request-retries",  0, CFGF_NONE),
+            CFG_BOOL("map-request-hedging", cfg_false, CFGF_NONE),
+            CFG_BOOL("dns-snooping",        cfg_false, CFGF_NONE),
+            CFG_BOOL("fast-handover",       cfg_false, CFGF_NONE),
+            CFG_BOOL("tun-policy-routing",  cfg_false, CFGF_NONE),
+            CFG_BOOL("fast-path",           cfg_false, CFGF_NONE),
+            CFG_STR("fast-path-object",     FAST_PATH_DEFAULT_OBJECT, CFGF_NONE),
+            CFG_INT("underlay-mtu",         0, CFGF_NONE),
+            CFG_INT("tun-mtu",              0, CFGF_NONE),
             CFG_INT("control-port",         0, CFGF_NONE),
             CFG_INT("debug",                0, CFGF_NONE),
+            CFG_BOOL("async-log",           cfg_false, CFGF_NONE),
+            CFG_STR("control-socket",       "", CFGF_NONE),
             CFG_BOOL("router-mode",         cfg_false, CFGF_NONE),
             CFG_INT("rloc-probing-interval",0, CFGF_NONE),
             CFG_STR_LIST("map-resolver",    0, CFGF_NONE),
@@ -637,6 +783,26 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
         map_request_retries = ret;
     }
 
+    map_request_hedging = cfg_getbool(cfg, "map-request-hedging") ? TRUE:FALSE;
+
+    dns_snooping = cfg_getbool(cfg, "dns-snooping") ? TRUE:FALSE;
+
+    fast_handover = cfg_getbool(cfg, "fast-handover") ? TRUE:FALSE;
+
+    tun_policy_routing = cfg_getbool(cfg, "tun-policy-routing") ? TRUE:FALSE;
+
+    fast_path = cfg_getbool(cfg, "fast-path") ? TRUE:FALSE;
+    fast_path_object = strdup(cfg_getstr(cfg, "fast-path-object"));
+
+    underlay_mtu = cfg_getint(cfg, "underlay-mtu");
+    tun_mtu = cfg_getint(cfg, "tun-mtu");
+
+    async_log = cfg_getbool(cfg, "async-log") ? TRUE:FALSE;
+
+    if (strlen(cfg_getstr(cfg, "control-socket")) != 0){
+        control_socket_path = strdup(cfg_getstr(cfg, "control-socket"));
+    }
+
 
     /*
      * Debug level
@@ -678,6 +844,7 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
         nat_aware   = cfg_getbool(nt, "nat_aware") ? TRUE:FALSE;
         nat_site_ID = cfg_getstr(nt, "site_ID");
         nat_xTR_ID  = cfg_getstr(nt, "xTR_ID");
+        rtr_load_sharing = cfg_getbool(nt, "rtr_load_sharing") ? TRUE:FALSE;
         if (nat_aware == TRUE){
             if ((convert_hex_string_to_bytes(nat_site_ID,site_ID.byte,8)) != GOOD){
                 lispd_log_msg(LISP_LOG_CRIT, "Configuration file: Wrong Site-ID format");
@@ -717,6 +884,16 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
 
     ddt_client   = cfg_getbool(cfg, "ddt-client") ? TRUE:FALSE;
 
+    ret = cfg_getint(cfg, "ddt-parallel-requests");
+    if (ret > 0){
+        if (ret > LISPD_MAX_DDT_PARALLEL_REQUESTS){
+            ret = LISPD_MAX_DDT_PARALLEL_REQUESTS;
+            lispd_log_msg(LISP_LOG_WARNING, "DDT parallel requests should be between 1 and %d. Using %d",
+                    LISPD_MAX_DDT_PARALLEL_REQUESTS, LISPD_MAX_DDT_PARALLEL_REQUESTS);
+        }
+        ddt_parallel_requests = ret;
+    }
+
     n = cfg_size(cfg, "ddt-root-node");
     for(i = 0; i < n; i++) {
         cfg_t *ddt_node = cfg_getnsec(cfg, "ddt-root-node", i);
@@ -766,7 +943,6 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
 
     n = cfg_size(cfg, "database-mapping");
     for(i = 0; i < n; i++) {
-        ctr ++;
         cfg_t *dm = cfg_getnsec(cfg, "database-mapping", i);
         if (add_database_mapping(cfg_getstr(dm, "eid-prefix"),
                 cfg_getint(dm, "iid"),
@@ -828,14 +1004,25 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
         }
     }
 
-    /* Check configured parameters when NAT-T activated. These limitations will be removed in future release */
-    if (nat_aware == TRUE){
-        if (ctr > 1){
-            lispd_log_msg(LISP_LOG_CRIT,"NAT aware on -> This version of LISPmob is limited to one EID prefix "
-                    "and one interface when NAT-T is enabled");
-            exit_cleanup();
+    /*
+     *  handle dscp-policy config
+     */
+
+    n = cfg_size(cfg, "dscp-policy");
+    for(i = 0; i < n; i++) {
+        cfg_t *dp = cfg_getnsec(cfg, "dscp-policy", i);
+        m = cfg_size(dp, "dscp");
+        for(j = 0; j < m; j++) {
+            if (add_dscp_policy(cfg_getnstr(dp, "dscp", j),
+                    cfg_getstr(dp, "rloc-selection"),
+                    cfg_getstr(dp, "interface")) != GOOD){
+                lispd_log_msg(LISP_LOG_WARNING, "Can't add dscp-policy for DSCP %s. Discarded ...", cfg_getnstr(dp, "dscp", j));
+            }
         }
+    }
 
+    /* Check configured parameters when NAT-T activated. These limitations will be removed in future release */
+    if (nat_aware == TRUE){
         if (map_servers->next != NULL || map_servers->address->afi != AF_INET){
             lispd_log_msg(LISP_LOG_INFO,"NAT aware on -> This version of LISPmob is limited to one IPv4 Map Server.");
             exit_cleanup();
@@ -1084,6 +1271,9 @@ int add_static_map_cache_entry(
     lisp_addr_t              *locator_addr          = NULL;
     lisp_addr_t              eid_prefix             = {.afi=AF_UNSPEC};
     int                      eid_prefix_length      = 0;
+    int                      mpriority              = UNUSED_RLOC_PRIORITY;
+    int                      mweight                = 0;
+    int                      new_entry              = FALSE;
 
 
     if (iid > MAX_IID || iid < 0) {
@@ -1113,31 +1303,51 @@ int add_static_map_cache_entry(
         return (BAD);
     }
 
-    map_cache_entry = new_map_cache_entry(eid_prefix, eid_prefix_length, STATIC_MAP_CACHE_ENTRY,255);
-    if (map_cache_entry == NULL){
-        free(locator_addr);
-        return (BAD);
+    /*
+     * The locators of a multicast group are its replication list. Each static-map-cache of the
+     * group adds a locator to the same entry.
+     */
+    if (is_multicast_addr(eid_prefix) == TRUE){
+        mpriority = priority;
+        mweight = weight;
+        map_cache_entry = lookup_map_cache_exact(eid_prefix, eid_prefix_length);
+        if (map_cache_entry != NULL && map_cache_entry->how_learned != STATIC_MAP_CACHE_ENTRY){
+            map_cache_entry = NULL;
+        }
     }
 
-    map_cache_entry->mapping->iid = iid;
+    if (map_cache_entry == NULL){
+        map_cache_entry = new_map_cache_entry(eid_prefix, eid_prefix_length, STATIC_MAP_CACHE_ENTRY,255);
+        if (map_cache_entry == NULL){
+            free(locator_addr);
+            return (BAD);
+        }
+        map_cache_entry->mapping->iid = iid;
+        new_entry = TRUE;
+    }
 
-    locator = new_static_rmt_locator(locator_addr,UP,priority,weight,255,0);
+    locator = new_static_rmt_locator(locator_addr,UP,priority,weight,mpriority,mweight);
 
     if (locator != NULL){
         if ((err=add_locator_to_mapping (map_cache_entry->mapping, locator)) != GOOD){
             free_locator(locator);
-            free_map_cache_entry(map_cache_entry);
+            if (new_entry == TRUE){
+                free_map_cache_entry(map_cache_entry);
+            }
             return (BAD);
         }
     }else{
-        free_map_cache_entry(map_cache_entry);
+        if (new_entry == TRUE){
+            free_map_cache_entry(map_cache_entry);
+        }
         return (BAD);
     }
 
     /*
-     * Programming rloc probing timer
+     * Programming rloc probing timer of the new locator. The locators of a multicast group are
+     * added to an existing entry
      */
-    programming_rloc_probing(map_cache_entry);
+    programming_locator_rloc_probing(map_cache_entry, locator);
 
     return (GOOD);
 }
@@ -1361,6 +1571,55 @@ int add_proxy_etr_entry(
     return(result);
 }
 
+/*
+ *  add_dscp_policy --
+ *
+ *  Set the locator selection policy of a traffic class. dscp is the decimal value or the
+ *  name of the class (EF, CSx, AFxy)
+ *
+ */
+
+int add_dscp_policy(
+        char    *dscp,
+        char    *rloc_selection,
+        char    *iface_name)
+{
+    int     dscp_value  = -1;
+    int     selection   = RLOC_SELECT_BALANCED;
+    char    *end        = NULL;
+
+    if (dscp == NULL){
+        lispd_log_msg(LISP_LOG_ERR, "Configuration file: The DSCP of the dscp-policy has not been specified");
+        return (BAD);
+    }
+
+    if (strcasecmp(dscp, "EF") == 0){
+        dscp_value = 46;
+    }else if (strncasecmp(dscp, "CS", 2) == 0 && dscp[2] >= '0' && dscp[2] <= '7' && dscp[3] == '\0'){
+        dscp_value = (dscp[2] - '0') * 8;
+    }else if (strncasecmp(dscp, "AF", 2) == 0 && dscp[2] >= '1' && dscp[2] <= '4' &&
+            dscp[3] >= '1' && dscp[3] <= '3' && dscp[4] == '\0'){
+        dscp_value = (dscp[2] - '0') * 8 + (dscp[3] - '0') * 2;
+    }else{
+        dscp_value = strtol(dscp, &end, 10);
+        if (end == dscp || *end != '\0' || dscp_value < 0 || dscp_value >= DSCP_VALUES){
+            lispd_log_msg(LISP_LOG_ERR, "Configuration file: Unknown DSCP %s", dscp);
+            return (BAD);
+        }
+    }
+
+    if (rloc_selection == NULL || strcmp(rloc_selection, "balanced") == 0){
+        selection = RLOC_SELECT_BALANCED;
+    }else if (strcmp(rloc_selection, "lowest-rtt") == 0){
+        selection = RLOC_SELECT_LOWEST_RTT;
+    }else{
+        lispd_log_msg(LISP_LOG_ERR, "Configuration file: Unknown rloc-selection %s. Use balanced or lowest-rtt", rloc_selection);
+        return (BAD);
+    }
+
+    return (set_dscp_policy(dscp_value, selection, iface_name));
+}
+
 void validate_rloc_probing_parameters (
         int probe_int,
         int probe_retries,
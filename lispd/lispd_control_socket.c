@@ -0,0 +1,451 @@
+/*
+ * lispd_control_socket.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Local Unix socket to query and manage lispd at runtime.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "lispd_control_socket.h"
+#include "lispd_flight_recorder.h"
+#include "lispd_log.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
+
+
+typedef int (*control_command_handler)(FILE *out, char *args);
+
+typedef struct control_command_ {
+    const char                  *name;
+    control_command_handler     handler;
+    const char                  *help;
+} control_command;
+
+/*
+ * Connection waiting for its command line or, once answer is not NULL, sending the answer.
+ * fd is -1 if the entry is free
+ */
+typedef struct control_client_ {
+    int                         fd;
+    int                         len;
+    time_t                      start;
+    char                        cmd[CONTROL_SOCKET_MAX_CMD_LEN];
+    char                        *answer;
+    size_t                      answer_len;
+    size_t                      sent;
+} control_client;
+
+
+/********************************** Function declaration ********************************/
+
+static void read_command(control_client *client);
+static void send_answer(control_client *client);
+static void process_command(
+        FILE    *out,
+        char    *cmd);
+static void close_control_client(control_client *client);
+static int cmd_stats(
+        FILE    *out,
+        char    *args);
+static int cmd_trace(
+        FILE    *out,
+        char    *args);
+static int cmd_flight(
+        FILE    *out,
+        char    *args);
+static int cmd_help(
+        FILE    *out,
+        char    *args);
+
+/****************************************************************************************/
+
+
+static control_command control_commands[] = {
+        {"stats",   cmd_stats,  "stats [json|prometheus]: counters and latency histograms (JSON by default)"},
+        {"trace",   cmd_trace,  "trace [eid <prefix>|rloc <address>|msg <type>|clear]: list, add or remove trace selectors. "
+                                "Types: map_request, map_reply, map_register, map_notify, map_referral, info_nat, encap_control"},
+        {"flight",  cmd_flight, "flight: last control plane events (flight recorder)"},
+        {"help",    cmd_help,   "help: list of commands"},
+        {NULL,      NULL,       NULL}
+};
+
+static control_client control_clients[CONTROL_SOCKET_MAX_CLIENTS];
+
+
+int open_control_socket(char *path)
+{
+    struct sockaddr_un  addr;
+    int                 fd      = -1;
+    int                 ctr     = 0;
+
+    for (ctr = 0 ; ctr < CONTROL_SOCKET_MAX_CLIENTS ; ctr++){
+        control_clients[ctr].fd = -1;
+        control_clients[ctr].answer = NULL;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)){
+        lispd_log_msg(LISP_LOG_WARNING, "open_control_socket: Path of the control socket too long: %s", path);
+        return (-1);
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0){
+        lispd_log_msg(LISP_LOG_WARNING, "open_control_socket: socket: %s", strerror(errno));
+        return (-1);
+    }
+
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    /* Socket left by a previous instance */
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) < 0){
+        lispd_log_msg(LISP_LOG_WARNING, "open_control_socket: Couldn't bind the control socket to %s: %s",
+                path, strerror(errno));
+        close(fd);
+        return (-1);
+    }
+    /* Only root can query lispd */
+    chmod(path, S_IRUSR | S_IWUSR);
+    /* A client closing the connection before reading the answer must not kill lispd */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (listen(fd, CONTROL_SOCKET_MAX_CLIENTS) < 0){
+        lispd_log_msg(LISP_LOG_WARNING, "open_control_socket: listen: %s", strerror(errno));
+        close(fd);
+        unlink(path);
+        return (-1);
+    }
+
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Control socket listening in %s", path);
+    return (fd);
+}
+
+
+void process_control_socket(int fd)
+{
+    control_client      *client     = NULL;
+    int                 client_fd   = -1;
+    int                 ctr         = 0;
+
+    if ((client_fd = accept(fd, NULL, NULL)) < 0){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "process_control_socket: accept: %s", strerror(errno));
+        return;
+    }
+    for (ctr = 0 ; ctr < CONTROL_SOCKET_MAX_CLIENTS ; ctr++){
+        if (control_clients[ctr].fd == -1){
+            client = &(control_clients[ctr]);
+            break;
+        }
+    }
+    if (client == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "process_control_socket: Too many clients (%d). Connection closed",
+                CONTROL_SOCKET_MAX_CLIENTS);
+        close(client_fd);
+        return;
+    }
+    if (fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) | O_NONBLOCK) < 0){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "process_control_socket: fcntl: %s", strerror(errno));
+        close(client_fd);
+        return;
+    }
+    client->fd = client_fd;
+    client->len = 0;
+    client->start = time(NULL);
+}
+
+
+int control_clients_fd_set(
+        fd_set  *readfds,
+        fd_set  *writefds,
+        int     max_fd)
+{
+    control_client  *client = NULL;
+    time_t          now     = time(NULL);
+    int             ctr     = 0;
+
+    for (ctr = 0 ; ctr < CONTROL_SOCKET_MAX_CLIENTS ; ctr++){
+        client = &(control_clients[ctr]);
+        if (client->fd == -1){
+            continue;
+        }
+        if (now - client->start > CONTROL_SOCKET_TIMEOUT){
+            if (client->answer == NULL){
+                lispd_log_msg(LISP_LOG_DEBUG_2, "Control socket: no command received in %d seconds. Connection closed",
+                        CONTROL_SOCKET_TIMEOUT);
+            }else{
+                lispd_log_msg(LISP_LOG_WARNING, "Control socket: answer not read in %d seconds. Truncated "
+                        "after %zu of %zu bytes", CONTROL_SOCKET_TIMEOUT, client->sent, client->answer_len);
+            }
+            close_control_client(client);
+            continue;
+        }
+        if (client->answer == NULL){
+            FD_SET(client->fd, readfds);
+        }else{
+            FD_SET(client->fd, writefds);
+        }
+        if (client->fd > max_fd){
+            max_fd = client->fd;
+        }
+    }
+    return (max_fd);
+}
+
+
+void process_control_clients(
+        fd_set  *readfds,
+        fd_set  *writefds)
+{
+    control_client  *client = NULL;
+    int             ctr     = 0;
+
+    for (ctr = 0 ; ctr < CONTROL_SOCKET_MAX_CLIENTS ; ctr++){
+        client = &(control_clients[ctr]);
+        if (client->fd == -1){
+            continue;
+        }
+        if (client->answer == NULL && FD_ISSET(client->fd, readfds)){
+            read_command(client);
+        }else if (client->answer != NULL && FD_ISSET(client->fd, writefds)){
+            send_answer(client);
+        }
+    }
+}
+
+
+void close_control_socket(
+        int     fd,
+        char    *path)
+{
+    int     ctr     = 0;
+
+    if (fd < 0){
+        return;
+    }
+    for (ctr = 0 ; ctr < CONTROL_SOCKET_MAX_CLIENTS ; ctr++){
+        if (control_clients[ctr].fd != -1){
+            close_control_client(&(control_clients[ctr]));
+        }
+    }
+    close(fd);
+    unlink(path);
+}
+
+
+/*
+ * Read the data available of the command line of the client. Once the line is complete (or the
+ * client closes its side), the command is processed and its answer sent.
+ */
+static void read_command(control_client *client)
+{
+    FILE                *out        = NULL;
+    int                 nread       = 0;
+    int                 error       = 0;
+
+    nread = read(client->fd, client->cmd + client->len, CONTROL_SOCKET_MAX_CMD_LEN - 1 - client->len);
+    if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        return;
+    }
+    if (nread > 0){
+        client->len += nread;
+        if (memchr(client->cmd + client->len - nread, '\n', nread) == NULL &&
+                client->len < CONTROL_SOCKET_MAX_CMD_LEN - 1){
+            return;
+        }
+    }
+
+    /* Without the line terminator */
+    client->cmd[client->len] = '\0';
+    client->cmd[strcspn(client->cmd, "\r\n")] = '\0';
+    if (client->cmd[0] == '\0'){
+        close_control_client(client);
+        return;
+    }
+
+    /* The answer is buffered in memory and sent as the client reads it */
+    if ((out = open_memstream(&(client->answer), &(client->answer_len))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "read_command: open_memstream: %s", strerror(errno));
+        close_control_client(client);
+        return;
+    }
+    process_command(out, client->cmd);
+    error = ferror(out);
+    if (fclose(out) != 0 || error != 0){
+        lispd_log_msg(LISP_LOG_WARNING, "read_command: Couldn't buffer the answer of \"%s\"", client->cmd);
+        close_control_client(client);
+        return;
+    }
+    client->sent = 0;
+    client->start = time(NULL);
+    send_answer(client);
+}
+
+
+/*
+ * Send the part of the answer that fits in the socket buffer. The connection is closed once
+ * the whole answer is sent.
+ */
+static void send_answer(control_client *client)
+{
+    ssize_t             nwritten    = 0;
+
+    nwritten = write(client->fd, client->answer + client->sent, client->answer_len - client->sent);
+    if (nwritten < 0){
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR){
+            return;
+        }
+        lispd_log_msg(LISP_LOG_WARNING, "Control socket: answer truncated after %zu of %zu bytes: %s",
+                client->sent, client->answer_len, strerror(errno));
+        close_control_client(client);
+        return;
+    }
+    client->sent += nwritten;
+    client->start = time(NULL);
+    if (client->sent == client->answer_len){
+        close_control_client(client);
+    }
+}
+
+
+/*
+ * Execute the command line and write its answer
+ */
+static void process_command(
+        FILE    *out,
+        char    *cmd)
+{
+    control_command     *command    = NULL;
+    char                *args       = NULL;
+
+    /* The command is the first word. The rest of the line are its arguments */
+    args = cmd + strcspn(cmd, " \t");
+    if (*args != '\0'){
+        *args = '\0';
+        args++;
+        args += strspn(args, " \t");
+    }
+
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Control socket: command \"%s\"", cmd);
+    for (command = control_commands ; command->name != NULL ; command++){
+        if (strcmp(command->name, cmd) == 0){
+            break;
+        }
+    }
+    if (command->name == NULL){
+        fprintf(out, "Unknown command: %s. Use \"help\"\n", cmd);
+    }else if (command->handler(out, args) != GOOD){
+        fprintf(out, "Usage: %s\n", command->help);
+    }
+}
+
+
+static void close_control_client(control_client *client)
+{
+    close(client->fd);
+    client->fd = -1;
+    client->len = 0;
+    free(client->answer);
+    client->answer = NULL;
+}
+
+
+static int cmd_stats(
+        FILE    *out,
+        char    *args)
+{
+    if (*args == '\0' || strcmp(args, "json") == 0){
+        stats_write_json(out);
+    }else if (strcmp(args, "prometheus") == 0){
+        stats_write_prometheus(out);
+    }else{
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+static int cmd_trace(
+        FILE    *out,
+        char    *args)
+{
+    char    *value  = NULL;
+
+    if (*args == '\0'){
+        trace_write_selectors(out);
+        return (GOOD);
+    }
+    if (strcmp(args, "clear") == 0){
+        trace_clear_selectors();
+        fprintf(out, "Trace selectors removed\n");
+        return (GOOD);
+    }
+    value = args + strcspn(args, " \t");
+    if (*value == '\0'){
+        return (BAD);
+    }
+    *value = '\0';
+    value++;
+    value += strspn(value, " \t");
+    if (trace_add_selector(args, value) != GOOD){
+        fprintf(out, "Couldn't add the trace selector (at most %d)\n", TRACE_MAX_SELECTORS);
+        return (BAD);
+    }
+    fprintf(out, "Trace selector added\n");
+    return (GOOD);
+}
+
+
+static int cmd_flight(
+        FILE    *out,
+        char    *args)
+{
+    if (*args != '\0'){
+        return (BAD);
+    }
+    flight_recorder_write(out);
+    return (GOOD);
+}
+
+
+static int cmd_help(
+        FILE    *out,
+        char    *args)
+{
+    control_command     *command    = NULL;
+
+    for (command = control_commands ; command->name != NULL ; command++){
+        fprintf(out, "%s\n", command->help);
+    }
+    return (GOOD);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,89 @@
+/*
+ * lispd_control_socket.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Local Unix socket to query and manage lispd at runtime.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_CONTROL_SOCKET_H_
+#define LISPD_CONTROL_SOCKET_H_
+
+#include "lispd.h"
+
+/*
+ * A client connects to the stream socket, sends a command line and reads the answer until
+ * lispd closes the connection, e.g.:
+ *     echo "stats prometheus" | socat - UNIX-CONNECT:/var/run/lispd.sock
+ * The clients are served from the event loop and never block it: the command is read as it
+ * arrives and the answer is buffered and sent as the socket becomes writable. A client that
+ * doesn't send its command or read its answer for CONTROL_SOCKET_TIMEOUT seconds is
+ * disconnected.
+ */
+#define CONTROL_SOCKET_MAX_CMD_LEN  256
+#define CONTROL_SOCKET_MAX_CLIENTS  4
+#define CONTROL_SOCKET_TIMEOUT      1
+
+
+/*
+ * Create the control socket listening in path. Return the socket or -1 on error.
+ */
+int open_control_socket(char *path);
+
+/*
+ * Accept a connection of the control socket. Its command is read by process_control_clients
+ */
+void process_control_socket(int fd);
+
+/*
+ * Add the clients waiting for their command to readfds and the ones with an answer to send to
+ * writefds for select. Clients inactive for CONTROL_SOCKET_TIMEOUT seconds are disconnected.
+ * Return the highest file descriptor of both sets.
+ */
+int control_clients_fd_set(
+        fd_set  *readfds,
+        fd_set  *writefds,
+        int     max_fd);
+
+/*
+ * Read the command of the clients with data in readfds and answer the complete ones. Send the
+ * pending answer of the clients in writefds.
+ */
+void process_control_clients(
+        fd_set  *readfds,
+        fd_set  *writefds);
+
+/*
+ * Close the control socket and remove its path
+ */
+void close_control_socket(
+        int     fd,
+        char    *path);
+
+#endif /* LISPD_CONTROL_SOCKET_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
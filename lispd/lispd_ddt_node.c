@@ -0,0 +1,319 @@
+/*
+ * lispd_ddt_node.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Response time statistics of the DDT nodes asked by the DDT client.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <time.h>
+#include "lispd_ddt_node.h"
+#include "lispd_external.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+
+
+static lispd_ddt_node   *ddt_nodes_table[DDT_NODES_TABLE_SIZE];
+
+
+/********************************** Function declaration ********************************/
+
+static lispd_ddt_node *get_ddt_node(
+        lisp_addr_t     *address,
+        int             create);
+static inline uint32_t get_ddt_node_hash(lisp_addr_t *address);
+static inline int is_ddt_node_down(lispd_ddt_node *ddt_node);
+
+/****************************************************************************************/
+
+
+uint32_t get_ddt_node_score(lisp_addr_t *address)
+{
+    lispd_ddt_node *ddt_node = NULL;
+
+    ddt_node = get_ddt_node(address, FALSE);
+    if (ddt_node == NULL){
+        return (0);
+    }
+    if (is_ddt_node_down(ddt_node) == TRUE){
+        return (LISPD_MAX_MRQ_TIMEOUT * 1000);
+    }
+    if (ddt_node->consecutive_timeouts >= DDT_NODE_MAX_TIMEOUTS){
+        /* Retry time of the down node has expired. Probe it again */
+        return (0);
+    }
+    return (ddt_node->srtt + 2 * ddt_node->rttvar);
+}
+
+/*
+ * Timeout in seconds to wait for the Map Referral of a DDT Map Request sent to the node:
+ * SRTT + 4 * RTTVAR rounded up to seconds, doubled for each previous attempt.
+ */
+int get_ddt_request_timeout(
+        lisp_addr_t     *address,
+        int             attempt)
+{
+    lispd_ddt_node  *ddt_node   = NULL;
+    int             timeout     = LISPD_INITIAL_DDT_MRQ_TIMEOUT;
+
+    ddt_node = get_ddt_node(address, FALSE);
+    if (ddt_node != NULL && ddt_node->srtt != 0){
+        timeout = (ddt_node->srtt + 4 * ddt_node->rttvar + 999) / 1000;
+        if (timeout < LISPD_INITIAL_DDT_MRQ_TIMEOUT){
+            timeout = LISPD_INITIAL_DDT_MRQ_TIMEOUT;
+        }
+    }
+
+    while (attempt > 0 && timeout < LISPD_MAX_MRQ_TIMEOUT){
+        timeout = timeout << 1;
+        attempt--;
+    }
+    if (timeout > LISPD_MAX_MRQ_TIMEOUT){
+        timeout = LISPD_MAX_MRQ_TIMEOUT;
+    }
+    return (timeout);
+}
+
+/*
+ * Seconds after which the next DDT node of the referral should be asked: SRTT + 2 * RTTVAR
+ * rounded up to seconds.
+ */
+int get_ddt_request_hedge_deadline(lisp_addr_t *address)
+{
+    lispd_ddt_node  *ddt_node   = NULL;
+    int             deadline    = 0;
+
+    if (map_request_hedging == FALSE){
+        return (0);
+    }
+    ddt_node = get_ddt_node(address, FALSE);
+    if (ddt_node == NULL || ddt_node->srtt == 0){
+        return (0);
+    }
+    deadline = (ddt_node->srtt + 2 * ddt_node->rttvar + 999) / 1000;
+    if (deadline < 1){
+        deadline = 1;
+    }
+    return (deadline);
+}
+
+void ddt_node_request_sent(lisp_addr_t *address)
+{
+    lispd_ddt_node *ddt_node = NULL;
+
+    ddt_node = get_ddt_node(address, TRUE);
+    if (ddt_node == NULL){
+        return;
+    }
+    ddt_node->requests++;
+}
+
+void ddt_node_reply_received(
+        lisp_addr_t     *address,
+        uint32_t        rtt)
+{
+    lispd_ddt_node *ddt_node = NULL;
+
+    ddt_node = get_ddt_node(address, TRUE);
+    if (ddt_node == NULL){
+        return;
+    }
+    update_rtt_estimation(&(ddt_node->srtt), &(ddt_node->rttvar), rtt);
+    ddt_node->replies++;
+    ddt_node->consecutive_timeouts = 0;
+
+    lispd_log_msg(LISP_LOG_DEBUG_3,"DDT node %s: rtt %u ms, srtt %u ms, rttvar %u ms",
+            get_char_from_lisp_addr_t(ddt_node->address), rtt, ddt_node->srtt, ddt_node->rttvar);
+}
+
+void ddt_node_request_timeout(lisp_addr_t *address)
+{
+    lispd_ddt_node *ddt_node = NULL;
+
+    ddt_node = get_ddt_node(address, TRUE);
+    if (ddt_node == NULL){
+        return;
+    }
+    ddt_node->timeouts++;
+    if (ddt_node->consecutive_timeouts < 255){
+        ddt_node->consecutive_timeouts++;
+    }
+    ddt_node->last_timeout = time(NULL);
+
+    if (ddt_node->consecutive_timeouts == DDT_NODE_MAX_TIMEOUTS){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"DDT node %s doesn't answer. It will be asked after the other nodes of the referrals",
+                get_char_from_lisp_addr_t(ddt_node->address));
+        dump_ddt_nodes(LISP_LOG_DEBUG_2);
+    }
+}
+
+void ddt_node_not_authoritative(
+        lisp_addr_t     *address,
+        lisp_addr_t     eid_prefix,
+        int             eid_prefix_length,
+        int             ttl)
+{
+    lispd_ddt_node          *ddt_node   = NULL;
+    lispd_ddt_node_not_auth *not_auth   = NULL;
+
+    ddt_node = get_ddt_node(address, TRUE);
+    if (ddt_node == NULL){
+        return;
+    }
+    if (ttl < DDT_NODE_NOT_AUTHORITATIVE_TTL){
+        ttl = DDT_NODE_NOT_AUTHORITATIVE_TTL;
+    }
+
+    for (not_auth = ddt_node->not_authoritative ; not_auth != NULL ; not_auth = not_auth->next){
+        if (not_auth->eid_prefix_length == eid_prefix_length &&
+                compare_lisp_addr_t(&(not_auth->eid_prefix), &eid_prefix) == 0){
+            break;
+        }
+    }
+    if (not_auth == NULL){
+        if ((not_auth = (lispd_ddt_node_not_auth *)malloc(sizeof(lispd_ddt_node_not_auth))) == NULL){
+            lispd_log_msg(LISP_LOG_WARNING,"ddt_node_not_authoritative: Unable to allocate memory for lispd_ddt_node_not_auth: %s",
+                    strerror(errno));
+            return;
+        }
+        copy_lisp_addr(&(not_auth->eid_prefix), &eid_prefix);
+        not_auth->eid_prefix_length = eid_prefix_length;
+        not_auth->next = ddt_node->not_authoritative;
+        ddt_node->not_authoritative = not_auth;
+    }
+    not_auth->expiry_time = time(NULL) + ttl * 60;
+}
+
+int is_ddt_node_not_authoritative(
+        lisp_addr_t     *address,
+        lisp_addr_t     eid)
+{
+    lispd_ddt_node          *ddt_node       = NULL;
+    lispd_ddt_node_not_auth **not_auth_ptr  = NULL;
+    lispd_ddt_node_not_auth *not_auth       = NULL;
+    time_t                  now             = time(NULL);
+
+    ddt_node = get_ddt_node(address, FALSE);
+    if (ddt_node == NULL){
+        return (FALSE);
+    }
+
+    not_auth_ptr = &(ddt_node->not_authoritative);
+    while (*not_auth_ptr != NULL){
+        not_auth = *not_auth_ptr;
+        if (not_auth->expiry_time <= now){
+            /* Expired. Remove it */
+            *not_auth_ptr = not_auth->next;
+            free (not_auth);
+            continue;
+        }
+        if (is_prefix_b_part_of_a(not_auth->eid_prefix, not_auth->eid_prefix_length,
+                eid, get_prefix_len(eid.afi)) == TRUE){
+            return (TRUE);
+        }
+        not_auth_ptr = &(not_auth->next);
+    }
+    return (FALSE);
+}
+
+void dump_ddt_nodes(int log_level)
+{
+    lispd_ddt_node  *ddt_node   = NULL;
+    int             ctr         = 0;
+
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+
+    lispd_log_msg(log_level,"*** DDT nodes ***");
+    for (ctr = 0 ; ctr < DDT_NODES_TABLE_SIZE ; ctr++){
+        for (ddt_node = ddt_nodes_table[ctr] ; ddt_node != NULL ; ddt_node = ddt_node->next){
+            lispd_log_msg(log_level," %s: srtt %u ms, rttvar %u ms, requests %u, replies %u, timeouts %u%s",
+                    get_char_from_lisp_addr_t(ddt_node->address),
+                    ddt_node->srtt,
+                    ddt_node->rttvar,
+                    ddt_node->requests,
+                    ddt_node->replies,
+                    ddt_node->timeouts,
+                    is_ddt_node_down(ddt_node) == TRUE ? " (down)" : "");
+        }
+    }
+}
+
+
+/*
+ * Return the statistics of the DDT node. If create is TRUE and the node
+ * is not found, a new entry is added to the table
+ */
+static lispd_ddt_node *get_ddt_node(
+        lisp_addr_t     *address,
+        int             create)
+{
+    lispd_ddt_node  *ddt_node   = NULL;
+    uint32_t        position    = 0;
+
+    position = get_ddt_node_hash(address) & (DDT_NODES_TABLE_SIZE - 1);
+    for (ddt_node = ddt_nodes_table[position] ; ddt_node != NULL ; ddt_node = ddt_node->next){
+        if (compare_lisp_addr_t(&(ddt_node->address), address) == 0){
+            return (ddt_node);
+        }
+    }
+    if (create == FALSE){
+        return (NULL);
+    }
+
+    if ((ddt_node = (lispd_ddt_node *)calloc(1, sizeof(lispd_ddt_node))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"get_ddt_node: Unable to allocate memory for lispd_ddt_node: %s", strerror(errno));
+        return (NULL);
+    }
+    copy_lisp_addr(&(ddt_node->address), address);
+    ddt_node->next = ddt_nodes_table[position];
+    ddt_nodes_table[position] = ddt_node;
+    return (ddt_node);
+}
+
+static inline uint32_t get_ddt_node_hash(lisp_addr_t *address)
+{
+    uint8_t     *byte   = (uint8_t *)&(address->address);
+    int         len     = get_addr_len(address->afi);
+    uint32_t    hash    = 2166136261U; // FNV-1a
+    int         ctr     = 0;
+
+    for (ctr = 0 ; ctr < len ; ctr++){
+        hash = (hash ^ byte[ctr]) * 16777619U;
+    }
+    return (hash);
+}
+
+static inline int is_ddt_node_down(lispd_ddt_node *ddt_node)
+{
+    return (ddt_node->consecutive_timeouts >= DDT_NODE_MAX_TIMEOUTS &&
+            time(NULL) - ddt_node->last_timeout < DDT_NODE_DOWN_RETRY_TIME);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,134 @@
+/*
+ * lispd_ddt_node.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Response time statistics of the DDT nodes asked by the DDT client.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_DDT_NODE_H_
+#define LISPD_DDT_NODE_H_
+
+#include "lispd.h"
+
+/*
+ * Number of consecutive timeouts after which a DDT node is considered down. A down
+ * DDT node is asked after the others until DDT_NODE_DOWN_RETRY_TIME seconds have passed
+ * since its last timeout.
+ */
+#define DDT_NODE_MAX_TIMEOUTS           3
+#define DDT_NODE_DOWN_RETRY_TIME        60
+
+/* Number of buckets of the table of DDT nodes. Must be power of 2 */
+#define DDT_NODES_TABLE_SIZE            256
+
+/* Maximum number of DDT nodes of a referral asked at the same time */
+#define LISPD_MAX_DDT_PARALLEL_REQUESTS 4
+
+/* Minimum time in minutes to remember that a DDT node is not authoritative for a prefix */
+#define DDT_NODE_NOT_AUTHORITATIVE_TTL  1
+
+/*
+ * Prefix for which the DDT node answered a NOT_AUTHORITATIVE referral
+ */
+typedef struct lispd_ddt_node_not_auth_ {
+    lisp_addr_t                         eid_prefix;
+    int                                 eid_prefix_length;
+    time_t                              expiry_time;
+    struct lispd_ddt_node_not_auth_     *next;
+} lispd_ddt_node_not_auth;
+
+/*
+ * Statistics of a DDT node. DDT nodes are identified by the address of the locator.
+ */
+typedef struct lispd_ddt_node_ {
+    lisp_addr_t                 address;
+    uint32_t                    srtt;                   // Smoothed RTT in ms. 0 if not measured yet
+    uint32_t                    rttvar;                 // RTT variation in ms
+    uint32_t                    requests;
+    uint32_t                    replies;
+    uint32_t                    timeouts;
+    uint8_t                     consecutive_timeouts;
+    time_t                      last_timeout;
+    lispd_ddt_node_not_auth     *not_authoritative;
+    struct lispd_ddt_node_      *next;
+} lispd_ddt_node;
+
+
+/*
+ * Expected response time of the DDT node in ms used to sort the DDT nodes of a referral
+ * with the same priority. Not measured nodes return 0 to be probed. Down nodes return
+ * the maximum timeout.
+ */
+uint32_t get_ddt_node_score(lisp_addr_t *address);
+
+/*
+ * Timeout in seconds to wait for the Map Referral of a DDT Map Request sent to the node.
+ * attempt is the number of previous transmissions and is used for exponential backoff
+ */
+int get_ddt_request_timeout(
+        lisp_addr_t     *address,
+        int             attempt);
+
+/*
+ * Seconds after which the next DDT node of the referral should be asked if the
+ * node doesn't answer. Return 0 if hedging is disabled or the node has not been measured
+ */
+int get_ddt_request_hedge_deadline(lisp_addr_t *address);
+
+void ddt_node_request_sent(lisp_addr_t *address);
+
+void ddt_node_reply_received(
+        lisp_addr_t     *address,
+        uint32_t        rtt);
+
+void ddt_node_request_timeout(lisp_addr_t *address);
+
+/*
+ * Remember during ttl minutes that the DDT node is not authoritative for the prefix
+ */
+void ddt_node_not_authoritative(
+        lisp_addr_t     *address,
+        lisp_addr_t     eid_prefix,
+        int             eid_prefix_length,
+        int             ttl);
+
+/*
+ * Return TRUE if the DDT node answered recently that it is not authoritative for the EID
+ */
+int is_ddt_node_not_authoritative(
+        lisp_addr_t     *address,
+        lisp_addr_t     eid);
+
+/*
+ * Log the statistics of the DDT nodes. Done when a DDT node is considered down
+ */
+void dump_ddt_nodes(int log_level);
+
+#endif /* LISPD_DDT_NODE_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
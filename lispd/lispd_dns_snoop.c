@@ -0,0 +1,235 @@
+/*
+ * lispd_dns_snoop.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Pre-resolution of the mappings of the addresses returned in DNS answers.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <time.h>
+#include "lispd_dns_snoop.h"
+#include "lispd_external.h"
+#include "lispd_lib.h"
+#include "lispd_local_db.h"
+#include "lispd_log.h"
+#include "lispd_map_cache_db.h"
+#include "lispd_output.h"
+
+
+static time_t   dns_snoop_window        = 0;
+static int      dns_snoop_requests      = 0;
+
+
+/********************************** Function declaration ********************************/
+
+static int skip_dns_name(
+        uint8_t     *dns,
+        int         dns_length,
+        int         *offset);
+static void dns_snoop_answer(
+        lisp_addr_t     *eid,
+        lisp_addr_t     *src_eid);
+
+/****************************************************************************************/
+
+
+void dns_snoop_packet(
+        uint8_t     *packet,
+        int         packet_length)
+{
+    struct iphdr        *iph            = (struct iphdr *)packet;
+    struct ip6_hdr      *ip6h           = NULL;
+    struct udphdr       *udph           = NULL;
+    lispd_dns_hdr       *dnsh           = NULL;
+    uint8_t             *dns            = NULL;
+    uint8_t             *record         = NULL;
+    lisp_addr_t         src_eid         = {.afi=AF_UNSPEC};
+    lisp_addr_t         answer_addr     = {.afi=AF_UNSPEC};
+    int                 header_len      = 0;
+    int                 dns_length      = 0;
+    int                 offset          = 0;
+    int                 answers         = 0;
+    uint16_t            type            = 0;
+    uint16_t            class           = 0;
+    uint16_t            rdlength        = 0;
+    int                 ctr             = 0;
+
+    if (dns_snooping == FALSE || packet_length < (int)sizeof(struct iphdr)){
+        return;
+    }
+
+    switch (iph->version){
+    case 4:
+        header_len = iph->ihl * 4;
+        /* Fragments are not processed */
+        if (header_len < (int)sizeof(struct iphdr) || iph->protocol != IPPROTO_UDP ||
+                (ntohs(iph->frag_off) & (IP_MF | IP_OFFMASK)) != 0){
+            return;
+        }
+        src_eid.afi = AF_INET;
+        src_eid.address.ip.s_addr = iph->daddr;
+        break;
+    case 6:
+        ip6h = (struct ip6_hdr *)packet;
+        header_len = sizeof(struct ip6_hdr);
+        /* Extension headers are not processed */
+        if (packet_length < header_len || ip6h->ip6_nxt != IPPROTO_UDP){
+            return;
+        }
+        src_eid.afi = AF_INET6;
+        memcpy(&(src_eid.address.ipv6), &(ip6h->ip6_dst), sizeof(struct in6_addr));
+        break;
+    default:
+        return;
+    }
+
+    if (packet_length < header_len + (int)sizeof(struct udphdr) + (int)sizeof(lispd_dns_hdr)){
+        return;
+    }
+    udph = (struct udphdr *)CO(packet, header_len);
+    if (ntohs(udph->source) != DNS_PORT){
+        return;
+    }
+
+    dns = (uint8_t *)CO(udph, sizeof(struct udphdr));
+    dns_length = packet_length - header_len - sizeof(struct udphdr);
+    dnsh = (lispd_dns_hdr *)dns;
+
+    /* Only complete responses without error */
+    if ((ntohs(dnsh->flags) & DNS_FLAG_QR) == 0 || (ntohs(dnsh->flags) & DNS_FLAG_TC) != 0 ||
+            (ntohs(dnsh->flags) & DNS_RCODE_MASK) != 0 || dnsh->ancount == 0){
+        return;
+    }
+
+    /* The host that asked has to be one of our EIDs to send the Map Request on its behalf */
+    if (lookup_eid_in_db(src_eid) == NULL){
+        return;
+    }
+
+    offset = sizeof(lispd_dns_hdr);
+    for (ctr = 0 ; ctr < ntohs(dnsh->qdcount) ; ctr++){
+        if (skip_dns_name(dns, dns_length, &offset) != GOOD || offset + 4 > dns_length){
+            return;
+        }
+        offset += 4; // Type and class
+    }
+
+    answers = ntohs(dnsh->ancount);
+    if (answers > DNS_SNOOP_MAX_ANSWERS){
+        answers = DNS_SNOOP_MAX_ANSWERS;
+    }
+    for (ctr = 0 ; ctr < answers ; ctr++){
+        if (skip_dns_name(dns, dns_length, &offset) != GOOD || offset + 10 > dns_length){
+            return;
+        }
+        record = CO(dns, offset);
+        type = ntohs(*(uint16_t *)record);
+        class = ntohs(*(uint16_t *)CO(record, 2));
+        rdlength = ntohs(*(uint16_t *)CO(record, 8));
+        offset += 10;
+        if (offset + rdlength > dns_length){
+            return;
+        }
+
+        if (class == DNS_CLASS_IN && type == DNS_TYPE_A && rdlength == sizeof(struct in_addr)){
+            answer_addr.afi = AF_INET;
+            memcpy(&(answer_addr.address.ip), CO(dns, offset), sizeof(struct in_addr));
+            dns_snoop_answer(&answer_addr, &src_eid);
+        }else if (class == DNS_CLASS_IN && type == DNS_TYPE_AAAA && rdlength == sizeof(struct in6_addr)){
+            answer_addr.afi = AF_INET6;
+            memcpy(&(answer_addr.address.ipv6), CO(dns, offset), sizeof(struct in6_addr));
+            dns_snoop_answer(&answer_addr, &src_eid);
+        }
+        offset += rdlength;
+    }
+}
+
+/*
+ * Send a Map Request for the address of the DNS answer if there is no map cache entry for it
+ */
+static void dns_snoop_answer(
+        lisp_addr_t     *eid,
+        lisp_addr_t     *src_eid)
+{
+    time_t      now     = time(NULL);
+
+    if (lookup_map_cache(*eid) != NULL || lookup_eid_in_db(*eid) != NULL){
+        return;
+    }
+
+    if (now != dns_snoop_window){
+        dns_snoop_window = now;
+        dns_snoop_requests = 0;
+    }
+    if (dns_snoop_requests >= DNS_SNOOP_MAX_REQUESTS){
+        lispd_log_msg(LISP_LOG_DEBUG_3,"dns_snoop_answer: Rate limit reached. No Map Request sent for %s",
+                get_char_from_lisp_addr_t(*eid));
+        return;
+    }
+    dns_snoop_requests++;
+
+    lispd_log_msg(LISP_LOG_DEBUG_2,"dns_snoop_answer: DNS answer %s without map cache entry. Requesting its mapping",
+            get_char_from_lisp_addr_t(*eid));
+
+    if (ddt_client == TRUE){
+        handle_map_cache_miss_with_ddt(eid, src_eid);
+    }else{
+        handle_map_cache_miss(eid, src_eid);
+    }
+}
+
+/*
+ * Move offset after the domain name starting at offset. Compressed names end with a pointer
+ */
+static int skip_dns_name(
+        uint8_t     *dns,
+        int         dns_length,
+        int         *offset)
+{
+    int     pos     = *offset;
+    uint8_t len     = 0;
+
+    while (pos < dns_length){
+        len = dns[pos];
+        if ((len & 0xC0) == 0xC0){
+            if (pos + 2 > dns_length){
+                return (BAD);
+            }
+            *offset = pos + 2;
+            return (GOOD);
+        }
+        if (len == 0){
+            *offset = pos + 1;
+            return (GOOD);
+        }
+        pos += len + 1;
+    }
+    return (BAD);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,74 @@
+/*
+ * lispd_dns_snoop.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Pre-resolution of the mappings of the addresses returned in DNS answers.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_DNS_SNOOP_H_
+#define LISPD_DNS_SNOOP_H_
+
+#include "lispd.h"
+
+#define DNS_PORT                        53
+
+/* Maximum number of Map Requests triggered by DNS answers per second */
+#define DNS_SNOOP_MAX_REQUESTS          20
+
+/* Maximum number of answer records of a DNS response processed */
+#define DNS_SNOOP_MAX_ANSWERS           8
+
+#define DNS_TYPE_A                      1
+#define DNS_TYPE_AAAA                   28
+#define DNS_CLASS_IN                    1
+
+typedef struct lispd_dns_hdr_ {
+    uint16_t    id;
+    uint16_t    flags;
+    uint16_t    qdcount;
+    uint16_t    ancount;
+    uint16_t    nscount;
+    uint16_t    arcount;
+} PACKED lispd_dns_hdr;
+
+#define DNS_FLAG_QR                     0x8000
+#define DNS_FLAG_TC                     0x0200
+#define DNS_RCODE_MASK                  0x000F
+
+/*
+ * Check if the IP packet is a DNS response addressed to a local EID. For each A or AAAA
+ * record without map cache entry, a Map Request is sent before the host starts the flow.
+ * Only done when dns-snooping is enabled.
+ */
+void dns_snoop_packet(
+        uint8_t     *packet,
+        int         packet_length);
+
+#endif /* LISPD_DNS_SNOOP_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
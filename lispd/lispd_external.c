@@ -35,11 +35,24 @@ void init_globales()
     router_mode                         = FALSE;
 	map_resolvers						= NULL;
 	ddt_client                          = FALSE;
+    ddt_parallel_requests               = 1;
 	proxy_itrs							= NULL;
 	proxy_etrs							= NULL;
 	map_servers							= NULL;
 	config_file							= NULL;
 	map_request_retries 				= DEFAULT_MAP_REQUEST_RETRIES;
+    map_request_hedging                 = FALSE;
+    dns_snooping                        = FALSE;
+    rtr_load_sharing                    = FALSE;
+    fast_handover                       = FALSE;
+    tun_policy_routing                  = FALSE;
+    fast_path                           = FALSE;
+    fast_path_object                    = NULL;
+    underlay_mtu                        = 0;
+    tun_mtu                             = 0;
+    max_ip_packet                       = MIN_PACKET_BUF_SIZE;
+    async_log                           = FALSE;
+    control_socket_path                 = NULL;
 	control_port            			= LISP_CONTROL_PORT;
 	debug_level             			= 0;
 	daemonize               			= FALSE;
@@ -51,6 +64,7 @@ void init_globales()
 	rloc_probe_retries_interval       	= DEFAULT_RLOC_PROBING_RETRIES_INTERVAL;
 	total_mappings                      = 0;
 	netlink_fd                          = 0;
+	control_fd                          = -1;
 	ipv4_data_input_fd                  = 0;
 	ipv6_data_input_fd                  = 0;
 	ipv4_control_input_fd               = 0;
@@ -65,10 +79,6 @@ void init_globales()
     lispd_xTR_ID    xTR_ID              = {.byte = {0}};
 	memset (&site_ID,0,sizeof(lispd_site_ID));
 	memset (&xTR_ID,0,sizeof(lispd_xTR_ID));
-	// Global variables used to store nonces of encapsulated map register and info request.
-	// To be removed when NAT with multihoming supported.
-	nat_emr_nonce  					= NULL;
-	nat_ir_nonce   					= NULL;
 
 
 
@@ -78,7 +88,6 @@ void init_globales()
 	default_out_iface_v4				= NULL;
 	default_out_iface_v6				= NULL;
 	smr_timer							= NULL;
-	info_reply_ttl_timer                = NULL;
 
 
 	memset (msg,0,sizeof(char)*128);
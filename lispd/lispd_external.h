@@ -42,12 +42,25 @@
 extern  uint8_t                 router_mode;
 extern  lispd_addr_list_t       *map_resolvers;
 extern  int                     ddt_client;
+extern  int                     ddt_parallel_requests;
 extern  lispd_addr_list_t       *proxy_itrs;
 extern  lispd_map_cache_entry   *proxy_etrs;
 extern  lispd_map_server_list_t *map_servers;
 extern  char                    *config_file;
 extern  char                    msg[];
 extern  int                     map_request_retries;
+extern  int                     map_request_hedging;
+extern  int                     dns_snooping;
+extern  int                     rtr_load_sharing;
+extern  int                     fast_handover;
+extern  int                     tun_policy_routing;
+extern  int                     fast_path;
+extern  char                    *fast_path_object;
+extern  int                     underlay_mtu;
+extern  int                     tun_mtu;
+extern  int                     max_ip_packet;
+extern  int                     async_log;
+extern  char                    *control_socket_path;
 extern  int                     control_port;
 extern  int                     debug_level;
 extern  int                     daemonize;
@@ -58,6 +71,7 @@ extern  int                     rloc_probe_retries;
 extern  int                     rloc_probe_retries_interval;
 extern  int                     total_mappings;
 extern  int                     netlink_fd;
+extern  int                     control_fd;
 extern  int                     ipv6_data_input_fd;
 extern  int                     ipv4_data_input_fd;
 extern  int                     ipv6_control_input_fd;
@@ -66,8 +80,6 @@ extern  int                     nat_aware;
 extern  int                     nat_status;
 extern  lispd_site_ID           site_ID;
 extern  lispd_xTR_ID            xTR_ID;
-extern  nonces_list             *nat_emr_nonce;
-extern  nonces_list             *nat_ir_nonce;
 extern  int                     timers_fd;
 extern  struct sockaddr_nl      dst_addr;
 extern  struct sockaddr_nl      src_addr;
@@ -78,7 +90,6 @@ extern lispd_iface_elt          *default_ctrl_iface_v6;
 extern lispd_iface_elt          *default_out_iface_v4;
 extern lispd_iface_elt          *default_out_iface_v6;
 extern timer                    *smr_timer;
-extern timer                    *info_reply_ttl_timer;
 
 void init_globales();
 
@@ -0,0 +1,491 @@
+/*
+ * lispd_fastpath.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Management of the tc eBPF fast path of the data plane.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/bpf.h>
+#include "bpf/lisp_fastpath.h"
+#include "lispd_external.h"
+#include "lispd_fastpath.h"
+#include "lispd_iface_list.h"
+#include "lispd_lib.h"
+#include "lispd_local_db.h"
+#include "lispd_log.h"
+#include "lispd_map_cache_db.h"
+#include "lispd_output.h"
+#include "lispd_tun.h"
+
+/*
+ * Maps of the fast path
+ */
+#define FP_LCL_V4           0
+#define FP_LCL_V6           1
+#define FP_RMT_V4           2
+#define FP_RMT_V6           3
+#define FP_RLOCS            4
+#define FP_CONF             5
+#define FP_NUM_MAPS         6
+
+static char *fp_map_names[FP_NUM_MAPS] = {
+        FP_MAP_LCL_V4, FP_MAP_LCL_V6, FP_MAP_RMT_V4, FP_MAP_RMT_V6, FP_MAP_RLOCS, FP_MAP_CONF};
+
+static int                  fp_map_fds[FP_NUM_MAPS]     = {-1,-1,-1,-1,-1,-1};
+static int                  fp_ready                    = FALSE;
+
+/* Local RLOCs present in the RLOCs map */
+static struct fp_rloc_key   fp_rlocs[FP_MAX_LCL_RLOCS];
+static int                  fp_rlocs_count              = 0;
+
+
+/********************************** Function declaration ********************************/
+
+static int fp_run_tc(char *const argv[]);
+static int fp_attach_program(
+        char    *iface_name,
+        char    *direction,
+        char    *section);
+static void fp_detach_programs(char *iface_name);
+static void fp_remove_pinned_maps();
+static int fp_bpf(
+        int                 cmd,
+        union bpf_attr      *attr);
+static int fp_map_update(
+        int     map,
+        void    *key,
+        void    *value);
+static int fp_map_delete(
+        int     map,
+        void    *key);
+static void fp_update_local_mapping(lispd_mapping_elt *mapping);
+static void fp_update_local_rlocs();
+static void fp_sync_map_cache();
+
+/****************************************************************************************/
+
+
+int fastpath_init()
+{
+    lispd_iface_list_elt    *iface_list     = NULL;
+    struct fp_conf          conf;
+    char                    path[PATH_MAX];
+    uint32_t                zero            = 0;
+    int                     ctr             = 0;
+
+    if (nat_aware == TRUE){
+        lispd_log_msg(LISP_LOG_WARNING, "fastpath_init: The fast path doesn't support NAT traversal. Disabled");
+        return (BAD);
+    }
+    /* The kernel selects the locators by the hash of the flow: the DSCP policies would be ignored */
+    if (is_dscp_policy_configured() == TRUE){
+        lispd_log_msg(LISP_LOG_WARNING, "fastpath_init: The fast path doesn't support DSCP policies. Disabled");
+        return (BAD);
+    }
+
+    /* Maps of previous executions could have stale entries */
+    fp_remove_pinned_maps();
+
+    if (fp_attach_program(TUN_IFACE_NAME, "egress", FP_SEC_ENCAP) != GOOD){
+        return (BAD);
+    }
+    iface_list = get_head_interface_list();
+    while (iface_list != NULL){
+        if (fp_attach_program(iface_list->iface->iface_name, "ingress", FP_SEC_DECAP) != GOOD){
+            fastpath_cleanup();
+            return (BAD);
+        }
+        iface_list = iface_list->next;
+    }
+
+    for (ctr = 0 ; ctr < FP_NUM_MAPS ; ctr++){
+        union bpf_attr attr;
+
+        snprintf(path, sizeof(path), "%s/%s", FP_PIN_PATH, fp_map_names[ctr]);
+        memset(&attr, 0, sizeof(attr));
+        attr.pathname = (uint64_t)(unsigned long)path;
+        fp_map_fds[ctr] = fp_bpf(BPF_OBJ_GET, &attr);
+        if (fp_map_fds[ctr] < 0){
+            lispd_log_msg(LISP_LOG_WARNING, "fastpath_init: Couldn't open the map %s: %s", path, strerror(errno));
+            fastpath_cleanup();
+            return (BAD);
+        }
+    }
+
+    memset(&conf, 0, sizeof(conf));
+    conf.tun_ifindex = tun_ifindex;
+    if (fp_map_update(FP_CONF, &zero, &conf) != GOOD){
+        fastpath_cleanup();
+        return (BAD);
+    }
+
+    fp_ready = TRUE;
+    fastpath_update_local_db();
+    fp_sync_map_cache();
+
+    lispd_log_msg(LISP_LOG_INFO, "Fast path enabled (%s)", fast_path_object);
+    return (GOOD);
+}
+
+
+void fastpath_cleanup()
+{
+    lispd_iface_list_elt    *iface_list     = NULL;
+    int                     ctr             = 0;
+
+    fp_ready = FALSE;
+    fp_detach_programs(TUN_IFACE_NAME);
+    iface_list = get_head_interface_list();
+    while (iface_list != NULL){
+        fp_detach_programs(iface_list->iface->iface_name);
+        iface_list = iface_list->next;
+    }
+    for (ctr = 0 ; ctr < FP_NUM_MAPS ; ctr++){
+        if (fp_map_fds[ctr] != -1){
+            close(fp_map_fds[ctr]);
+            fp_map_fds[ctr] = -1;
+        }
+    }
+    fp_remove_pinned_maps();
+    fp_rlocs_count = 0;
+}
+
+
+void fastpath_update_local_db()
+{
+    patricia_tree_t     *local_dbs[2]   = {NULL,NULL};
+    patricia_node_t     *node           = NULL;
+    int                 ctr             = 0;
+
+    if (fp_ready == FALSE){
+        return;
+    }
+
+    local_dbs[0] = get_local_db(AF_INET);
+    local_dbs[1] = get_local_db(AF_INET6);
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (local_dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(local_dbs[ctr]->head, node) {
+            fp_update_local_mapping((lispd_mapping_elt *)(node->data));
+        } PATRICIA_WALK_END;
+    }
+    fp_update_local_rlocs();
+}
+
+
+void fastpath_update_map_cache_entry(lispd_map_cache_entry *entry)
+{
+    balancing_locators_vecs     *blv        = NULL;
+    struct fp_rmt_entry         value;
+    struct fp_key_v6            key;
+    int                         ctr         = 0;
+
+    /* The proxy-ETRs are not used by the fast path: the misses must reach lispd */
+    if (fp_ready == FALSE || entry == proxy_etrs){
+        return;
+    }
+
+    memset(&value, 0, sizeof(value));
+    /* The multicast groups are replicated by lispd */
+    if (entry->active == NO_ACTIVE || is_multicast_addr(entry->mapping->eid_prefix) == TRUE){
+        fastpath_del_map_cache_entry(entry);
+        return;
+    }
+    if (entry->mapping->locator_count == 0){
+        /* Only drop entries are handled by the fast path. The rest of negative entries are processed by lispd */
+        if (entry->actions != MAPPING_ACT_DROP){
+            fastpath_del_map_cache_entry(entry);
+            return;
+        }
+        value.action = FP_ACT_DROP;
+    }else{
+        blv = &(((rmt_mapping_extended_info *)entry->mapping->extended_info)->rmt_balancing_locators_vecs);
+        if (blv->v4_balancing_locators_vec == NULL || blv->v4_locators_vec_length > FP_MAX_RLOCS){
+            fastpath_del_map_cache_entry(entry);
+            return;
+        }
+        value.action = FP_ACT_ENCAP;
+        value.rloc_count = blv->v4_locators_vec_length;
+        for (ctr = 0 ; ctr < blv->v4_locators_vec_length ; ctr++){
+            value.rlocs[ctr] = blv->v4_balancing_locators_vec[ctr]->locator_addr->address.ip.s_addr;
+        }
+    }
+
+    /* The IPv6 key is used for both maps: the kernel only reads the size of the key of the map */
+    memset(&key, 0, sizeof(key));
+    key.prefixlen = entry->mapping->eid_prefix_length;
+    memcopy_lisp_addr(key.addr, &(entry->mapping->eid_prefix));
+    if (entry->mapping->eid_prefix.afi == AF_INET){
+        fp_map_update(FP_RMT_V4, &key, &value);
+    }else{
+        fp_map_update(FP_RMT_V6, &key, &value);
+    }
+}
+
+
+void fastpath_del_map_cache_entry(lispd_map_cache_entry *entry)
+{
+    struct fp_key_v6            key;
+
+    if (fp_ready == FALSE || entry == proxy_etrs){
+        return;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.prefixlen = entry->mapping->eid_prefix_length;
+    memcopy_lisp_addr(key.addr, &(entry->mapping->eid_prefix));
+    if (entry->mapping->eid_prefix.afi == AF_INET){
+        fp_map_delete(FP_RMT_V4, &key);
+    }else{
+        fp_map_delete(FP_RMT_V6, &key);
+    }
+}
+
+
+/*
+ * Write the IPv4 balancing vector of the local mapping in the fast path
+ */
+static void fp_update_local_mapping(lispd_mapping_elt *mapping)
+{
+    balancing_locators_vecs     *blv        = NULL;
+    lispd_locator_elt           *locator    = NULL;
+    lispd_iface_elt             *iface      = NULL;
+    struct fp_lcl_entry         value;
+    struct fp_key_v6            key;
+    int                         ctr         = 0;
+
+    memset(&value, 0, sizeof(value));
+    blv = &(((lcl_mapping_extended_info *)mapping->extended_info)->outgoing_balancing_locators_vecs);
+    /* The entry is added even without locators: it is also used to decapsulate */
+    if (blv->v4_balancing_locators_vec != NULL && blv->v4_locators_vec_length <= FP_MAX_LCL_RLOCS){
+        for (ctr = 0 ; ctr < blv->v4_locators_vec_length ; ctr++){
+            locator = blv->v4_balancing_locators_vec[ctr];
+            iface = get_interface_with_address(locator->locator_addr);
+            if (iface == NULL){
+                continue;
+            }
+            value.rlocs[value.rloc_count].addr = locator->locator_addr->address.ip.s_addr;
+            value.rlocs[value.rloc_count].ifindex = iface->iface_index;
+            value.rlocs[value.rloc_count].mtu = get_iface_mtu(iface->iface_name);
+            value.rloc_count++;
+        }
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.prefixlen = mapping->eid_prefix_length;
+    memcopy_lisp_addr(key.addr, &(mapping->eid_prefix));
+    if (mapping->eid_prefix.afi == AF_INET){
+        fp_map_update(FP_LCL_V4, &key, &value);
+    }else{
+        fp_map_update(FP_LCL_V6, &key, &value);
+    }
+}
+
+
+/*
+ * Replace the addresses of the RLOCs map with the current addresses of the interfaces
+ */
+static void fp_update_local_rlocs()
+{
+    lispd_iface_list_elt    *iface_list     = NULL;
+    lispd_iface_elt         *iface          = NULL;
+    lisp_addr_t             *addrs[2]       = {NULL,NULL};
+    uint32_t                value           = 1;
+    int                     ctr             = 0;
+
+    for (ctr = 0 ; ctr < fp_rlocs_count ; ctr++){
+        fp_map_delete(FP_RLOCS, &(fp_rlocs[ctr]));
+    }
+    fp_rlocs_count = 0;
+
+    iface_list = get_head_interface_list();
+    while (iface_list != NULL){
+        iface = iface_list->iface;
+        addrs[0] = iface->ipv4_address;
+        addrs[1] = iface->ipv6_address;
+        for (ctr = 0 ; ctr < 2 ; ctr++){
+            if (addrs[ctr]->afi == AF_UNSPEC || fp_rlocs_count == FP_MAX_LCL_RLOCS){
+                continue;
+            }
+            memset(&(fp_rlocs[fp_rlocs_count]), 0, sizeof(struct fp_rloc_key));
+            fp_rlocs[fp_rlocs_count].family = addrs[ctr]->afi;
+            memcopy_lisp_addr(fp_rlocs[fp_rlocs_count].addr, addrs[ctr]);
+            if (fp_map_update(FP_RLOCS, &(fp_rlocs[fp_rlocs_count]), &value) == GOOD){
+                fp_rlocs_count++;
+            }
+        }
+        iface_list = iface_list->next;
+    }
+}
+
+
+/*
+ * Write the entries already present in the map cache (static entries) in the fast path
+ */
+static void fp_sync_map_cache()
+{
+    patricia_tree_t     *dbs[2]     = {NULL,NULL};
+    patricia_node_t     *node       = NULL;
+    int                 ctr         = 0;
+
+    dbs[0] = get_map_cache_db(AF_INET);
+    dbs[1] = get_map_cache_db(AF_INET6);
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(dbs[ctr]->head, node) {
+            fastpath_update_map_cache_entry((lispd_map_cache_entry *)(node->data));
+        } PATRICIA_WALK_END;
+    }
+}
+
+
+/*
+ * Execute tc with the arguments of argv. Returns GOOD if tc finished without error
+ */
+static int fp_run_tc(char *const argv[])
+{
+    pid_t   pid     = 0;
+    int     status  = 0;
+    int     fd      = 0;
+
+    pid = fork();
+    if (pid < 0){
+        lispd_log_msg(LISP_LOG_WARNING, "fp_run_tc: fork failed: %s", strerror(errno));
+        return (BAD);
+    }
+    if (pid == 0){
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0){
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0){
+        return (BAD);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+static int fp_attach_program(
+        char    *iface_name,
+        char    *direction,
+        char    *section)
+{
+    char *qdisc_argv[] = {"tc", "qdisc", "replace", "dev", iface_name, "clsact", NULL};
+    char *filter_argv[] = {"tc", "filter", "replace", "dev", iface_name, direction, "prio", "1", "handle", "1",
+            "bpf", "direct-action", "object-file", fast_path_object, "section", section, NULL};
+
+    if (fp_run_tc(qdisc_argv) != GOOD || fp_run_tc(filter_argv) != GOOD){
+        lispd_log_msg(LISP_LOG_WARNING, "fp_attach_program: Couldn't attach the fast path program %s of %s to %s %s",
+                section, fast_path_object, iface_name, direction);
+        return (BAD);
+    }
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Fast path program %s attached to %s %s", section, iface_name, direction);
+    return (GOOD);
+}
+
+
+static void fp_detach_programs(char *iface_name)
+{
+    char *qdisc_argv[] = {"tc", "qdisc", "del", "dev", iface_name, "clsact", NULL};
+
+    fp_run_tc(qdisc_argv);
+}
+
+
+static void fp_remove_pinned_maps()
+{
+    char    path[PATH_MAX];
+    int     ctr     = 0;
+
+    for (ctr = 0 ; ctr < FP_NUM_MAPS ; ctr++){
+        snprintf(path, sizeof(path), "%s/%s", FP_PIN_PATH, fp_map_names[ctr]);
+        unlink(path);
+    }
+}
+
+
+static int fp_bpf(
+        int                 cmd,
+        union bpf_attr      *attr)
+{
+    return (syscall(__NR_bpf, cmd, attr, sizeof(union bpf_attr)));
+}
+
+
+static int fp_map_update(
+        int     map,
+        void    *key,
+        void    *value)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fp_map_fds[map];
+    attr.key = (uint64_t)(unsigned long)key;
+    attr.value = (uint64_t)(unsigned long)value;
+    attr.flags = BPF_ANY;
+    if (fp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "fp_map_update: Couldn't update the map %s: %s", fp_map_names[map], strerror(errno));
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+static int fp_map_delete(
+        int     map,
+        void    *key)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fp_map_fds[map];
+    attr.key = (uint64_t)(unsigned long)key;
+    if (fp_bpf(BPF_MAP_DELETE_ELEM, &attr) < 0){
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
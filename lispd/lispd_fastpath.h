@@ -0,0 +1,78 @@
+/*
+ * lispd_fastpath.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Management of the tc eBPF fast path of the data plane.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_FASTPATH_H_
+#define LISPD_FASTPATH_H_
+
+#include "lispd.h"
+#include "lispd_map_cache.h"
+
+/*
+ * The fast path encapsulates in the kernel the packets sent to the tun interface and
+ * decapsulates the packets received in the RLOC interfaces. lispd attaches the programs
+ * of the object file with tc and mirrors in their maps the local database and the map
+ * cache. lispd keeps processing all the packets that the fast path can not handle.
+ */
+#define FAST_PATH_DEFAULT_OBJECT    "/usr/local/lib/lispd/lisp_fastpath_kern.o"
+
+
+/*
+ * Attach the fast path programs to the tun and the RLOC interfaces and fill their maps.
+ * If it fails, lispd works without fast path.
+ */
+int fastpath_init();
+
+/*
+ * Detach the fast path programs and remove their maps
+ */
+void fastpath_cleanup();
+
+/*
+ * Update the local EID prefixes and the local RLOCs of the fast path. To be called when the
+ * balancing vectors of the local mappings change.
+ */
+void fastpath_update_local_db();
+
+/*
+ * Update a map cache entry in the fast path. To be called when the entry is activated or
+ * its balancing vectors change.
+ */
+void fastpath_update_map_cache_entry(lispd_map_cache_entry *entry);
+
+/*
+ * Remove a map cache entry from the fast path
+ */
+void fastpath_del_map_cache_entry(lispd_map_cache_entry *entry);
+
+#endif /* LISPD_FASTPATH_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
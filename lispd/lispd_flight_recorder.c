@@ -0,0 +1,269 @@
+/*
+ * lispd_flight_recorder.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Ring of the last control plane events, dumped on demand.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <inttypes.h>
+#include <time.h>
+#include "lispd_flight_recorder.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_nonce.h"
+
+#define FLIGHT_LINE_LEN     256
+
+
+/* 40 bytes per event */
+typedef struct flight_event_ {
+    uint32_t            sec;            /* CLOCK_MONOTONIC */
+    uint32_t            usec;
+    uint32_t            value;
+    uint8_t             type;
+    uint8_t             afi;
+    uint8_t             prefix_length;
+    uint8_t             flags;
+    union {
+        struct {
+            uint64_t    nonce;
+            uint8_t     addr[16];
+        } msg;
+        char            timer_name[FLIGHT_TIMER_NAME_LEN];
+    } data;
+} flight_event;
+
+
+static flight_event     flight_ring[FLIGHT_RECORDER_SIZE];
+static uint32_t         flight_next     = 0;
+
+
+/********************************** Function declaration ********************************/
+
+static flight_event *new_flight_event(uint8_t type);
+static void format_flight_event(
+        flight_event        *event,
+        struct timespec     *now,
+        char                *line,
+        int                 line_len);
+static char *flight_addr_to_char(flight_event *event);
+static char *flight_flags_to_char(uint8_t flags);
+
+/****************************************************************************************/
+
+
+void flight_record(
+        uint8_t         type,
+        lisp_addr_t     *addr,
+        uint8_t         prefix_length,
+        uint8_t         flags,
+        uint32_t        value,
+        uint64_t        nonce)
+{
+    flight_event    *event  = new_flight_event(type);
+
+    event->value = value;
+    event->prefix_length = prefix_length;
+    event->flags = flags;
+    event->data.msg.nonce = nonce;
+    if (addr != NULL){
+        event->afi = addr->afi;
+        memcpy(event->data.msg.addr, &(addr->address), sizeof(event->data.msg.addr));
+    }else{
+        event->afi = AF_UNSPEC;
+    }
+}
+
+
+void flight_record_timer(const char *name)
+{
+    flight_event    *event  = new_flight_event(FLIGHT_TIMER_EXPIRED);
+
+    strncpy(event->data.timer_name, name, FLIGHT_TIMER_NAME_LEN);
+}
+
+
+void flight_recorder_write(FILE *out)
+{
+    struct timespec     now;
+    char                line[FLIGHT_LINE_LEN];
+    uint32_t            first   = 0;
+    uint32_t            ctr     = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    first = (flight_next > FLIGHT_RECORDER_SIZE) ? flight_next - FLIGHT_RECORDER_SIZE : 0;
+
+    fprintf(out, "%u control plane events (last %u kept)\n", flight_next, flight_next - first);
+    for (ctr = first ; ctr != flight_next ; ctr++){
+        format_flight_event(&(flight_ring[ctr & (FLIGHT_RECORDER_SIZE - 1)]), &now, line, FLIGHT_LINE_LEN);
+        fprintf(out, "%s\n", line);
+    }
+}
+
+
+void flight_recorder_dump()
+{
+    struct timespec     now;
+    char                line[FLIGHT_LINE_LEN];
+    uint32_t            first   = 0;
+    uint32_t            ctr     = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    first = (flight_next > FLIGHT_RECORDER_SIZE) ? flight_next - FLIGHT_RECORDER_SIZE : 0;
+
+    /* The dump is bigger than the ring of the asynchronous logging: it is written directly */
+    lispd_log_msg_sync(LISP_LOG_INFO, "Flight recorder: %u control plane events (last %u kept)", flight_next, flight_next - first);
+    for (ctr = first ; ctr != flight_next ; ctr++){
+        format_flight_event(&(flight_ring[ctr & (FLIGHT_RECORDER_SIZE - 1)]), &now, line, FLIGHT_LINE_LEN);
+        lispd_log_msg_sync(LISP_LOG_INFO, "Flight recorder: %s", line);
+    }
+}
+
+
+/*
+ * Take the next slot of the ring and set the type and time of the event
+ */
+static flight_event *new_flight_event(uint8_t type)
+{
+    flight_event        *event  = &(flight_ring[flight_next & (FLIGHT_RECORDER_SIZE - 1)]);
+    struct timespec     now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    flight_next++;
+    event->sec = now.tv_sec;
+    event->usec = now.tv_nsec / 1000;
+    event->type = type;
+    return (event);
+}
+
+
+static void format_flight_event(
+        flight_event        *event,
+        struct timespec     *now,
+        char                *line,
+        int                 line_len)
+{
+    uint64_t    age     = 0;
+    int         len     = 0;
+
+    age = ((uint64_t)now->tv_sec - event->sec) * 1000000 + now->tv_nsec / 1000 - event->usec;
+    len = snprintf(line, line_len, "-%"PRIu64".%06"PRIu64"s ", age / 1000000, age % 1000000);
+    line += len;
+    line_len -= len;
+
+    switch (event->type){
+    case FLIGHT_MAP_REQUEST_SENT:
+        snprintf(line, line_len, "Map-Request sent for %s/%d%s, nonce %s", flight_addr_to_char(event),
+                event->prefix_length, flight_flags_to_char(event->flags), get_char_from_nonce(event->data.msg.nonce));
+        break;
+    case FLIGHT_MAP_REQUEST_TIMEOUT:
+        snprintf(line, line_len, "Map-Request to %s timed out, nonce %s", flight_addr_to_char(event),
+                get_char_from_nonce(event->data.msg.nonce));
+        break;
+    case FLIGHT_MAP_REPLY_RECEIVED:
+        snprintf(line, line_len, "Map-Reply received%s, nonce %s, latency %u us", flight_flags_to_char(event->flags),
+                get_char_from_nonce(event->data.msg.nonce), event->value);
+        break;
+    case FLIGHT_MAP_REPLY_SENT:
+        snprintf(line, line_len, "Map-Reply sent for %s/%d%s, nonce %s", flight_addr_to_char(event),
+                event->prefix_length, flight_flags_to_char(event->flags), get_char_from_nonce(event->data.msg.nonce));
+        break;
+    case FLIGHT_SMR_RECEIVED:
+        snprintf(line, line_len, "SMR received for %s/%d, nonce %s", flight_addr_to_char(event),
+                event->prefix_length, get_char_from_nonce(event->data.msg.nonce));
+        break;
+    case FLIGHT_MAP_REGISTER_SENT:
+        snprintf(line, line_len, "Map-Register sent for %s/%d%s, nonce %s", flight_addr_to_char(event),
+                event->prefix_length, flight_flags_to_char(event->flags), get_char_from_nonce(event->data.msg.nonce));
+        break;
+    case FLIGHT_MAP_NOTIFY_RECEIVED:
+        snprintf(line, line_len, "Map-Notify received (%s), nonce %s",
+                (event->flags & FLIGHT_FLAG_UP) ? "valid" : "invalid", get_char_from_nonce(event->data.msg.nonce));
+        break;
+    case FLIGHT_RLOC_STATE:
+        snprintf(line, line_len, "RLOC %s changes to %s", flight_addr_to_char(event),
+                (event->flags & FLIGHT_FLAG_UP) ? "UP" : "DOWN");
+        break;
+    case FLIGHT_NL_NEW_ADDRESS:
+        snprintf(line, line_len, "Netlink: new address %s in interface %u", flight_addr_to_char(event), event->value);
+        break;
+    case FLIGHT_NL_DEL_ADDRESS:
+        snprintf(line, line_len, "Netlink: address %s removed from interface %u", flight_addr_to_char(event), event->value);
+        break;
+    case FLIGHT_NL_LINK:
+        snprintf(line, line_len, "Netlink: interface %u changes to %s", event->value,
+                (event->flags & FLIGHT_FLAG_UP) ? "UP" : "DOWN");
+        break;
+    case FLIGHT_NL_GATEWAY:
+        snprintf(line, line_len, "Netlink: new gateway %s in interface %u", flight_addr_to_char(event), event->value);
+        break;
+    case FLIGHT_TIMER_EXPIRED:
+        snprintf(line, line_len, "Timer %.*s expired", FLIGHT_TIMER_NAME_LEN, event->data.timer_name);
+        break;
+    default:
+        snprintf(line, line_len, "Unknown event %d", event->type);
+        break;
+    }
+}
+
+
+static char *flight_addr_to_char(flight_event *event)
+{
+    lisp_addr_t     addr;
+
+    if (event->afi != AF_INET && event->afi != AF_INET6){
+        return ("-");
+    }
+    addr.afi = event->afi;
+    memcpy(&(addr.address), event->data.msg.addr, sizeof(event->data.msg.addr));
+    return (get_char_from_lisp_addr_t(addr));
+}
+
+
+static char *flight_flags_to_char(uint8_t flags)
+{
+    static char     flags_str[64];
+
+    flags_str[0] = '\0';
+    if (flags & FLIGHT_FLAG_ENCAP){
+        strcat(flags_str, " [encap]");
+    }
+    if (flags & FLIGHT_FLAG_PROBE){
+        strcat(flags_str, " [probe]");
+    }
+    if (flags & FLIGHT_FLAG_SMR){
+        strcat(flags_str, " [SMR]");
+    }
+    if (flags & FLIGHT_FLAG_SMR_INVOKED){
+        strcat(flags_str, " [SMR-invoked]");
+    }
+    return (flags_str);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,99 @@
+/*
+ * lispd_flight_recorder.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Ring of the last control plane events, dumped on demand.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_FLIGHT_RECORDER_H_
+#define LISPD_FLIGHT_RECORDER_H_
+
+#include <stdio.h>
+#include "lispd.h"
+
+/*
+ * The recorder is always on. Events are stored in binary form in a ring of FLIGHT_RECORDER_SIZE
+ * entries (power of 2) overwriting the oldest ones, and only converted to text when the ring is
+ * dumped (SIGUSR1 or "flight" command of the control socket). It is only used from the main
+ * thread, so it needs no locking.
+ */
+#define FLIGHT_RECORDER_SIZE            2048
+#define FLIGHT_TIMER_NAME_LEN           24
+
+/* Events */
+#define FLIGHT_MAP_REQUEST_SENT         1   /* EID, nonce */
+#define FLIGHT_MAP_REQUEST_TIMEOUT      2   /* Map Resolver, nonce */
+#define FLIGHT_MAP_REPLY_RECEIVED       3   /* nonce, latency (us) */
+#define FLIGHT_MAP_REPLY_SENT           4   /* EID, nonce */
+#define FLIGHT_SMR_RECEIVED             5   /* EID of the map cache entry, nonce */
+#define FLIGHT_MAP_REGISTER_SENT        6   /* EID, nonce */
+#define FLIGHT_MAP_NOTIFY_RECEIVED      7   /* nonce */
+#define FLIGHT_RLOC_STATE               8   /* Remote RLOC, new state */
+#define FLIGHT_NL_NEW_ADDRESS           9   /* Address, interface index */
+#define FLIGHT_NL_DEL_ADDRESS           10  /* Address, interface index */
+#define FLIGHT_NL_LINK                  11  /* Interface index, new state */
+#define FLIGHT_NL_GATEWAY               12  /* Gateway, interface index */
+#define FLIGHT_TIMER_EXPIRED            13  /* Timer name */
+
+/* Flags of the events */
+#define FLIGHT_FLAG_PROBE               0x01
+#define FLIGHT_FLAG_SMR                 0x02
+#define FLIGHT_FLAG_SMR_INVOKED         0x04
+#define FLIGHT_FLAG_ENCAP               0x08
+#define FLIGHT_FLAG_UP                  0x10    /* Link or RLOC up. Valid Map Notify */
+
+
+/*
+ * Record an event. addr can be NULL. Only stores, no formatting.
+ */
+void flight_record(
+        uint8_t         type,
+        lisp_addr_t     *addr,
+        uint8_t         prefix_length,
+        uint8_t         flags,
+        uint32_t        value,
+        uint64_t        nonce);
+
+/*
+ * Record the expiration of a timer. The name is truncated to FLIGHT_TIMER_NAME_LEN characters
+ */
+void flight_record_timer(const char *name);
+
+/*
+ * Write the recorded events, oldest first, with their age
+ */
+void flight_recorder_write(FILE *out);
+
+/*
+ * Write the recorded events in the log (LISP_LOG_INFO)
+ */
+void flight_recorder_dump();
+
+#endif /* LISPD_FLIGHT_RECORDER_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -30,8 +30,9 @@
  */
 
 #include "lispd_external.h"
-#include "lispd_info_request.h"
+#include "lispd_fastpath.h"
 #include "lispd_lib.h"
+#include "lispd_map_cache_db.h"
 #include "lispd_routing_tables_lib.h"
 #include "lispd_sockets.h"
 #include "lispd_tun.h"
@@ -152,6 +153,16 @@ lispd_iface_elt *add_interface(char *iface_name)
     iface->ipv6_changed = TRUE;
     iface->ipv4_gateway = NULL;
     iface->ipv6_gateway = NULL;
+    iface->nl_pending = FALSE;
+    iface->flap_suppressed = FALSE;
+    iface->pending_status = iface->status;
+    iface->pending_ipv4_address.afi = AF_UNSPEC;
+    iface->pending_ipv6_address.afi = AF_UNSPEC;
+    iface->flap_penalty = 0;
+    iface->flap_time = 0;
+    iface->nat_status = UNKNOWN;
+    iface->nat_ir_nonce = NULL;
+    iface->info_request_timer = NULL;
     iface_list->iface = iface;
     iface_list->next = NULL;
 
@@ -212,6 +223,9 @@ int add_mapping_to_interface (
     }
 
     mappings_list->mapping=mapping;
+    mappings_list->iface = interface;
+    mappings_list->emr_nonce = NULL;
+    mappings_list->emr_timer = NULL;
     mappings_list->next = NULL;
 
     switch(afi){
@@ -522,6 +536,9 @@ void set_default_output_ifaces()
     if (!default_out_iface_v4 && !default_out_iface_v6){
         lispd_log_msg(LISP_LOG_CRIT,"NO OUTPUT IFACE: all the locators are down");
     }
+
+    /* The natively forwarded traffic follows the new output interfaces */
+    update_native_forward_rules();
 }
 
 void set_default_ctrl_ifaces()
@@ -547,13 +564,6 @@ void set_default_ctrl_ifaces()
         }
     }
 
-    /* Check NAT status */
-    if (nat_aware == TRUE && ( (default_ctrl_iface_v4 != NULL) || (default_ctrl_iface_v6 != NULL))){
-              // TODO : To be modified when implementing NAT per multiple interfaces
-              nat_status = UNKNOWN;
-              initial_info_request_process();
-    }
-
     if (!default_ctrl_iface_v4 && !default_ctrl_iface_v6){
         lispd_log_msg(LISP_LOG_ERR,"NO CONTROL IFACE: all the locators are down");
     }
@@ -610,6 +620,30 @@ lispd_iface_list_elt *get_head_interface_list()
 }
 
 
+/*
+ * Return the MTU of the interface or 0 if it can not be obtained
+ */
+
+int get_iface_mtu(char *iface_name)
+{
+    struct ifreq    ifr;
+    int             sock    = 0;
+    int             mtu     = 0;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0){
+        return (0);
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface_name, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFMTU, &ifr) == 0){
+        mtu = ifr.ifr_mtu;
+    }
+    close(sock);
+    return (mtu);
+}
+
+
 /*
  * Recalculate balancing vector of the mappings assorciated to iface
  */
@@ -627,6 +661,7 @@ void iface_balancing_vectors_calc(lispd_iface_elt  *iface)
                 &(lcl_extended_info->outgoing_balancing_locators_vecs));
         mapping_list = mapping_list->next;
     }
+    fastpath_update_local_db();
 }
 
 /*
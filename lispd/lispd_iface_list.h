@@ -35,6 +35,7 @@
 
 #include "lispd.h"
 #include "lispd_mapping.h"
+#include "lispd_nonce.h"
 #include "lispd_timers.h"
 
 /*
@@ -44,6 +45,10 @@ typedef struct lispd_iface_mappings_list_ {
     lispd_mapping_elt                       *mapping;
     uint8_t                                 use_ipv4_address:1;// The mapping has a locator that use the IPv4 address of iface
     uint8_t                                 use_ipv6_address:1;// The mapping has a locator that use the IPv6 address of iface
+    /* Encapsulated Map-Registers of the mapping through the RTR of iface. See lispd_map_register.c */
+    struct lispd_iface_elt_                 *iface;
+    nonces_list                             *emr_nonce;
+    timer                                   *emr_timer;
     struct lispd_iface_mappings_list_       *next;
 } lispd_iface_mappings_list;
 
@@ -68,6 +73,18 @@ typedef struct lispd_iface_elt_ {
     uint8_t                     ipv6_changed:1;
     int                         out_socket_v4;
     int                         out_socket_v6;
+    /* Netlink changes waiting for the interface to settle. See lispd_iface_mgmt.c */
+    uint8_t                     nl_pending:1;
+    uint8_t                     flap_suppressed:1;
+    uint8_t                     pending_status;
+    lisp_addr_t                 pending_ipv4_address;
+    lisp_addr_t                 pending_ipv6_address;
+    uint32_t                    flap_penalty;
+    time_t                      flap_time;
+    /* NAT traversal state of the IPv4 address of the interface. See lispd_info_request.c */
+    int                         nat_status;         /* UNKNOWN, NO_NAT or FULL_NAT (behind NAT) */
+    nonces_list                 *nat_ir_nonce;
+    timer                       *info_request_timer;
 }lispd_iface_elt;
 
 /*
@@ -155,6 +172,12 @@ int get_iface_socket(lispd_iface_elt *iface, int afi);
 
 lispd_iface_list_elt *get_head_interface_list();
 
+/*
+ * Return the MTU of the interface or 0 if it can not be obtained
+ */
+
+int get_iface_mtu(char *iface_name);
+
 /*
  * Recalculate balancing vector of the mappings assorciated to iface
  */
@@ -28,6 +28,7 @@
  *
  */
 #include "lispd_external.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_iface_mgmt.h"
 #include "lispd_info_request.h"
 #include "lispd_lib.h"
@@ -39,10 +40,10 @@
 #include "lispd_timers.h"
 #include "lispd_tun.h"
 
-// Used when an interface with status DOWN change its address. When interface changes to UP
-// and nat_aware_iface_address_change is TRUE init info request process
-// XXX NAT: Valid only for one interface
-uint8_t nat_aware_iface_address_change = FALSE;
+/* Timer to apply the netlink changes once the interfaces settle */
+timer   *iface_events_timer = NULL;
+/* Time of the first netlink change not applied yet */
+time_t  iface_events_first  = 0;
 
 /************************* FUNCTION DECLARTAION ********************************/
 
@@ -54,23 +55,70 @@ void process_nl_new_route (struct nlmsghdr *nlh);
 
 /*
  * Change the address of the interface. If the address belongs to a not initialized locator, activate it.
- * Program SMR
+ * Return TRUE if the address of the interface has changed
  */
 
-void process_address_change (
+uint8_t process_address_change (
         lispd_iface_elt     *iface,
         lisp_addr_t         new_addr);
 
 
 /*
  * Change the satus of the interface. Recalculate default control and output interfaces if it's needed.
- * Program SMR
+ * Return TRUE if the status of the interface has changed
  */
 
-void process_link_status_change(
+uint8_t process_link_status_change(
         lispd_iface_elt     *iface,
         int                 new_status);
 
+/*
+ * Store the new address of the interface until the interface settles
+ */
+
+void record_address_change (
+        lispd_iface_elt     *iface,
+        lisp_addr_t         new_addr);
+
+/*
+ * (Re)program the timer that applies the pending changes of the interfaces
+ */
+
+void program_iface_changes();
+
+/*
+ * Apply the net effect of the pending changes of each interface. Balancing vectors are
+ * calculated once per interface and the SMR process is programmed once.
+ */
+
+int apply_iface_changes(
+        timer   *t,
+        void    *arg);
+
+/*
+ * Apply the pending changes of the interface. Return TRUE if the interface has changed.
+ * The interface keeps pending changes if it is flapping
+ */
+
+uint8_t apply_iface_pending_changes(
+        lispd_iface_elt     *iface,
+        time_t              now);
+
+/*
+ * Fast handover: apply the pending changes of the interface without waiting for it to
+ * settle and announce them at once
+ */
+
+void apply_iface_changes_now(lispd_iface_elt *iface);
+
+/*
+ * Return the flap penalty of the interface after applying the decay
+ */
+
+uint32_t get_iface_flap_penalty(
+        lispd_iface_elt     *iface,
+        time_t              now);
+
 /*
  *
  */
@@ -112,7 +160,7 @@ int opent_netlink_socket()
 
 void process_netlink_msg(int netlink_fd){
     int                 len             = 0;
-    char                buffer[4096];
+    char                buffer[NETLINK_BUFFER_SIZE];
     struct iovec        iov;
     struct sockaddr_nl  dst_addr;
     struct msghdr       msgh;
@@ -122,7 +170,7 @@ void process_netlink_msg(int netlink_fd){
 
     memset(&iov, 0, sizeof(iov));
     iov.iov_base = (void *)nlh;
-    iov.iov_len = sizeof(nlh);
+    iov.iov_len = sizeof(buffer);
 
     memset(&msgh, 0, sizeof(msgh));
     msgh.msg_name = (void *)&(dst_addr);
@@ -130,7 +178,10 @@ void process_netlink_msg(int netlink_fd){
     msgh.msg_iov = &iov;
     msgh.msg_iovlen = 1;
 
-    while ((len = recv (netlink_fd,nlh,4096,MSG_DONTWAIT)) > 0){
+    while ((len = recvmsg (netlink_fd,&msgh,MSG_DONTWAIT)) > 0){
+        if ((msgh.msg_flags & MSG_TRUNC) != 0){
+            lispd_log_msg(LISP_LOG_WARNING, "process_netlink_msg: Netlink message truncated. Some interface changes could be lost");
+        }
         for (;(NLMSG_OK (nlh, len)) && (nlh->nlmsg_type != NLMSG_DONE); nlh = NLMSG_NEXT(nlh, len)){
             switch(nlh->nlmsg_type){
             case RTM_NEWADDR:
@@ -154,7 +205,6 @@ void process_netlink_msg(int netlink_fd){
             }
         }
         nlh = (struct nlmsghdr *)buffer;
-        memset(nlh,0,4096);
     }
     lispd_log_msg(LISP_LOG_DEBUG_2, "Finish pocessing netlink message");
     return;
@@ -198,24 +248,16 @@ void process_nl_add_address (struct nlmsghdr *nlh)
                 memcpy (&(new_addr.address),(struct in6_addr *)RTA_DATA(rth),sizeof(struct in6_addr));
                 new_addr.afi = AF_INET6;
             }
-            process_address_change (iface, new_addr);
+            flight_record(FLIGHT_NL_NEW_ADDRESS, &new_addr, 0, 0, iface_index, 0);
+            record_address_change (iface, new_addr);
         }
     }
 }
 
-/*
- * Change the address of the interface. If the address belongs to a not initialized locator, activate it.
- * Program SMR
- */
-
-void process_address_change (
+void record_address_change (
         lispd_iface_elt     *iface,
         lisp_addr_t         new_addr)
 {
-    lisp_addr_t                 *iface_addr         = NULL;
-    lispd_iface_mappings_list   *mapping_list       = NULL;
-    int                         aux_afi             = 0;
-
     // XXX To be modified when full NAT implemented --> When Nat Aware active no IPv6 RLOCs supported
     if (nat_aware == TRUE && new_addr.afi == AF_INET6){
         return;
@@ -223,16 +265,48 @@ void process_address_change (
 
     /* Check if the addres is a global address*/
     if (is_link_local_addr(new_addr) == TRUE){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"precess_address_change: the extractet address from the netlink "
+        lispd_log_msg(LISP_LOG_DEBUG_2,"record_address_change: the extractet address from the netlink "
                 "messages is a local link address: %s discarded", get_char_from_lisp_addr_t(new_addr));
         return;
     }
     /* If default RLOC afi defined (-a 4 or 6), only accept addresses of the specified afi */
     if (default_rloc_afi != AF_UNSPEC && default_rloc_afi != new_addr.afi){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"precess_address_change: Default RLOC afi defined (-a #): Skipped %s address in iface %s",
+        lispd_log_msg(LISP_LOG_DEBUG_2,"record_address_change: Default RLOC afi defined (-a #): Skipped %s address in iface %s",
                 (new_addr.afi == AF_INET) ? "IPv4" : "IPv6",iface->iface_name);
         return;
     }
+
+    switch (new_addr.afi){
+    case AF_INET:
+        copy_lisp_addr(&(iface->pending_ipv4_address), &new_addr);
+        break;
+    case AF_INET6:
+        copy_lisp_addr(&(iface->pending_ipv6_address), &new_addr);
+        break;
+    default:
+        return;
+    }
+    iface->nl_pending = TRUE;
+    if (fast_handover == TRUE){
+        apply_iface_changes_now(iface);
+        return;
+    }
+    program_iface_changes();
+}
+
+/*
+ * Change the address of the interface. If the address belongs to a not initialized locator, activate it.
+ * Program SMR
+ */
+
+uint8_t process_address_change (
+        lispd_iface_elt     *iface,
+        lisp_addr_t         new_addr)
+{
+    lisp_addr_t                 *iface_addr         = NULL;
+    lispd_iface_mappings_list   *mapping_list       = NULL;
+    int                         aux_afi             = 0;
+
     /*
      * Actions to be done due to a change of address: SMR
      */
@@ -260,7 +334,7 @@ void process_address_change (
             break;
         }
 
-        return;
+        return (FALSE);
     }
 
     /*
@@ -307,8 +381,6 @@ void process_address_change (
                 , get_char_from_lisp_addr_t(new_addr));
         activate_interface_address(iface, new_addr);
         if (iface->status == UP){
-            iface_balancing_vectors_calc(iface);
-
             /*
              * If no default control and data interface, recalculate it
              */
@@ -374,23 +446,11 @@ void process_address_change (
     /* Check if the new address is behind NAT */
 
     if(nat_aware==TRUE){
-        // TODO : To be modified when implementing NAT per multiple interfaces
-        nat_status = UNKNOWN;
-        clear_rtr_from_locators (iface);
-
-        if (iface->status == UP){
-            initial_info_request_process();
-        }else{
-        	nat_aware_iface_address_change = TRUE;
-        }
+        /* If the interface is down, the info request process starts when it changes to UP */
+        iface_initial_info_request(iface);
     }
 
-    /* Reprograming SMR timer*/
-    if (smr_timer == NULL){
-        smr_timer = create_timer (SMR_TIMER);
-    }
-
-    start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
+    return (TRUE);
 }
 
 
@@ -429,6 +489,7 @@ void process_nl_del_address (struct nlmsghdr *nlh)
                 memcpy (&(new_addr.address),(struct in6_addr *)RTA_DATA(rth),sizeof(struct in6_addr));
                 new_addr.afi = AF_INET6;
             }
+            flight_record(FLIGHT_NL_DEL_ADDRESS, &new_addr, 0, 0, iface_index, 0);
             break;
         }
     }
@@ -495,7 +556,16 @@ void process_nl_new_link (struct nlmsghdr *nlh)
         status = DOWN;
     }
 
-    process_link_status_change (iface, status);
+    flight_record(FLIGHT_NL_LINK, NULL, 0, status == UP ? FLIGHT_FLAG_UP : 0, iface_index, 0);
+
+    /* The change of status is applied when the interface settles */
+    iface->pending_status = status;
+    iface->nl_pending = TRUE;
+    if (fast_handover == TRUE){
+        apply_iface_changes_now(iface);
+        return;
+    }
+    program_iface_changes();
 }
 
 
@@ -586,6 +656,7 @@ void process_nl_new_route (struct nlmsghdr *nlh)
         /* Process the new gateway */
         lispd_log_msg(LISP_LOG_DEBUG_1,  "process_nl_new_route: Process new gateway associated to the interface %s:  %s",
                 iface_name, get_char_from_lisp_addr_t(gateway));
+        flight_record(FLIGHT_NL_GATEWAY, &gateway, 0, 0, iface_index, 0);
         process_new_gateway(gateway,iface);
     }
 }
@@ -629,13 +700,13 @@ void process_new_gateway (
  * Program SMR
  */
 
-void process_link_status_change(
+uint8_t process_link_status_change(
     lispd_iface_elt     *iface,
     int                 new_status)
 {
     if (iface->status == new_status){
         lispd_log_msg(LISP_LOG_DEBUG_2,"process_link_status_change: The detected change of status doesn't affect");
-        return;
+        return (FALSE);
     }
 
     if (iface->status_changed == TRUE){
@@ -666,21 +737,155 @@ void process_link_status_change(
         lispd_log_msg(LISP_LOG_DEBUG_2,"Default output interface down. Recalculate new output interface");
         set_default_output_ifaces();
     }
-    iface_balancing_vectors_calc(iface);
 
-    /* When NAT aware, if address has change when interface down, when UP init info request process */
-    if(new_status == UP && nat_aware==TRUE && nat_aware_iface_address_change == TRUE){
-    	initial_info_request_process();
-    	nat_aware_iface_address_change = FALSE;
+    /* When NAT aware, the NAT status of the interface is discovered again each time it changes to UP */
+    if(nat_aware==TRUE){
+        if (new_status == UP){
+            iface_initial_info_request(iface);
+        }else{
+            reset_iface_nat_state(iface);
+        }
+    }
+
+    return (TRUE);
+}
+
+void program_iface_changes()
+{
+    time_t  now = time(NULL);
+
+    if (iface_events_timer == NULL){
+        iface_events_timer = create_timer (IFACE_EVENTS_TIMER);
+        if (iface_events_timer == NULL){
+            return;
+        }
+        iface_events_first = now;
+    }else if (iface_events_first == 0){
+        iface_events_first = now;
+    }else if (now - iface_events_first >= IFACE_EVENTS_MAX_HOLD_TIME){
+        /* Don't postpone more the pending changes of a link that doesn't settle */
+        return;
+    }
+    start_timer(iface_events_timer, IFACE_EVENTS_SETTLE_TIME, (timer_callback)apply_iface_changes, NULL);
+}
+
+int apply_iface_changes(
+        timer   *t,
+        void    *arg)
+{
+    lispd_iface_list_elt    *iface_list     = head_interface_list;
+    lispd_iface_elt         *iface          = NULL;
+    time_t                  now             = time(NULL);
+    uint8_t                 smr_required    = FALSE;
+    uint8_t                 suppressed      = FALSE;
+
+    iface_events_first = 0;
+
+    while (iface_list != NULL){
+        iface = iface_list->iface;
+        iface_list = iface_list->next;
+        if (iface->nl_pending == FALSE){
+            continue;
+        }
+        if (apply_iface_pending_changes(iface, now) == TRUE){
+            iface_balancing_vectors_calc(iface);
+            smr_required = TRUE;
+        }
+        if (iface->nl_pending == TRUE){
+            suppressed = TRUE;
+        }
     }
 
     /* Reprograming SMR timer*/
-    if (smr_timer == NULL){
-        smr_timer = create_timer (SMR_TIMER);
+    if (smr_required == TRUE){
+        if (smr_timer == NULL){
+            smr_timer = create_timer (SMR_TIMER);
+        }
+        start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
     }
 
-    start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
+    /* Check again the suppressed interfaces when their penalty could have decayed */
+    if (suppressed == TRUE){
+        start_timer(iface_events_timer, IFACE_FLAP_HALF_LIFE, (timer_callback)apply_iface_changes, NULL);
+    }
+    return (GOOD);
+}
+
+uint8_t apply_iface_pending_changes(
+        lispd_iface_elt     *iface,
+        time_t              now)
+{
+    uint8_t     changed     = FALSE;
+
+    iface->nl_pending = FALSE;
 
+    if (iface->pending_status != iface->status){
+        iface->flap_penalty = get_iface_flap_penalty(iface, now);
+        if (iface->flap_suppressed == TRUE && iface->flap_penalty < IFACE_FLAP_REUSE_PENALTY){
+            iface->flap_suppressed = FALSE;
+        }
+        if (iface->pending_status == UP && iface->flap_suppressed == TRUE){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "apply_iface_pending_changes: Interface %s is flapping. Keeping it DOWN",
+                    iface->iface_name);
+            iface->nl_pending = TRUE;
+        }else{
+            iface->flap_penalty += IFACE_FLAP_PENALTY;
+            if (iface->flap_penalty >= IFACE_FLAP_SUPPRESS_PENALTY){
+                iface->flap_suppressed = TRUE;
+            }
+            changed = process_link_status_change (iface, iface->pending_status);
+        }
+    }
+    if (iface->pending_ipv4_address.afi != AF_UNSPEC){
+        changed |= process_address_change (iface, iface->pending_ipv4_address);
+        iface->pending_ipv4_address.afi = AF_UNSPEC;
+    }
+    if (iface->pending_ipv6_address.afi != AF_UNSPEC){
+        changed |= process_address_change (iface, iface->pending_ipv6_address);
+        iface->pending_ipv6_address.afi = AF_UNSPEC;
+    }
+    return (changed);
+}
+
+void apply_iface_changes_now(lispd_iface_elt *iface)
+{
+    if (apply_iface_pending_changes(iface, time(NULL)) == TRUE){
+        /* Local balancing vectors use the new locator before the peers are notified */
+        iface_balancing_vectors_calc(iface);
+        lispd_log_msg(LISP_LOG_DEBUG_1, "apply_iface_changes_now: Fast handover of interface %s. Sending Map-Register and SMRs",
+                iface->iface_name);
+        /* A SMR cycle already programmed would only repeat this one */
+        if (smr_timer != NULL){
+            stop_timer(smr_timer);
+            smr_timer = NULL;
+        }
+        init_smr(NULL, NULL);
+    }
+    /* Flapping interface: retry later */
+    if (iface->nl_pending == TRUE){
+        program_iface_changes();
+    }
+}
+
+uint32_t get_iface_flap_penalty(
+        lispd_iface_elt     *iface,
+        time_t              now)
+{
+    int     half_lives  = 0;
+
+    if (iface->flap_penalty == 0){
+        iface->flap_time = now;
+        return (0);
+    }
+    half_lives = (now - iface->flap_time) / IFACE_FLAP_HALF_LIFE;
+    if (half_lives <= 0){
+        return (iface->flap_penalty);
+    }
+    iface->flap_time += half_lives * IFACE_FLAP_HALF_LIFE;
+    if (half_lives >= 32){
+        return (0);
+    }
+    return (iface->flap_penalty >> half_lives);
 }
 
 
@@ -33,6 +33,28 @@
 
 #include "lispd_iface_list.h"
 
+/* Size of the buffer used to receive netlink messages */
+#define NETLINK_BUFFER_SIZE             16384
+
+/*
+ * Netlink changes of the interfaces are not applied immediately. They are accumulated
+ * until no new change is received during IFACE_EVENTS_SETTLE_TIME seconds (or at most
+ * IFACE_EVENTS_MAX_HOLD_TIME seconds), and then only the net effect is processed.
+ */
+#define IFACE_EVENTS_SETTLE_TIME        2
+#define IFACE_EVENTS_MAX_HOLD_TIME      10
+
+/*
+ * Flap damping. Each change of status of an interface adds IFACE_FLAP_PENALTY to its
+ * penalty, that is halved every IFACE_FLAP_HALF_LIFE seconds. When the penalty reaches
+ * IFACE_FLAP_SUPPRESS_PENALTY, the interface is not set UP again until the penalty
+ * decays below IFACE_FLAP_REUSE_PENALTY.
+ */
+#define IFACE_FLAP_PENALTY              1000
+#define IFACE_FLAP_SUPPRESS_PENALTY     3000
+#define IFACE_FLAP_REUSE_PENALTY        1500
+#define IFACE_FLAP_HALF_LIFE            15
+
 
 int opent_netlink_socket();
 void process_netlink_msg(int netlink_fd);
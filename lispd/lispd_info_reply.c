@@ -39,6 +39,7 @@
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_map_register.h"
+#include "lispd_nat_rtr.h"
 #include "lispd_nonce.h"
 #include "lispd_smr.h"
 #include "cksum.h"
@@ -85,7 +86,8 @@ int process_info_reply_msg(
     lisp_addr_t                 private_etr_rloc        = {.afi=AF_UNSPEC};
     lispd_rtr_locators_list     *rtr_locators_list      = NULL;
 
-    lispd_mapping_elt           *mapping                = NULL;
+    lispd_iface_elt             *iface                  = NULL;
+    lispd_iface_mappings_list   *mappings_list          = NULL;
     lispd_locator_elt           *locator                = NULL;
     lcl_locator_extended_info   *lcl_locator_ext_inf    = NULL;
 
@@ -167,12 +169,22 @@ int process_info_reply_msg(
     }
 
 
+    /* The NAT state is kept per interface: the one of the address where we received the message */
+
+    iface = get_interface_with_address(&local_rloc);
+    if (iface == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Info-Reply: Received in %s that is not the address of any interface",
+                get_char_from_lisp_addr_t(local_rloc));
+        free_rtr_list(rtr_locators_list);
+        return (BAD);
+    }
+
     /* Checking the nonce */
 
-    if (check_nonce(nat_ir_nonce,nonce) == GOOD ){
+    if (check_nonce(iface->nat_ir_nonce,nonce) == GOOD ){
         lispd_log_msg(LISP_LOG_DEBUG_2, "Info-Reply: Correct nonce field checking ");
-        free(nat_ir_nonce);
-        nat_ir_nonce = NULL;
+        free(iface->nat_ir_nonce);
+        iface->nat_ir_nonce = NULL;
     }else{
         lispd_log_msg(LISP_LOG_DEBUG_1, "Info-Reply: Error checking nonce field. No Info Request generated with nonce: %s",
                 get_char_from_nonce (nonce));
@@ -219,50 +231,55 @@ int process_info_reply_msg(
                     " but there is no RTR compatible with local AFI", get_char_from_lisp_addr_t(local_rloc));
         }
 
-        mapping = lookup_eid_exact_in_db(eid_prefix, eid_mask_len);
-        if (mapping == NULL){
-            lispd_log_msg(LISP_LOG_DEBUG_2, "process_info_reply_msg: Info Reply is not for any local EID");
-            return (BAD);
-        }
-        locator = get_locator_from_mapping(mapping,local_rloc);
-        if (locator == NULL){
-            lispd_log_msg(LISP_LOG_DEBUG_2, "process_info_reply_msg: Info Reply received in the wrong locator");
-            return (BAD);
-        }
-
-        lcl_locator_ext_inf = (lcl_locator_extended_info *)locator->extended_info;
-        if (lcl_locator_ext_inf->rtr_locators_list != NULL){
-            free_rtr_list(lcl_locator_ext_inf->rtr_locators_list);
+        /* All the locators of the interface are behind the same NAT and use the same RTRs */
+        mappings_list = iface->head_mappings_list;
+        while (mappings_list != NULL){
+            locator = NULL;
+            if (mappings_list->use_ipv4_address == TRUE){
+                locator = get_locator_from_mapping(mappings_list->mapping,local_rloc);
+            }
+            if (locator != NULL){
+                lcl_locator_ext_inf = (lcl_locator_extended_info *)locator->extended_info;
+                aux_rtr_locators_list = copy_rtr_locators_list(rtr_locators_list);
+                if (lcl_locator_ext_inf->rtr_locators_list != NULL){
+                    copy_rtr_locators_state(lcl_locator_ext_inf->rtr_locators_list, aux_rtr_locators_list);
+                    free_rtr_list(lcl_locator_ext_inf->rtr_locators_list);
+                }
+                lcl_locator_ext_inf->rtr_locators_list = aux_rtr_locators_list;
+            }
+            mappings_list = mappings_list->next;
         }
-        lcl_locator_ext_inf->rtr_locators_list = rtr_locators_list;
-
-        if (nat_status == NO_NAT || nat_status == PARTIAL_NAT){
-            nat_status = PARTIAL_NAT;
-        }else{
-            nat_status = FULL_NAT;
+        /* Measure the latency of the RTRs to select the best one */
+        if (rtr_locators_list != NULL){
+            programming_rtr_probing();
         }
+        iface->nat_status = FULL_NAT;
     }else{
-        if (nat_status == FULL_NAT || nat_status == PARTIAL_NAT){
-            nat_status = PARTIAL_NAT;
-        }else{
-            nat_status = NO_NAT;
-        }
+        /* The RTRs of a previous NAT of the interface are not used anymore */
+        clear_rtr_from_locators(iface);
+        iface->nat_status = NO_NAT;
     }
+    free_rtr_list(rtr_locators_list);
+    update_nat_status();
 
     /* If we are behind NAT, the program timer to send Info Request after TTL minutes */
     if (is_behind_nat == TRUE){
-        if (info_reply_ttl_timer == NULL) {
-            info_reply_ttl_timer = create_timer(INFO_REPLY_TTL_TIMER);
+        if (iface->info_request_timer == NULL) {
+            iface->info_request_timer = create_timer(INFO_REPLY_TTL_TIMER);
         }
-        start_timer(info_reply_ttl_timer, ttl*60, info_request, (void *)mapping);
-        lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed info request in %d minutes",ttl);
+        start_timer(iface->info_request_timer, ttl*60, info_request, (void *)iface);
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed info request of %s in %d minutes",iface->iface_name,ttl);
     }else{
-        stop_timer(info_reply_ttl_timer);
-        info_reply_ttl_timer = NULL;
+        stop_timer(iface->info_request_timer);
+        iface->info_request_timer = NULL;
     }
 
-    /* Once we know the NAT state we send a Map-Register */
-    map_register(NULL,NULL);
+    /* Once we know the NAT state of the interface we register its mappings */
+    if (is_behind_nat == TRUE){
+        iface_encapsulated_map_register(iface);
+    }else{
+        map_register_process();
+    }
 
     return (GOOD);
 }
@@ -224,32 +224,104 @@ int build_and_send_info_request(
     return (result);
 }
 
+/*
+ * The NAT traversal state is kept per interface: each interface with an IPv4 locator has its own
+ * Info-Request cycle, nonces, RTR list in its locators and Encapsulated Map-Register timer.
+ * nat_status summarizes the state of all the interfaces.
+ */
+
 int initial_info_request_process()
 {
-    int result = 0;
-    patricia_tree_t           *dbs[2]           = {NULL,NULL};
-    int                       ctr               = 0;
-    patricia_tree_t           *tree             = NULL;
-    patricia_node_t           *node             = NULL;
-    lispd_mapping_elt         *mapping          = NULL;
-
-    dbs[0] = get_local_db(AF_INET);
-    dbs[1] = get_local_db(AF_INET6);
-
-    for (ctr = 0 ; ctr < 2 ; ctr++) {
-        tree = dbs[ctr];
-        if (!tree){
-            continue;
+    lispd_iface_list_elt    *iface_list     = NULL;
+
+    iface_list = get_head_interface_list();
+    while (iface_list != NULL){
+        iface_initial_info_request(iface_list->iface);
+        iface_list = iface_list->next;
+    }
+    return (GOOD);
+}
+
+
+int iface_initial_info_request(lispd_iface_elt *iface)
+{
+    reset_iface_nat_state(iface);
+
+    if (iface->status != UP || get_iface_nat_mapping(iface) == NULL){
+        return (GOOD);
+    }
+    return (info_request(NULL, iface));
+}
+
+
+void reset_iface_nat_state(lispd_iface_elt *iface)
+{
+    lispd_iface_mappings_list   *mappings_list  = NULL;
+
+    iface->nat_status = UNKNOWN;
+    free(iface->nat_ir_nonce);
+    iface->nat_ir_nonce = NULL;
+    stop_timer(iface->info_request_timer);
+    iface->info_request_timer = NULL;
+    mappings_list = iface->head_mappings_list;
+    while (mappings_list != NULL){
+        free(mappings_list->emr_nonce);
+        mappings_list->emr_nonce = NULL;
+        stop_timer(mappings_list->emr_timer);
+        mappings_list->emr_timer = NULL;
+        mappings_list = mappings_list->next;
+    }
+    clear_rtr_from_locators(iface);
+    update_nat_status();
+}
+
+
+lispd_mapping_elt *get_iface_nat_mapping(lispd_iface_elt *iface)
+{
+    lispd_iface_mappings_list   *mappings_list  = NULL;
+
+    if (iface->ipv4_address == NULL || iface->ipv4_address->afi != AF_INET){
+        return (NULL);
+    }
+    mappings_list = iface->head_mappings_list;
+    while (mappings_list != NULL){
+        if (mappings_list->use_ipv4_address == TRUE){
+            return (mappings_list->mapping);
         }
-        PATRICIA_WALK(tree->head, node) {
-            mapping = ((lispd_mapping_elt *)(node->data));
-            if (mapping->locator_count != 0){
-                result = info_request(NULL,mapping);
-                return (result);
-            }
-        }PATRICIA_WALK_END;
+        mappings_list = mappings_list->next;
+    }
+    return (NULL);
+}
+
+
+void update_nat_status()
+{
+    lispd_iface_list_elt    *iface_list     = NULL;
+    int                     natted          = 0;
+    int                     not_natted      = 0;
+
+    iface_list = get_head_interface_list();
+    while (iface_list != NULL){
+        switch (iface_list->iface->nat_status){
+        case FULL_NAT:
+            natted++;
+            break;
+        case NO_NAT:
+            not_natted++;
+            break;
+        }
+        iface_list = iface_list->next;
+    }
+
+    if (natted == 0 && not_natted == 0){
+        nat_status = UNKNOWN;
+    }else if (natted == 0){
+        nat_status = NO_NAT;
+    }else if (not_natted == 0){
+        nat_status = FULL_NAT;
+    }else{
+        nat_status = PARTIAL_NAT;
     }
-    return(GOOD);
 }
 
 
@@ -258,50 +330,53 @@ int info_request(
         timer   *ttl_timer,
         void    *arg)
 {
+    lispd_iface_elt    *iface           = NULL;
     lispd_mapping_elt  *mapping         = NULL;
     int                next_timer_time  = 0;
 
-    mapping = (lispd_mapping_elt *)arg;
+    iface = (lispd_iface_elt *)arg;
 
-    if (default_ctrl_iface_v4 != NULL){
-        if (nat_ir_nonce == NULL){
-            nat_ir_nonce = new_nonces_list();
-            if (nat_ir_nonce == NULL){
-                lispd_log_msg(LISP_LOG_WARNING,"info_request: Unable to allocate memory for nonces.");
-                return (BAD);
-            }
+    mapping = get_iface_nat_mapping(iface);
+    if (mapping == NULL){
+        return (BAD);
+    }
+
+    if (iface->nat_ir_nonce == NULL){
+        iface->nat_ir_nonce = new_nonces_list();
+        if (iface->nat_ir_nonce == NULL){
+            lispd_log_msg(LISP_LOG_WARNING,"info_request: Unable to allocate memory for nonces.");
+            return (BAD);
         }
+    }
 
-        if (nat_ir_nonce->retransmits <= LISPD_MAX_RETRANSMITS){
-            if ((err=build_and_send_info_request(
-                    map_servers,
-                    DEFAULT_INFO_REQUEST_TIMEOUT,
-                    mapping->eid_prefix_length,
-                    &(mapping->eid_prefix),
-                    default_ctrl_iface_v4,
-                    &(nat_ir_nonce->nonce[nat_ir_nonce->retransmits])))!=GOOD){
-                lispd_log_msg(LISP_LOG_DEBUG_1,"info_request: Couldn't send info request message.");
-            }
-            nat_ir_nonce->retransmits++;
-            next_timer_time = LISPD_INITIAL_EMR_TIMEOUT;
-        } else{
-            free (nat_ir_nonce);
-            nat_ir_nonce = NULL;
-            lispd_log_msg(LISP_LOG_ERR,"info_request: Communication error between LISPmob and RTR. Retry after %d seconds",MAP_REGISTER_INTERVAL);
-            next_timer_time = MAP_REGISTER_INTERVAL;
+    if (iface->nat_ir_nonce->retransmits <= LISPD_MAX_RETRANSMITS){
+        if ((err=build_and_send_info_request(
+                map_servers,
+                DEFAULT_INFO_REQUEST_TIMEOUT,
+                mapping->eid_prefix_length,
+                &(mapping->eid_prefix),
+                iface,
+                &(iface->nat_ir_nonce->nonce[iface->nat_ir_nonce->retransmits])))!=GOOD){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"info_request: Couldn't send info request message through %s.",iface->iface_name);
         }
-    }else {
-        return (BAD);
+        iface->nat_ir_nonce->retransmits++;
+        next_timer_time = LISPD_INITIAL_EMR_TIMEOUT;
+    } else{
+        free (iface->nat_ir_nonce);
+        iface->nat_ir_nonce = NULL;
+        lispd_log_msg(LISP_LOG_ERR,"info_request: Communication error between LISPmob and RTR through %s. Retry after %d seconds",
+                iface->iface_name, MAP_REGISTER_INTERVAL);
+        next_timer_time = MAP_REGISTER_INTERVAL;
     }
 
     /*
-     * Configure timer to send the next map register.
+     * Configure timer to send the next info request.
      */
-    if (info_reply_ttl_timer == NULL) {
-        info_reply_ttl_timer = create_timer(INFO_REPLY_TTL_TIMER);
+    if (iface->info_request_timer == NULL) {
+        iface->info_request_timer = create_timer(INFO_REPLY_TTL_TIMER);
     }
-    start_timer(info_reply_ttl_timer, next_timer_time, info_request, mapping);
-    lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed info request in %d seconds",next_timer_time);
+    start_timer(iface->info_request_timer, next_timer_time, info_request, iface);
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed info request of %s in %d seconds",iface->iface_name, next_timer_time);
     return(GOOD);
 }
 
@@ -67,10 +67,32 @@ int  build_and_send_info_request(
         uint64_t                    *nonce);
 
 
-/* Send initial Info Request message to know nat status*/
+/* Send initial Info Request message through each interface to know its nat status*/
 int initial_info_request_process();
 
-/* Send Info Request */
+/*
+ * Restart the discovery of the NAT status of the interface. To be called when the
+ * address or the status of the interface changes
+ */
+int iface_initial_info_request(lispd_iface_elt *iface);
+
+/*
+ * Forget the NAT status of the interface: stop its timers and remove the RTRs of its locators
+ */
+void reset_iface_nat_state(lispd_iface_elt *iface);
+
+/*
+ * Return the first mapping with a locator that uses the IPv4 address of the interface. The
+ * Info Requests of the interface are sent for this EID. NULL if the interface has no IPv4 locator
+ */
+lispd_mapping_elt *get_iface_nat_mapping(lispd_iface_elt *iface);
+
+/*
+ * Calculate nat_status from the NAT status of the interfaces
+ */
+void update_nat_status();
+
+/* Send Info Request through the interface passed as argument */
 int info_request(
         timer   *ttl_timer,
         void    *arg);
@@ -27,40 +27,57 @@
  */
 
 
+#include "lispd_dns_snoop.h"
 #include "lispd_input.h"
+#include "lispd_local_db.h"
+#include "lispd_rloc_probing.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
 
 void process_input_packet(int fd,
                           int afi,
                           int tun_receive_fd)
 {
-    uint8_t             *packet = NULL;
+    static uint8_t      *packet = NULL; /* Data packets are processed one by one */
     int                 length = 0;
     uint8_t             ttl = 0;
     uint8_t             tos = 0;
+    lisp_addr_t         src_rloc;
+    lisp_addr_t         src_eid;
+    lisp_addr_t         dst_eid;
+    int                 written = 0;
+#ifdef LISPD_LATENCY_STATS
+    struct timespec     stage_ts;
+#endif
 
     struct lisphdr      *lisp_hdr = NULL;
     struct iphdr        *iph = NULL;
     struct ip6_hdr      *ip6h = NULL;
     struct udphdr       *udph = NULL;
+    lispd_map_cache_entry *map_cache_entry = NULL;
 
 
-    if ((packet = (uint8_t *) malloc(MAX_IP_PACKET))==NULL){
-        lispd_log_msg(LISP_LOG_ERR,"process_input_packet: Couldn't allocate space for packet: %s", strerror(errno));
-        return;
+    /* The kernel delivers outer fragments already reassembled: the buffer holds any IP datagram */
+    if (packet == NULL){
+        if ((packet = (uint8_t *) malloc(IP_MAXPACKET))==NULL){
+            lispd_log_msg(LISP_LOG_ERR,"process_input_packet: Couldn't allocate space for packet: %s", strerror(errno));
+            stats.drops[STATS_DROP_RECEIVE_ERROR]++;
+            return;
+        }
     }
-
-    memset(packet,0,MAX_IP_PACKET);
     
     if (get_data_packet (fd,
                          afi,
                          packet,
                          &length,
                          &ttl,
-                         &tos) != GOOD){
+                         &tos,
+                         &src_rloc) != GOOD){
         lispd_log_msg(LISP_LOG_DEBUG_2,"process_input_packet: get_data_packet error: %s", strerror(errno));
-        free(packet);
+        stats.drops[STATS_DROP_RECEIVE_ERROR]++;
         return;
     }
+    STAGE_START(stage_ts);
 
     if(afi == AF_INET){
         /* With input RAW UDP sockets in IPv4, we get the whole external IPv4 packet */
@@ -72,8 +89,10 @@ void process_input_packet(int fd,
     
     /* With input RAW UDP sockets, we receive all UDP packets, we only want lisp data ones */
     if(ntohs(udph->dest) != LISP_DATA_PORT){
-        free(packet);
         //lispd_log_msg(LISP_LOG_DEBUG_3,"INPUT (No LISP data): UDP dest: %d ",ntohs(udph->dest));
+        if (trace_enabled == TRUE){
+            trace_data_packet("IN", NULL, NULL, &src_rloc, NULL, length, "ignored (not LISP data port)");
+        }
         return;
     }
 
@@ -83,6 +102,16 @@ void process_input_packet(int fd,
     
     iph = (struct iphdr *) CO(lisp_hdr,sizeof(struct lisphdr));
 
+    if (length < (int)sizeof(struct iphdr) || (iph->version != 4 && iph->version != 6) ||
+            (iph->version == 6 && length < (int)sizeof(struct ip6_hdr))){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"process_input_packet: Inner packet malformed. Discarding packet");
+        stats.drops[STATS_DROP_MALFORMED]++;
+        if (trace_enabled == TRUE){
+            trace_data_packet("IN", NULL, NULL, &src_rloc, NULL, length, "dropped (malformed)");
+        }
+        return;
+    }
+
     lispd_log_msg(LISP_LOG_DEBUG_3,"INPUT (4341): Inner src: %s | Inner dst: %s ",
                   get_char_from_lisp_addr_t(extract_src_addr_from_packet((uint8_t *)iph)),
                   get_char_from_lisp_addr_t(extract_dst_addr_from_packet((uint8_t *)iph)));
@@ -113,10 +142,39 @@ void process_input_packet(int fd,
         //Is there something to do here?
     }
     
-    if ((write(tun_receive_fd, iph, length)) < 0){
+    /* Pre-resolve the mappings of the addresses of DNS answers */
+    if (dns_snooping == TRUE){
+        dns_snoop_packet((uint8_t *)iph, length);
+    }
+
+    /* Remember the peers that are sending to us to SMR them first after a handover */
+    if (fast_handover == TRUE){
+        map_cache_entry = lookup_map_cache(extract_src_addr_from_packet((uint8_t *)iph));
+        if (map_cache_entry != NULL){
+            map_cache_entry->last_activity = time(NULL);
+        }
+    }
+
+    /* Traffic from the RLOC to a local EID: RLOC probing of this locator can be postponed */
+    dst_eid = extract_dst_addr_from_packet((uint8_t *)iph);
+    if (lookup_eid_in_db(dst_eid) != NULL){
+        rloc_seen(&src_rloc);
+    }
+
+    STAGE_END(STATS_STAGE_DECAP, stage_ts, 1);
+    if ((written = write(tun_receive_fd, iph, length)) < 0){
         lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_input: write error: %s\n ", strerror(errno));
+        stats.drops[STATS_DROP_TUN_WRITE]++;
+    }else{
+        stats.decap_packets++;
+        stats.decap_bytes += length;
+    }
+    STAGE_END(STATS_STAGE_TUN_WRITE, stage_ts, 1);
+
+    if (trace_enabled == TRUE){
+        src_eid = extract_src_addr_from_packet((uint8_t *)iph);
+        trace_data_packet("IN", &src_eid, &dst_eid, &src_rloc, NULL, length,
+                written < 0 ? "dropped (tun write error)" : "decapsulated");
     }
-    
-    free(packet);
 }
 
@@ -65,13 +65,14 @@
 #include "lispd_map_reply.h"
 #include "lispd_map_notify.h"
 #include "lispd_sockets.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
 #include "patricia/patricia.h"
 #include "lispd_info_nat.h"
 
 /********************************** Function declaration ********************************/
 
 int isfqdn(char *s);
-inline lisp_addr_t *get_server(lispd_addr_list_t *server_list,int afi);
 inline int convert_hex_char_to_byte (char val);
 inline lisp_addr_t get_network_address_v4(
         lisp_addr_t address,
@@ -861,6 +862,33 @@ int is_link_local_addr (lisp_addr_t addr)
 }
 
 
+/*
+ * Return TRUE if the address belongs to:
+ *          IPv4: 224.0.0.0/4
+ *          IPv6: ff00::/8
+ */
+
+int is_multicast_addr (lisp_addr_t addr)
+{
+    int         is_multicast = FALSE;
+
+    switch (addr.afi){
+    case AF_INET:
+        if (IN_MULTICAST(ntohl(addr.address.ip.s_addr))){
+            is_multicast = TRUE;
+        }
+        break;
+    case AF_INET6:
+        if (IN6_IS_ADDR_MULTICAST(&(addr.address.ipv6))){
+            is_multicast = TRUE;
+        }
+        break;
+    }
+
+    return (is_multicast);
+}
+
+
 void print_hmac(
         uchar *hmac,
         int len)
@@ -1124,53 +1152,14 @@ int get_prefix_len(int afi)
 }
 
 /*
- * Return the first Map Resolver. If no default rloc afi is specified, then IPv4 has more priority than IPv6
- */
-
-
-lisp_addr_t *get_map_resolver()
-{
-    lisp_addr_t *dst_rloc = NULL;
-
-    if (default_ctrl_iface_v4 != NULL){
-        dst_rloc = get_server(map_resolvers, AF_INET);
-    }
-    if (dst_rloc == NULL && default_ctrl_iface_v6 != NULL){
-        dst_rloc = get_server(map_resolvers, AF_INET6);
-    }
-
-    if (dst_rloc == NULL){
-        lispd_log_msg(LISP_LOG_ERR,"No Map Resolver with a RLOC compatible with local RLOCs");
-    }
-    return dst_rloc;
-}
-
-inline lisp_addr_t *get_server(
-        lispd_addr_list_t   *server_list,
-        int                 afi)
-{
-    lispd_addr_list_t *server_elt;
-
-    server_elt = server_list;
-    while (server_elt != NULL){
-        if (server_elt->address->afi == afi){
-            return (server_elt->address);
-        }
-        server_elt = server_elt->next;
-    }
-    return (NULL);
-}
-
-
-
-/*
- *  select from among readfds, the largest of which
+ *  select from among readfds and writefds, the largest of which
  *  is max_fd.
  */
 
 int have_input(
     int         max_fd,
-    fd_set      *readfds)
+    fd_set      *readfds,
+    fd_set      *writefds)
 {
     struct timeval tv;
     tv.tv_sec  = 0;
@@ -1179,7 +1168,7 @@ int have_input(
     while (1)
     {
 
-        if (select(max_fd+1,readfds,NULL,NULL,&tv) == -1) {
+        if (select(max_fd+1,readfds,writefds,NULL,&tv) == -1) {
             if (errno == EINTR){
                 continue;
             }
@@ -1205,15 +1194,31 @@ int process_lisp_ctr_msg(
         int afi)
 {
 
-    uint8_t             packet[MAX_IP_PACKET];
+    static uint8_t      *packet     = NULL; /* Control messages are processed one by one */
     lisp_addr_t         local_rloc;
+    lisp_addr_t         remote_rloc;
     uint16_t            remote_port;
+    int                 result      = BAD;
+#ifdef LISPD_LATENCY_STATS
+    struct timespec     stage_ts;
+#endif
+
+    if (packet == NULL){
+        if ((packet = (uint8_t *) malloc(max_ip_packet)) == NULL){
+            lispd_log_msg(LISP_LOG_ERR,"process_lisp_ctr_msg: Couldn't allocate space for packet: %s", strerror(errno));
+            return (BAD);
+        }
+    }
 
-    if  ( get_packet_and_socket_inf (sock, afi, packet, &local_rloc, &remote_port) != GOOD ){
+    if  ( get_packet_and_socket_inf (sock, afi, packet, &local_rloc, &remote_rloc, &remote_port) != GOOD ){
         return BAD;
     }
 
     lispd_log_msg(LISP_LOG_DEBUG_2, "Received a LISP control message");
+    stats.control_received[((lisp_encap_control_hdr_t *) packet)->type]++;
+    if (trace_enabled == TRUE){
+        trace_control_msg("received", ((lisp_encap_control_hdr_t *) packet)->type, &remote_rloc, NULL, 0);
+    }
 
     switch (((lisp_encap_control_hdr_t *) packet)->type) {
     case LISP_MAP_REQUEST:      //Got Map-Request
@@ -1224,7 +1229,10 @@ int process_lisp_ctr_msg(
         break;
     case LISP_MAP_REPLY:    //Got Map Reply
         lispd_log_msg(LISP_LOG_DEBUG_1, "Received a LISP Map-Reply message");
-        if (process_map_reply(packet) != GOOD){
+        STAGE_START(stage_ts);
+        result = process_map_reply(packet);
+        STAGE_END(STATS_STAGE_MAP_REPLY, stage_ts, 1);
+        if (result != GOOD){
             return (BAD);
         }
         break;
@@ -1449,6 +1457,56 @@ inline lisp_addr_t get_network_address_v6(
 }
 
 
+/*
+ * Milliseconds elapsed since the indicated time of CLOCK_MONOTONIC
+ */
+uint32_t get_elapsed_ms(struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000);
+}
+
+/*
+ * Microseconds elapsed since the indicated time of CLOCK_MONOTONIC
+ */
+uint64_t get_elapsed_us(struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)(now.tv_sec - since->tv_sec) * 1000000 + (now.tv_nsec - since->tv_nsec) / 1000);
+}
+
+/*
+ * Update the smoothed RTT and the RTT variation (ms) with a new sample as described
+ * in RFC 6298. A srtt of 0 means that no sample has been obtained yet
+ */
+void update_rtt_estimation(
+        uint32_t    *srtt,
+        uint32_t    *rttvar,
+        uint32_t    rtt)
+{
+    uint32_t delta = 0;
+
+    if (rtt == 0){
+        rtt = 1;
+    }
+    if (*srtt == 0){
+        *srtt = rtt;
+        *rttvar = rtt / 2;
+    }else{
+        delta = (*srtt > rtt) ? *srtt - rtt : rtt - *srtt;
+        *rttvar = (3 * *rttvar + delta) / 4;
+        *srtt = (7 * *srtt + rtt) / 8;
+        if (*srtt == 0){
+            *srtt = 1;
+        }
+    }
+}
+
+
 /*
  * Editor modelines
  *
@@ -77,6 +77,14 @@ int get_afi(char *str);
 
 int is_link_local_addr (lisp_addr_t addr);
 
+/*
+ * Return TRUE if the address belongs to:
+ *          IPv4: 224.0.0.0/4
+ *          IPv6: ff00::/8
+ */
+
+int is_multicast_addr (lisp_addr_t addr);
+
 
 /*
  *      Copy a lisp_addr_t to a memory location, htonl'ing it
@@ -134,12 +142,6 @@ int get_addr_len(int afi);
  */
 int get_prefix_len(int afi);
 
-/*
- * Return the first Map Resolver with the correct AFI
- */
-
-lisp_addr_t *get_map_resolver();
-
 /*
  * Return lisp_addr_t in a char format;
  */
@@ -172,10 +174,10 @@ int get_lisp_addr_and_mask_from_char (char *address, lisp_addr_t *lisp_addr, int
 
 
 /*
- *  select from among readfds, the largest of which
+ *  select from among readfds and writefds, the largest of which
  *  is max_fd.
  */
-int have_input(int max_fd,fd_set *readfds);
+int have_input(int max_fd,fd_set *readfds,fd_set *writefds);
 
 /*
  *  Process a LISP protocol message sitting on
@@ -244,6 +246,25 @@ lisp_addr_t get_network_address(
         lisp_addr_t address,
         int prefix_length);
 
+/*
+ * Milliseconds elapsed since the indicated time of CLOCK_MONOTONIC
+ */
+uint32_t get_elapsed_ms(struct timespec *since);
+
+/*
+ * Microseconds elapsed since the indicated time of CLOCK_MONOTONIC
+ */
+uint64_t get_elapsed_us(struct timespec *since);
+
+/*
+ * Update the smoothed RTT and the RTT variation (ms) with a new sample as described
+ * in RFC 6298. A srtt of 0 means that no sample has been obtained yet
+ */
+void update_rtt_estimation(
+        uint32_t    *srtt,
+        uint32_t    *rttvar,
+        uint32_t    rtt);
+
 
 #endif /*LISPD_LIB_H_*/
 
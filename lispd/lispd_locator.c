@@ -50,11 +50,6 @@ inline rmt_locator_extended_info *new_rmt_locator_extended_info();
  */
 lcl_locator_extended_info *copy_lcl_locator_extended_info(lcl_locator_extended_info *extended_info);
 
-/*
- * Generates a clone of a rtr localtors list. Timers and nonces not cloned
- */
-lispd_rtr_locators_list *copy_rtr_locators_list(lispd_rtr_locators_list *rtr_list);
-
 /*
  * Generates a clone of remote localtor extended info. Timers and nonces not cloned
  */
@@ -349,6 +344,8 @@ inline rmt_locator_extended_info *new_rmt_locator_extended_info()
     }
     rmt_loc_ext_inf->rloc_probing_nonces = NULL;
     rmt_loc_ext_inf->probe_timer = NULL;
+    rmt_loc_ext_inf->latency = 0;
+    rmt_loc_ext_inf->rttvar = 0;
 
     return rmt_loc_ext_inf;
 }
@@ -364,6 +361,8 @@ rmt_locator_extended_info *copy_rmt_locator_extended_info(rmt_locator_extended_i
     if (rmt_extended_info == NULL){
         return (NULL);
     }
+    rmt_extended_info->latency = extended_info->latency;
+    rmt_extended_info->rttvar = extended_info->rttvar;
 
     return (rmt_extended_info);
 }
@@ -382,6 +381,10 @@ lispd_rtr_locator *new_rtr_locator(lisp_addr_t address)
     }
     rtr_locator->address = address;
     rtr_locator->latency = 0;
+    rtr_locator->rttvar = 0;
+    rtr_locator->probe_nonce = 0;
+    rtr_locator->consecutive_timeouts = 0;
+    rtr_locator->registered = FALSE;
     rtr_locator->state = UP;
 
     return (rtr_locator);
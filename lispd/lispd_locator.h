@@ -67,7 +67,12 @@ typedef struct lispd_locators_list_ {
 typedef struct lispd_rtr_locator_ {
     lisp_addr_t                 address;
     uint8_t                     state;    /* UP , DOWN */
-    uint32_t                    latency;
+    uint32_t                    latency;  /* Smoothed RTT in ms. 0 if not measured yet */
+    uint32_t                    rttvar;
+    uint64_t                    probe_nonce;
+    struct timespec             probe_time;
+    uint8_t                     consecutive_timeouts;
+    uint8_t                     registered; /* An Encapsulated Map-Register has been sent through the RTR */
 }lispd_rtr_locator;
 
 /*
@@ -90,6 +95,9 @@ typedef struct lcl_locator_extended_info_ {
 typedef struct rmt_locator_extended_info_ {
     nonces_list                 *rloc_probing_nonces;
     timer                       *probe_timer;
+    struct timespec             probe_time;     /* Time of the first Map-Request probe of the current cycle */
+    uint32_t                    latency;        /* Smoothed RTT in ms measured by RLOC probing. 0 if not measured yet */
+    uint32_t                    rttvar;
 }rmt_locator_extended_info;
 
 
@@ -167,6 +175,11 @@ void free_locator(lispd_locator_elt   *locator);
  */
 void free_rtr_list(lispd_rtr_locators_list *rtr_list_elt);
 
+/*
+ * Generates a clone of a rtr localtors list. Timers and nonces not cloned
+ */
+lispd_rtr_locators_list *copy_rtr_locators_list(lispd_rtr_locators_list *rtr_list);
+
 /*
  * Print the information of a locator element
  */
@@ -32,103 +32,335 @@
 
 #include "lispd_log.h"
 #include "lispd_external.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
 #include <syslog.h>
 #include <stdarg.h>
 
 FILE *fp = NULL;
 
-inline void lispd_log(
+/*
+ * Entry of the ring of the asynchronous logger. seq is the position of the ring the entry can
+ * be written for (seq == pos) or read for (seq == pos + 1)
+ */
+typedef struct log_entry_ {
+    uint32_t        seq;
+    int             log_level;
+    char            *log_name;
+    char            msg[LOG_MSG_LEN];
+} log_entry;
+
+static log_entry        *log_ring           = NULL;
+static uint32_t         log_head            = 0;    /* Next position to write. Shared by the producers */
+static uint32_t         log_tail            = 0;    /* Next position to read. Only used by the writer */
+static uint32_t         log_dropped         = 0;
+static int              log_async_running   = FALSE;
+static int              log_writer_stop     = FALSE;
+static sem_t            log_sem;
+static pthread_t        log_writer;
+
+static void lispd_log_vmsg(
+        int         lisp_log_level,
+        int         sync,
+        const char  *format,
+        va_list     args);
+
+static inline void lispd_log(
         int         log_level,
         char        *log_name,
+        int         sync,
         const char  *format,
         va_list     args);
 
+static void lispd_log_async(
+        int         log_level,
+        char        *log_name,
+        const char  *format,
+        va_list     args);
+
+static void lispd_log_write(
+        int         log_level,
+        char        *log_name,
+        char        *msg);
+
+static void *log_writer_thread(void *arg);
+
 
 void lispd_log_msg(
         int lisp_log_level, const char *format, ...)
 {
     va_list args;
-    char *log_name; /* To store the log level in string format for printf output */
-    int log_level;
 
+    va_start (args, format);
+    lispd_log_vmsg(lisp_log_level, FALSE, format, args);
+    va_end (args);
+}
+
+void lispd_log_msg_sync(
+        int lisp_log_level, const char *format, ...)
+{
+    va_list args;
 
     va_start (args, format);
+    lispd_log_vmsg(lisp_log_level, TRUE, format, args);
+    va_end (args);
+}
+
+static void lispd_log_vmsg(
+        int         lisp_log_level,
+        int         sync,
+        const char  *format,
+        va_list     args)
+{
+    char *log_name; /* To store the log level in string format for printf output */
+    int log_level;
+
 
     switch (lisp_log_level){
     case LISP_LOG_CRIT:
         log_name = "CRIT";
         log_level = LOG_CRIT;
-        lispd_log(log_level, log_name, format, args);
+        lispd_log(log_level, log_name, sync, format, args);
         break;
     case LISP_LOG_ERR:
         log_name = "ERR";
         log_level = LOG_ERR;
-        lispd_log(log_level, log_name, format, args);
+        lispd_log(log_level, log_name, sync, format, args);
         break;
     case LISP_LOG_WARNING:
         log_name = "WARNING";
         log_level = LOG_WARNING;
-        lispd_log(log_level, log_name, format, args);
+        lispd_log(log_level, log_name, sync, format, args);
         break;
     case LISP_LOG_INFO:
         log_name = "INFO";
         log_level = LOG_INFO;
-        lispd_log(log_level, log_name, format, args);
+        lispd_log(log_level, log_name, sync, format, args);
         break;
     case LISP_LOG_DEBUG_1:
         if (debug_level > 0){
             log_name = "DEBUG";
             log_level = LOG_DEBUG;
-            lispd_log(log_level, log_name, format, args);
+            lispd_log(log_level, log_name, sync, format, args);
         }
         break;
     case LISP_LOG_DEBUG_2:
         if (debug_level > 1){
             log_name = "DEBUG-2";
             log_level = LOG_DEBUG;
-            lispd_log(log_level, log_name, format, args);
+            lispd_log(log_level, log_name, sync, format, args);
         }
         break;
     case LISP_LOG_DEBUG_3:
         if (debug_level > 2){
             log_name = "DEBUG-3";
             log_level = LOG_DEBUG;
-            lispd_log(log_level, log_name, format, args);
+            lispd_log(log_level, log_name, sync, format, args);
         }
         break;
     default:
         log_name = "LOG";
         log_level = LOG_INFO;
-        lispd_log(log_level, log_name, format, args);
+        lispd_log(log_level, log_name, sync, format, args);
         break;
     }
-
-    va_end (args);
 }
 
-inline void lispd_log(
+static inline void lispd_log(
         int         log_level,
         char        *log_name,
+        int         sync,
         const char  *format,
         va_list     args)
 {
+    if (log_async_running == TRUE && sync == FALSE){
+        lispd_log_async(log_level, log_name, format, args);
+        return;
+    }
+    /* The lock keeps the line whole if the writer thread of the asynchronous logging is printing */
     if (daemonize){
 #ifdef ANDROID
+        flockfile(fp);
     	fprintf(fp,"%s: ",log_name);
     	vfprintf(fp,format,args);
     	fprintf(fp,"\n");
     	fflush(fp);
+        funlockfile(fp);
 #else
         vsyslog(log_level,format,args);
 #endif
 
     }else{
+        flockfile(stdout);
         printf("%s: ",log_name);
         vfprintf(stdout,format,args);
         printf("\n");
+        funlockfile(stdout);
     }
 }
 
+/*
+ * Format the message in a free entry of the ring and wake up the writer. The ring is a bounded
+ * MPMC queue: a producer reserves a position moving log_head with a CAS and publishes the entry
+ * updating its seq. If the ring is full, the message is counted as dropped: the producer never waits.
+ */
+static void lispd_log_async(
+        int         log_level,
+        char        *log_name,
+        const char  *format,
+        va_list     args)
+{
+    log_entry   *entry  = NULL;
+    uint32_t    pos     = 0;
+    uint32_t    seq     = 0;
+
+    pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    for (;;){
+        entry = &(log_ring[pos & (LOG_RING_SIZE - 1)]);
+        seq = __atomic_load_n(&(entry->seq), __ATOMIC_ACQUIRE);
+        if (seq == pos){
+            if (__atomic_compare_exchange_n(&log_head, &pos, pos + 1, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+                break;
+            }
+        }else if ((int32_t)(seq - pos) < 0){
+            /* Full: the entry still holds the message of the previous lap */
+            __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }else{
+            pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    entry->log_level = log_level;
+    entry->log_name = log_name;
+    vsnprintf(entry->msg, LOG_MSG_LEN, format, args);
+    __atomic_store_n(&(entry->seq), pos + 1, __ATOMIC_RELEASE);
+    sem_post(&log_sem);
+}
+
+/*
+ * Write a formatted message to the output of the log
+ */
+static void lispd_log_write(
+        int         log_level,
+        char        *log_name,
+        char        *msg)
+{
+    if (daemonize){
+#ifdef ANDROID
+        fprintf(fp,"%s: %s\n",log_name,msg);
+        fflush(fp);
+#else
+        syslog(log_level,"%s",msg);
+#endif
+    }else{
+        printf("%s: %s\n",log_name,msg);
+    }
+}
+
+/*
+ * Drain the ring to the output of the log. The number of messages dropped because the ring was
+ * full is reported when the writer catches up.
+ */
+static void *log_writer_thread(void *arg)
+{
+    log_entry   *entry          = NULL;
+    uint32_t    dropped         = 0;
+    uint32_t    reported        = 0;
+    char        msg[LOG_MSG_LEN];
+
+    for (;;){
+        sem_wait(&log_sem);
+        for (;;){
+            entry = &(log_ring[log_tail & (LOG_RING_SIZE - 1)]);
+            if (__atomic_load_n(&(entry->seq), __ATOMIC_ACQUIRE) != log_tail + 1){
+                break;
+            }
+            lispd_log_write(entry->log_level, entry->log_name, entry->msg);
+            __atomic_store_n(&(entry->seq), log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+            log_tail++;
+        }
+        dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+        if (dropped != reported){
+            snprintf(msg, LOG_MSG_LEN, "Log buffer full: %u messages dropped", dropped - reported);
+            lispd_log_write(LOG_WARNING, "WARNING", msg);
+            reported = dropped;
+        }
+        if (__atomic_load_n(&log_writer_stop, __ATOMIC_ACQUIRE) == TRUE){
+            break;
+        }
+    }
+    return (NULL);
+}
+
+int init_async_log()
+{
+    sigset_t    all_signals;
+    sigset_t    old_signals;
+    uint32_t    ctr         = 0;
+    int         err         = 0;
+
+    if (log_async_running == TRUE){
+        return (GOOD);
+    }
+    log_ring = (log_entry *)malloc(LOG_RING_SIZE * sizeof(log_entry));
+    if (log_ring == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "init_async_log: Unable to allocate memory for the log buffer: %s", strerror(errno));
+        return (BAD);
+    }
+    for (ctr = 0 ; ctr < LOG_RING_SIZE ; ctr++){
+        log_ring[ctr].seq = ctr;
+    }
+    log_head = 0;
+    log_tail = 0;
+    log_dropped = 0;
+    log_writer_stop = FALSE;
+
+    if (sem_init(&log_sem, 0, 0) != 0){
+        lispd_log_msg(LISP_LOG_WARNING, "init_async_log: Unable to create the semaphore: %s", strerror(errno));
+        free(log_ring);
+        log_ring = NULL;
+        return (BAD);
+    }
+    /* The signals are processed by the main thread. The writer inherits the blocked mask */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    err = pthread_create(&log_writer, NULL, log_writer_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (err != 0){
+        lispd_log_msg(LISP_LOG_WARNING, "init_async_log: Unable to create the log writer thread");
+        sem_destroy(&log_sem);
+        free(log_ring);
+        log_ring = NULL;
+        return (BAD);
+    }
+    log_async_running = TRUE;
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Asynchronous logging enabled. Log buffer of %d messages", LOG_RING_SIZE);
+
+    return (GOOD);
+}
+
+void close_async_log()
+{
+    if (log_async_running == FALSE){
+        return;
+    }
+    /* The next messages are written directly. The writer drains the ring before exiting */
+    log_async_running = FALSE;
+    __atomic_store_n(&log_writer_stop, TRUE, __ATOMIC_RELEASE);
+    sem_post(&log_sem);
+    pthread_join(log_writer, NULL);
+    sem_destroy(&log_sem);
+    free(log_ring);
+    log_ring = NULL;
+}
+
+uint32_t get_log_dropped()
+{
+    return (__atomic_load_n(&log_dropped, __ATOMIC_RELAXED));
+}
+
 void open_log_file()
 {
 	if (fp == NULL){
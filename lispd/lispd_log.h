@@ -34,6 +34,8 @@
 #ifndef LISPD_LOG_H_
 #define LISPD_LOG_H_
 
+#include <stdint.h>
+
 
 
 // If these set of defines is modified, check the function is_loggable()
@@ -49,13 +51,42 @@
 
 #define LOGFILE_LOCATION	"/sdcard/lispd.log"
 
+/*
+ * Asynchronous logging: the messages are formatted in a preallocated ring of LOG_RING_SIZE
+ * entries (power of 2) and written by a dedicated thread. Messages are truncated to LOG_MSG_LEN
+ * bytes and dropped (and counted) when the ring is full.
+ */
+#define LOG_RING_SIZE       1024
+#define LOG_MSG_LEN         512
+
 
 void lispd_log_msg(int lisp_log_level, const char *format, ...);
 
+/*
+ * Like lispd_log_msg, but the message is written directly even when the asynchronous logging
+ * is running. For bursts of messages bigger than the ring of the asynchronous logging
+ */
+void lispd_log_msg_sync(int lisp_log_level, const char *format, ...);
+
 void open_log_file();
 
 void close_log_file();
 
+/*
+ * Start the writer thread of the asynchronous logging. To be called after daemonizing
+ */
+int init_async_log();
+
+/*
+ * Write the pending messages and stop the writer thread. The next messages are written directly
+ */
+void close_async_log();
+
+/*
+ * Number of messages dropped because the ring of the asynchronous logging was full
+ */
+uint32_t get_log_dropped();
+
 /*
  * True if log_level is enough to print results
  */
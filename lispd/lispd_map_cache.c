@@ -28,11 +28,13 @@
  *    Albert Lopez      <alopez@ac.upc.edu>
  */
 
-#include "lispd.h"
+#include "lispd_external.h"
+#include "lispd_fastpath.h"
 #include "lispd_lib.h"
 #include "lispd_log.h"
 #include "lispd_map_cache.h"
 #include "lispd_map_cache_db.h"
+#include "lispd_routing_tables_lib.h"
 
 
 /*
@@ -59,6 +61,8 @@ lispd_map_cache_entry *new_map_cache_entry_no_db (
     }
 
     map_cache_entry->active_witin_period = FALSE;
+    map_cache_entry->last_activity = 0;
+    map_cache_entry->native_fwd_table = 0;
     map_cache_entry->how_learned = how_learned;
     map_cache_entry->ttl = ttl;
     if (how_learned == DYNAMIC_MAP_CACHE_ENTRY){
@@ -133,6 +137,7 @@ lispd_map_cache_entry *copy_map_cache_entry (lispd_map_cache_entry *map_cache_en
     map_cache_entry_dst->active_witin_period    = map_cache_entry_src->active_witin_period;
     map_cache_entry_dst->ttl                    = map_cache_entry_src->ttl;
     map_cache_entry_dst->timestamp              = map_cache_entry_src->timestamp;
+    map_cache_entry_dst->last_activity          = map_cache_entry_src->last_activity;
 
     return (map_cache_entry_dst);
 }
@@ -146,6 +151,8 @@ void free_map_cache_entry(lispd_map_cache_entry *entry)
         return;
     }
 
+    del_native_forward_rule(entry);
+    fastpath_del_map_cache_entry(entry);
     free_mapping_elt(entry->mapping);
     /*
      * Free the entry
@@ -216,9 +223,79 @@ int activate_negative_map_cache (
     lispd_log_msg(LISP_LOG_DEBUG_1,"Activated negative map cache with prefix %s/%d. The entry will expire in %d minutes.",
             get_char_from_lisp_addr_t(cache_entry->mapping->eid_prefix),
             cache_entry->mapping->eid_prefix_length, cache_entry->ttl);
+    program_native_forward_rule(cache_entry);
+    fastpath_update_map_cache_entry(cache_entry);
     return (GOOD);
 }
 
+/*
+ * Install a rule to forward natively in the kernel the traffic to the EID prefix of a negative
+ * map cache entry with native forward action, or remove it if the entry is not such an entry anymore.
+ * The traffic is looked up in the routing table of the default output interface and never reaches
+ * the tun interface. The rule is removed when the entry expires.
+ */
+void program_native_forward_rule(lispd_map_cache_entry *entry)
+{
+    lispd_iface_elt     *out_iface      = NULL;
+    uint8_t             table           = 0;
+
+    if (entry->active == ACTIVE && entry->mapping->locator_count == 0 &&
+            entry->actions == MAPPING_ACT_NATIVELY_FORWARD){
+        if (entry->mapping->eid_prefix.afi == AF_INET){
+            out_iface = default_out_iface_v4;
+        }else{
+            out_iface = default_out_iface_v6;
+        }
+        if (out_iface != NULL){
+            table = out_iface->iface_index;
+        }
+    }
+
+    if (entry->native_fwd_table == table){
+        return;
+    }
+    del_native_forward_rule(entry);
+    if (table == 0){
+        return;
+    }
+    if (add_rule(entry->mapping->eid_prefix.afi,
+            0,
+            table,
+            NATIVE_FORWARD_RULE_PRIORITY,
+            RTN_UNICAST,
+            NULL,
+            0,
+            &(entry->mapping->eid_prefix),
+            entry->mapping->eid_prefix_length,
+            0) == GOOD){
+        entry->native_fwd_table = table;
+        lispd_log_msg(LISP_LOG_DEBUG_1,"Traffic to %s/%d forwarded natively by the kernel through %s",
+                get_char_from_lisp_addr_t(entry->mapping->eid_prefix),
+                entry->mapping->eid_prefix_length, out_iface->iface_name);
+    }
+}
+
+/*
+ * Remove the native forward rule of the map cache entry if it has been installed
+ */
+void del_native_forward_rule(lispd_map_cache_entry *entry)
+{
+    if (entry->native_fwd_table == 0){
+        return;
+    }
+    del_rule(entry->mapping->eid_prefix.afi,
+            0,
+            entry->native_fwd_table,
+            NATIVE_FORWARD_RULE_PRIORITY,
+            RTN_UNICAST,
+            NULL,
+            0,
+            &(entry->mapping->eid_prefix),
+            entry->mapping->eid_prefix_length,
+            0);
+    entry->native_fwd_table = 0;
+}
+
 /*
  * Print the information of a lispd_map_cache_entry element
  */
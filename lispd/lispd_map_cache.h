@@ -49,6 +49,13 @@
 #define NO_ACTIVE                       0
 #define ACTIVE                          1
 
+/*
+ * Priority of the rules that send the traffic to the EID prefix of a negative map cache entry with
+ * native forward action to the routing table of the default output interface. It has to be lower
+ * (preferred) than the priority of the main table and of the rules of the tun interface.
+ */
+#define NATIVE_FORWARD_RULE_PRIORITY    31000
+
 /****************************************  STRUCTURES **************************************/
 
 /*
@@ -60,8 +67,10 @@ typedef struct lispd_map_cache_entry_ {
     uint8_t                     actions:2;
     uint8_t                     active:1;       /* TRUE if we have received a map reply for this entry */
     uint8_t                     active_witin_period:1;
+    uint8_t                     native_fwd_table;   /* Table of the native forward rule. 0 if not installed */
     uint16_t                    ttl;
     time_t                      timestamp;
+    time_t                      last_activity;  /* Last packet received from the EID. Only with fast handover */
     timer                       *expiry_cache_timer;
     timer                       *request_retry_timer;
     timer                       *smr_inv_timer;
@@ -109,6 +118,17 @@ int activate_negative_map_cache (
         int                     ttl,
         uint8_t                 action);
 
+/*
+ * Install a rule to forward natively in the kernel the traffic to the EID prefix of a negative
+ * map cache entry with native forward action, or remove it if the entry is not such an entry anymore.
+ */
+void program_native_forward_rule(lispd_map_cache_entry *entry);
+
+/*
+ * Remove the native forward rule of the map cache entry if it has been installed
+ */
+void del_native_forward_rule(lispd_map_cache_entry *entry);
+
 /**
  * Print the information of a lispd_map_cache_entry element
  */
@@ -29,7 +29,10 @@
  */
 
 #include "lispd_lib.h"
+#include "lispd_fastpath.h"
 #include "lispd_map_cache_db.h"
+#include "lispd_referral_cache.h"
+#include "lispd_stats.h"
 #include <math.h>
 
 /*
@@ -320,6 +323,9 @@ int change_map_cache_prefix_in_db(
     if (node == NULL){
         return (BAD);
     }
+    /* The rule of a native forward entry is for the old prefix */
+    del_native_forward_rule(cache_entry);
+    fastpath_del_map_cache_entry(cache_entry);
     /* Remove the node from the database*/
     if (cache_entry->mapping->eid_prefix.afi==AF_INET){
         patricia_remove(AF4_map_cache, node);
@@ -343,6 +349,9 @@ int change_map_cache_prefix_in_db(
         free_map_cache_entry(cache_entry);
         return (BAD);
     }
+    /* The entry could be resolved by the DDT client */
+    update_pending_referral_cache_entry_eid(cache_entry, old_eid_prefix, old_eid_prefix_length);
+
     lispd_log_msg(LISP_LOG_DEBUG_2,"EID prefix of the map cache entry %s/%d changed to %s/%d.",
             get_char_from_lisp_addr_t(old_eid_prefix),
             old_eid_prefix_length,
@@ -364,10 +373,88 @@ void map_cache_entry_expiration(
 
     lispd_log_msg(LISP_LOG_DEBUG_1,"Got expiration for EID %s/%d", get_char_from_lisp_addr_t(entry->mapping->eid_prefix),
             entry->mapping->eid_prefix_length);
+    stats.map_cache_expirations++;
     del_map_cache_entry_from_db(entry->mapping->eid_prefix, entry->mapping->eid_prefix_length);
 }
 
 
+/*
+ * Reprogram the native forward rules of the map cache entries in the routing table of the
+ * current default output interfaces
+ */
+void update_native_forward_rules()
+{
+    patricia_tree_t             *dbs [2]    = {AF4_map_cache, AF6_map_cache};
+    patricia_node_t             *node       = NULL;
+    lispd_map_cache_entry       *entry      = NULL;
+    int                         ctr         = 0;
+
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(dbs[ctr]->head, node) {
+            entry = ((lispd_map_cache_entry *)(node->data));
+            program_native_forward_rule(entry);
+        } PATRICIA_WALK_END;
+    }
+}
+
+/*
+ * Remove the native forward rules of the map cache entries from the kernel
+ */
+void remove_native_forward_rules()
+{
+    patricia_tree_t             *dbs [2]    = {AF4_map_cache, AF6_map_cache};
+    patricia_node_t             *node       = NULL;
+    lispd_map_cache_entry       *entry      = NULL;
+    int                         ctr         = 0;
+
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(dbs[ctr]->head, node) {
+            entry = ((lispd_map_cache_entry *)(node->data));
+            del_native_forward_rule(entry);
+        } PATRICIA_WALK_END;
+    }
+}
+
+/*
+ * Number of entries of the map cache, number of them waiting for a Map-Reply and number of
+ * nonces of Map-Requests sent for them still waiting for an answer
+ */
+void get_map_cache_stats(
+        int     *entries,
+        int     *pending,
+        int     *nonces)
+{
+    patricia_tree_t             *dbs [2]    = {AF4_map_cache, AF6_map_cache};
+    patricia_node_t             *node       = NULL;
+    lispd_map_cache_entry       *entry      = NULL;
+    int                         ctr         = 0;
+
+    *entries = 0;
+    *pending = 0;
+    *nonces = 0;
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(dbs[ctr]->head, node) {
+            entry = ((lispd_map_cache_entry *)(node->data));
+            (*entries)++;
+            if (entry->active == NO_ACTIVE){
+                (*pending)++;
+            }
+            if (entry->nonces != NULL){
+                (*nonces) += entry->nonces->retransmits;
+            }
+        } PATRICIA_WALK_END;
+    }
+}
+
 /*
  * dump_map_cache
  */
@@ -98,6 +98,25 @@ int change_map_cache_prefix_in_db(lisp_addr_t         new_eid_prefix,
 
 void map_cache_entry_expiration(timer *t, void *arg);
 
+/*
+ * Reprogram the native forward rules of the map cache entries in the routing table of the
+ * current default output interfaces
+ */
+void update_native_forward_rules();
+
+/*
+ * Remove the native forward rules of the map cache entries from the kernel
+ */
+void remove_native_forward_rules();
+
+/*
+ * Number of entries of the map cache, number of them waiting for a Map-Reply and number of
+ * nonces of Map-Requests sent for them still waiting for an answer
+ */
+void get_map_cache_stats(
+        int     *entries,
+        int     *pending,
+        int     *nonces);
 
 void dump_map_cache_db(int log_level);
 
@@ -35,6 +35,7 @@
 #include <openssl/evp.h>
 #include "lispd_afi.h"
 #include "lispd_external.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_lib.h"
 #include "lispd_map_notify.h"
 #include "lispd_map_register.h"
@@ -63,15 +64,32 @@ int process_map_notify(uint8_t *packet)
     lispd_xTR_ID                        *xTR_ID_msg                 = NULL;
     int                                 next_timer_time             = 0;
     int                                 result                      = BAD;
+    lispd_iface_list_elt                *iface_list                 = NULL;
+    lispd_iface_mappings_list           *mappings_list              = NULL;
+    lispd_iface_mappings_list           *emr_mapping                = NULL;
 
 
 
     map_notify = (lispd_pkt_map_notify_t *)packet;
     record_count = map_notify->record_count;
 
-    /* Check the nonce of data Map Notify*/
+    /*
+     * Check the nonce of data Map Notify. It identifies the mapping and the interface of the
+     * Encapsulated Map Register
+     */
     if (map_notify->xtr_id_present == TRUE){
-        if (check_nonce(nat_emr_nonce,map_notify->nonce) == GOOD){
+        iface_list = get_head_interface_list();
+        while (iface_list != NULL && emr_mapping == NULL){
+            mappings_list = iface_list->iface->head_mappings_list;
+            while (mappings_list != NULL && emr_mapping == NULL){
+                if (check_nonce(mappings_list->emr_nonce,map_notify->nonce) == GOOD){
+                    emr_mapping = mappings_list;
+                }
+                mappings_list = mappings_list->next;
+            }
+            iface_list = iface_list->next;
+        }
+        if (emr_mapping != NULL){
             lispd_log_msg(LISP_LOG_DEBUG_2, "Data Map Notify: Correct nonce field checking ");
             /* Free nonce if authentication is ok */
         }else{
@@ -161,8 +179,10 @@ int process_map_notify(uint8_t *packet)
     if ((strncmp((char *)map_notify->auth_data, (char *)auth_data, (size_t)LISP_SHA1_AUTH_DATA_LEN)) == 0){
         lispd_log_msg(LISP_LOG_DEBUG_1, "Map-Notify message confirms correct registration");
         next_timer_time = MAP_REGISTER_INTERVAL;
-        free (nat_emr_nonce);
-        nat_emr_nonce = NULL;
+        if (emr_mapping != NULL){
+            free (emr_mapping->emr_nonce);
+            emr_mapping->emr_nonce = NULL;
+        }
         result = GOOD;
 
     } else{
@@ -170,11 +190,19 @@ int process_map_notify(uint8_t *packet)
         next_timer_time = LISPD_INITIAL_EMR_TIMEOUT;
         result = BAD;
     }
+    flight_record(FLIGHT_MAP_NOTIFY_RECEIVED, NULL, 0, result == GOOD ? FLIGHT_FLAG_UP : 0, 0, map_notify->nonce);
 
-    if (map_register_timer == NULL) {
-        map_register_timer = create_timer(MAP_REGISTER_TIMER);
+    if (emr_mapping != NULL){
+        if (emr_mapping->emr_timer == NULL) {
+            emr_mapping->emr_timer = create_timer(MAP_REGISTER_TIMER);
+        }
+        start_timer(emr_mapping->emr_timer, next_timer_time, encapsulated_map_register, emr_mapping);
+    }else{
+        if (map_register_timer == NULL) {
+            map_register_timer = create_timer(MAP_REGISTER_TIMER);
+        }
+        start_timer(map_register_timer, next_timer_time, map_register, NULL);
     }
-    start_timer(map_register_timer, next_timer_time, map_register, NULL);
 
     return(result);
 }
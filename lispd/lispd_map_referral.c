@@ -30,6 +30,7 @@
 
 #include "lispd.h"
 #include "lispd_afi.h"
+#include "lispd_ddt_node.h"
 #include "lispd_external.h"
 #include "lispd_lib.h"
 #include "lispd_map_referral.h"
@@ -98,6 +99,21 @@ void program_referral_expiry_timer(lispd_referral_cache_entry *referral_entry);
  */
 int referral_expiry(timer *t,void    *arg);
 
+/*
+ * Timer function called before the expiry of a MS referral. If the referral is being used, a DDT Map Request is
+ * sent to the nodes of its parent to refresh it before it expires.
+ */
+int referral_prefetch(timer *t,void    *arg);
+
+int send_referral_prefetch(lispd_referral_cache_entry *referral_entry);
+
+/*
+ * Process a Map Referral record answering a DDT Map Request sent to refresh a referral cache entry
+ */
+int process_referral_prefetch_record(
+        uint8_t                     **offset,
+        lispd_referral_cache_entry  *referral_entry);
+
 /****************************************************************************************/
 
 int process_map_referral(uint8_t *packet)
@@ -135,6 +151,7 @@ int process_map_referral_record(
     lispd_referral_cache_entry              *previous_referral_entry    = NULL;
     lispd_mapping_elt                       *referral_mapping           = NULL;
     lispd_pending_referral_cache_entry      *pending_referral_entry     = NULL;
+    lispd_pending_referral_nonce_elt        *nonce_elt                  = NULL;
     lispd_map_cache_entry                   *map_cache_entry            = NULL;
     lisp_addr_t                             ddt_node_locator_addr       = {.afi=AF_UNSPEC};
     lisp_addr_t                             aux_eid_prefix;
@@ -149,26 +166,32 @@ int process_map_referral_record(
     record = (lispd_pkt_referral_mapping_record_t *)(cur_ptr);
 
 
-    pending_referral_entry = lookup_pending_referral_cache_entry_by_nonce (nonce);
+    nonce_elt = lookup_pending_referral_nonce (nonce);
 
-    if (pending_referral_entry == NULL){
+    if (nonce_elt == NULL && (referral_entry = lookup_referral_cache_entry_prefetch (nonce)) != NULL){
+        return (process_referral_prefetch_record(offset, referral_entry));
+    }
+
+    if (nonce_elt == NULL){
         lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_referral_record:  The nonce of the Map-Referral doesn't match the nonce of any generated Map-Request. Discarding message ...");
         free_mapping_elt(referral_mapping);
         return (BAD);
     }else {
+        pending_referral_entry = nonce_elt->pending_referral_cache_entry;
         if (pending_referral_entry->previous_referral->act_entry_type == MS_NOT_REGISTERED){
             previous_referral_entry = pending_referral_entry->previous_referral->parent_node;
-            ddt_node_locator_addr = get_ddt_locator_addr_at_position(pending_referral_entry->previous_referral->parent_node,
-                    ctrl_supported_afi, pending_referral_entry->tried_locators);
         }else{
             previous_referral_entry = pending_referral_entry->previous_referral;
-            ddt_node_locator_addr = get_ddt_locator_addr_at_position(pending_referral_entry->previous_referral,
-                    ctrl_supported_afi, pending_referral_entry->tried_locators);
+        }
+        /* The DDT node that answered is the one the nonce was sent to */
+        ddt_node_locator_addr = nonce_elt->ddt_node_addr;
+        if (ddt_node_locator_addr.afi != AF_UNSPEC){
+            ddt_node_reply_received(&ddt_node_locator_addr, get_elapsed_ms(&(nonce_elt->sent)));
         }
     }
 
-    free(pending_referral_entry->nonces);
-    pending_referral_entry->nonces = NULL;
+    /* Requests sent in parallel to other DDT nodes are not needed any more. Their answers will be discarded */
+    free_pending_referral_cache_entry_nonces(pending_referral_entry);
 
     /* Stop the timer to not retry to send the map request */
     stop_timer(pending_referral_entry->ddt_request_retry_timer);
@@ -577,7 +600,7 @@ int process_ms_not_registered_reply(
         referral_entry = db_referral_entry;
     }
     /* Try with the next ddt node*/
-    pending_referral_entry->tried_locators = pending_referral_entry->tried_locators + 1;
+    pending_referral_entry->tried_locators = pending_referral_entry->tried_locators + pending_referral_entry->asked_locators;
     lispd_log_msg(LISP_LOG_DEBUG_1,"process_ms_not_registered_reply: Receive a MS_NOT_REGISTERED referral. Trying next node");
     err = send_ddt_map_request_miss(NULL,(void *)pending_referral_entry);
     /* If we asked to all MS where prefix is delegated and all reply  MS_NOT_REGISTERED, remove entry from pending list
@@ -647,6 +670,12 @@ int process_not_authoritative_reply(
             get_char_from_lisp_addr_t(pending_referral_entry->map_cache_entry->mapping->eid_prefix),
             pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
 
+    /* Don't ask again this node for EIDs of the prefix during the TTL of the referral */
+    if (referral_entry->src_inf_ddt_node_locator_addr.afi != AF_UNSPEC){
+        ddt_node_not_authoritative(&(referral_entry->src_inf_ddt_node_locator_addr), referral_entry->mapping->eid_prefix,
+                referral_entry->mapping->eid_prefix_length, referral_entry->ttl);
+    }
+
     err = try_next_referral_node_or_go_through_root (pending_referral_entry);
     if (err != GOOD){
         if (err == ERR_DST_ADDR){
@@ -672,7 +701,7 @@ int process_not_authoritative_reply(
  */
 inline int try_next_referral_node_or_go_through_root (lispd_pending_referral_cache_entry *pending_referral_entry)
 {
-    pending_referral_entry->tried_locators = pending_referral_entry->tried_locators + 1;
+    pending_referral_entry->tried_locators = pending_referral_entry->tried_locators + pending_referral_entry->asked_locators;
     err = send_ddt_map_request_miss(NULL,(void *)pending_referral_entry);
     /*
      * If we asked to all Referral Nodes for this prefix without obtaing and authoritative answer:
@@ -696,14 +725,156 @@ inline int try_next_referral_node_or_go_through_root (lispd_pending_referral_cac
 
 /*
  * Program timer to remove referral cache entry after TTL
- * If the timer was already programed, it reprogram it with the new time to expiry
+ * If the timer was already programed, it reprogram it with the new time to expiry.
+ * MS referrals are checked DDT_REFERRAL_PREFETCH_TIME seconds before expiring to be refreshed if they are in use.
  */
 void program_referral_expiry_timer(lispd_referral_cache_entry *referral_entry)
 {
     if (referral_entry->expiry_ddt_cache_timer == NULL){
         referral_entry->expiry_ddt_cache_timer = create_timer(DDT_EXPIRE_MAP_REFERRAL);
     }
-    start_timer(referral_entry->expiry_ddt_cache_timer, referral_entry->ttl*60, referral_expiry, (void *)referral_entry);
+    referral_entry->expiry_time = time(NULL) + referral_entry->ttl*60;
+    referral_entry->hits = 0;
+    if (referral_entry->prefetch_nonce != 0){
+        remove_referral_cache_entry_prefetch(referral_entry);
+    }
+    if (referral_entry->act_entry_type == MS_REFERRAL && referral_entry->parent_node != NULL &&
+            referral_entry->ttl*60 > DDT_REFERRAL_PREFETCH_TIME){
+        start_timer(referral_entry->expiry_ddt_cache_timer, referral_entry->ttl*60 - DDT_REFERRAL_PREFETCH_TIME,
+                referral_prefetch, (void *)referral_entry);
+    }else{
+        start_timer(referral_entry->expiry_ddt_cache_timer, referral_entry->ttl*60, referral_expiry, (void *)referral_entry);
+    }
+}
+
+int referral_prefetch(
+        timer   *t,
+        void    *arg)
+{
+    lispd_referral_cache_entry  *referral_entry = (lispd_referral_cache_entry *)arg;
+    int                         remaining_time  = 0;
+
+    if (referral_entry->hits >= DDT_REFERRAL_PREFETCH_MIN_HITS){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"referral_prefetch: The referral entry with prefix %s/%d is going to expire. "
+                "Refreshing it (%u resolutions)", get_char_from_lisp_addr_t(referral_entry->mapping->eid_prefix),
+                referral_entry->mapping->eid_prefix_length, referral_entry->hits);
+        send_referral_prefetch(referral_entry);
+    }
+
+    remaining_time = referral_entry->expiry_time - time(NULL);
+    if (remaining_time < 1){
+        remaining_time = 1;
+    }
+    start_timer(referral_entry->expiry_ddt_cache_timer, remaining_time, referral_expiry, (void *)referral_entry);
+    return (GOOD);
+}
+
+/*
+ * Send a DDT Map Request for the prefix of the referral to the best DDT node of its parent
+ */
+int send_referral_prefetch(lispd_referral_cache_entry *referral_entry)
+{
+    lispd_referral_cache_entry  *parent_entry   = referral_entry->parent_node;
+    lispd_locators_list         *locators_list  = NULL;
+    lisp_addr_t                 *dst_rloc       = NULL;
+    uint32_t                    score           = 0;
+    uint32_t                    best_score      = 0;
+    uint64_t                    nonce           = 0;
+    map_request_opts            opts;
+    int                         ctr             = 0;
+
+    memset ( &opts, FALSE, sizeof(map_request_opts));
+    opts.encap              = TRUE;
+    opts.encap_opts.ddt_bit = TRUE;
+
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (ctr == 0 && (ctrl_supported_afi == AFI_SUPPORT_4 || ctrl_supported_afi == AFI_SUPPORT_4_6)){
+            locators_list = parent_entry->mapping->head_v4_locators_list;
+        }else if (ctr == 1 && (ctrl_supported_afi == AFI_SUPPORT_6 || ctrl_supported_afi == AFI_SUPPORT_4_6)){
+            locators_list = parent_entry->mapping->head_v6_locators_list;
+        }else{
+            continue;
+        }
+        for ( ; locators_list != NULL ; locators_list = locators_list->next){
+            score = get_ddt_node_score(locators_list->locator->locator_addr);
+            if (dst_rloc == NULL || score < best_score){
+                dst_rloc = locators_list->locator->locator_addr;
+                best_score = score;
+            }
+        }
+    }
+    if (dst_rloc == NULL){
+        return (ERR_DST_ADDR);
+    }
+
+    if (build_and_send_map_request_msg(referral_entry->mapping, NULL, dst_rloc, opts, &nonce) != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "send_referral_prefetch: Couldn't send DDT Map Request to refresh %s/%d",
+                get_char_from_lisp_addr_t(referral_entry->mapping->eid_prefix), referral_entry->mapping->eid_prefix_length);
+        return (BAD);
+    }
+    return (add_referral_cache_entry_prefetch(referral_entry, nonce));
+}
+
+int process_referral_prefetch_record(
+        uint8_t                     **offset,
+        lispd_referral_cache_entry  *referral_entry)
+{
+    uint8_t                                 *cur_ptr                    = *offset;
+    lispd_pkt_referral_mapping_record_t     *record                     = NULL;
+    lispd_referral_cache_entry              *new_referral_entry         = NULL;
+    lispd_mapping_elt                       *referral_mapping           = NULL;
+    lisp_addr_t                             aux_eid_prefix;
+    int                                     ctr                         = 0;
+
+    remove_referral_cache_entry_prefetch(referral_entry);
+
+    record = (lispd_pkt_referral_mapping_record_t *)(cur_ptr);
+    referral_mapping = new_mapping(aux_eid_prefix,0,0);
+    if (referral_mapping == NULL){
+        return (BAD);
+    }
+    cur_ptr = (uint8_t *)&(record->eid_prefix_afi);
+    if (pkt_process_eid_afi(&cur_ptr,referral_mapping) != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"process_referral_prefetch_record:  Error processing the EID of the map referral record");
+        free_mapping_elt(referral_mapping);
+        return (BAD);
+    }
+    referral_mapping->eid_prefix_length = record->eid_prefix_length;
+
+    new_referral_entry = new_referral_cache_entry(referral_mapping, record->action, ntohl(record->ttl));
+    if (new_referral_entry == NULL){
+        free_mapping_elt(referral_mapping);
+        return (BAD);
+    }
+    for (ctr=0 ; ctr < record->locator_count ; ctr++){
+        if ((process_map_referral_locator (&cur_ptr, new_referral_entry->mapping)) != GOOD){
+            free_referral_cache_entry(new_referral_entry);
+            return(BAD);
+        }
+    }
+    *offset = cur_ptr;
+
+    /*
+     * Only refresh the entry if the delegation has not changed. Otherwise the entry expires and the
+     * next resolution learns the new delegation.
+     */
+    if (new_referral_entry->act_entry_type != MS_REFERRAL ||
+            new_referral_entry->mapping->eid_prefix_length != referral_entry->mapping->eid_prefix_length ||
+            compare_lisp_addr_t(&(new_referral_entry->mapping->eid_prefix), &(referral_entry->mapping->eid_prefix)) != 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"process_referral_prefetch_record: Delegation of %s/%d has changed. Not refreshed",
+                get_char_from_lisp_addr_t(referral_entry->mapping->eid_prefix), referral_entry->mapping->eid_prefix_length);
+        free_referral_cache_entry(new_referral_entry);
+        return (GOOD);
+    }
+
+    lispd_log_msg(LISP_LOG_DEBUG_1,"process_referral_prefetch_record: Referral entry %s/%d refreshed. TTL: %d minutes",
+            get_char_from_lisp_addr_t(referral_entry->mapping->eid_prefix), referral_entry->mapping->eid_prefix_length,
+            new_referral_entry->ttl);
+    update_referral_cache_data(referral_entry, new_referral_entry);
+    free_referral_cache_entry(new_referral_entry);
+    program_referral_expiry_timer(referral_entry);
+
+    return (GOOD);
 }
 
 /*
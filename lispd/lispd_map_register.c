@@ -40,17 +40,21 @@
 	#include <openssl/evp.h>
 #endif
 #include "lispd_external.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_map_register.h"
+#include "lispd_nat_rtr.h"
 #include "lispd_map_request.h"
 #include "lispd_pkt_lib.h"
 #include "lispd_sockets.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
 #include "patricia/patricia.h"
 #include "lispd_info_request.h"
 
-int map_register_process();
 int encapsulated_map_register_process();
+static int is_mapping_behind_nat(lispd_mapping_elt *mapping);
 
 
 /*
@@ -81,12 +85,17 @@ int map_register(
             result = initial_info_request_process();
         }
 
-        if(nat_status == FULL_NAT){
+        /*
+         * The mappings of the interfaces behind NAT register through their RTR with their own timers.
+         * They are restarted unless we are called by the timer of the standard Map-Register
+         */
+        if(t == NULL && (nat_status == FULL_NAT || nat_status == PARTIAL_NAT)){
             result = encapsulated_map_register_process();
         }
     }
 
-    if((nat_aware == FALSE)||((nat_aware == TRUE)&&(nat_status ==NO_NAT ))){/* Standard Map-Register mechanism */
+    /* Standard Map-Register mechanism. With PARTIAL_NAT, for the interfaces not behind NAT */
+    if((nat_aware == FALSE)||((nat_aware == TRUE)&&(nat_status == NO_NAT || nat_status == PARTIAL_NAT))){
         result = map_register_process();
     }
 
@@ -113,7 +122,12 @@ int map_register_process()
         }
         PATRICIA_WALK(tree->head, node) {
             mapping = ((lispd_mapping_elt *)(node->data));
-            if (mapping->locator_count != 0){
+            /* With PARTIAL_NAT, the mappings behind NAT are registered through their RTR */
+            if (nat_aware == TRUE && is_mapping_behind_nat(mapping) == TRUE){
+                lispd_log_msg(LISP_LOG_DEBUG_2, "map_register: %s/%d is registered through its RTR",
+                        get_char_from_lisp_addr_t(mapping->eid_prefix),
+                        mapping->eid_prefix_length);
+            }else if (mapping->locator_count != 0){
 
                 err = build_and_send_map_register_msg(mapping);
                 if (err != GOOD){
@@ -136,102 +150,149 @@ int map_register_process()
     return(GOOD);
 }
 
+/*
+ * Return TRUE if a locator of the mapping is behind NAT (it has the RTRs of its interface).
+ * The Encapsulated Map-Register of the mapping already carries all its locators, and a standard
+ * Map-Register with the private addresses would replace the registration done by the RTR.
+ */
+static int is_mapping_behind_nat(lispd_mapping_elt *mapping)
+{
+    lispd_locators_list         *locators_list  = NULL;
+    lcl_locator_extended_info   *extended_info  = NULL;
+
+    locators_list = mapping->head_v4_locators_list;
+    while (locators_list != NULL){
+        extended_info = (lcl_locator_extended_info *)locators_list->locator->extended_info;
+        if (extended_info != NULL && extended_info->rtr_locators_list != NULL){
+            return (TRUE);
+        }
+        locators_list = locators_list->next;
+    }
+    return (FALSE);
+}
+
+
 int encapsulated_map_register_process()
 {
-    patricia_tree_t           *dbs[2]           = {NULL,NULL};
-    patricia_tree_t           *tree             = NULL;
-    patricia_node_t           *node             = NULL;
-    lispd_mapping_elt         *mapping          = NULL;
-    lispd_locators_list       *locators_list[2] = {NULL, NULL};
-    lispd_locator_elt         *locator          = NULL;
-    lisp_addr_t               *nat_rtr          = NULL;
-    int                       next_timer_time   = 0;
-    int                       ctr               = 0;
-    int                       ctr1              = 0;
+    lispd_iface_list_elt    *iface_list     = NULL;
+
+    iface_list = get_head_interface_list();
+    while (iface_list != NULL){
+        if (iface_list->iface->nat_status == FULL_NAT){
+            iface_encapsulated_map_register(iface_list->iface);
+        }
+        iface_list = iface_list->next;
+    }
+    return (GOOD);
+}
+
+
+int iface_encapsulated_map_register(lispd_iface_elt *iface)
+{
+    lispd_iface_mappings_list   *mappings_list  = NULL;
+
+    mappings_list = iface->head_mappings_list;
+    while (mappings_list != NULL){
+        if (mappings_list->use_ipv4_address == TRUE){
+            free (mappings_list->emr_nonce);
+            mappings_list->emr_nonce = NULL;
+            encapsulated_map_register(NULL, mappings_list);
+        }
+        mappings_list = mappings_list->next;
+    }
+    return (GOOD);
+}
 
-    dbs[0] = get_local_db(AF_INET);
-    dbs[1] = get_local_db(AF_INET6);
 
+int encapsulated_map_register(
+        timer   *t,
+        void    *arg)
+{
+    lispd_iface_mappings_list   *mappings_list  = NULL;
+    lispd_iface_elt             *iface          = NULL;
+    lispd_mapping_elt           *mapping        = NULL;
+    lispd_locator_elt           *locator        = NULL;
+    lispd_rtr_locators_list     *rtr_list       = NULL;
+    lispd_rtr_locators_list     *aux_list       = NULL;
+    lispd_rtr_locator           *nat_rtr        = NULL;
+    uint64_t                    *nonce          = NULL;
+    int                         next_timer_time = 0;
+
+    mappings_list = (lispd_iface_mappings_list *)arg;
+    iface = mappings_list->iface;
+    mapping = mappings_list->mapping;
+
+    /* The mapping is registered through the RTR of its locator in the interface */
+    locator = get_locator_from_mapping(mapping, *(iface->ipv4_address));
+    if (locator == NULL || ((lcl_locator_extended_info *)locator->extended_info)->rtr_locators_list == NULL){
+        return (GOOD);
+    }
+    rtr_list = ((lcl_locator_extended_info *)locator->extended_info)->rtr_locators_list;
 
-    if (nat_emr_nonce == NULL){
-        nat_emr_nonce = new_nonces_list();
-        if (nat_emr_nonce == NULL){
-            lispd_log_msg(LISP_LOG_WARNING,"encapsulated_map_register_process: Unable to allocate memory for nonces.");
+    if (mappings_list->emr_nonce == NULL){
+        mappings_list->emr_nonce = new_nonces_list();
+        if (mappings_list->emr_nonce == NULL){
+            lispd_log_msg(LISP_LOG_WARNING,"encapsulated_map_register: Unable to allocate memory for nonces.");
             return (BAD);
         }
     }
-    if (nat_emr_nonce->retransmits <= LISPD_MAX_RETRANSMITS){
+    if (mappings_list->emr_nonce->retransmits <= LISPD_MAX_RETRANSMITS){
 
-        if (nat_emr_nonce->retransmits > 0){
-            lispd_log_msg(LISP_LOG_DEBUG_1,"No Map Notify received. Retransmitting encapsulated map register.");
+        if (mappings_list->emr_nonce->retransmits > 0){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"No Map Notify received. Retransmitting encapsulated map register of %s/%d through %s.",
+                    get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length, iface->iface_name);
         }
 
-        for (ctr = 0 ; ctr < 2 ; ctr++) {
-            tree = dbs[ctr];
-            if (!tree){
-                continue;
-            }
-            PATRICIA_WALK(tree->head, node) {
-                mapping = ((lispd_mapping_elt *)(node->data));
-                if (mapping->locator_count != 0){
-
-                    /* Find the locator behind NAT */
-                    locators_list[0] = mapping->head_v4_locators_list;
-                    locators_list[1] = mapping->head_v6_locators_list;
-                    for (ctr1 = 0 ; ctr1 < 2 ; ctr1++){
-                        while (locators_list[ctr1] != NULL){
-                            locator = locators_list[ctr1]->locator;
-                            if ((((lcl_locator_extended_info *)locator->extended_info)->rtr_locators_list) != NULL){
-                                break;
-                            }
-                            locator = NULL;
-                            locators_list[ctr1] = locators_list[ctr1]->next;
-                        }
-                        if (locator != NULL){
-                            break;
-                        }
-                    }
-                    /* If found a locator behind NAT, send Encapsulated Map Register */
-                    if (locator != NULL && default_ctrl_iface_v4 != NULL){
-                        nat_rtr = &(((lcl_locator_extended_info *)locator->extended_info)->rtr_locators_list->locator->address);
-                        /* ECM map register only sent to the first Map Server */
-                        err = build_and_send_ecm_map_register(mapping,
-                                map_servers,
-                                nat_rtr,
-                                default_ctrl_iface_v4,
-                                &site_ID,
-                                &xTR_ID,
-                                &(nat_emr_nonce->nonce[nat_emr_nonce->retransmits]));
-                        if (err != GOOD){
-                            lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register_process: Couldn't send encapsulated map register.");
-                        }
-                        nat_emr_nonce->retransmits++;
-                    }else{
-                        if (locator == NULL){
-                            lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register_process: Couldn't send encapsulated map register. No RTR found");
-                        }else{
-                            lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register_process: Couldn't send encapsulated map register. No output interface found");
-                        }
-                    }
-                    next_timer_time = LISPD_INITIAL_EMR_TIMEOUT;
+        nat_rtr = select_rtr_locator(rtr_list, NULL);
+        nonce = &(mappings_list->emr_nonce->nonce[mappings_list->emr_nonce->retransmits]);
+        /* ECM map register only sent to the first Map Server */
+        err = build_and_send_ecm_map_register(mapping,
+                map_servers,
+                &(nat_rtr->address),
+                iface,
+                &site_ID,
+                &xTR_ID,
+                nonce);
+        if (err != GOOD){
+            lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register: Couldn't send encapsulated map register of %s/%d through %s.",
+                    get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length, iface->iface_name);
+        }else{
+            nat_rtr->registered = TRUE;
+        }
+        /*
+         * The flows shared among the RTRs come back through the RTR they were sent to: register
+         * the mapping through all the RTRs up, with the same nonce
+         */
+        if (rtr_load_sharing == TRUE){
+            for (aux_list = rtr_list ; aux_list != NULL ; aux_list = aux_list->next){
+                if (aux_list->locator == nat_rtr || aux_list->locator->state != UP){
+                    continue;
                 }
-            }PATRICIA_WALK_END;
+                if (build_and_send_ecm_map_register(mapping, map_servers, &(aux_list->locator->address),
+                        iface, &site_ID, &xTR_ID, nonce) == GOOD){
+                    aux_list->locator->registered = TRUE;
+                }
+            }
         }
+        mappings_list->emr_nonce->retransmits++;
+        next_timer_time = LISPD_INITIAL_EMR_TIMEOUT;
 
     }else{
-        free (nat_emr_nonce);
-        nat_emr_nonce = NULL;
-        lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register_process: Communication error between LISPmob and RTR/MS. Retry after %d seconds",MAP_REGISTER_INTERVAL);
+        free (mappings_list->emr_nonce);
+        mappings_list->emr_nonce = NULL;
+        lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register: Communication error between LISPmob and RTR/MS registering %s/%d through %s. "
+                "Retry after %d seconds", get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length,
+                iface->iface_name, MAP_REGISTER_INTERVAL);
         next_timer_time = MAP_REGISTER_INTERVAL;
     }
 
     /*
-     * Configure timer to send the next map register.
+     * Configure timer to send the next encapsulated map register of the mapping.
      */
-    if (map_register_timer == NULL) {
-        map_register_timer = create_timer(MAP_REGISTER_TIMER);
+    if (mappings_list->emr_timer == NULL) {
+        mappings_list->emr_timer = create_timer(MAP_REGISTER_TIMER);
     }
-    start_timer(map_register_timer, next_timer_time, map_register, NULL);
+    start_timer(mappings_list->emr_timer, next_timer_time, encapsulated_map_register, mappings_list);
     return(GOOD);
 }
 
@@ -336,6 +397,11 @@ int build_and_send_map_register_msg(lispd_mapping_elt *mapping)
                     mapping->eid_prefix_length,
                     get_char_from_lisp_addr_t(*(ms->address)));
             sent_map_registers++;
+            stats.map_registers_sent++;
+            if (trace_enabled == TRUE){
+                trace_control_msg("sent", LISP_MAP_REGISTER, ms->address, &(mapping->eid_prefix), 0);
+            }
+            flight_record(FLIGHT_MAP_REGISTER_SENT, &(mapping->eid_prefix), mapping->eid_prefix_length, 0, 0, 0);
         }else{
             lispd_log_msg(LISP_LOG_WARNING, "Couldn't send Map Register for %s to the Map Server %s",
                     get_char_from_lisp_addr_t(mapping->eid_prefix),
@@ -451,8 +517,10 @@ int build_and_send_ecm_map_register(
 
     /* XXX Quick hack */
     /* Cisco IOS RTR implementation drops Data-Map-Notify if ECM Map Register nonce = 0 */
-    map_register_pkt->nonce = build_nonce((unsigned int) time(NULL));
-    *nonce = map_register_pkt->nonce;
+    if (*nonce == 0){
+        *nonce = build_nonce((unsigned int) time(NULL));
+    }
+    map_register_pkt->nonce = *nonce;
 
     /* Add xTR-ID and site-ID fields */
 
@@ -552,6 +620,12 @@ int build_and_send_ecm_map_register(
                 mapping->eid_prefix_length,
                 get_char_from_lisp_addr_t(*(map_server->address)),
                 get_char_from_lisp_addr_t(*nat_rtr_addr));
+        stats.map_registers_sent++;
+        if (trace_enabled == TRUE){
+            trace_control_msg("sent", LISP_MAP_REGISTER, map_server->address, &(mapping->eid_prefix), 0);
+        }
+        flight_record(FLIGHT_MAP_REGISTER_SENT, &(mapping->eid_prefix), mapping->eid_prefix_length,
+                FLIGHT_FLAG_ENCAP, 0, *nonce);
         result = GOOD;
     }else{
         lispd_log_msg(LISP_LOG_DEBUG_1, "build_and_send_ecm_map_register: Couldn't sent Encapsulated Map-Register message for %s/%d to Map Server at %s through RTR %s",
@@ -131,6 +131,24 @@ typedef struct lispd_pkt_map_register_t_ {
 
 int map_register(timer *t, void *arg);
 
+/*
+ * Send a Map-Register for each local mapping with locators
+ */
+int map_register_process();
+
+/*
+ * Start a new cycle of Encapsulated Map-Registers through the RTR of the interface for each
+ * mapping with a locator in the interface. The interface should be behind NAT.
+ * Each mapping has its own nonces and timer, so its retransmissions don't depend on the others.
+ */
+int iface_encapsulated_map_register(lispd_iface_elt *iface);
+
+/*
+ * Timer callback of the Encapsulated Map-Registers of a mapping through an interface.
+ * The argument is the lispd_iface_mappings_list element of the mapping in the interface
+ */
+int encapsulated_map_register(timer *t, void *arg);
+
 uint8_t *build_map_register_pkt(
         lispd_mapping_elt       *mapping,
         int                     *mrp_len);
@@ -141,6 +159,11 @@ uint8_t *build_map_register_pkt(
 
 int build_and_send_map_register_msg(lispd_mapping_elt *mapping);
 
+/*
+ * Build and send an Encapsulated Map-Register of the mapping through the RTR. The nonce is
+ * generated and returned if *nonce is 0, otherwise it is used (copies sent through other RTRs)
+ */
+
 int build_and_send_ecm_map_register(
         lispd_mapping_elt           *mapping,
         lispd_map_server_list_t     *map_servers,
@@ -65,13 +65,19 @@
 #include "cksum.h"
 #include "lispd_afi.h"
 #include "lispd_external.h"
+#include "lispd_fastpath.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_map_reply.h"
+#include "lispd_map_resolver.h"
+#include "lispd_nat_rtr.h"
 #include "lispd_pkt_lib.h"
 #include "lispd_rloc_probing.h"
 #include "lispd_sockets.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
 
 /********************************** Function declaration ********************************/
 
@@ -112,6 +118,7 @@ int process_map_reply(uint8_t *packet)
     //uint8_t                     rloc_probe;
     int                         record_count;
     int                         ctr;
+    uint32_t                    latency         = 0;
 
     mrp = (lispd_pkt_map_reply_t *)packet;
     nonce = mrp->nonce;
@@ -119,6 +126,16 @@ int process_map_reply(uint8_t *packet)
 
     lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_reply: Nonce of the Map Reply is: %s", get_char_from_nonce(nonce));
 
+    /* Update the RTT of the Map Resolver that answered the request */
+    if (mrp->rloc_probe == FALSE){
+        latency = map_resolver_reply_received(nonce);
+    }
+    flight_record(FLIGHT_MAP_REPLY_RECEIVED, NULL, 0, mrp->rloc_probe ? FLIGHT_FLAG_PROBE : 0, latency, nonce);
+    if (mrp->rloc_probe == TRUE && rtr_probe_reply_received(nonce) == GOOD){
+        /* Probe sent to measure the latency of an RTR */
+        return (TRUE);
+    }
+
     packet = CO(packet, sizeof(lispd_pkt_map_reply_t));
     for (ctr=0;ctr<record_count;ctr++){
         if (mrp->rloc_probe == FALSE){
@@ -252,6 +269,9 @@ int process_map_reply_record(uint8_t **cur_ptr, uint64_t nonce)
                 cache_entry->mapping,
                 &(((rmt_mapping_extended_info *)cache_entry->mapping->extended_info)->rmt_balancing_locators_vecs));
     }
+    /* Offload to the kernel the native forwarding of negative entries */
+    program_native_forward_rule(cache_entry);
+    fastpath_update_map_cache_entry(cache_entry);
     /*
      * Reprogramming timers
      */
@@ -341,6 +361,7 @@ int process_map_reply_probe_record(
             rmt_locator_ext_inf = (rmt_locator_extended_info *)(aux_locator->extended_info);
             /* Check the nonce of the message match with the one stored in the structure of the locator */
             if ((check_nonce(rmt_locator_ext_inf->rloc_probing_nonces,nonce)) == GOOD){
+                rloc_probe_reply_received(aux_locator);
                 free(rmt_locator_ext_inf->rloc_probing_nonces);
                 rmt_locator_ext_inf->rloc_probing_nonces = NULL;
                 if (locators_probed == 0){
@@ -371,6 +392,7 @@ int process_map_reply_probe_record(
                     aux_locator = locators_list[ctr]->locator;
                     rmt_locator_ext_inf = (rmt_locator_extended_info *)(aux_locator->extended_info);
                     if ((check_nonce(rmt_locator_ext_inf->rloc_probing_nonces,nonce)) == GOOD){
+                        rloc_probe_reply_received(aux_locator);
                         free (rmt_locator_ext_inf->rloc_probing_nonces);
                         rmt_locator_ext_inf->rloc_probing_nonces = NULL;
                         locator = aux_locator;
@@ -403,6 +425,7 @@ int process_map_reply_probe_record(
 
     if (*(locator->state) == DOWN){
         *(locator->state) = UP;
+        flight_record(FLIGHT_RLOC_STATE, locator->locator_addr, 0, FLIGHT_FLAG_UP, 0, 0);
 
         lispd_log_msg(LISP_LOG_DEBUG_1,"Map-Reply Probe received for locator %s -> Locator state changes to UP",
                            get_char_from_lisp_addr_t(*(locator->locator_addr)));
@@ -411,6 +434,7 @@ int process_map_reply_probe_record(
         calculate_balancing_vectors (
                 cache_entry->mapping,
                 &(((rmt_mapping_extended_info *)cache_entry->mapping->extended_info)->rmt_balancing_locators_vecs));
+        fastpath_update_map_cache_entry(cache_entry);
     }
     /*
      * Reprogramming timers of rloc probing
@@ -605,6 +629,12 @@ int build_and_send_map_reply_msg(
     /* Send the packet */
 
     if ((err = send_packet(out_socket,packet,packet_len)) == GOOD){
+        stats.map_replies_sent++;
+        if (trace_enabled == TRUE){
+            trace_control_msg("sent", LISP_MAP_REPLY, dst_rloc_addr, &(requested_mapping->eid_prefix), nonce);
+        }
+        flight_record(FLIGHT_MAP_REPLY_SENT, &(requested_mapping->eid_prefix), requested_mapping->eid_prefix_length,
+                opts.rloc_probe ? FLIGHT_FLAG_PROBE : 0, 0, nonce);
         if (opts.rloc_probe == TRUE){
             lispd_log_msg(LISP_LOG_DEBUG_1, "Sent Map-Reply packet for %s/%d probing local locator %s",
                     get_char_from_lisp_addr_t(requested_mapping->eid_prefix),
@@ -89,11 +89,14 @@
 
 #include "cksum.h"
 #include "lispd_afi.h"
+#include "lispd_ddt_node.h"
 #include "lispd_external.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_iface_list.h"
 #include "lispd_lib.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_map_referral.h"
+#include "lispd_map_resolver.h"
 #include "lispd_map_reply.h"
 #include "lispd_map_request.h"
 #include "lispd_nonce.h"
@@ -101,6 +104,8 @@
 #include "lispd_referral_cache_db.h"
 #include "lispd_smr.h"
 #include "lispd_sockets.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
 #include "patricia/patricia.h"
 #include <time.h>
 
@@ -210,6 +215,8 @@ int process_map_request_record(
              free_mapping_elt(source_mapping);
              return (BAD);
          }
+         flight_record(FLIGHT_SMR_RECEIVED, &(map_cache_entry->mapping->eid_prefix),
+                 map_cache_entry->mapping->eid_prefix_length, 0, 0, msg->nonce);
          /* Free source_mapping once we have a valid map cache entry */
          free_mapping_elt(source_mapping);
 
@@ -395,6 +402,20 @@ int build_and_send_map_request_msg(
                         (opts.solicit_map_request == TRUE ? 'Y' : 'N'),
                         (opts.smr_invoked == TRUE ? 'Y' : 'N'),
                         get_char_from_nonce(*nonce));
+        if (opts.probe == TRUE){
+            stats.rloc_probes_sent++;
+        }else if (opts.solicit_map_request == TRUE){
+            stats.smrs_sent++;
+        }else{
+            stats.map_requests_sent++;
+        }
+        if (trace_enabled == TRUE){
+            trace_control_msg("sent", LISP_MAP_REQUEST, dst_rloc_addr, &(requested_mapping->eid_prefix), *nonce);
+        }
+        flight_record(FLIGHT_MAP_REQUEST_SENT, &(requested_mapping->eid_prefix), requested_mapping->eid_prefix_length,
+                (opts.encap ? FLIGHT_FLAG_ENCAP : 0) | (opts.probe ? FLIGHT_FLAG_PROBE : 0) |
+                (opts.solicit_map_request ? FLIGHT_FLAG_SMR : 0) | (opts.smr_invoked ? FLIGHT_FLAG_SMR_INVOKED : 0),
+                0, *nonce);
         result = GOOD;
     }else{
         lispd_log_msg(LISP_LOG_DEBUG_1, "Couldn't sent Map-Request packet for %s/%d: Encap: %c, Probe: %c, SMR: %c, SMR-inv: %c ",
@@ -647,6 +668,9 @@ int send_map_request_miss(timer *t, void *arg)
     nonces_list                         *nonces = map_cache_entry->nonces;
     lisp_addr_t                         *dst_rloc = NULL;
     map_request_opts                    opts;
+    int                                 timeout = 0;
+    int                                 hedge_deadline = 0;
+    int                                 ctr = 0;
 
     memset ( &opts, FALSE, sizeof(map_request_opts));
 
@@ -666,13 +690,30 @@ int send_map_request_miss(timer *t, void *arg)
         }
 
         if (nonces->retransmits > 0){
-            lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting Map Request for EID: %s (%d retries)",
-                    get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
-                    nonces->retransmits);
+            if (argument->hedge_pending == TRUE){
+                lispd_log_msg(LISP_LOG_DEBUG_1,"Sending hedged Map Request for EID: %s",
+                        get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix));
+            }else{
+                lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting Map Request for EID: %s (%d retries)",
+                        get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
+                        nonces->retransmits);
+                /* The previous requests have not been answered on time */
+                for (ctr = 0 ; ctr < nonces->retransmits ; ctr++){
+                    map_resolver_request_timeout(nonces->nonce[ctr]);
+                }
+            }
         }
 
-        /* Get the RLOC of the Map Resolver to be used */
-        dst_rloc = get_map_resolver();
+        /*
+         * Get the RLOC of the Map Resolver to be used. Retransmissions and hedged requests
+         * are sent to a different Map Resolver when possible
+         */
+        if (argument->map_resolver != NULL){
+            dst_rloc = get_map_resolver_excluding(argument->map_resolver);
+        }
+        if (dst_rloc == NULL){
+            dst_rloc = get_map_resolver();
+        }
 
         opts.encap = TRUE;
         if ((dst_rloc == NULL) || (build_and_send_map_request_msg(
@@ -683,10 +724,28 @@ int send_map_request_miss(timer *t, void *arg)
                 &nonces->nonce[nonces->retransmits]))==BAD){
             lispd_log_msg (LISP_LOG_DEBUG_1, "send_map_request_miss: Couldn't send map request for a new map cache entry");
 
+        }else{
+            map_resolver_request_sent(dst_rloc, nonces->nonce[nonces->retransmits]);
         }
 
+        /*
+         * If the Map Resolver is usually faster than the timeout, a second request is sent
+         * to another Map Resolver when the expected reply time is exceeded
+         */
+        timeout = get_map_request_timeout(dst_rloc, argument->hedge_pending == TRUE ? 0 : nonces->retransmits);
+        if (nonces->retransmits == 0 && nonces->retransmits < map_request_retries){
+            hedge_deadline = get_map_request_hedge_deadline(dst_rloc);
+        }
+        if (hedge_deadline > 0 && hedge_deadline < timeout){
+            argument->hedge_pending = TRUE;
+            timeout = hedge_deadline;
+        }else{
+            argument->hedge_pending = FALSE;
+        }
+        argument->map_resolver = dst_rloc;
+
         nonces->retransmits ++;
-        start_timer(map_cache_entry->request_retry_timer, LISPD_INITIAL_MRQ_TIMEOUT,
+        start_timer(map_cache_entry->request_retry_timer, timeout,
                 send_map_request_miss, (void *)argument);
 
     }else{
@@ -694,6 +753,10 @@ int send_map_request_miss(timer *t, void *arg)
                         get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
                         map_cache_entry->mapping->eid_prefix_length,
                         nonces->retransmits -1);
+        /* The last request (and a hedged one) has not been answered either */
+        for (ctr = 0 ; ctr < nonces->retransmits ; ctr++){
+            map_resolver_request_timeout(nonces->nonce[ctr]);
+        }
         del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix,
                 map_cache_entry->mapping->eid_prefix_length);
 
@@ -718,9 +781,15 @@ int send_ddt_map_request_miss(timer *t, void *arg)
     nonces_list                         *nonces_map_cache       = map_cache_entry->nonces;
     lisp_addr_t                         *src_eid                = NULL;
     lisp_addr_t                         dst_rloc                = {.afi=AF_UNSPEC};
+    lisp_addr_t                         first_rloc              = {.afi=AF_UNSPEC};
     map_request_opts                    opts;
     lispd_referral_cache_entry          *referral_entry         = NULL;
+    lispd_referral_cache_entry          *ddt_nodes_referral     = NULL;
     lispd_mapping_elt                   *referral_mapping       = NULL;
+    uint64_t                            nonce                   = 0;
+    int                                 ddt_request_timeout     = 0;
+    int                                 hedge_deadline          = 0;
+    int                                 ctr                     = 0;
 
 
     memset ( &opts, FALSE, sizeof(map_request_opts));
@@ -742,55 +811,128 @@ int send_ddt_map_request_miss(timer *t, void *arg)
         nonces_map_cache = new_nonces_list();
         if (nonces_map_cache==NULL){
             lispd_log_msg(LISP_LOG_WARNING,"send_ddt_map_request_miss: Unable to allocate memory for nonces.");
-            free (nonces_referral);
+            free_pending_referral_cache_entry_nonces(pending_referral_entry);
             return (BAD);
         }
         map_cache_entry->nonces = nonces_map_cache;
         nonces_map_cache->retransmits = 1;
     }
+
+    /*
+     * Get the referral with the ddt nodes to be used to send the Map Request
+     */
+    if (pending_referral_entry->previous_referral->act_entry_type == MS_NOT_REGISTERED){
+        ddt_nodes_referral = pending_referral_entry->previous_referral->parent_node;
+    }else{
+        ddt_nodes_referral = pending_referral_entry->previous_referral;
+    }
+
+    opts.encap              = TRUE;
+    opts.encap_opts.ddt_bit = TRUE;
+
+    if (pending_referral_entry->hedge_pending == TRUE){
+        /*
+         * The asked ddt node has not answered in its usual response time. Ask also the next node of the
+         * referral without waiting for the timeout of the first request.
+         */
+        pending_referral_entry->hedge_pending = FALSE;
+        dst_rloc = get_ddt_locator_addr_at_position(pending_referral_entry, ddt_nodes_referral,
+                ctrl_supported_afi, pending_referral_entry->tried_locators + pending_referral_entry->asked_locators);
+        if (dst_rloc.afi != AF_UNSPEC){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"send_ddt_map_request_miss: Hedged DDT Map Request for EID %s to %s",
+                    get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
+                    get_char_from_lisp_addr_t(dst_rloc));
+            if ((build_and_send_map_request_msg(map_cache_entry->mapping, src_eid, &dst_rloc, opts, &nonce))!=GOOD){
+                lispd_log_msg (LISP_LOG_DEBUG_1, "send_ddt_map_request_miss: Couldn't send hedged Map Request");
+            }else{
+                ddt_node_request_sent(&dst_rloc);
+            }
+            add_nonce_to_pending_referral_cache_entry(pending_referral_entry, nonce, &dst_rloc);
+            if (nonces_map_cache->retransmits <= LISPD_MAX_RETRANSMITS){
+                nonces_map_cache->nonce[nonces_map_cache->retransmits] = nonce;
+                nonces_map_cache->retransmits ++;
+            }
+            pending_referral_entry->asked_locators ++;
+            start_timer(pending_referral_entry->ddt_request_retry_timer,
+                    get_ddt_request_timeout(&dst_rloc, nonces_referral->retransmits - 1),
+                    send_ddt_map_request_miss, (void *)pending_referral_entry);
+            return (GOOD);
+        }
+        /* No more nodes in the referral. Wait the timeout of the request already sent */
+        start_timer(pending_referral_entry->ddt_request_retry_timer, LISPD_INITIAL_DDT_MRQ_TIMEOUT,
+                send_ddt_map_request_miss, (void *)pending_referral_entry);
+        return (GOOD);
+    }
+
     if ( nonces_referral->retransmits - 1 <= map_request_retries ){
 
         if (nonces_referral->retransmits > 0){
             lispd_log_msg(LISP_LOG_DEBUG_1,"send_ddt_map_request_miss: Retransmiting DDT Map Request for EID: %s (%d retries)",
                     get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
                     nonces_referral->retransmits);
+            pending_referral_cache_entry_requests_timeout(pending_referral_entry);
+        }else{
+            pending_referral_entry->asked_locators = ddt_parallel_requests;
         }
+
         /*
-         * Get the RLOC of the ddt node to be used to send the Map Request
+         * Send the Map Request to the next ddt nodes of the referral. Nodes are sorted by priority and
+         * response time. Several nodes are asked at the same time when ddt-parallel-requests > 1.
+         * The first Map Referral received is used.
          */
-        if (pending_referral_entry->previous_referral->act_entry_type == MS_NOT_REGISTERED){
-            dst_rloc = get_ddt_locator_addr_at_position(pending_referral_entry->previous_referral->parent_node,
-                    ctrl_supported_afi, pending_referral_entry->tried_locators);
-        }else{
-            dst_rloc = get_ddt_locator_addr_at_position(pending_referral_entry->previous_referral,
-                    ctrl_supported_afi, pending_referral_entry->tried_locators);
+        nonces_map_cache->retransmits = 0;
+        ddt_request_timeout = 0;
+        for (ctr = 0 ; ctr < pending_referral_entry->asked_locators ; ctr++){
+            dst_rloc = get_ddt_locator_addr_at_position(pending_referral_entry, ddt_nodes_referral,
+                    ctrl_supported_afi, pending_referral_entry->tried_locators + ctr);
+            if (dst_rloc.afi == AF_UNSPEC){
+                break;
+            }
+            if ((build_and_send_map_request_msg(map_cache_entry->mapping, src_eid, &dst_rloc, opts, &nonce))!=GOOD){
+                lispd_log_msg (LISP_LOG_DEBUG_1, "send_ddt_map_request_miss: Couldn't send Map Request for a new map cache entry");
+            }else{
+                ddt_node_request_sent(&dst_rloc);
+            }
+            add_nonce_to_pending_referral_cache_entry(pending_referral_entry, nonce, &dst_rloc);
+            nonces_map_cache->nonce[nonces_map_cache->retransmits] = nonce;
+            nonces_map_cache->retransmits ++;
+            if (ctr == 0){
+                first_rloc = dst_rloc;
+                nonces_referral->nonce[nonces_referral->retransmits] = nonce;
+            }
+            /* The timeout doubles with each retransmission */
+            if (get_ddt_request_timeout(&dst_rloc, nonces_referral->retransmits) > ddt_request_timeout){
+                ddt_request_timeout = get_ddt_request_timeout(&dst_rloc, nonces_referral->retransmits);
+            }
         }
 
-        if (dst_rloc.afi == AF_UNSPEC){
+        if (ctr == 0){
             return (ERR_DST_ADDR);
         }
-
-
-        opts.encap              = TRUE;
-        opts.encap_opts.ddt_bit = TRUE;
-
-        if ((build_and_send_map_request_msg(
-                map_cache_entry->mapping,
-                src_eid,
-                &dst_rloc,
-                opts,
-                &nonces_referral->nonce[nonces_referral->retransmits]))!=GOOD){
-            lispd_log_msg (LISP_LOG_DEBUG_1, "send_ddt_map_request_miss: Couldn't send Map Request for a new map cache entry");
-
-        }
-        nonces_map_cache->nonce[0] = nonces_referral->nonce[nonces_referral->retransmits];
+        pending_referral_entry->asked_locators = ctr;
         nonces_referral->retransmits ++;
 
         if (pending_referral_entry->ddt_request_retry_timer == NULL){
             pending_referral_entry->ddt_request_retry_timer = create_timer (DDT_MAP_REQUEST_RETRY_TIMER);
         }
 
-        start_timer(pending_referral_entry->ddt_request_retry_timer, LISPD_INITIAL_DDT_MRQ_TIMEOUT,
+        /*
+         * If the node is slower than usual, ask the next node of the referral before the timeout expires.
+         * Only done for the first transmission to a single node.
+         */
+        if (nonces_referral->retransmits == 1 && pending_referral_entry->asked_locators == 1){
+            hedge_deadline = get_ddt_request_hedge_deadline(&first_rloc);
+            dst_rloc = get_ddt_locator_addr_at_position(pending_referral_entry, ddt_nodes_referral,
+                    ctrl_supported_afi, pending_referral_entry->tried_locators + 1);
+            if (hedge_deadline > 0 && hedge_deadline < ddt_request_timeout && dst_rloc.afi != AF_UNSPEC){
+                pending_referral_entry->hedge_pending = TRUE;
+                start_timer(pending_referral_entry->ddt_request_retry_timer, hedge_deadline,
+                        send_ddt_map_request_miss, (void *)pending_referral_entry);
+                return (GOOD);
+            }
+        }
+
+        start_timer(pending_referral_entry->ddt_request_retry_timer, ddt_request_timeout,
                 send_ddt_map_request_miss, (void *)pending_referral_entry);
 
     }else{ // End of retransmits. Try next node. If last node asked, activate negative map cache
@@ -799,9 +941,9 @@ int send_ddt_map_request_miss(timer *t, void *arg)
                 map_cache_entry->mapping->eid_prefix_length,
                 nonces_referral->retransmits -1);
 
-        pending_referral_entry->tried_locators = pending_referral_entry->tried_locators +1;
-        free (pending_referral_entry->nonces);
-        pending_referral_entry->nonces = NULL;
+        pending_referral_cache_entry_requests_timeout(pending_referral_entry);
+        pending_referral_entry->tried_locators = pending_referral_entry->tried_locators + pending_referral_entry->asked_locators;
+        free_pending_referral_cache_entry_nonces(pending_referral_entry);
 
         err = send_ddt_map_request_miss(NULL,arg);
         if (err == ERR_DST_ADDR){ // We asked all nodes without obtaining answer
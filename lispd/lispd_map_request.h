@@ -179,6 +179,8 @@ typedef struct {
 typedef struct _timer_map_request_argument{
     lispd_map_cache_entry   *map_cache_entry;
     lisp_addr_t             src_eid;
+    lisp_addr_t             *map_resolver;      // Map Resolver of the last transmitted request
+    uint8_t                 hedge_pending;      // Next expiration of the timer sends a hedged request
 } timer_map_request_argument;
 
 
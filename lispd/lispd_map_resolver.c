@@ -0,0 +1,441 @@
+/*
+ * lispd_map_resolver.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Pool of Map Resolvers ranked by measured RTT and loss.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <time.h>
+#include "lispd_external.h"
+#include "lispd_flight_recorder.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_map_resolver.h"
+#include "lispd_nonce.h"
+#include "lispd_stats.h"
+
+
+/*
+ * Map Request sent to a Map Resolver and still waiting for the Map Reply
+ */
+typedef struct {
+    uint64_t            nonce;
+    lispd_map_resolver  *map_resolver;
+    struct timespec     sent;
+} pending_map_request;
+
+
+static lispd_map_resolver   *mr_pool        = NULL;
+static int                  mr_pool_size    = 0;
+static pending_map_request  pending_requests[MAP_RESOLVER_PENDING_TABLE_SIZE];
+
+
+/********************************** Function declaration ********************************/
+
+static int build_map_resolver_pool();
+static lispd_map_resolver *get_map_resolver_stats(lisp_addr_t *address);
+static inline int is_map_resolver_usable(lispd_map_resolver *map_resolver);
+static inline uint32_t get_map_resolver_score(
+        lispd_map_resolver  *map_resolver,
+        time_t              now);
+static lispd_map_resolver *select_map_resolver(lisp_addr_t *excluded);
+static inline pending_map_request *get_pending_request_slot(uint64_t nonce);
+static pending_map_request *lookup_pending_request(uint64_t nonce);
+
+/****************************************************************************************/
+
+
+/*
+ * Return the Map Resolver with the best expected response time among the ones
+ * with a RLOC compatible with local RLOCs
+ */
+
+lisp_addr_t *get_map_resolver()
+{
+    lispd_map_resolver *map_resolver = NULL;
+
+    map_resolver = select_map_resolver(NULL);
+    if (map_resolver == NULL){
+        lispd_log_msg(LISP_LOG_ERR,"No Map Resolver with a RLOC compatible with local RLOCs");
+        return (NULL);
+    }
+    return (map_resolver->address);
+}
+
+/*
+ * Return the best Map Resolver different from the one indicated.
+ * Return NULL if there is no other Map Resolver available
+ */
+
+lisp_addr_t *get_map_resolver_excluding(lisp_addr_t *excluded)
+{
+    lispd_map_resolver *map_resolver = NULL;
+
+    map_resolver = select_map_resolver(excluded);
+    if (map_resolver == NULL){
+        return (NULL);
+    }
+    return (map_resolver->address);
+}
+
+/*
+ * Timeout in seconds to wait for the Map Reply of a Map Request sent to the
+ * Map Resolver: SRTT + 4 * RTTVAR rounded up to seconds, doubled for each
+ * previous attempt.
+ */
+
+int get_map_request_timeout(
+        lisp_addr_t     *map_resolver,
+        int             attempt)
+{
+    lispd_map_resolver  *mr_stats   = NULL;
+    int                 timeout     = LISPD_INITIAL_MRQ_TIMEOUT;
+
+    mr_stats = get_map_resolver_stats(map_resolver);
+    if (mr_stats != NULL && mr_stats->srtt != 0){
+        timeout = (mr_stats->srtt + 4 * mr_stats->rttvar + 999) / 1000;
+        if (timeout < LISPD_INITIAL_MRQ_TIMEOUT){
+            timeout = LISPD_INITIAL_MRQ_TIMEOUT;
+        }
+    }
+
+    while (attempt > 0 && timeout < LISPD_MAX_MRQ_TIMEOUT){
+        timeout = timeout << 1;
+        attempt--;
+    }
+    if (timeout > LISPD_MAX_MRQ_TIMEOUT){
+        timeout = LISPD_MAX_MRQ_TIMEOUT;
+    }
+    return (timeout);
+}
+
+/*
+ * Seconds after which a hedged Map Request should be sent to a second Map
+ * Resolver: SRTT + 2 * RTTVAR rounded up to seconds.
+ * Return 0 if no hedged Map Request should be sent.
+ */
+
+int get_map_request_hedge_deadline(lisp_addr_t *map_resolver)
+{
+    lispd_map_resolver  *mr_stats   = NULL;
+    int                 usable      = 0;
+    int                 deadline    = 0;
+    int                 ctr         = 0;
+
+    if (map_request_hedging == FALSE){
+        return (0);
+    }
+    mr_stats = get_map_resolver_stats(map_resolver);
+    if (mr_stats == NULL || mr_stats->srtt == 0){
+        return (0);
+    }
+    for (ctr = 0 ; ctr < mr_pool_size ; ctr++){
+        if (is_map_resolver_usable(&(mr_pool[ctr])) == TRUE){
+            usable++;
+        }
+    }
+    if (usable < 2){
+        return (0);
+    }
+
+    deadline = (mr_stats->srtt + 2 * mr_stats->rttvar + 999) / 1000;
+    if (deadline < 1){
+        deadline = 1;
+    }
+    return (deadline);
+}
+
+/*
+ * Register a Map Request sent to a Map Resolver to measure its RTT
+ */
+
+void map_resolver_request_sent(
+        lisp_addr_t     *map_resolver,
+        uint64_t        nonce)
+{
+    lispd_map_resolver  *mr_stats   = NULL;
+    pending_map_request *slot       = NULL;
+
+    mr_stats = get_map_resolver_stats(map_resolver);
+    if (mr_stats == NULL){
+        return;
+    }
+    mr_stats->requests++;
+
+    /* A collision overwrites the oldest request: only a RTT sample is lost */
+    slot = get_pending_request_slot(nonce);
+    slot->nonce = nonce;
+    slot->map_resolver = mr_stats;
+    clock_gettime(CLOCK_MONOTONIC, &(slot->sent));
+}
+
+/*
+ * Update the statistics of the Map Resolver with the nonce of a received Map Reply.
+ */
+
+uint32_t map_resolver_reply_received(uint64_t nonce)
+{
+    pending_map_request *slot       = NULL;
+    lispd_map_resolver  *mr_stats   = NULL;
+    uint32_t            rtt         = 0;
+    uint64_t            latency     = 0;
+
+    slot = lookup_pending_request(nonce);
+    if (slot == NULL){
+        return (0);
+    }
+    mr_stats = slot->map_resolver;
+    slot->map_resolver = NULL;
+
+    latency = get_elapsed_us(&(slot->sent));
+    histogram_record(&(stats.map_request_latency), latency);
+    rtt = get_elapsed_ms(&(slot->sent));
+    update_rtt_estimation(&(mr_stats->srtt), &(mr_stats->rttvar), rtt);
+    mr_stats->loss = mr_stats->loss - mr_stats->loss / 8;
+    mr_stats->replies++;
+    mr_stats->consecutive_timeouts = 0;
+
+    lispd_log_msg(LISP_LOG_DEBUG_3,"Map Resolver %s: rtt %u ms, srtt %u ms, rttvar %u ms",
+            get_char_from_lisp_addr_t(*(mr_stats->address)), rtt, mr_stats->srtt, mr_stats->rttvar);
+    return (latency);
+}
+
+/*
+ * Account a Map Request not replied on time as lost
+ */
+
+void map_resolver_request_timeout(uint64_t nonce)
+{
+    pending_map_request *slot       = NULL;
+    lispd_map_resolver  *mr_stats   = NULL;
+
+    slot = lookup_pending_request(nonce);
+    if (slot == NULL){
+        return;
+    }
+    mr_stats = slot->map_resolver;
+    slot->map_resolver = NULL;
+
+    mr_stats->loss = mr_stats->loss - mr_stats->loss / 8 + 1000 / 8;
+    mr_stats->timeouts++;
+    stats.map_request_timeouts++;
+    flight_record(FLIGHT_MAP_REQUEST_TIMEOUT, mr_stats->address, 0, 0, 0, nonce);
+    if (mr_stats->consecutive_timeouts < 255){
+        mr_stats->consecutive_timeouts++;
+    }
+    mr_stats->last_timeout = time(NULL);
+
+    if (mr_stats->consecutive_timeouts == MAP_RESOLVER_MAX_TIMEOUTS){
+        lispd_log_msg(LISP_LOG_WARNING,"Map Resolver %s doesn't answer. Using other Map Resolvers if available",
+                get_char_from_lisp_addr_t(*(mr_stats->address)));
+        dump_map_resolvers(LISP_LOG_DEBUG_1);
+    }
+}
+
+int get_pending_map_requests()
+{
+    int ctr     = 0;
+    int pending = 0;
+
+    for (ctr = 0 ; ctr < MAP_RESOLVER_PENDING_TABLE_SIZE ; ctr++){
+        if (pending_requests[ctr].map_resolver != NULL){
+            pending++;
+        }
+    }
+    return (pending);
+}
+
+void dump_map_resolvers(int log_level)
+{
+    int ctr = 0;
+
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    if (build_map_resolver_pool() != GOOD){
+        return;
+    }
+
+    lispd_log_msg(log_level,"*** Map Resolvers ***");
+    for (ctr = 0 ; ctr < mr_pool_size ; ctr++){
+        lispd_log_msg(log_level," %s: srtt %u ms, rttvar %u ms, loss %u.%u%%, requests %u, replies %u, timeouts %u%s",
+                get_char_from_lisp_addr_t(*(mr_pool[ctr].address)),
+                mr_pool[ctr].srtt,
+                mr_pool[ctr].rttvar,
+                mr_pool[ctr].loss / 10, mr_pool[ctr].loss % 10,
+                mr_pool[ctr].requests,
+                mr_pool[ctr].replies,
+                mr_pool[ctr].timeouts,
+                mr_pool[ctr].consecutive_timeouts >= MAP_RESOLVER_MAX_TIMEOUTS ? " (down)" : "");
+    }
+}
+
+
+/*
+ * The pool is built the first time it is required from the list of
+ * Map Resolvers obtained from the configuration
+ */
+
+static int build_map_resolver_pool()
+{
+    lispd_addr_list_t   *mr_elt = NULL;
+    int                 ctr     = 0;
+
+    if (mr_pool != NULL){
+        return (GOOD);
+    }
+
+    for (mr_elt = map_resolvers ; mr_elt != NULL ; mr_elt = mr_elt->next){
+        mr_pool_size++;
+    }
+    if (mr_pool_size == 0){
+        return (BAD);
+    }
+    if ((mr_pool = (lispd_map_resolver *)calloc(mr_pool_size, sizeof(lispd_map_resolver))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"build_map_resolver_pool: Unable to allocate memory for lispd_map_resolver: %s",
+                strerror(errno));
+        mr_pool_size = 0;
+        return (ERR_MALLOC);
+    }
+    for (mr_elt = map_resolvers ; mr_elt != NULL ; mr_elt = mr_elt->next){
+        mr_pool[ctr].address = mr_elt->address;
+        ctr++;
+    }
+    return (GOOD);
+}
+
+static lispd_map_resolver *get_map_resolver_stats(lisp_addr_t *address)
+{
+    int ctr = 0;
+
+    if (address == NULL || build_map_resolver_pool() != GOOD){
+        return (NULL);
+    }
+    for (ctr = 0 ; ctr < mr_pool_size ; ctr++){
+        if (mr_pool[ctr].address == address || compare_lisp_addr_t(mr_pool[ctr].address, address) == 0){
+            return (&(mr_pool[ctr]));
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * A Map Resolver is usable if we have a control interface of its AFI
+ */
+
+static inline int is_map_resolver_usable(lispd_map_resolver *map_resolver)
+{
+    switch (map_resolver->address->afi){
+    case AF_INET:
+        return (default_ctrl_iface_v4 != NULL);
+    case AF_INET6:
+        return (default_ctrl_iface_v6 != NULL);
+    default:
+        return (FALSE);
+    }
+}
+
+/*
+ * Expected time in ms to obtain a reply from the Map Resolver. Map Resolvers not
+ * measured yet get the best score in order to be probed. Map Resolvers down get
+ * a score just worse than the ones up: after MAP_RESOLVER_DOWN_RETRY_TIME seconds
+ * they are retried before the ones down more recently, or by a hedged request.
+ */
+
+static inline uint32_t get_map_resolver_score(
+        lispd_map_resolver  *map_resolver,
+        time_t              now)
+{
+    uint32_t score = 0;
+
+    if (map_resolver->consecutive_timeouts >= MAP_RESOLVER_MAX_TIMEOUTS){
+        if (now - map_resolver->last_timeout < MAP_RESOLVER_DOWN_RETRY_TIME){
+            return (MAP_RESOLVER_DOWN_SCORE);
+        }
+        return (MAP_RESOLVER_RETRY_SCORE);
+    }
+    if (map_resolver->srtt == 0){
+        return (0);
+    }
+    score = map_resolver->srtt + 2 * map_resolver->rttvar;
+    score += map_resolver->loss * (LISPD_INITIAL_MRQ_TIMEOUT * 1000) / 1000;
+    if (score >= MAP_RESOLVER_RETRY_SCORE){
+        score = MAP_RESOLVER_RETRY_SCORE - 1;
+    }
+    return (score);
+}
+
+static lispd_map_resolver *select_map_resolver(lisp_addr_t *excluded)
+{
+    lispd_map_resolver  *best       = NULL;
+    uint32_t            best_score  = 0;
+    uint32_t            score       = 0;
+    time_t              now         = 0;
+    int                 ctr         = 0;
+
+    if (build_map_resolver_pool() != GOOD){
+        return (NULL);
+    }
+    now = time(NULL);
+
+    /* IPv4 Map Resolvers are preferred when scores are equal, as in the configuration order */
+    for (ctr = 0 ; ctr < mr_pool_size ; ctr++){
+        if (is_map_resolver_usable(&(mr_pool[ctr])) == FALSE){
+            continue;
+        }
+        if (excluded != NULL && compare_lisp_addr_t(mr_pool[ctr].address, excluded) == 0){
+            continue;
+        }
+        score = get_map_resolver_score(&(mr_pool[ctr]), now);
+        if (best == NULL || score < best_score ||
+                (score == best_score && mr_pool[ctr].address->afi == AF_INET && best->address->afi != AF_INET)){
+            best = &(mr_pool[ctr]);
+            best_score = score;
+        }
+    }
+    return (best);
+}
+
+static inline pending_map_request *get_pending_request_slot(uint64_t nonce)
+{
+    return (&(pending_requests[nonce_hash(nonce) & (MAP_RESOLVER_PENDING_TABLE_SIZE - 1)]));
+}
+
+static pending_map_request *lookup_pending_request(uint64_t nonce)
+{
+    pending_map_request *slot = NULL;
+
+    slot = get_pending_request_slot(nonce);
+    if (slot->map_resolver == NULL || slot->nonce != nonce){
+        return (NULL);
+    }
+    return (slot);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,131 @@
+/*
+ * lispd_map_resolver.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Pool of Map Resolvers ranked by measured RTT and loss.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_MAP_RESOLVER_H_
+#define LISPD_MAP_RESOLVER_H_
+
+#include "lispd.h"
+
+/*
+ * Number of consecutive timeouts after which a Map Resolver is considered down.
+ * A down Map Resolver is only used when no other is available. After
+ * MAP_RESOLVER_DOWN_RETRY_TIME seconds since its last timeout, it is preferred to
+ * the Map Resolvers recently down, and it is the alternative of the hedged requests.
+ */
+#define MAP_RESOLVER_MAX_TIMEOUTS           3
+#define MAP_RESOLVER_DOWN_RETRY_TIME        60
+
+/* Scores of the Map Resolvers down: worse than any Map Resolver up */
+#define MAP_RESOLVER_DOWN_SCORE             0xFFFFFFFF
+#define MAP_RESOLVER_RETRY_SCORE            (MAP_RESOLVER_DOWN_SCORE - 1)
+
+/* Size of the table of Map Requests waiting for a reply. Must be power of 2 */
+#define MAP_RESOLVER_PENDING_TABLE_SIZE     4096
+
+/*
+ * Statistics of a Map Resolver obtained from the nonces of the
+ * Encapsulated Map Requests sent to it
+ */
+typedef struct lispd_map_resolver_ {
+    lisp_addr_t     *address;
+    uint32_t        srtt;                   // Smoothed RTT in ms. 0 if not measured yet
+    uint32_t        rttvar;                 // RTT variation in ms
+    uint32_t        loss;                   // Loss rate in 1/1000 (moving average)
+    uint32_t        requests;
+    uint32_t        replies;
+    uint32_t        timeouts;
+    uint8_t         consecutive_timeouts;
+    time_t          last_timeout;
+} lispd_map_resolver;
+
+
+/*
+ * Return the Map Resolver with the best expected response time among the ones
+ * with a RLOC compatible with local RLOCs
+ */
+lisp_addr_t *get_map_resolver();
+
+/*
+ * Return the best Map Resolver different from the one indicated. Used to send
+ * retransmissions and hedged requests to another Map Resolver.
+ * Return NULL if there is no other Map Resolver available
+ */
+lisp_addr_t *get_map_resolver_excluding(lisp_addr_t *excluded);
+
+/*
+ * Timeout in seconds to wait for the Map Reply of a Map Request sent to the
+ * Map Resolver. attempt is the number of previous transmissions and is used
+ * to apply exponential backoff up to LISPD_MAX_MRQ_TIMEOUT
+ */
+int get_map_request_timeout(
+        lisp_addr_t     *map_resolver,
+        int             attempt);
+
+/*
+ * Seconds after which a hedged Map Request should be sent to a second Map
+ * Resolver. Return 0 if hedging is disabled or the Map Resolver has not
+ * been measured yet.
+ */
+int get_map_request_hedge_deadline(lisp_addr_t *map_resolver);
+
+/*
+ * Register a Map Request sent to a Map Resolver to measure its RTT
+ */
+void map_resolver_request_sent(
+        lisp_addr_t     *map_resolver,
+        uint64_t        nonce);
+
+/*
+ * Update the statistics of the Map Resolver with the nonce of a received Map Reply.
+ * Nothing is done if the nonce doesn't belong to a Map Request sent to a Map Resolver.
+ * Return the latency of the request in microseconds (0 if unknown)
+ */
+uint32_t map_resolver_reply_received(uint64_t nonce);
+
+/*
+ * Account a Map Request not replied on time as lost
+ */
+void map_resolver_request_timeout(uint64_t nonce);
+
+/*
+ * Number of Map Requests sent to Map Resolvers still waiting for the Map Reply
+ */
+int get_pending_map_requests();
+
+/*
+ * Log the statistics of the Map Resolvers. Done when a Map Resolver is considered down
+ */
+void dump_map_resolvers(int log_level);
+
+#endif /* LISPD_MAP_RESOLVER_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,332 @@
+/*
+ * lispd_nat_rtr.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Selection of the RTR used by the locators behind NAT.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include "lispd_external.h"
+#include "lispd_lib.h"
+#include "lispd_local_db.h"
+#include "lispd_log.h"
+#include "lispd_map_request.h"
+#include "lispd_nat_rtr.h"
+#include "lispd_output.h"
+
+
+static timer    *rtr_probing_timer  = NULL;
+
+
+/********************************** Function declaration ********************************/
+
+static int rtr_probing(
+        timer   *t,
+        void    *arg);
+static int probe_rtr_locators(
+        lispd_mapping_elt           *mapping,
+        lispd_rtr_locators_list     *rtr_list);
+static lispd_rtr_locator *lookup_rtr_locator_by_nonce(uint64_t nonce);
+static inline int is_better_rtr_locator(
+        lispd_rtr_locator   *rtr,
+        lispd_rtr_locator   *best_rtr);
+static inline int is_load_sharing_rtr(
+        lispd_rtr_locator   *rtr,
+        uint32_t            max_latency);
+
+/****************************************************************************************/
+
+
+lispd_rtr_locator *select_rtr_locator(
+        lispd_rtr_locators_list     *rtr_list,
+        packet_tuple                *tuple)
+{
+    lispd_rtr_locators_list     *aux_list       = rtr_list;
+    lispd_rtr_locator           *best_rtr       = NULL;
+    uint32_t                    max_latency     = 0;
+    uint32_t                    candidates      = 0;
+    uint32_t                    pos             = 0;
+
+    if (rtr_list == NULL){
+        return (NULL);
+    }
+
+    while (aux_list != NULL){
+        if (aux_list->locator->state == UP && is_better_rtr_locator(aux_list->locator, best_rtr) == TRUE){
+            best_rtr = aux_list->locator;
+        }
+        aux_list = aux_list->next;
+    }
+    /* All the RTRs are down. Keep using the first one until one answers again */
+    if (best_rtr == NULL){
+        return (rtr_list->locator);
+    }
+    if (rtr_load_sharing == FALSE || tuple == NULL || best_rtr->latency == 0){
+        return (best_rtr);
+    }
+
+    /* The RTRs without the registration of our mappings couldn't send back the traffic */
+    max_latency = best_rtr->latency * RTR_LOAD_SHARING_LATENCY_FACTOR;
+    for (aux_list = rtr_list ; aux_list != NULL ; aux_list = aux_list->next){
+        if (is_load_sharing_rtr(aux_list->locator, max_latency) == TRUE){
+            candidates++;
+        }
+    }
+    if (candidates == 0){
+        return (best_rtr);
+    }
+    pos = get_hash_from_tuple(*tuple) % candidates;
+    for (aux_list = rtr_list ; aux_list != NULL ; aux_list = aux_list->next){
+        if (is_load_sharing_rtr(aux_list->locator, max_latency) == TRUE){
+            if (pos == 0){
+                return (aux_list->locator);
+            }
+            pos--;
+        }
+    }
+    return (best_rtr);
+}
+
+void programming_rtr_probing()
+{
+    if (rtr_probing_timer != NULL){
+        return;
+    }
+    rtr_probing_timer = create_timer(RTR_PROBING_TIMER);
+    if (rtr_probing_timer == NULL){
+        return;
+    }
+    /* First probe as soon as possible to select the RTR before sending traffic */
+    start_timer(rtr_probing_timer, 1, (timer_callback)rtr_probing, NULL);
+}
+
+int rtr_probe_reply_received(uint64_t nonce)
+{
+    lispd_rtr_locator   *rtr    = NULL;
+    uint32_t            rtt     = 0;
+
+    rtr = lookup_rtr_locator_by_nonce(nonce);
+    if (rtr == NULL){
+        return (BAD);
+    }
+    rtt = get_elapsed_ms(&(rtr->probe_time));
+    update_rtt_estimation(&(rtr->latency), &(rtr->rttvar), rtt);
+    rtr->probe_nonce = 0;
+    rtr->consecutive_timeouts = 0;
+    if (rtr->state == DOWN){
+        rtr->state = UP;
+        lispd_log_msg(LISP_LOG_DEBUG_1,"RTR %s answers again -> RTR state changes to UP",
+                get_char_from_lisp_addr_t(rtr->address));
+    }
+    lispd_log_msg(LISP_LOG_DEBUG_2,"rtr_probe_reply_received: RTR %s RTT %u ms (srtt %u ms)",
+            get_char_from_lisp_addr_t(rtr->address), rtt, rtr->latency);
+    return (GOOD);
+}
+
+void copy_rtr_locators_state(
+        lispd_rtr_locators_list     *old_list,
+        lispd_rtr_locators_list     *new_list)
+{
+    lispd_rtr_locators_list     *aux_list   = NULL;
+
+    while (new_list != NULL){
+        for (aux_list = old_list ; aux_list != NULL ; aux_list = aux_list->next){
+            if (compare_lisp_addr_t(&(aux_list->locator->address), &(new_list->locator->address)) == 0){
+                new_list->locator->state = aux_list->locator->state;
+                new_list->locator->latency = aux_list->locator->latency;
+                new_list->locator->rttvar = aux_list->locator->rttvar;
+                new_list->locator->probe_nonce = aux_list->locator->probe_nonce;
+                new_list->locator->probe_time = aux_list->locator->probe_time;
+                new_list->locator->consecutive_timeouts = aux_list->locator->consecutive_timeouts;
+                new_list->locator->registered = aux_list->locator->registered;
+                break;
+            }
+        }
+        new_list = new_list->next;
+    }
+}
+
+/*
+ * Send a Map Request probe to each RTR of the local locators behind NAT. A previous probe
+ * still without answer is accounted as a timeout.
+ */
+static int rtr_probing(
+        timer   *t,
+        void    *arg)
+{
+    patricia_tree_t         *dbs[2]             = {NULL,NULL};
+    patricia_node_t         *node               = NULL;
+    lispd_mapping_elt       *mapping            = NULL;
+    lispd_locators_list     *locators_list[2]   = {NULL,NULL};
+    lcl_locator_extended_info *lcl_ext_inf      = NULL;
+    int                     probed_rtrs         = 0;
+    int                     ctr                 = 0;
+    int                     ctr1                = 0;
+
+    dbs[0] = get_local_db(AF_INET);
+    dbs[1] = get_local_db(AF_INET6);
+
+    for (ctr = 0 ; ctr < 2 ; ctr++) {
+        if (dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(dbs[ctr]->head, node) {
+            mapping = ((lispd_mapping_elt *)(node->data));
+            locators_list[0] = mapping->head_v4_locators_list;
+            locators_list[1] = mapping->head_v6_locators_list;
+            for (ctr1 = 0 ; ctr1 < 2 ; ctr1++){
+                while (locators_list[ctr1] != NULL){
+                    lcl_ext_inf = (lcl_locator_extended_info *)locators_list[ctr1]->locator->extended_info;
+                    probed_rtrs += probe_rtr_locators(mapping, lcl_ext_inf->rtr_locators_list);
+                    locators_list[ctr1] = locators_list[ctr1]->next;
+                }
+            }
+        } PATRICIA_WALK_END;
+    }
+
+    /* No more locators behind NAT */
+    if (probed_rtrs == 0){
+        stop_timer(rtr_probing_timer);
+        rtr_probing_timer = NULL;
+        return (GOOD);
+    }
+    start_timer(rtr_probing_timer, RTR_PROBING_INTERVAL, (timer_callback)rtr_probing, NULL);
+    return (GOOD);
+}
+
+static int probe_rtr_locators(
+        lispd_mapping_elt           *mapping,
+        lispd_rtr_locators_list     *rtr_list)
+{
+    lispd_rtr_locator   *rtr        = NULL;
+    int                 probed_rtrs = 0;
+    map_request_opts    opts;
+
+    memset(&opts, FALSE, sizeof(map_request_opts));
+    opts.probe = TRUE;
+
+    while (rtr_list != NULL){
+        rtr = rtr_list->locator;
+        rtr_list = rtr_list->next;
+        probed_rtrs++;
+
+        if (rtr->probe_nonce != 0){
+            rtr->consecutive_timeouts++;
+            if (rtr->state == UP && rtr->consecutive_timeouts >= RTR_PROBE_MAX_TIMEOUTS){
+                rtr->state = DOWN;
+                lispd_log_msg(LISP_LOG_DEBUG_1,"rtr_probing: No Map-Reply Probe received from RTR %s -> RTR state changes to DOWN",
+                        get_char_from_lisp_addr_t(rtr->address));
+            }
+        }
+        if ((rtr->address.afi == AF_INET && default_ctrl_iface_v4 == NULL) ||
+                (rtr->address.afi == AF_INET6 && default_ctrl_iface_v6 == NULL)){
+            rtr->probe_nonce = 0;
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &(rtr->probe_time));
+        if (build_and_send_map_request_msg(mapping, NULL, &(rtr->address), opts, &(rtr->probe_nonce)) != GOOD){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"rtr_probing: Couldn't send Map-Request Probe to RTR %s",
+                    get_char_from_lisp_addr_t(rtr->address));
+            rtr->probe_nonce = 0;
+        }
+    }
+    return (probed_rtrs);
+}
+
+static lispd_rtr_locator *lookup_rtr_locator_by_nonce(uint64_t nonce)
+{
+    patricia_tree_t             *dbs[2]             = {NULL,NULL};
+    patricia_node_t             *node               = NULL;
+    lispd_mapping_elt           *mapping            = NULL;
+    lispd_locators_list         *locators_list[2]   = {NULL,NULL};
+    lispd_rtr_locators_list     *rtr_list           = NULL;
+    int                         ctr                 = 0;
+    int                         ctr1                = 0;
+
+    if (nonce == 0){
+        return (NULL);
+    }
+    dbs[0] = get_local_db(AF_INET);
+    dbs[1] = get_local_db(AF_INET6);
+
+    for (ctr = 0 ; ctr < 2 ; ctr++) {
+        if (dbs[ctr] == NULL){
+            continue;
+        }
+        PATRICIA_WALK(dbs[ctr]->head, node) {
+            mapping = ((lispd_mapping_elt *)(node->data));
+            locators_list[0] = mapping->head_v4_locators_list;
+            locators_list[1] = mapping->head_v6_locators_list;
+            for (ctr1 = 0 ; ctr1 < 2 ; ctr1++){
+                while (locators_list[ctr1] != NULL){
+                    rtr_list = ((lcl_locator_extended_info *)locators_list[ctr1]->locator->extended_info)->rtr_locators_list;
+                    while (rtr_list != NULL){
+                        if (rtr_list->locator->probe_nonce == nonce){
+                            return (rtr_list->locator);
+                        }
+                        rtr_list = rtr_list->next;
+                    }
+                    locators_list[ctr1] = locators_list[ctr1]->next;
+                }
+            }
+        } PATRICIA_WALK_END;
+    }
+    return (NULL);
+}
+
+/*
+ * An RTR with measured latency is preferred to one not measured yet
+ */
+static inline int is_better_rtr_locator(
+        lispd_rtr_locator   *rtr,
+        lispd_rtr_locator   *best_rtr)
+{
+    if (best_rtr == NULL){
+        return (TRUE);
+    }
+    if (rtr->latency == 0){
+        return (FALSE);
+    }
+    if (best_rtr->latency == 0 || rtr->latency < best_rtr->latency){
+        return (TRUE);
+    }
+    return (FALSE);
+}
+
+/*
+ * An RTR shares the flows if it is up, registered and its latency is not above max_latency
+ */
+static inline int is_load_sharing_rtr(
+        lispd_rtr_locator   *rtr,
+        uint32_t            max_latency)
+{
+    return (rtr->state == UP && rtr->registered == TRUE && rtr->latency != 0 && rtr->latency <= max_latency);
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,86 @@
+/*
+ * lispd_nat_rtr.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Selection of the RTR used by the locators behind NAT.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_NAT_RTR_H_
+#define LISPD_NAT_RTR_H_
+
+#include "lispd.h"
+#include "lispd_locator.h"
+
+/*
+ * Each RTR is probed every RTR_PROBING_INTERVAL seconds with a Map Request probe to
+ * measure its latency. After RTR_PROBE_MAX_TIMEOUTS consecutive probes without answer
+ * the RTR is considered down and is not selected while another RTR is up.
+ */
+#define RTR_PROBING_INTERVAL                10
+#define RTR_PROBE_MAX_TIMEOUTS              2
+
+/*
+ * With rtr-load-sharing enabled, the mappings are registered through all the RTRs up and
+ * flows are distributed among the registered RTRs whose latency is less than
+ * RTR_LOAD_SHARING_LATENCY_FACTOR times the latency of the best RTR
+ */
+#define RTR_LOAD_SHARING_LATENCY_FACTOR     2
+
+
+/*
+ * Return the RTR to be used to send the traffic of a locator behind NAT. The RTR with
+ * the lowest measured latency among the ones that are up is selected. If rtr-load-sharing
+ * is enabled and tuple is not NULL, the flow is assigned to one of the RTRs with similar
+ * latency using the hash of the tuple. Return NULL if the list is empty.
+ */
+lispd_rtr_locator *select_rtr_locator(
+        lispd_rtr_locators_list     *rtr_list,
+        packet_tuple                *tuple);
+
+/*
+ * Start probing the RTRs of the local locators behind NAT if not already done
+ */
+void programming_rtr_probing();
+
+/*
+ * Update the latency of the RTR that sent a Map Reply probe with the nonce.
+ * Return BAD if the nonce doesn't belong to a probe sent to an RTR
+ */
+int rtr_probe_reply_received(uint64_t nonce);
+
+/*
+ * Keep the measured latency and state of the RTRs of old_list that are still present
+ * in new_list. Used when the list of RTRs is refreshed by an Info Reply
+ */
+void copy_rtr_locators_state(
+        lispd_rtr_locators_list     *old_list,
+        lispd_rtr_locators_list     *new_list);
+
+#endif /* LISPD_NAT_RTR_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
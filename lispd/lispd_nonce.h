@@ -59,6 +59,15 @@ nonces_list *new_nonces_list();
 
 int check_nonce(nonces_list   *nonces, uint64_t nonce);
 
+/*
+ * Hash of the nonce to index tables. The low bits of the nonce come from the nanosecond clock:
+ * they are mixed (Fibonacci hashing) and the high bits of the product are returned
+ */
+static inline uint32_t nonce_hash(uint64_t nonce)
+{
+    return ((uint32_t)((nonce * 0x9E3779B97F4A7C15ULL) >> 32));
+}
+
 
 /*
  * Print 64-bit nonce in 0x%08x-0x%08x format.
@@ -30,14 +30,23 @@
 
 #include <assert.h>
 #include "bob/lookup3.c"
+#include "lispd_dns_snoop.h"
 #include "lispd_info_nat.h"
 #include "lispd_locator.h"
+#include "lispd_map_referral.h"
 #include "lispd_map_request.h"
 #include "lispd_mapping.h"
+#include "lispd_nat_rtr.h"
 #include "lispd_output.h"
 #include "lispd_pkt_lib.h"
 #include "lispd_referral_cache_db.h"
 #include "lispd_sockets.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
+
+
+static dscp_policy      dscp_policies[DSCP_VALUES];
+static int              dscp_policies_configured    = FALSE;
 
 
 /*
@@ -62,6 +71,25 @@ int select_src_rmt_locators_from_balancing_locators_vec (
         lispd_locator_elt   **src_locator,
         lispd_locator_elt   **dst_locator);
 
+static lispd_locator_elt *select_iface_locator(
+        lispd_locator_elt   **loc_vec,
+        int                 vec_len,
+        lispd_iface_elt     *iface);
+
+static lispd_locator_elt *select_lowest_rtt_locator(
+        lispd_locator_elt   **loc_vec,
+        int                 vec_len);
+
+static void build_replica_header(
+        uint8_t         *header,
+        uint8_t         *template_header,
+        int             headers_size,
+        lisp_addr_t     *dst_addr);
+
+static void output_stage_trace(
+        output_pkt_desc     *batch,
+        int                 count);
+
 
 
 void add_ip_header (
@@ -189,29 +217,55 @@ void add_lisp_header(
 
 }
 
-int encapsulate_packet(
+/*
+ * Write the outer IP, UDP and LISP headers of the packet just before it. position has to point to
+ * get_encap_headers_size(src_addr->afi) bytes before original_packet.
+ */
+void add_encap_headers(
+        uint8_t     *position,
         uint8_t     *original_packet,
         int         original_packet_length,
         lisp_addr_t *src_addr,
         lisp_addr_t *dst_addr,
         int         src_port,
         int         dst_port,
-        int         iid,
-        uint8_t     **encap_packet,
-        int         *encap_packet_size)
+        int         iid)
 {
-    int         extra_headers_size  = 0;
-    uint8_t     *new_packet         = NULL;
     struct      udphdr *udh         = NULL;
-    int         encap_afi           = 0;
-
     int         iphdr_len           = 0;
     int         udphdr_len          = 0;
     int         lisphdr_len         = 0;
 
-    encap_afi = src_addr->afi;
+    iphdr_len = get_encap_headers_size(src_addr->afi) - sizeof(struct udphdr) - sizeof(struct lisphdr);
+    udphdr_len = sizeof(struct udphdr);
+    lisphdr_len = sizeof(struct lisphdr);
+
+    memset(position, 0, iphdr_len + udphdr_len + lisphdr_len);
+
+    add_lisp_header(CO(position,iphdr_len + udphdr_len), iid);
+
+    add_udp_header(CO(position,iphdr_len),original_packet_length+lisphdr_len,src_port,dst_port);
+
+
+    add_ip_header(position,
+            original_packet,
+            original_packet_length+lisphdr_len+udphdr_len,
+            src_addr,
+            dst_addr);
+
+    /* UDP checksum mandatory for IPv6. Could be skipped if check disabled on receiver */
+    udh = (struct udphdr *)(position + iphdr_len);
+    udh->check = udp_checksum(udh,ntohs(udh->len),position,src_addr->afi);
+}
+
+/*
+ * Size of the headers added by the encapsulation with an outer header of the afi
+ */
+int get_encap_headers_size(int afi)
+{
+    int         iphdr_len           = 0;
 
-    switch (encap_afi){
+    switch (afi){
     case AF_INET:
         iphdr_len = sizeof(struct iphdr);
         break;
@@ -219,12 +273,24 @@ int encapsulate_packet(
         iphdr_len = sizeof(struct ip6_hdr);
         break;
     }
+    return (iphdr_len + sizeof(struct udphdr) + sizeof(struct lisphdr));
+}
 
+int encapsulate_packet(
+        uint8_t     *original_packet,
+        int         original_packet_length,
+        lisp_addr_t *src_addr,
+        lisp_addr_t *dst_addr,
+        int         src_port,
+        int         dst_port,
+        int         iid,
+        uint8_t     **encap_packet,
+        int         *encap_packet_size)
+{
+    int         extra_headers_size  = 0;
+    uint8_t     *new_packet         = NULL;
 
-    udphdr_len = sizeof(struct udphdr);
-    lisphdr_len = sizeof(struct lisphdr);
-
-    extra_headers_size = iphdr_len + udphdr_len + lisphdr_len;
+    extra_headers_size = get_encap_headers_size(src_addr->afi);
 
     new_packet = (uint8_t *) malloc (original_packet_length + extra_headers_size);
     if (new_packet == NULL){
@@ -232,26 +298,16 @@ int encapsulate_packet(
         return (BAD);
     }
 
-    memset(new_packet,0,original_packet_length+extra_headers_size);
-
     memcpy (new_packet + extra_headers_size, original_packet, original_packet_length);
 
-
-
-    add_lisp_header(CO(new_packet,iphdr_len + udphdr_len), iid);
-
-    add_udp_header(CO(new_packet,iphdr_len),original_packet_length+lisphdr_len,src_port,dst_port);
-
-
-    add_ip_header(new_packet,
-            original_packet,
-            original_packet_length+lisphdr_len+udphdr_len,
+    add_encap_headers(new_packet,
+            new_packet + extra_headers_size,
+            original_packet_length,
             src_addr,
-            dst_addr);
-
-    /* UDP checksum mandatory for IPv6. Could be skipped if check disabled on receiver */
-    udh = (struct udphdr *)(new_packet + iphdr_len);
-    udh->check = udp_checksum(udh,ntohs(udh->len),new_packet,encap_afi);
+            dst_addr,
+            src_port,
+            dst_port,
+            iid);
 
     *encap_packet = new_packet;
     *encap_packet_size = extra_headers_size + original_packet_length;
@@ -308,6 +364,9 @@ int forward_native(
 
 
     ret = send_packet(output_socket,packet_buf,pckt_length);
+    if (ret == GOOD){
+        stats.native_packets++;
+    }
 
     return (ret);
 
@@ -353,7 +412,7 @@ int fordward_to_petr(
     /* If the selected src locator is behind NAT, fordware to the RTR */
     loc_extended_info = (lcl_locator_extended_info *)outer_src_locator->extended_info;
     if (loc_extended_info->rtr_locators_list != NULL){
-        dst_addr = &(loc_extended_info->rtr_locators_list->locator->address);
+        dst_addr = &(select_rtr_locator(loc_extended_info->rtr_locators_list, &tuple)->address);
     }
 
     if (encapsulate_packet(original_packet,
@@ -376,6 +435,8 @@ int fordward_to_petr(
     }
 
     lispd_log_msg(LISP_LOG_DEBUG_3, "Fordwarded eid %s to petr",get_char_from_lisp_addr_t(extract_dst_addr_from_packet(original_packet)));
+    stats.encap_packets++;
+    stats.encap_bytes += encap_packet_size;
     free (encap_packet );
 
     return (GOOD);
@@ -384,7 +445,8 @@ int fordward_to_petr(
 int forward_to_natt_rtr(
         uint8_t             *original_packet,
         int                 original_packet_length,
-        lispd_locator_elt   *src_locator)
+        lispd_locator_elt   *src_locator,
+        packet_tuple        *tuple)
 {
 
     uint8_t                     *encap_packet       = NULL;
@@ -405,7 +467,7 @@ int forward_to_natt_rtr(
         return (BAD);
     }
     src_addr = src_locator->locator_addr;
-    dst_addr = &(rtr_locators_list->locator->address);
+    dst_addr = &(select_rtr_locator(rtr_locators_list, tuple)->address);
 
     lispd_log_msg(LISP_LOG_DEBUG_3, "Forwarding eid %s to NAT RTR",get_char_from_lisp_addr_t(extract_dst_addr_from_packet(original_packet)));
 
@@ -428,6 +490,8 @@ int forward_to_natt_rtr(
     }
 
     lispd_log_msg(LISP_LOG_DEBUG_3, "Fordwarded eid %s to NAT RTR",get_char_from_lisp_addr_t(extract_dst_addr_from_packet(original_packet)));
+    stats.encap_packets++;
+    stats.encap_bytes += encap_packet_size;
     free (encap_packet );
 
     return (GOOD);
@@ -534,6 +598,8 @@ int handle_map_cache_miss(
 
     arguments->map_cache_entry = entry;
     arguments->src_eid = *src_eid;
+    arguments->map_resolver = NULL;
+    arguments->hedge_pending = FALSE;
 
     if ((err=send_map_request_miss(NULL, (void *)arguments))!=GOOD){
         return (BAD);
@@ -554,6 +620,7 @@ int handle_map_cache_miss_with_ddt(
     lispd_referral_cache_entry          *referral_cache     = NULL;
     lispd_pending_referral_cache_entry  *pending_referral   = NULL;
     int                                 prefix_length       = 0;
+    int                                 ttl                 = 0;
 
     switch (requested_eid->afi){
     case AF_INET:
@@ -593,6 +660,21 @@ int handle_map_cache_miss_with_ddt(
         return (BAD);
     }
 
+    /* The EID belongs to a known delegation hole: No need to ask the DDT tree until the referral expires */
+    if (referral_cache->act_entry_type == DELEGATION_HOLE){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"handle_map_cache_miss_with_ddt: %s belongs to the delegation hole %s/%d. Activating negative map cache",
+                get_char_from_lisp_addr_t(*requested_eid),get_char_from_lisp_addr_t(referral_cache->mapping->eid_prefix),
+                referral_cache->mapping->eid_prefix_length);
+        ttl = (referral_cache->expiry_time - time(NULL) + 59) / 60;
+        if (activate_negative_map_cache (map_cache_entry, referral_cache->mapping->eid_prefix,
+                referral_cache->mapping->eid_prefix_length, ttl > 0 ? ttl : 1, MAPPING_ACT_NO_ACTION) != GOOD){
+            del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix, map_cache_entry->mapping->eid_prefix_length);
+            return (BAD);
+        }
+        return (GOOD);
+    }
+    referral_cache->hits++;
+
     lispd_log_msg(LISP_LOG_DEBUG_1,"handle_map_cache_miss_with_ddt: Start DDT process to resolve %s. Process started from prefix %s/%d",
             get_char_from_lisp_addr_t(*requested_eid),get_char_from_lisp_addr_t(referral_cache->mapping->eid_prefix),
             referral_cache->mapping->eid_prefix_length);
@@ -726,10 +808,16 @@ int select_src_rmt_locators_from_balancing_locators_vec (
     balancing_locators_vecs *dst_blv        = NULL;
     lispd_locator_elt       **src_loc_vec   = NULL;
     lispd_locator_elt       **dst_loc_vec   = NULL;
+    lispd_locator_elt       *locator        = NULL;
+    dscp_policy             *policy         = NULL;
 
     src_blv = &((lcl_mapping_extended_info *)(src_mapping->extended_info))->outgoing_balancing_locators_vecs;
     dst_blv = &((rmt_mapping_extended_info *)(dst_mapping->extended_info))->rmt_balancing_locators_vecs;
 
+    if (dscp_policies_configured == TRUE && dscp_policies[tuple.dscp].configured == TRUE){
+        policy = &(dscp_policies[tuple.dscp]);
+    }
+
 
     if (src_blv->balancing_locators_vec != NULL && dst_blv->balancing_locators_vec != NULL){
         src_loc_vec = src_blv->balancing_locators_vec;
@@ -756,6 +844,12 @@ int select_src_rmt_locators_from_balancing_locators_vec (
     }
     pos = hash%src_vec_len;
     *src_locator =  src_loc_vec[pos];
+    if (policy != NULL && policy->iface != NULL){
+        locator = select_iface_locator(src_loc_vec, src_vec_len, policy->iface);
+        if (locator != NULL){
+            *src_locator = locator;
+        }
+    }
 
     switch ((*src_locator)->locator_addr->afi){
     case (AF_INET):
@@ -772,6 +866,12 @@ int select_src_rmt_locators_from_balancing_locators_vec (
 
     pos = hash%dst_vec_len;
     *dst_locator =  dst_loc_vec[pos];
+    if (policy != NULL && policy->rloc_selection == RLOC_SELECT_LOWEST_RTT){
+        locator = select_lowest_rtt_locator(dst_loc_vec, dst_vec_len);
+        if (locator != NULL){
+            *dst_locator = locator;
+        }
+    }
 
     lispd_log_msg(LISP_LOG_DEBUG_3,"select_src_rmt_locators_from_balancing_locators_vec: "
             "src EID: %s, rmt EID: %s, protocol: %d, src port: %d , dst port: %d --> src RLOC: %s, dst RLOC: %s",
@@ -785,6 +885,118 @@ int select_src_rmt_locators_from_balancing_locators_vec (
 }
 
 
+/*
+ * Return the locator of the vector associated to the interface or NULL if the interface
+ * is not in the vector
+ */
+
+static lispd_locator_elt *select_iface_locator(
+        lispd_locator_elt   **loc_vec,
+        int                 vec_len,
+        lispd_iface_elt     *iface)
+{
+    int     ctr     = 0;
+
+    if (iface->status != UP){
+        return (NULL);
+    }
+    for (ctr = 0 ; ctr < vec_len ; ctr++){
+        if (loc_vec[ctr]->locator_addr == iface->ipv4_address ||
+                loc_vec[ctr]->locator_addr == iface->ipv6_address){
+            return (loc_vec[ctr]);
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * Return the locator of the vector with the lowest smoothed RTT or NULL if the RTT of none
+ * of them has been measured
+ */
+
+static lispd_locator_elt *select_lowest_rtt_locator(
+        lispd_locator_elt   **loc_vec,
+        int                 vec_len)
+{
+    lispd_locator_elt           *best_locator   = NULL;
+    rmt_locator_extended_info   *ext_info       = NULL;
+    uint32_t                    best_latency    = 0;
+    int                         ctr             = 0;
+
+    for (ctr = 0 ; ctr < vec_len ; ctr++){
+        ext_info = (rmt_locator_extended_info *)loc_vec[ctr]->extended_info;
+        if (ext_info->latency == 0 || *(loc_vec[ctr]->state) != UP){
+            continue;
+        }
+        if (best_locator == NULL || ext_info->latency < best_latency){
+            best_locator = loc_vec[ctr];
+            best_latency = ext_info->latency;
+        }
+    }
+    return (best_locator);
+}
+
+
+int set_dscp_policy(
+        int         dscp,
+        int         rloc_selection,
+        char        *iface_name)
+{
+    if (dscp < 0 || dscp >= DSCP_VALUES){
+        lispd_log_msg(LISP_LOG_WARNING, "set_dscp_policy: Invalid DSCP value: %d", dscp);
+        return (BAD);
+    }
+    /* The class may be redefined */
+    free(dscp_policies[dscp].iface_name);
+    dscp_policies[dscp].configured = TRUE;
+    dscp_policies[dscp].rloc_selection = rloc_selection;
+    dscp_policies[dscp].iface_name = (iface_name != NULL) ? strdup(iface_name) : NULL;
+    dscp_policies[dscp].iface = NULL;
+    dscp_policies_configured = TRUE;
+
+    return (GOOD);
+}
+
+
+void init_dscp_policies()
+{
+    int     ctr     = 0;
+
+    for (ctr = 0 ; ctr < DSCP_VALUES ; ctr++){
+        if (dscp_policies[ctr].configured == FALSE || dscp_policies[ctr].iface_name == NULL){
+            continue;
+        }
+        dscp_policies[ctr].iface = get_interface(dscp_policies[ctr].iface_name);
+        if (dscp_policies[ctr].iface == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "init_dscp_policies: Interface %s of the policy of DSCP %d is not used "
+                    "by any database-mapping. Ignoring it", dscp_policies[ctr].iface_name, ctr);
+        }
+    }
+}
+
+
+int is_dscp_policy_configured()
+{
+    return (dscp_policies_configured);
+}
+
+
+int is_lowest_rtt_policy_configured()
+{
+    int     ctr     = 0;
+
+    if (dscp_policies_configured == FALSE){
+        return (FALSE);
+    }
+    for (ctr = 0 ; ctr < DSCP_VALUES ; ctr++){
+        if (dscp_policies[ctr].configured == TRUE && dscp_policies[ctr].rloc_selection == RLOC_SELECT_LOWEST_RTT){
+            return (TRUE);
+        }
+    }
+    return (FALSE);
+}
+
+
 lisp_addr_t *get_default_locator_addr(
         lispd_map_cache_entry   *entry,
         int                     afi)
@@ -855,140 +1067,501 @@ int is_lisp_packet(
 }
 
 
-int lisp_output (
-        uint8_t *original_packet,
-        int     original_packet_length )
-{
-    lispd_mapping_elt           *src_mapping        = NULL;
-    lispd_mapping_elt           *dst_mapping        = NULL;
-    lispd_map_cache_entry       *entry              = NULL;
-    uint8_t                     *encap_packet       = NULL;
-    int                         encap_packet_size   = 0;
-    lispd_locator_elt           *outer_src_locator  = NULL;
-    lispd_locator_elt           *outer_dst_locator  = NULL;
-    lisp_addr_t                 *src_addr           = NULL;
-    lisp_addr_t                 *dst_addr           = NULL;
-    lcl_locator_extended_info   *loc_extended_info  = NULL;
-    int                         output_socket       = 0;
-    packet_tuple                tuple;
-
-    //arnatal TODO TODO: Check if local -> Do not encapsulate (can be solved with proper route configuration)
-    //arnatal: Do not need to check here if route metrics setted correctly -> local more preferable than default (tun)
-
+/*
+ * Output pipeline
+ *
+ * The packets read from the tun interface are processed in batches of up to OUTPUT_BATCH_SIZE
+ * packets. Each stage processes the whole batch before the next one starts, so the code and the
+ * data of a stage (local database, map cache, balancing vectors, sockets) stay in cache for all
+ * the packets of the batch. Packets that can't be encapsulated directly (native forwarding,
+ * PETR, NAT) leave the pipeline in the slow path stage.
+ */
 
-    if (extract_5_tuples_from_packet (original_packet,&tuple) != GOOD){
-        return (BAD);
+/*
+ * Read the packets available in the tun interface. Each packet is stored after OUTPUT_HEADROOM
+ * bytes so the outer headers can be added without copying it.
+ */
+static int output_stage_read(
+        int                 fd,
+        uint8_t             *buf,
+        unsigned int        buf_size,
+        output_pkt_desc     *batch)
+{
+    int             nread       = 0;
+    int             count       = 0;
+    unsigned int    slot_size   = buf_size / OUTPUT_BATCH_SIZE;
+    uint8_t         *slot       = NULL;
+
+    while (count < OUTPUT_BATCH_SIZE){
+        slot = buf + count * slot_size;
+        nread = read (fd, slot + OUTPUT_HEADROOM, slot_size - OUTPUT_HEADROOM);
+        if (nread <= 0){
+            break;
+        }
+        memset(&(batch[count]), 0, sizeof(output_pkt_desc));
+        batch[count].packet = slot + OUTPUT_HEADROOM;
+        batch[count].packet_length = nread;
+        batch[count].action = OUTPUT_ACT_ENCAP;
+        count++;
     }
+    return (count);
+}
 
-    lispd_log_msg(LISP_LOG_DEBUG_3,"OUTPUT: Orig src: %s | Orig dst: %s\n",
-            get_char_from_lisp_addr_t(tuple.src_addr),get_char_from_lisp_addr_t(tuple.dst_addr));
+/*
+ * Extract the tuple of the packets and filter the packets that must not be encapsulated
+ */
+static void output_stage_parse(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc     *desc   = NULL;
+    int                 ctr     = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        if (extract_5_tuples_from_packet (desc->packet,&(desc->tuple)) != GOOD){
+            stats.drops[STATS_DROP_MALFORMED]++;
+            desc->action = OUTPUT_ACT_DROP;
+            continue;
+        }
 
+        lispd_log_msg(LISP_LOG_DEBUG_3,"OUTPUT: Orig src: %s | Orig dst: %s\n",
+                get_char_from_lisp_addr_t(desc->tuple.src_addr),get_char_from_lisp_addr_t(desc->tuple.dst_addr));
 
-    /* If already LISP packet, do not encapsulate again */
+        /* Pre-resolve the mappings of the addresses of DNS answers */
+        if (dns_snooping == TRUE){
+            dns_snoop_packet(desc->packet, desc->packet_length);
+        }
 
-    if (is_lisp_packet(original_packet,original_packet_length) == TRUE){
-        return (forward_native(original_packet,original_packet_length));
+        /* If already LISP packet, do not encapsulate again */
+        if (is_lisp_packet(desc->packet,desc->packet_length) == TRUE){
+            desc->action = OUTPUT_ACT_NATIVE;
+        }
     }
+}
 
-    /* If received packet doesn't have a source EID, forward it natively */
-    src_mapping = lookup_eid_in_db (tuple.src_addr);
-    if (src_mapping == NULL){
-        return (forward_native(original_packet,original_packet_length));
-    }
+/*
+ * Look up the source EID of the packets in the local database
+ */
+static void output_stage_classify(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc     *desc   = NULL;
+    int                 ctr     = 0;
 
-    /* If we are behind a full nat system, send the message directly to the RTR */
-    if ((nat_aware == TRUE)&&(nat_status == FULL_NAT)){
-        if (select_src_locators_from_balancing_locators_vec (src_mapping,tuple,&outer_src_locator) != GOOD){
-            return (BAD);
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        if (desc->action != OUTPUT_ACT_ENCAP){
+            continue;
+        }
+        /* If received packet doesn't have a source EID, forward it natively */
+        desc->src_mapping = lookup_eid_in_db (desc->tuple.src_addr);
+        if (desc->src_mapping == NULL){
+            desc->action = OUTPUT_ACT_NATIVE;
+            continue;
+        }
+        /* If we are behind a full nat system, send the message directly to the RTR */
+        if ((nat_aware == TRUE)&&(nat_status == FULL_NAT)){
+            desc->action = OUTPUT_ACT_RTR;
         }
-        return (forward_to_natt_rtr(original_packet, original_packet_length, outer_src_locator));
     }
+}
 
+/*
+ * Look up the destination EID of the packets in the map cache and apply the actions of the
+ * negative entries
+ */
+static void output_stage_lookup(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc         *desc   = NULL;
+    lispd_map_cache_entry   *entry  = NULL;
+    int                     ctr     = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        if (desc->action != OUTPUT_ACT_ENCAP){
+            continue;
+        }
+        /* The miss is processed now: the next packets of the batch to the same EID find the new entry */
+        entry = lookup_map_cache(desc->tuple.dst_addr);
+        if (entry == NULL){ /* There is no entry in the map cache */
+            lispd_log_msg(LISP_LOG_DEBUG_1, "No map cache retrieved for eid %s",get_char_from_lisp_addr_t(desc->tuple.dst_addr));
+            if (ddt_client == TRUE){
+                handle_map_cache_miss_with_ddt(&(desc->tuple.dst_addr), &(desc->tuple.src_addr));
+            }else{
+                handle_map_cache_miss(&(desc->tuple.dst_addr), &(desc->tuple.src_addr));
+            }
+            stats.map_cache_misses++;
+            desc->action = OUTPUT_ACT_PETR;
+            continue;
+        }
+        stats.map_cache_hits++;
+        desc->entry = entry;
+        /* Negative map cache entries: apply the action of the Map-Reply */
+        if (entry->active == ACTIVE && entry->mapping->locator_count == 0){
+            switch (entry->actions){
+            case MAPPING_ACT_NATIVELY_FORWARD:
+                desc->action = OUTPUT_ACT_NATIVE;
+                continue;
+            case MAPPING_ACT_DROP:
+                lispd_log_msg(LISP_LOG_DEBUG_3,"lisp_output: Negative map cache entry with drop action for %s. Discarding packet",
+                        get_char_from_lisp_addr_t(desc->tuple.dst_addr));
+                stats.drops[STATS_DROP_NEGATIVE_MAPPING]++;
+                desc->action = OUTPUT_ACT_DROP;
+                continue;
+            default:
+                break;
+            }
+        }
+        /* Packets with negative map cache entry or no active map cache entry are forwarded to PETR */
+        if (entry->active == NO_ACTIVE || entry->mapping->locator_count == 0){
+            desc->action = OUTPUT_ACT_PETR;
+            continue;
+        }
+    }
+}
 
-    entry = lookup_map_cache(tuple.dst_addr);
+/*
+ * Select the source and destination locators of the packets
+ */
+static void output_stage_select(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc             *desc               = NULL;
+    output_pkt_desc             *ahead              = NULL;
+    lcl_locator_extended_info   *loc_extended_info  = NULL;
+    int                         ctr                 = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        /* The mappings of the packets ahead are known: load their balancing vectors meanwhile */
+        if (ctr + OUTPUT_PREFETCH_DISTANCE < count){
+            ahead = &(batch[ctr + OUTPUT_PREFETCH_DISTANCE]);
+            if (ahead->action == OUTPUT_ACT_ENCAP){
+                __builtin_prefetch(ahead->src_mapping->extended_info);
+                __builtin_prefetch(ahead->entry->mapping->extended_info);
+            }
+        }
+        desc = &(batch[ctr]);
+        if (desc->action != OUTPUT_ACT_ENCAP){
+            continue;
+        }
+        /* Multicast packets are replicated to the locators of the entry unless we are behind NAT */
+        if (is_multicast_addr(desc->tuple.dst_addr) == TRUE){
+            if (select_src_locators_from_balancing_locators_vec (desc->src_mapping,desc->tuple,&(desc->src_locator)) != GOOD){
+                stats.drops[STATS_DROP_NO_LOCATOR]++;
+                desc->action = OUTPUT_ACT_DROP;
+                continue;
+            }
+            loc_extended_info = (lcl_locator_extended_info *)desc->src_locator->extended_info;
+            if (loc_extended_info->rtr_locators_list == NULL){
+                desc->out_socket = *(loc_extended_info->out_socket);
+                desc->action = OUTPUT_ACT_REPLICATE;
+                continue;
+            }
+        }
+        if (select_src_rmt_locators_from_balancing_locators_vec (
+                desc->src_mapping,
+                desc->entry->mapping,
+                desc->tuple,
+                &(desc->src_locator),
+                &(desc->dst_locator))!=GOOD){
+            /* If no match between afi of source and destinatiion RLOC, try to fordward to petr*/
+            desc->action = OUTPUT_ACT_PETR;
+            continue;
+        }
+        if (desc->src_locator == NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_output: No output src locator");
+            stats.drops[STATS_DROP_NO_LOCATOR]++;
+            desc->action = OUTPUT_ACT_DROP;
+            continue;
+        }
+        if (desc->dst_locator == NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_output: No destination locator selectable");
+            stats.drops[STATS_DROP_NO_LOCATOR]++;
+            desc->action = OUTPUT_ACT_DROP;
+            continue;
+        }
+        desc->outer_dst_addr = desc->dst_locator->locator_addr;
 
-    if (entry == NULL){ /* There is no entry in the map cache */
-        lispd_log_msg(LISP_LOG_DEBUG_1, "No map cache retrieved for eid %s",get_char_from_lisp_addr_t(tuple.dst_addr));
-        if (ddt_client == TRUE){
-            handle_map_cache_miss_with_ddt(&(tuple.dst_addr), &(tuple.src_addr));
-        }else{
-            handle_map_cache_miss(&(tuple.dst_addr), &(tuple.src_addr));
+        /* If the selected src locator is behind NAT, fordware to the RTR */
+        loc_extended_info = (lcl_locator_extended_info *)desc->src_locator->extended_info;
+        if (loc_extended_info->rtr_locators_list != NULL){
+            desc->outer_dst_addr = &(select_rtr_locator(loc_extended_info->rtr_locators_list, &(desc->tuple))->address);
         }
+        desc->out_socket = *(loc_extended_info->out_socket);
     }
-    /* Packets with negative map cache entry, no active map cache entry or no map cache entry are forwarded to PETR */
-    if ((entry == NULL) || (entry->active == NO_ACTIVE) || (entry->mapping->locator_count == 0) ){ /* There is no entry or is not active*/
+}
 
-        /* Try to fordward to petr*/
-        if (fordward_to_petr(
-                original_packet,
-                original_packet_length,
-                src_mapping,
-                tuple) != GOOD){
-            /* If error, fordward native*/
-            return (forward_native(original_packet,original_packet_length));
+/*
+ * Add the outer headers in the headroom of the packets
+ */
+static void output_stage_encap(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc     *desc           = NULL;
+    int                 headers_size    = 0;
+    int                 ctr             = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        if (desc->action != OUTPUT_ACT_ENCAP){
+            continue;
         }
-        return (GOOD);
+        headers_size = get_encap_headers_size(desc->src_locator->locator_addr->afi);
+        desc->encap_packet = desc->packet - headers_size;
+        desc->encap_packet_length = desc->packet_length + headers_size;
+        add_encap_headers(desc->encap_packet,
+                desc->packet,
+                desc->packet_length,
+                desc->src_locator->locator_addr,
+                desc->outer_dst_addr,
+                LISP_DATA_PORT, //TODO: UDP src port based on hash?
+                LISP_DATA_PORT,
+                //entry->mapping->iid, //XXX iid not supported yet
+                0);
+
+        lispd_log_msg(LISP_LOG_DEBUG_3,"OUTPUT: Encap src: %s | Encap dst: %s\n",
+                get_char_from_lisp_addr_t(*(desc->src_locator->locator_addr)),
+                get_char_from_lisp_addr_t(*(desc->outer_dst_addr)));
     }
+}
 
-    dst_mapping = entry->mapping;
-
-    /* There is an entry in the map cache */
+/*
+ * Head-end replication of the multicast packets (RFC 6831): a copy is sent to each locator of the
+ * map cache entry of the group with the AFI of the source locator, excluding the locators with
+ * multicast priority 255. The packet is encapsulated once in its headroom and the outer headers
+ * of the copies, which only differ in the destination RLOC, are derived from it in a separate
+ * buffer. All the copies share the inner packet and are sent with a single system call.
+ */
+static void output_stage_replicate(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    uint8_t                 headers[MAX_SEND_BATCH][OUTPUT_HEADROOM];
+    uint8_t                 *header_ptrs[MAX_SEND_BATCH];
+    output_pkt_desc         *desc           = NULL;
+    lispd_locators_list     *locators_list  = NULL;
+    lispd_locator_elt       *locator        = NULL;
+    uint8_t                 *template_header= NULL;
+    int                     afi             = 0;
+    int                     headers_size    = 0;
+    int                     pending         = 0;
+    int                     copies          = 0;
+    int                     ctr             = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        if (desc->action != OUTPUT_ACT_REPLICATE){
+            continue;
+        }
+        afi = desc->src_locator->locator_addr->afi;
+        if (afi == AF_INET){
+            locators_list = desc->entry->mapping->head_v4_locators_list;
+        }else{
+            locators_list = desc->entry->mapping->head_v6_locators_list;
+        }
+        headers_size = get_encap_headers_size(afi);
+        template_header = desc->packet - headers_size;
+        pending = 0;
+        copies = 0;
+
+        for (; locators_list != NULL ; locators_list = locators_list->next){
+            locator = locators_list->locator;
+            if (*(locator->state) != UP || locator->mpriority == UNUSED_RLOC_PRIORITY){
+                continue;
+            }
+            if (copies == 0){
+                add_encap_headers(template_header,
+                        desc->packet,
+                        desc->packet_length,
+                        desc->src_locator->locator_addr,
+                        locator->locator_addr,
+                        LISP_DATA_PORT,
+                        LISP_DATA_PORT,
+                        0);
+            }
+            build_replica_header(headers[pending], template_header, headers_size, locator->locator_addr);
+            header_ptrs[pending] = headers[pending];
+            pending++;
+            copies++;
+            if (pending == MAX_SEND_BATCH){
+                send_packet_replicas(desc->out_socket, header_ptrs, headers_size, desc->packet, desc->packet_length, pending);
+                pending = 0;
+            }
+        }
+        if (pending != 0){
+            send_packet_replicas(desc->out_socket, header_ptrs, headers_size, desc->packet, desc->packet_length, pending);
+        }
 
-    /* Find locators to be used */
-    if (select_src_rmt_locators_from_balancing_locators_vec (
-            src_mapping,
-            dst_mapping,
-            tuple,
-            &outer_src_locator,
-            &outer_dst_locator)!=GOOD){
-        /* If no match between afi of source and destinatiion RLOC, try to fordward to petr*/
-        if (fordward_to_petr(
-                original_packet,
-                original_packet_length,
-                src_mapping,
-                tuple) != GOOD){
-            /* If error, fordward native*/
-            return (forward_native(original_packet,original_packet_length));
+        if (copies == 0){
+            lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_output: No locator in the replication list of %s. Discarding packet",
+                    get_char_from_lisp_addr_t(desc->tuple.dst_addr));
+            stats.drops[STATS_DROP_NO_LOCATOR]++;
         }else{
-            return (GOOD);
+            stats.encap_packets += copies;
+            stats.encap_bytes += (uint64_t)copies * (headers_size + desc->packet_length);
+            lispd_log_msg(LISP_LOG_DEBUG_3,"OUTPUT: Multicast packet to %s replicated to %d RLOCs\n",
+                    get_char_from_lisp_addr_t(desc->tuple.dst_addr), copies);
         }
     }
+}
 
-    if (outer_src_locator == NULL){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_output: No output src locator");
-        return (BAD);
-    }
-    if (outer_dst_locator == NULL){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_output: No destination locator selectable");
-        return (BAD);
-    }
+/*
+ * Copy the outer headers of template_header to header and change its destination RLOC. The UDP
+ * checksum is updated incrementally, so the inner packet is not read again.
+ */
+static void build_replica_header(
+        uint8_t         *header,
+        uint8_t         *template_header,
+        int             headers_size,
+        lisp_addr_t     *dst_addr)
+{
+    struct iphdr        *iph        = NULL;
+    struct ip6_hdr      *ip6h       = NULL;
+    struct udphdr       *udh        = NULL;
 
-    src_addr = outer_src_locator->locator_addr;
-    dst_addr = outer_dst_locator->locator_addr;
+    memcpy(header, template_header, headers_size);
 
-    /* If the selected src locator is behind NAT, fordware to the RTR */
-    loc_extended_info = (lcl_locator_extended_info *)outer_src_locator->extended_info;
-    if (loc_extended_info->rtr_locators_list != NULL){
-        dst_addr = &(loc_extended_info->rtr_locators_list->locator->address);
+    switch (dst_addr->afi){
+    case AF_INET:
+        iph = (struct iphdr *)header;
+        udh = (struct udphdr *)(header + sizeof(struct iphdr));
+        udh->check = cksum_update(udh->check, &(iph->daddr), &(dst_addr->address.ip), sizeof(struct in_addr));
+        iph->daddr = dst_addr->address.ip.s_addr;
+        iph->id = htons(get_IP_ID());
+        break;
+    case AF_INET6:
+        ip6h = (struct ip6_hdr *)header;
+        udh = (struct udphdr *)(header + sizeof(struct ip6_hdr));
+        udh->check = cksum_update(udh->check, &(ip6h->ip6_dst), &(dst_addr->address.ipv6), sizeof(struct in6_addr));
+        ip6h->ip6_dst = dst_addr->address.ipv6;
+        break;
     }
+    /* A computed checksum of 0 is sent as 0xFFFF: 0 means no checksum (RFC 768) */
+    if (udh != NULL && udh->check == 0){
+        udh->check = 0xFFFF;
+    }
+}
 
-    encapsulate_packet(original_packet,
-            original_packet_length,
-            src_addr,
-            dst_addr,
-            LISP_DATA_PORT, //TODO: UDP src port based on hash?
-            LISP_DATA_PORT,
-            //entry->mapping->iid, //XXX iid not supported yet
-            0,
-            &encap_packet,
-            &encap_packet_size);
-
-    output_socket = *(((lcl_locator_extended_info *)(outer_src_locator->extended_info))->out_socket);
-    send_packet (output_socket,encap_packet,encap_packet_size);
+/*
+ * Send the packets that don't follow the common path: native forwarding, PETR and NAT RTR
+ */
+static void output_stage_slow_path(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc     *desc           = NULL;
+    lispd_locator_elt   *src_locator    = NULL;
+    int                 ctr             = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        switch (desc->action){
+        case OUTPUT_ACT_NATIVE:
+            forward_native(desc->packet,desc->packet_length);
+            break;
+        case OUTPUT_ACT_PETR:
+            /* Try to fordward to petr*/
+            if (fordward_to_petr(
+                    desc->packet,
+                    desc->packet_length,
+                    desc->src_mapping,
+                    desc->tuple) != GOOD){
+                /* If error, fordward native*/
+                forward_native(desc->packet,desc->packet_length);
+            }
+            break;
+        case OUTPUT_ACT_RTR:
+            if (select_src_locators_from_balancing_locators_vec (desc->src_mapping,desc->tuple,&src_locator) == GOOD){
+                forward_to_natt_rtr(desc->packet, desc->packet_length, src_locator, &(desc->tuple));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
 
-    free (encap_packet);
+/*
+ * Send the encapsulated packets. Consecutive packets with the same output socket are sent with
+ * a single system call.
+ */
+static void output_stage_transmit(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    uint8_t         *packets[OUTPUT_BATCH_SIZE];
+    int             lengths[OUTPUT_BATCH_SIZE];
+    int             socket      = -1;
+    int             pending     = 0;
+    int             ctr         = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        if (batch[ctr].action != OUTPUT_ACT_ENCAP){
+            continue;
+        }
+        if (pending != 0 && batch[ctr].out_socket != socket){
+            send_packet_batch(socket, packets, lengths, pending);
+            pending = 0;
+        }
+        socket = batch[ctr].out_socket;
+        packets[pending] = batch[ctr].encap_packet;
+        lengths[pending] = batch[ctr].encap_packet_length;
+        pending++;
+        stats.encap_packets++;
+        stats.encap_bytes += batch[ctr].encap_packet_length;
+    }
+    if (pending != 0){
+        send_packet_batch(socket, packets, lengths, pending);
+    }
+}
 
-    return (GOOD);
+/*
+ * Trace the packets of the batch that match a trace selector. Only called when there are selectors
+ */
+static void output_stage_trace(
+        output_pkt_desc     *batch,
+        int                 count)
+{
+    output_pkt_desc     *desc       = NULL;
+    lisp_addr_t         *src_rloc   = NULL;
+    lisp_addr_t         *dst_rloc   = NULL;
+    const char          *result     = NULL;
+    int                 ctr         = 0;
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        desc = &(batch[ctr]);
+        src_rloc = (desc->src_locator != NULL) ? desc->src_locator->locator_addr : NULL;
+        dst_rloc = NULL;
+        switch (desc->action){
+        case OUTPUT_ACT_ENCAP:
+            dst_rloc = desc->outer_dst_addr;
+            result = "encapsulated";
+            break;
+        case OUTPUT_ACT_NATIVE:
+            result = "forwarded natively";
+            break;
+        case OUTPUT_ACT_PETR:
+            result = "sent to the PETR (no active map cache entry)";
+            break;
+        case OUTPUT_ACT_RTR:
+            result = "sent to the RTR (behind NAT)";
+            break;
+        case OUTPUT_ACT_REPLICATE:
+            result = "replicated to the locators of the group";
+            break;
+        default:
+            result = "dropped";
+            break;
+        }
+        trace_data_packet("OUT", &(desc->tuple.src_addr), &(desc->tuple.dst_addr), src_rloc, dst_rloc,
+                desc->packet_length, result);
+    }
 }
 
 void process_output_packet (
@@ -996,9 +1569,34 @@ void process_output_packet (
         uint8_t         *tun_receive_buf,
         unsigned int    tun_receive_size )
 {
-    int nread   = 0;
-
-    nread = read ( fd, tun_receive_buf, tun_receive_size );
+    output_pkt_desc     batch[OUTPUT_BATCH_SIZE];
+    int                 count       = 0;
+#ifdef LISPD_LATENCY_STATS
+    struct timespec     stage_ts;
+#endif
+
+    count = output_stage_read(fd, tun_receive_buf, tun_receive_size, batch);
+    if (count == 0){
+        return;
+    }
 
-    lisp_output ( tun_receive_buf, nread );
+    STAGE_START(stage_ts);
+    output_stage_parse(batch, count);
+    output_stage_classify(batch, count);
+    STAGE_END(STATS_STAGE_CLASSIFY, stage_ts, count);
+    output_stage_lookup(batch, count);
+    STAGE_END(STATS_STAGE_LOOKUP, stage_ts, count);
+    output_stage_select(batch, count);
+    STAGE_END(STATS_STAGE_SELECT, stage_ts, count);
+    output_stage_encap(batch, count);
+    output_stage_replicate(batch, count);
+    STAGE_END(STATS_STAGE_ENCAP, stage_ts, count);
+    output_stage_slow_path(batch, count);
+    output_stage_transmit(batch, count);
+    STAGE_END(STATS_STAGE_SEND, stage_ts, count);
+
+    if (trace_enabled == TRUE){
+        output_stage_trace(batch, count);
+    }
 }
+
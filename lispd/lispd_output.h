@@ -43,10 +43,115 @@
 #include "cksum.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_external.h"
+#include "lispd_tun.h"
 
 
+/*
+ * The packets of the tun interface are processed in batches. Each packet of the batch is read in
+ * its own slot of the receive buffer after a headroom where the outer headers are added.
+ */
+#define OUTPUT_BATCH_SIZE       32
+#define OUTPUT_HEADROOM         64      /* >= IPv6 + UDP + LISP headers */
+#define OUTPUT_SLOT_SIZE(mtu)       (OUTPUT_HEADROOM + (mtu))
+#define OUTPUT_BATCH_BUF_SIZE(mtu)  (OUTPUT_BATCH_SIZE * OUTPUT_SLOT_SIZE(mtu))
+/* Packets ahead of the current one whose balancing vectors are prefetched by the select stage */
+#define OUTPUT_PREFETCH_DISTANCE    4
+
+/* What to do with a packet of the batch */
+#define OUTPUT_ACT_ENCAP        0
+#define OUTPUT_ACT_NATIVE       1
+#define OUTPUT_ACT_PETR         2
+#define OUTPUT_ACT_RTR          3
+#define OUTPUT_ACT_DROP         4
+#define OUTPUT_ACT_REPLICATE    5       /* Multicast: a copy to each locator of the entry */
+
+/*
+ * State of a packet along the stages of the output pipeline
+ */
+typedef struct output_pkt_desc_ {
+    uint8_t                 *packet;
+    int                     packet_length;
+    packet_tuple            tuple;
+    lispd_mapping_elt       *src_mapping;
+    lispd_map_cache_entry   *entry;
+    lispd_locator_elt       *src_locator;
+    lispd_locator_elt       *dst_locator;
+    lisp_addr_t             *outer_dst_addr;
+    uint8_t                 *encap_packet;
+    int                     encap_packet_length;
+    int                     out_socket;
+    int                     action;
+} output_pkt_desc;
+
+
+/*
+ * Locator selection policy of the traffic classes (DSCP of the inner packet). By default the
+ * locators are selected with the hash of the tuple over the balancing vectors. The packets of
+ * a class can use the destination locator with the lowest RTT measured by RLOC probing and
+ * the local locator of a given interface.
+ */
+#define RLOC_SELECT_BALANCED    0
+#define RLOC_SELECT_LOWEST_RTT  1
+
+#define DSCP_VALUES             64
+
+typedef struct dscp_policy_ {
+    uint8_t                 configured;
+    uint8_t                 rloc_selection;
+    char                    *iface_name;    /* Interface of the local locator. NULL to balance */
+    lispd_iface_elt         *iface;
+} dscp_policy;
+
+
+/*
+ * Read and process the packets available in the tun interface. tun_receive_buf should have
+ * room for OUTPUT_BATCH_BUF_SIZE(tun_mtu) bytes.
+ */
 void process_output_packet(int fd, uint8_t *tun_receive_buf, unsigned int tun_receive_size);
 
+/*
+ * Add the outer IP, UDP and LISP headers in position. The original packet should start
+ * get_encap_headers_size() bytes after position.
+ */
+void add_encap_headers(
+        uint8_t     *position,
+        uint8_t     *original_packet,
+        int         original_packet_length,
+        lisp_addr_t *src_addr,
+        lisp_addr_t *dst_addr,
+        int         src_port,
+        int         dst_port,
+        int         iid);
+
+/*
+ * Size of the outer headers of an encapsulated packet with RLOCs of the afi
+ */
+int get_encap_headers_size(int afi);
+
+/*
+ * Configure the locator selection policy of the traffic class dscp
+ */
+int set_dscp_policy(
+        int         dscp,
+        int         rloc_selection,
+        char        *iface_name);
+
+/*
+ * Resolve the interfaces of the DSCP policies. To be called once the configuration is loaded
+ */
+void init_dscp_policies();
+
+/*
+ * Return TRUE if a traffic class has a locator selection policy
+ */
+int is_dscp_policy_configured();
+
+/*
+ * Return TRUE if a traffic class selects the destination locator with the lowest RTT. The RTT
+ * of the locators is then kept up to date by RLOC probing, even when they are sending data.
+ */
+int is_lowest_rtt_policy_configured();
+
 lisp_addr_t extract_dst_addr_from_packet ( uint8_t *packet );
 
 lisp_addr_t extract_src_addr_from_packet ( uint8_t *packet );
@@ -65,6 +170,8 @@ int handle_map_cache_miss_with_ddt(lisp_addr_t *requested_eid,lisp_addr_t *src_e
 
 lisp_addr_t *get_proxy_etr(int afi);
 
+uint32_t get_hash_from_tuple (packet_tuple tuple);
+
 
 /* Macros extracted from ROHC library code: http://rohc-lib.org/ */
 
@@ -33,6 +33,7 @@
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_map_register.h"
+#include "lispd_nat_rtr.h"
 #include "lispd_external.h"
 #include "lispd_sockets.h"
 #include <netinet/udp.h>
@@ -274,7 +275,7 @@ uint8_t *pkt_fill_mapping_record(
 
             lct_extended_info = (lcl_locator_extended_info *)(locator->extended_info);
             if (lct_extended_info->rtr_locators_list != NULL){
-                itr_address = &(lct_extended_info->rtr_locators_list->locator->address);
+                itr_address = &(select_rtr_locator(lct_extended_info->rtr_locators_list, NULL)->address);
             }else{
                 itr_address = locator->locator_addr;
             }
@@ -315,6 +316,7 @@ int extract_5_tuples_from_packet (
         tuple->src_addr.address.ip.s_addr = iph->saddr;
         tuple->dst_addr.address.ip.s_addr = iph->daddr;
         tuple->protocol = iph->protocol;
+        tuple->dscp = iph->tos >> 2;
         len = iph->ihl*4;
         break;
     case 6:
@@ -324,6 +326,7 @@ int extract_5_tuples_from_packet (
         memcpy(&(tuple->src_addr.address.ipv6),&(ip6h->ip6_src),sizeof(struct in6_addr));
         memcpy(&(tuple->dst_addr.address.ipv6),&(ip6h->ip6_dst),sizeof(struct in6_addr));
         tuple->protocol = ip6h->ip6_ctlun.ip6_un1.ip6_un1_nxt;
+        tuple->dscp = (ntohl(ip6h->ip6_flow) >> 22) & 0x3f; /* 6 high bits of the Traffic Class */
         len = sizeof(struct ip6_hdr);
         break;
     default:
@@ -29,6 +29,7 @@
  */
 
 #include "lispd_afi.h"
+#include "lispd_ddt_node.h"
 #include "lispd_lib.h"
 #include "lispd_log.h"
 #include "lispd_map_referral.h"
@@ -37,10 +38,121 @@
 #include "lispd_referral_cache.h"
 #include "lispd_referral_cache_db.h"
 
+#define PENDING_REFERRALS_INITIAL_TABLE_SIZE    256
+
 lispd_pending_referral_cache_list  *pening_referrals_list    = NULL;
 
+static lispd_pending_referral_cache_list   **pending_referrals_eid_table       = NULL;
+static uint32_t                            pending_referrals_eid_table_size    = 0;
+static uint32_t                            pending_referrals_count             = 0;
+static lispd_pending_referral_nonce_elt    **pending_referrals_nonce_table     = NULL;
+static uint32_t                            pending_referrals_nonce_table_size  = 0;
+static uint32_t                            pending_referrals_nonce_count       = 0;
+/* Referral cache entries with a DDT Map Request sent to refresh them */
+static lispd_referral_cache_list           *prefetching_referrals              = NULL;
+
 inline lispd_referral_cache_list *new_referral_cache_list_elt(lispd_referral_cache_entry *referral_cache_entry);
 inline void free_lispd_referral_cache_list (lispd_referral_cache_list *referral_cache_list);
+static int sort_ddt_locators(
+        lispd_pending_referral_cache_entry  *pending_referral,
+        lispd_referral_cache_entry          *referral_cache,
+        int                                 afi);
+
+
+/*
+ * Hash tables of pending referrals indexed by EID prefix and by nonce.
+ * Their sizes are powers of 2 and are doubled when the number of elements
+ * exceeds the number of buckets
+ */
+
+static inline uint32_t get_pending_referral_eid_hash(
+        lisp_addr_t     *eid_prefix,
+        int             eid_prefix_length)
+{
+    uint8_t     *byte   = (uint8_t *)&(eid_prefix->address);
+    int         len     = get_addr_len(eid_prefix->afi);
+    uint32_t    hash    = 2166136261U; // FNV-1a
+    int         ctr     = 0;
+
+    for (ctr = 0 ; ctr < len ; ctr++){
+        hash = (hash ^ byte[ctr]) * 16777619U;
+    }
+    hash = (hash ^ (uint8_t)eid_prefix_length) * 16777619U;
+    hash = (hash ^ (uint8_t)eid_prefix->afi) * 16777619U;
+    return (hash);
+}
+
+static inline void add_pending_referral_to_eid_table(lispd_pending_referral_cache_list *list_elt)
+{
+    uint32_t position = list_elt->eid_hash & (pending_referrals_eid_table_size - 1);
+
+    list_elt->next_in_bucket = pending_referrals_eid_table[position];
+    pending_referrals_eid_table[position] = list_elt;
+}
+
+static inline void remove_pending_referral_from_eid_table(lispd_pending_referral_cache_list *list_elt)
+{
+    lispd_pending_referral_cache_list **bucket_elt_ptr = NULL;
+
+    bucket_elt_ptr = &(pending_referrals_eid_table[list_elt->eid_hash & (pending_referrals_eid_table_size - 1)]);
+    while (*bucket_elt_ptr != NULL){
+        if (*bucket_elt_ptr == list_elt){
+            *bucket_elt_ptr = list_elt->next_in_bucket;
+            list_elt->next_in_bucket = NULL;
+            return;
+        }
+        bucket_elt_ptr = &((*bucket_elt_ptr)->next_in_bucket);
+    }
+}
+
+static int resize_pending_referrals_eid_table(uint32_t new_size)
+{
+    lispd_pending_referral_cache_list   **new_table = NULL;
+    lispd_pending_referral_cache_list   *list_elt   = NULL;
+
+    if ((new_table = calloc(new_size, sizeof(lispd_pending_referral_cache_list *))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"resize_pending_referrals_eid_table: Unable to allocate memory for the table of pending referrals: %s",
+                strerror(errno));
+        return (ERR_MALLOC);
+    }
+    free (pending_referrals_eid_table);
+    pending_referrals_eid_table = new_table;
+    pending_referrals_eid_table_size = new_size;
+
+    for (list_elt = pening_referrals_list ; list_elt != NULL ; list_elt = list_elt->next){
+        add_pending_referral_to_eid_table(list_elt);
+    }
+    return (GOOD);
+}
+
+static int resize_pending_referrals_nonce_table(uint32_t new_size)
+{
+    lispd_pending_referral_nonce_elt    **new_table = NULL;
+    lispd_pending_referral_nonce_elt    *nonce_elt  = NULL;
+    lispd_pending_referral_nonce_elt    *next_elt   = NULL;
+    uint32_t                            position    = 0;
+    uint32_t                            ctr         = 0;
+
+    if ((new_table = calloc(new_size, sizeof(lispd_pending_referral_nonce_elt *))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"resize_pending_referrals_nonce_table: Unable to allocate memory for the table of nonces: %s",
+                strerror(errno));
+        return (ERR_MALLOC);
+    }
+    for (ctr = 0 ; ctr < pending_referrals_nonce_table_size ; ctr++){
+        nonce_elt = pending_referrals_nonce_table[ctr];
+        while (nonce_elt != NULL){
+            next_elt = nonce_elt->next;
+            position = nonce_hash(nonce_elt->nonce) & (new_size - 1);
+            nonce_elt->next = new_table[position];
+            new_table[position] = nonce_elt;
+            nonce_elt = next_elt;
+        }
+    }
+    free (pending_referrals_nonce_table);
+    pending_referrals_nonce_table = new_table;
+    pending_referrals_nonce_table_size = new_size;
+    return (GOOD);
+}
 
 
 /*
@@ -66,6 +178,9 @@ lispd_referral_cache_entry *new_referral_cache_entry(
     referral_cache_entry->children_nodes                    = NULL;
     referral_cache_entry->expiry_ddt_cache_timer            = NULL;
     referral_cache_entry->src_inf_ddt_node_locator_addr.afi = AF_UNSPEC;
+    referral_cache_entry->expiry_time                       = 0;
+    referral_cache_entry->hits                              = 0;
+    referral_cache_entry->prefetch_nonce                    = 0;
 
     return (referral_cache_entry);
 }
@@ -80,12 +195,15 @@ void free_referral_cache_entry(lispd_referral_cache_entry *referral_cache_entry)
     /* We remove the list of childs (lispd_referral_cache_list) but not the childs  (lispd_referral_cache_entry)*/
     while (list_elt != NULL){
         aux_list_elt = list_elt->next;
-        free(aux_list_elt);
+        free(list_elt);
         list_elt = aux_list_elt;
     }
     if (referral_cache_entry->expiry_ddt_cache_timer != NULL){
         stop_timer(referral_cache_entry->expiry_ddt_cache_timer);
     }
+    if (referral_cache_entry->prefetch_nonce != 0){
+        remove_referral_cache_entry_prefetch(referral_cache_entry);
+    }
     free (referral_cache_entry);
 }
 
@@ -100,6 +218,9 @@ void free_referral_cache_entry_recursive(lispd_referral_cache_entry *referral_ca
     }
     remove_referral_cache_entry_from_parent_node(referral_cache_entry);
     free_lispd_referral_cache_list(referral_cache_entry->children_nodes);
+    if (referral_cache_entry->prefetch_nonce != 0){
+        remove_referral_cache_entry_prefetch(referral_cache_entry);
+    }
     free (referral_cache_entry);
 }
 
@@ -213,6 +334,60 @@ inline void free_lispd_referral_cache_list (lispd_referral_cache_list *referral_
 
 
 
+/*
+ * Register the nonce of the DDT Map Request sent to refresh the referral cache entry
+ */
+int add_referral_cache_entry_prefetch(
+        lispd_referral_cache_entry          *referral_cache_entry,
+        uint64_t                            nonce)
+{
+    lispd_referral_cache_list   *list_elt   = NULL;
+
+    if (referral_cache_entry->prefetch_nonce == 0){
+        list_elt = new_referral_cache_list_elt(referral_cache_entry);
+        if (list_elt == NULL){
+            return (ERR_MALLOC);
+        }
+        list_elt->next = prefetching_referrals;
+        prefetching_referrals = list_elt;
+    }
+    referral_cache_entry->prefetch_nonce = nonce;
+    return (GOOD);
+}
+
+/*
+ * Return the referral cache entry being refreshed with the nonce or NULL if not found
+ */
+lispd_referral_cache_entry *lookup_referral_cache_entry_prefetch(uint64_t nonce)
+{
+    lispd_referral_cache_list   *list_elt   = prefetching_referrals;
+
+    while (list_elt != NULL){
+        if (list_elt->referral_cache_entry->prefetch_nonce == nonce){
+            return (list_elt->referral_cache_entry);
+        }
+        list_elt = list_elt->next;
+    }
+    return (NULL);
+}
+
+void remove_referral_cache_entry_prefetch(lispd_referral_cache_entry *referral_cache_entry)
+{
+    lispd_referral_cache_list   **list_elt_ptr  = &prefetching_referrals;
+    lispd_referral_cache_list   *list_elt       = NULL;
+
+    while (*list_elt_ptr != NULL){
+        list_elt = *list_elt_ptr;
+        if (list_elt->referral_cache_entry == referral_cache_entry){
+            *list_elt_ptr = list_elt->next;
+            free (list_elt);
+            break;
+        }
+        list_elt_ptr = &(list_elt->next);
+    }
+    referral_cache_entry->prefetch_nonce = 0;
+}
+
 lispd_pending_referral_cache_entry *new_pending_referral_cache_entry(
         lispd_map_cache_entry           *map_cache_entry,
         lisp_addr_t                     src_eid,
@@ -232,6 +407,13 @@ lispd_pending_referral_cache_entry *new_pending_referral_cache_entry(
     pending_referral_cache_entry->nonces                                = NULL;
     pending_referral_cache_entry->ddt_request_retry_timer               = NULL;
     pending_referral_cache_entry->tried_locators                        = 0;
+    pending_referral_cache_entry->asked_locators                        = 0;
+    pending_referral_cache_entry->hedge_pending                         = FALSE;
+    pending_referral_cache_entry->list_elt                              = NULL;
+    pending_referral_cache_entry->nonce_elts                            = NULL;
+    pending_referral_cache_entry->ddt_nodes_referral                    = NULL;
+    pending_referral_cache_entry->ddt_nodes                             = NULL;
+    pending_referral_cache_entry->ddt_nodes_count                       = 0;
 
     if (previous_referral->parent_node == NULL){
         // The previous referral is a root node
@@ -245,48 +427,55 @@ lispd_pending_referral_cache_entry *new_pending_referral_cache_entry(
 
 int add_pending_referral_cache_entry_to_list(lispd_pending_referral_cache_entry *pending_referral_cache_entry)
 {
-    lispd_pending_referral_cache_list *pending_referral_list_elt = NULL;
+    lispd_pending_referral_cache_list   *pending_referral_list_elt  = NULL;
+    lispd_mapping_elt                   *mapping                    = pending_referral_cache_entry->map_cache_entry->mapping;
+
+    if (pending_referrals_count >= pending_referrals_eid_table_size){
+        if (resize_pending_referrals_eid_table(pending_referrals_eid_table_size == 0 ?
+                PENDING_REFERRALS_INITIAL_TABLE_SIZE : pending_referrals_eid_table_size << 1) != GOOD){
+            return (BAD);
+        }
+    }
+
     pending_referral_list_elt = (lispd_pending_referral_cache_list *)malloc(sizeof(lispd_pending_referral_cache_list));
     if (pending_referral_list_elt == NULL){
         lispd_log_msg(LISP_LOG_WARNING,"add_pending_referral_cache_entry_to_list: Unable to allocate memory for a lispd_pending_referral_cache_list");
         return (BAD);
     }
     pending_referral_list_elt->pending_referral_cache_entry = pending_referral_cache_entry;
-    if (pening_referrals_list == NULL){
-        pening_referrals_list = pending_referral_list_elt;
-        pending_referral_list_elt->next = NULL;
-    }else{
-        pending_referral_list_elt->next = pening_referrals_list;
-        pening_referrals_list = pending_referral_list_elt;
+    pending_referral_list_elt->prev = NULL;
+    pending_referral_list_elt->next = pening_referrals_list;
+    if (pening_referrals_list != NULL){
+        pening_referrals_list->prev = pending_referral_list_elt;
     }
+    pening_referrals_list = pending_referral_list_elt;
+    pending_referral_cache_entry->list_elt = pending_referral_list_elt;
+
+    pending_referral_list_elt->eid_hash = get_pending_referral_eid_hash(&(mapping->eid_prefix), mapping->eid_prefix_length);
+    add_pending_referral_to_eid_table(pending_referral_list_elt);
+    pending_referrals_count++;
+
     return (GOOD);
 }
 
 int remove_pending_referral_cache_entry_from_list(lispd_pending_referral_cache_entry *pending_referral)
 {
-    lispd_pending_referral_cache_list       *list_elt           = NULL;
-    lispd_pending_referral_cache_list       *prev_list_elt      = NULL;
-    uint8_t                                 entry_found         = FALSE;
+    lispd_pending_referral_cache_list       *list_elt           = pending_referral->list_elt;
     uint8_t                                 result              = FALSE;
 
-    list_elt = pening_referrals_list;
-
-    while (list_elt != NULL){
-        if (list_elt->pending_referral_cache_entry == pending_referral){
-            if (prev_list_elt == NULL){
-                pening_referrals_list = list_elt->next;
-            }else{
-                prev_list_elt->next = list_elt->next;
-            }
-            entry_found = TRUE;
-            break;
+    if (list_elt != NULL){
+        if (list_elt->prev == NULL){
+            pening_referrals_list = list_elt->next;
+        }else{
+            list_elt->prev->next = list_elt->next;
         }
-        prev_list_elt = list_elt;
-        list_elt = list_elt->next;
-    }
-
-    if (entry_found == TRUE){
+        if (list_elt->next != NULL){
+            list_elt->next->prev = list_elt->prev;
+        }
+        remove_pending_referral_from_eid_table(list_elt);
+        pending_referrals_count--;
         free (list_elt);
+        pending_referral->list_elt = NULL;
         result = GOOD;
     }else{
         lispd_log_msg(LISP_LOG_DEBUG_1,"remove_pending_referral_cache_entry_from_list: The entry %s/%d has not been found"
@@ -306,18 +495,18 @@ int remove_pending_referral_cache_entry_from_list(lispd_pending_referral_cache_e
 void reset_pending_referrals_with_expired_previous_referral(lispd_referral_cache_entry *expired_referral_cache)
 {
     lispd_pending_referral_cache_list   *pending_referrals      = pening_referrals_list;
+    lispd_pending_referral_cache_list   *next_pending_referral  = NULL;
     lispd_pending_referral_cache_entry  *pending_referral_entry = NULL;
 
     while (pending_referrals != NULL){
+        /* send_ddt_map_request_miss could remove the pending referral from the list */
+        next_pending_referral = pending_referrals->next;
         if (pending_referrals->pending_referral_cache_entry->previous_referral == expired_referral_cache){
             pending_referral_entry = pending_referrals->pending_referral_cache_entry;
             pending_referral_entry->previous_referral = get_root_referral_cache(pending_referral_entry->map_cache_entry->mapping->eid_prefix.afi);
             pending_referral_entry->tried_locators = 0;
             pending_referral_entry->request_through_root = TRUE;
-            if (pending_referral_entry->nonces != NULL){
-                free(pending_referral_entry->nonces);
-                pending_referral_entry->nonces = NULL;
-            }
+            free_pending_referral_cache_entry_nonces(pending_referral_entry);
             if (pending_referral_entry->ddt_request_retry_timer != NULL){
                 stop_timer(pending_referral_entry->ddt_request_retry_timer);
                 pending_referral_entry->ddt_request_retry_timer = NULL;
@@ -328,7 +517,7 @@ void reset_pending_referrals_with_expired_previous_referral(lispd_referral_cache
                     pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
             err = send_ddt_map_request_miss(NULL,(void *)pending_referral_entry);
         }
-        pending_referrals = pending_referrals->next;
+        pending_referrals = next_pending_referral;
     }
 }
 
@@ -337,21 +526,26 @@ lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_eid (
         lisp_addr_t eid_prefix,
         int eid_prefix_length)
 {
-    lispd_pending_referral_cache_entry      *pending_referral   = NULL;
+    lispd_pending_referral_cache_list       *aux_list           = NULL;
     lispd_mapping_elt                       *mapping            = NULL;
+    uint32_t                                hash                = 0;
 
+    if (pending_referrals_count == 0){
+        return (NULL);
+    }
 
-    lispd_pending_referral_cache_list *aux_list = pening_referrals_list;
+    hash = get_pending_referral_eid_hash(&eid_prefix, eid_prefix_length);
+    aux_list = pending_referrals_eid_table[hash & (pending_referrals_eid_table_size - 1)];
     while (aux_list != NULL){
         mapping = aux_list->pending_referral_cache_entry->map_cache_entry->mapping;
-        if (compare_lisp_addr_t (&(mapping->eid_prefix), &eid_prefix) == 0 &&
-                mapping->eid_prefix_length == eid_prefix_length){
-            pending_referral = aux_list->pending_referral_cache_entry;
-            break;
+        if (aux_list->eid_hash == hash &&
+                mapping->eid_prefix_length == eid_prefix_length &&
+                compare_lisp_addr_t (&(mapping->eid_prefix), &eid_prefix) == 0){
+            return (aux_list->pending_referral_cache_entry);
         }
-        aux_list = aux_list->next;
+        aux_list = aux_list->next_in_bucket;
     }
-    return (pending_referral);
+    return (NULL);
 }
 
 /*
@@ -359,29 +553,168 @@ lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_eid (
  */
 lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_nonce (uint64_t nonce)
 {
-    lispd_pending_referral_cache_entry      *pending_referral   = NULL;
+    lispd_pending_referral_nonce_elt        *nonce_elt          = NULL;
 
-    lispd_pending_referral_cache_list *aux_list = pening_referrals_list;
-    while (aux_list != NULL){
-        if (check_nonce(aux_list->pending_referral_cache_entry->nonces, nonce) == GOOD){
-            pending_referral = aux_list->pending_referral_cache_entry;
-            break;
+    nonce_elt = lookup_pending_referral_nonce (nonce);
+    if (nonce_elt == NULL){
+        return (NULL);
+    }
+    return (nonce_elt->pending_referral_cache_entry);
+}
+
+/*
+ *  Search the DDT Map Request with the nonce. Return NULL if it has not been found
+ */
+lispd_pending_referral_nonce_elt *lookup_pending_referral_nonce (uint64_t nonce)
+{
+    lispd_pending_referral_nonce_elt        *nonce_elt          = NULL;
+
+    if (pending_referrals_nonce_count == 0){
+        return (NULL);
+    }
+
+    nonce_elt = pending_referrals_nonce_table[nonce_hash(nonce) & (pending_referrals_nonce_table_size - 1)];
+    while (nonce_elt != NULL){
+        if (nonce_elt->nonce == nonce){
+            return (nonce_elt);
+        }
+        nonce_elt = nonce_elt->next;
+    }
+    return (NULL);
+}
+
+/*
+ * Index the nonce of a DDT Map Request sent for the pending referral to the DDT node
+ */
+int add_nonce_to_pending_referral_cache_entry(
+        lispd_pending_referral_cache_entry  *pending_referral,
+        uint64_t                            nonce,
+        lisp_addr_t                         *ddt_node_addr)
+{
+    lispd_pending_referral_nonce_elt    *nonce_elt  = NULL;
+    uint32_t                            position    = 0;
+
+    if (pending_referrals_nonce_count >= pending_referrals_nonce_table_size){
+        if (resize_pending_referrals_nonce_table(pending_referrals_nonce_table_size == 0 ?
+                PENDING_REFERRALS_INITIAL_TABLE_SIZE : pending_referrals_nonce_table_size << 1) != GOOD){
+            return (BAD);
+        }
+    }
+
+    nonce_elt = (lispd_pending_referral_nonce_elt *)malloc(sizeof(lispd_pending_referral_nonce_elt));
+    if (nonce_elt == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"add_nonce_to_pending_referral_cache_entry: Unable to allocate memory for lispd_pending_referral_nonce_elt: %s",
+                strerror(errno));
+        return (BAD);
+    }
+    nonce_elt->nonce = nonce;
+    nonce_elt->pending_referral_cache_entry = pending_referral;
+    nonce_elt->timed_out = FALSE;
+    if (ddt_node_addr != NULL){
+        copy_lisp_addr(&(nonce_elt->ddt_node_addr), ddt_node_addr);
+    }else{
+        nonce_elt->ddt_node_addr.afi = AF_UNSPEC;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &(nonce_elt->sent));
+
+    position = nonce_hash(nonce) & (pending_referrals_nonce_table_size - 1);
+    nonce_elt->next = pending_referrals_nonce_table[position];
+    pending_referrals_nonce_table[position] = nonce_elt;
+    nonce_elt->next_of_entry = pending_referral->nonce_elts;
+    pending_referral->nonce_elts = nonce_elt;
+    pending_referrals_nonce_count++;
+
+    return (GOOD);
+}
+
+/*
+ * Account as timed out the DDT Map Requests of the pending referral not answered yet
+ */
+void pending_referral_cache_entry_requests_timeout(lispd_pending_referral_cache_entry *pending_referral)
+{
+    lispd_pending_referral_nonce_elt    *nonce_elt      = NULL;
+
+    for (nonce_elt = pending_referral->nonce_elts ; nonce_elt != NULL ; nonce_elt = nonce_elt->next_of_entry){
+        if (nonce_elt->timed_out == FALSE && nonce_elt->ddt_node_addr.afi != AF_UNSPEC){
+            ddt_node_request_timeout(&(nonce_elt->ddt_node_addr));
+        }
+        nonce_elt->timed_out = TRUE;
+    }
+}
+
+/*
+ * Remove the nonces of the pending referral from the index and release its list of nonces
+ */
+void free_pending_referral_cache_entry_nonces(lispd_pending_referral_cache_entry *pending_referral)
+{
+    lispd_pending_referral_nonce_elt    **nonce_elt_ptr = NULL;
+    lispd_pending_referral_nonce_elt    *nonce_elt      = NULL;
+    lispd_pending_referral_nonce_elt    *next_elt       = NULL;
+
+    nonce_elt = pending_referral->nonce_elts;
+    while (nonce_elt != NULL){
+        next_elt = nonce_elt->next_of_entry;
+        nonce_elt_ptr = &(pending_referrals_nonce_table[nonce_hash(nonce_elt->nonce) & (pending_referrals_nonce_table_size - 1)]);
+        while (*nonce_elt_ptr != NULL){
+            if (*nonce_elt_ptr == nonce_elt){
+                *nonce_elt_ptr = nonce_elt->next;
+                break;
+            }
+            nonce_elt_ptr = &((*nonce_elt_ptr)->next);
         }
-        aux_list = aux_list->next;
+        free (nonce_elt);
+        pending_referrals_nonce_count--;
+        nonce_elt = next_elt;
+    }
+    pending_referral->nonce_elts = NULL;
+    pending_referral->hedge_pending = FALSE;
+
+    if (pending_referral->nonces != NULL){
+        free (pending_referral->nonces);
+        pending_referral->nonces = NULL;
+    }
+}
+
+/*
+ * Update the EID index of pending referrals when the EID prefix of the map cache entry changes
+ */
+void update_pending_referral_cache_entry_eid(
+        lispd_map_cache_entry   *map_cache_entry,
+        lisp_addr_t             old_eid_prefix,
+        int                     old_eid_prefix_length)
+{
+    lispd_pending_referral_cache_list   *list_elt   = NULL;
+    lispd_mapping_elt                   *mapping    = map_cache_entry->mapping;
+    uint32_t                            hash        = 0;
+
+    if (pending_referrals_count == 0){
+        return;
+    }
+
+    hash = get_pending_referral_eid_hash(&old_eid_prefix, old_eid_prefix_length);
+    list_elt = pending_referrals_eid_table[hash & (pending_referrals_eid_table_size - 1)];
+    while (list_elt != NULL){
+        if (list_elt->pending_referral_cache_entry->map_cache_entry == map_cache_entry){
+            remove_pending_referral_from_eid_table(list_elt);
+            list_elt->eid_hash = get_pending_referral_eid_hash(&(mapping->eid_prefix), mapping->eid_prefix_length);
+            add_pending_referral_to_eid_table(list_elt);
+            return;
+        }
+        list_elt = list_elt->next_in_bucket;
     }
-    return (pending_referral);
 }
 
 
 void free_pending_referral_cache_entry(lispd_pending_referral_cache_entry *pending_referral_cache_entry)
 {
     //map_cache_entry nad previous referral cache should not be free.
-    if (pending_referral_cache_entry->nonces != NULL){
-        free (pending_referral_cache_entry->nonces);
-    }
+    free_pending_referral_cache_entry_nonces(pending_referral_cache_entry);
     if (pending_referral_cache_entry->ddt_request_retry_timer != NULL){
         stop_timer(pending_referral_cache_entry->ddt_request_retry_timer);
     }
+    if (pending_referral_cache_entry->ddt_nodes != NULL){
+        free (pending_referral_cache_entry->ddt_nodes);
+    }
     free (pending_referral_cache_entry);
 }
 
@@ -455,26 +788,47 @@ void dump_referral_cache_entry(
 }
 
 /*
- * Sort the list of locators of ddt node by its priority and retuns the locator in the position
- * indicated by the parameter "position". Only the locators of the specified afi are considered except afi =  AF_UNSPEC.
- * In that case, we use all locators.
+ * Sort the list of locators of ddt node by its priority and, with the same priority, by the measured
+ * response time of the node. Returns the locator in the position indicated by the parameter "position".
+ * Only the locators of the specified afi are considered. The sorted list is kept in the pending referral
+ * while the same referral is asked, so the positions don't change between retransmissions.
  */
 
 lisp_addr_t get_ddt_locator_addr_at_position(
-        lispd_referral_cache_entry *referral_cache,
-        int afi,
-        int position)
+        lispd_pending_referral_cache_entry  *pending_referral,
+        lispd_referral_cache_entry          *referral_cache,
+        int                                 afi,
+        int                                 position)
 {
     lisp_addr_t             ddt_locator_addr        = {.afi=AF_UNSPEC};
-    lispd_locator_elt       *ddt_locator            = NULL;
+
+    if (pending_referral->ddt_nodes_referral != referral_cache || pending_referral->ddt_nodes == NULL){
+        if (sort_ddt_locators(pending_referral, referral_cache, afi) != GOOD){
+            return (ddt_locator_addr);
+        }
+    }
+
+    if (position < pending_referral->ddt_nodes_count){
+        ddt_locator_addr = pending_referral->ddt_nodes[position];
+    }
+
+    return (ddt_locator_addr);
+}
+
+static int sort_ddt_locators(
+        lispd_pending_referral_cache_entry  *pending_referral,
+        lispd_referral_cache_entry          *referral_cache,
+        int                                 afi)
+{
     lispd_mapping_elt       *mapping                = referral_cache->mapping;
     lispd_locators_list     *locators_list[2]       = {NULL,NULL};
-    lispd_locators_list     *sorted_locators_list   = NULL;
-    lispd_locators_list     *locators_list_elt      = NULL;
-    lispd_locators_list     *new_locator_list_elt   = NULL;
-    lispd_locators_list     *prev_locators_list_elt = NULL;
-    int                     locators_list_length    = 0;
+    lispd_locator_elt       **locators              = NULL;
+    uint32_t                *scores                 = NULL;
+    lispd_locator_elt       *aux_locator            = NULL;
+    uint32_t                aux_score               = 0;
+    int                     locators_count          = 0;
     int                     ctr                     = 0;
+    int                     ctr2                    = 0;
 
     if (afi == AFI_SUPPORT_4 || afi == AFI_SUPPORT_4_6){
         locators_list[0] = mapping->head_v4_locators_list;
@@ -482,50 +836,64 @@ lisp_addr_t get_ddt_locator_addr_at_position(
     if (afi == AFI_SUPPORT_6 || afi == AFI_SUPPORT_4_6){
         locators_list[1] = mapping->head_v6_locators_list;
     }
-    /* Generate list of locators sorted by priority */
-    for (ctr=0 ; ctr<2 ; ctr++){
-        if (locators_list[ctr] == NULL){
-            continue;
-        }
-        while (locators_list[ctr] != NULL){
-            new_locator_list_elt = new_locators_list_elt(locators_list[ctr]->locator);
-            if (new_locator_list_elt != NULL){
-                locators_list_elt = sorted_locators_list;
-                while (locators_list_elt != NULL){
-                    if (locators_list_elt->locator->priority > locators_list[ctr]->locator->priority){
-                        break;
-                    }
-                    prev_locators_list_elt = locators_list_elt;
-                    locators_list_elt = locators_list_elt->next;
-                }
-                if (prev_locators_list_elt == NULL){
-                    new_locator_list_elt->next = sorted_locators_list;
-                    sorted_locators_list = new_locator_list_elt;
-                }else{
-                    prev_locators_list_elt->next = new_locator_list_elt;
-                    new_locator_list_elt->next = locators_list_elt;
-                }
-                locators_list_length ++;
-            }
-            locators_list[ctr] = locators_list[ctr]->next;
-        }
+
+    if (pending_referral->ddt_nodes != NULL){
+        free (pending_referral->ddt_nodes);
+        pending_referral->ddt_nodes = NULL;
+    }
+    pending_referral->ddt_nodes_count = 0;
+    pending_referral->ddt_nodes_referral = referral_cache;
+
+    if (mapping->locator_count == 0){
+        return (GOOD);
+    }
+    locators = (lispd_locator_elt **)malloc(mapping->locator_count * sizeof(lispd_locator_elt *));
+    scores = (uint32_t *)malloc(mapping->locator_count * sizeof(uint32_t));
+    pending_referral->ddt_nodes = (lisp_addr_t *)malloc(mapping->locator_count * sizeof(lisp_addr_t));
+    if (locators == NULL || scores == NULL || pending_referral->ddt_nodes == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"sort_ddt_locators: Unable to allocate memory: %s", strerror(errno));
+        free (locators);
+        free (scores);
+        free (pending_referral->ddt_nodes);
+        pending_referral->ddt_nodes = NULL;
+        pending_referral->ddt_nodes_referral = NULL;
+        return (ERR_MALLOC);
     }
 
-    if (locators_list_length > position){
-        /* Free the sorted locator list and get the ddt locator at the same time */
-        locators_list_elt = sorted_locators_list;
-        ctr = 0;
-        while (locators_list_elt != NULL){
-            if (ctr == position){
-                ddt_locator = locators_list_elt->locator;
-                ddt_locator_addr = *(ddt_locator->locator_addr);
+    /*
+     * Generate list of locators sorted by priority and response time of the node. Nodes that recently answered
+     * they are not authoritative for the requested EID are not asked.
+     */
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        for ( ; locators_list[ctr] != NULL && locators_count < mapping->locator_count ; locators_list[ctr] = locators_list[ctr]->next){
+            aux_locator = locators_list[ctr]->locator;
+            if (is_ddt_node_not_authoritative(aux_locator->locator_addr,
+                    pending_referral->map_cache_entry->mapping->eid_prefix) == TRUE){
+                lispd_log_msg(LISP_LOG_DEBUG_2,"sort_ddt_locators: DDT node %s is not authoritative for %s. Skipping it",
+                        get_char_from_lisp_addr_t(*(aux_locator->locator_addr)),
+                        get_char_from_lisp_addr_t(pending_referral->map_cache_entry->mapping->eid_prefix));
+                continue;
             }
-            prev_locators_list_elt = locators_list_elt;
-            locators_list_elt = locators_list_elt->next;
-            free (prev_locators_list_elt);
-            ctr ++;
+            aux_score = get_ddt_node_score(aux_locator->locator_addr);
+            ctr2 = locators_count;
+            while (ctr2 > 0 && (locators[ctr2-1]->priority > aux_locator->priority ||
+                    (locators[ctr2-1]->priority == aux_locator->priority && scores[ctr2-1] > aux_score))){
+                locators[ctr2] = locators[ctr2-1];
+                scores[ctr2] = scores[ctr2-1];
+                ctr2--;
+            }
+            locators[ctr2] = aux_locator;
+            scores[ctr2] = aux_score;
+            locators_count++;
         }
     }
 
-    return (ddt_locator_addr);
+    for (ctr = 0 ; ctr < locators_count ; ctr++){
+        copy_lisp_addr(&(pending_referral->ddt_nodes[ctr]), locators[ctr]->locator_addr);
+    }
+    pending_referral->ddt_nodes_count = locators_count;
+
+    free (locators);
+    free (scores);
+    return (GOOD);
 }
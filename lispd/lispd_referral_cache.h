@@ -50,6 +50,9 @@ typedef struct lispd_referral_cache_entry_{
     int                                 act_entry_type;
     int                                 ttl;
     timer                               *expiry_ddt_cache_timer;
+    time_t                              expiry_time;
+    uint32_t                            hits;           // DDT resolutions started from this entry since last refresh
+    uint64_t                            prefetch_nonce; // Nonce of the DDT Map Request refreshing the entry. 0 if none
 }lispd_referral_cache_entry;
 
 typedef struct lispd_referral_cache_list_ {
@@ -63,15 +66,51 @@ typedef struct lispd_pending_referral_cache_entry_ {
     nonces_list                     *nonces;
     lispd_referral_cache_entry      *previous_referral;
     int                             tried_locators; // Locators from the list of the referral cache entry that has been asked
+    int                             asked_locators; // Locators asked in parallel starting from tried_locators
     timer                           *ddt_request_retry_timer;
     uint8_t                         request_through_root;
+    uint8_t                         hedge_pending;  // Next expiration of the timer asks the next locator without retransmitting
+    struct lispd_pending_referral_cache_list_   *list_elt; // Element of the list of pending referrals containing the entry
+    struct lispd_pending_referral_nonce_elt_    *nonce_elts; // Nonces of the DDT Map Requests waiting for a Map Referral
+    /* Locators of the referral being asked sorted by priority and response time */
+    lispd_referral_cache_entry      *ddt_nodes_referral;
+    lisp_addr_t                     *ddt_nodes;
+    int                             ddt_nodes_count;
 }lispd_pending_referral_cache_entry;
 
+/*
+ * List of pending referrals. Each element is also chained in the bucket of the EID hash
+ * table of pending referrals. The hash is calculated from the EID prefix of the map cache entry
+ */
 typedef struct lispd_pending_referral_cache_list_ {
     lispd_pending_referral_cache_entry              *pending_referral_cache_entry;
     struct lispd_pending_referral_cache_list_       *next;
+    struct lispd_pending_referral_cache_list_       *prev;
+    struct lispd_pending_referral_cache_list_       *next_in_bucket;
+    uint32_t                                        eid_hash;
 }lispd_pending_referral_cache_list;
 
+/*
+ * Element of the nonce hash table of pending referrals. It also keeps the DDT node
+ * where the request was sent to measure its response time.
+ */
+typedef struct lispd_pending_referral_nonce_elt_ {
+    uint64_t                                        nonce;
+    lispd_pending_referral_cache_entry              *pending_referral_cache_entry;
+    lisp_addr_t                                     ddt_node_addr;
+    struct timespec                                 sent;
+    uint8_t                                         timed_out;
+    struct lispd_pending_referral_nonce_elt_        *next;
+    struct lispd_pending_referral_nonce_elt_        *next_of_entry; // Next nonce of the same pending referral
+}lispd_pending_referral_nonce_elt;
+
+/*
+ * Seconds before the expiry of a MS referral to refresh it if it has been used at least
+ * DDT_REFERRAL_PREFETCH_MIN_HITS times since it was received
+ */
+#define DDT_REFERRAL_PREFETCH_TIME          30
+#define DDT_REFERRAL_PREFETCH_MIN_HITS      2
+
 /*
  * Creates a referral_cache_entry. It is inserted to the tree by add_referral_cache_entry_to_tree
  */
@@ -111,6 +150,22 @@ void add_referral_cache_entry_to_tree (lispd_referral_cache_entry *parent, lispd
  */
 void remove_referral_cache_entry_from_parent_node(lispd_referral_cache_entry *referral_cache_entry);
 
+/*
+ * Register the nonce of the DDT Map Request sent to refresh the referral cache entry
+ */
+
+int add_referral_cache_entry_prefetch(
+        lispd_referral_cache_entry          *referral_cache_entry,
+        uint64_t                            nonce);
+
+/*
+ * Return the referral cache entry being refreshed with the nonce or NULL if not found
+ */
+
+lispd_referral_cache_entry *lookup_referral_cache_entry_prefetch(uint64_t nonce);
+
+void remove_referral_cache_entry_prefetch(lispd_referral_cache_entry *referral_cache_entry);
+
 lispd_pending_referral_cache_entry *new_pending_referral_cache_entry(
         lispd_map_cache_entry           *map_cache_entry,
         lisp_addr_t                     src_eid,
@@ -136,6 +191,43 @@ lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_eid (
 
 lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_nonce (uint64_t nonce);
 
+/*
+ *  Search the DDT Map Request with the nonce. Return NULL if it has not been found
+ */
+
+lispd_pending_referral_nonce_elt *lookup_pending_referral_nonce (uint64_t nonce);
+
+/*
+ * Index the nonce of a DDT Map Request sent for the pending referral to the DDT node
+ */
+
+int add_nonce_to_pending_referral_cache_entry(
+        lispd_pending_referral_cache_entry  *pending_referral,
+        uint64_t                            nonce,
+        lisp_addr_t                         *ddt_node_addr);
+
+/*
+ * Account as timed out the DDT Map Requests of the pending referral not answered yet
+ */
+
+void pending_referral_cache_entry_requests_timeout(lispd_pending_referral_cache_entry *pending_referral);
+
+/*
+ * Remove the nonces of the pending referral from the index and release its list of nonces.
+ * Map Referrals received later for these requests are discarded.
+ */
+
+void free_pending_referral_cache_entry_nonces(lispd_pending_referral_cache_entry *pending_referral);
+
+/*
+ * Update the EID index of pending referrals when the EID prefix of the map cache entry changes
+ */
+
+void update_pending_referral_cache_entry_eid(
+        lispd_map_cache_entry   *map_cache_entry,
+        lisp_addr_t             old_eid_prefix,
+        int                     old_eid_prefix_length);
+
 
 void free_pending_referral_cache_entry(lispd_pending_referral_cache_entry *pending_referral_cache_entry);
 
@@ -144,14 +236,16 @@ void dump_referral_cache_entry(
         int                             log_level);
 
 /*
- * Sort the list of locators of ddt node by its priority and retuns the locator in the position
- * indicated as a parameter. Only the locators of the specified afi are considered except afi =
- * AF_UNSPEC. In that case, we use all locators.
+ * Sort the list of locators of ddt node by its priority and the response time of the node and retuns
+ * the locator in the position indicated as a parameter. Only the locators of the specified afi are
+ * considered. The sorted list is kept in the pending referral while the same referral is asked, so
+ * positions don't change between retries.
  */
 
 lisp_addr_t get_ddt_locator_addr_at_position(
-        lispd_referral_cache_entry  *referral_cache,
-        int                         afi,
-        int                         position);
+        lispd_pending_referral_cache_entry  *pending_referral,
+        lispd_referral_cache_entry          *referral_cache,
+        int                                 afi,
+        int                                 position);
 
 #endif /* LISPD_REFERRAL_CACHE_H_ */
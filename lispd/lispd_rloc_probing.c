@@ -31,13 +31,38 @@
  */
 
 #include "lispd_external.h"
+#include "lispd_fastpath.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_local_db.h"
 #include "lispd_lib.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_map_request.h"
+#include "lispd_output.h"
 #include "lispd_rloc_probing.h"
 
 
+typedef struct rloc_seen_elt_ {
+    lisp_addr_t     rloc;
+    time_t          last_seen;
+} rloc_seen_elt;
+
+static rloc_seen_elt    rloc_seen_table[RLOC_SEEN_TABLE_SIZE];
+
+
+static inline uint32_t get_rloc_hash(lisp_addr_t *rloc)
+{
+    uint8_t     *byte   = (uint8_t *)&(rloc->address);
+    int         len     = get_addr_len(rloc->afi);
+    uint32_t    hash    = 2166136261U; // FNV-1a
+    int         ctr     = 0;
+
+    for (ctr = 0; ctr < len; ctr++){
+        hash = (hash ^ byte[ctr]) * 16777619U;
+    }
+    return (hash);
+}
+
+
 /*
  * Send a Map-Request probe to check the status of the locator passed through arg
  * If the number of retries without answer is higher than rloc_probe_retries. Change the status of the locator to down
@@ -106,6 +131,24 @@ int rloc_probing(
         locator_ext_inf->rloc_probing_nonces = nonces;
     }
 
+    /*
+     * A new probe cycle of an UP locator is not needed if we have recently received data from it.
+     * Probing is kept for idle and suspect locators, and for the locators of mappings with several
+     * locators when a traffic class selects them by their RTT: the probes measure it.
+     */
+
+    if (nonces->retransmits == 0 && *(locator->state) == UP &&
+            time(NULL) - rloc_last_seen(locator->locator_addr) < rloc_probe_interval &&
+            (mapping->locator_count < 2 || is_lowest_rtt_policy_configured() == FALSE)){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"rloc_probing: Recent data received from locator %s of the EID %s/%d. "
+                "Postponing RLOC probing %d seconds",
+                get_char_from_lisp_addr_t(*(locator->locator_addr)),
+                get_char_from_lisp_addr_t(mapping->eid_prefix),
+                mapping->eid_prefix_length, rloc_probe_interval);
+        start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, arg);
+        return (GOOD);
+    }
+
     /*
      * If the number of retransmits is less than rloc_probe_retries, then try to send the Map Request Probe again
      */
@@ -120,6 +163,9 @@ int rloc_probing(
         }
 
         opts.probe = TRUE;
+        if (nonces->retransmits == 0){
+            clock_gettime(CLOCK_MONOTONIC, &(locator_ext_inf->probe_time));
+        }
         err = build_and_send_map_request_msg(mapping,NULL,locator->locator_addr,opts,&(nonces->nonce[nonces->retransmits]));
 
         if (err != GOOD){
@@ -135,6 +181,7 @@ int rloc_probing(
     }else{ /* If we have reached maximum number of retransmissions, change remote locator status */
         if (*(locator->state) == UP){
             *(locator->state) = DOWN;
+            flight_record(FLIGHT_RLOC_STATE, locator->locator_addr, 0, 0, 0, 0);
             lispd_log_msg(LISP_LOG_DEBUG_1,"rloc_probing: No Map-Reply Probe received for locator %s and EID: %s/%d"
                     "-> Locator state changes to DOWN",
                     get_char_from_lisp_addr_t(*(locator->locator_addr)),
@@ -145,6 +192,7 @@ int rloc_probing(
             calculate_balancing_vectors (
                     mapping,
                     &(((rmt_mapping_extended_info *)mapping->extended_info)->rmt_balancing_locators_vecs));
+            fastpath_update_map_cache_entry(timer_argument->map_cache_entry);
         }
         free (locator_ext_inf->rloc_probing_nonces);
         locator_ext_inf->rloc_probing_nonces = NULL;
@@ -167,9 +215,6 @@ int rloc_probing(
 void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry)
 {
     lispd_locators_list         *locators_lists[2]  = {NULL,NULL};
-    lispd_locator_elt           *locator            = NULL;
-    timer_rloc_probe_argument   *timer_arg          = NULL;
-    rmt_locator_extended_info   *locator_ext_inf    = NULL;
     int                         ctr                 = 0;
 
     locators_lists[0] = map_cache_entry->mapping->head_v4_locators_list;
@@ -177,19 +222,32 @@ void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry)
     /* Start rloc probing for each locator of the mapping */
     for (ctr=0; ctr < 2 ; ctr++){
         while (locators_lists[ctr] != NULL){
-            locator = locators_lists[ctr]->locator;
-            locator_ext_inf = (rmt_locator_extended_info *)locator->extended_info;
-            timer_arg = new_timer_rloc_probe_argument (map_cache_entry, locator);
-            /* Create and program the timer */
-            if (locator_ext_inf->probe_timer == NULL){
-                locator_ext_inf->probe_timer = create_timer (RLOC_PROBING_TIMER);
-            }
-            start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, (void *)timer_arg);
+            programming_locator_rloc_probing(map_cache_entry, locators_lists[ctr]->locator);
             locators_lists[ctr] = locators_lists[ctr]->next;
         }
     }
 }
 
+/*
+ * Program RLOC probing for a locator of the mapping
+ */
+
+void programming_locator_rloc_probing(
+        lispd_map_cache_entry   *map_cache_entry,
+        lispd_locator_elt       *locator)
+{
+    timer_rloc_probe_argument   *timer_arg          = NULL;
+    rmt_locator_extended_info   *locator_ext_inf    = NULL;
+
+    locator_ext_inf = (rmt_locator_extended_info *)locator->extended_info;
+    timer_arg = new_timer_rloc_probe_argument (map_cache_entry, locator);
+    /* Create and program the timer */
+    if (locator_ext_inf->probe_timer == NULL){
+        locator_ext_inf->probe_timer = create_timer (RLOC_PROBING_TIMER);
+    }
+    start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, (void *)timer_arg);
+}
+
 /*
  * Program RLOC probing for each proxy-ETR
  */
@@ -241,3 +299,55 @@ timer_rloc_probe_argument *new_timer_rloc_probe_argument(
 
     return (timer_argument);
 }
+
+
+/*
+ * Update the RTT of the locator when its Map-Reply probe is received. To be called before
+ * releasing the nonces of the locator. Following Karn's algorithm, only probes answered
+ * without retransmissions are used as samples.
+ */
+
+void rloc_probe_reply_received(lispd_locator_elt *locator)
+{
+    rmt_locator_extended_info   *locator_ext_inf    = (rmt_locator_extended_info *)(locator->extended_info);
+    uint32_t                    rtt                 = 0;
+
+    if (locator_ext_inf->rloc_probing_nonces == NULL || locator_ext_inf->rloc_probing_nonces->retransmits != 1){
+        return;
+    }
+    rtt = get_elapsed_ms(&(locator_ext_inf->probe_time));
+    update_rtt_estimation(&(locator_ext_inf->latency), &(locator_ext_inf->rttvar), rtt);
+
+    lispd_log_msg(LISP_LOG_DEBUG_3,"RLOC %s: rtt %u ms, srtt %u ms, rttvar %u ms",
+            get_char_from_lisp_addr_t(*(locator->locator_addr)), rtt, locator_ext_inf->latency, locator_ext_inf->rttvar);
+}
+
+/*
+ * Register that a data packet from the RLOC has been received
+ */
+
+void rloc_seen(lisp_addr_t *rloc)
+{
+    rloc_seen_elt   *elt    = NULL;
+
+    elt = &(rloc_seen_table[get_rloc_hash(rloc) & (RLOC_SEEN_TABLE_SIZE - 1)]);
+    if (compare_lisp_addr_t(&(elt->rloc), rloc) != 0){
+        copy_lisp_addr(&(elt->rloc), rloc);
+    }
+    elt->last_seen = time(NULL);
+}
+
+/*
+ * Return the time of the last data packet received from the RLOC or 0 if not known
+ */
+
+time_t rloc_last_seen(lisp_addr_t *rloc)
+{
+    rloc_seen_elt   *elt    = NULL;
+
+    elt = &(rloc_seen_table[get_rloc_hash(rloc) & (RLOC_SEEN_TABLE_SIZE - 1)]);
+    if (compare_lisp_addr_t(&(elt->rloc), rloc) != 0){
+        return (0);
+    }
+    return (elt->last_seen);
+}
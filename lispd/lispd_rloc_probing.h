@@ -52,10 +52,46 @@ int rloc_probing(
 
 void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry);
 
+/*
+ * Program RLOC probing for a locator of the mapping
+ */
+
+void programming_locator_rloc_probing(
+        lispd_map_cache_entry   *map_cache_entry,
+        lispd_locator_elt       *locator);
+
 /*
  * Program RLOC probing for each proxy-ETR
  */
 
 void programming_petr_rloc_probing();
 
+/*
+ * Update the RTT of the locator when its Map-Reply probe is received. To be called before
+ * releasing the nonces of the locator
+ */
+
+void rloc_probe_reply_received(lispd_locator_elt *locator);
+
+/*
+ * Passive liveness of the remote RLOCs. The time of the last data packet received from each
+ * RLOC is kept in a direct mapped table of RLOC_SEEN_TABLE_SIZE entries (power of 2). A locator
+ * that is UP and from which data has been received in the last rloc_probe_interval seconds is
+ * not probed in that interval. Collisions only cause extra probes.
+ */
+
+#define RLOC_SEEN_TABLE_SIZE    1024
+
+/*
+ * Register that a data packet from the RLOC has been received
+ */
+
+void rloc_seen(lisp_addr_t *rloc);
+
+/*
+ * Return the time of the last data packet received from the RLOC or 0 if not known
+ */
+
+time_t rloc_last_seen(lisp_addr_t *rloc);
+
 #endif /*LISPD_RLOC_PROBING_H_*/
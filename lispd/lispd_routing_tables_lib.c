@@ -243,8 +243,13 @@ int add_rule(
     int result = BAD;
     result = modify_rule(afi, if_index, RTM_NEWRULE, table,priority, type, src_addr, src_plen, dst_addr, dst_plen, flags);
     if (result == GOOD){
-        lispd_log_msg(LISP_LOG_DEBUG_1, "add_rule: Add rule for source routing of src addr: %s",
-                get_char_from_lisp_addr_t(*src_addr));
+        if (src_addr != NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "add_rule: Add rule for source routing of src addr: %s",
+                    get_char_from_lisp_addr_t(*src_addr));
+        }else if (dst_addr != NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "add_rule: Add rule for dst addr: %s/%d",
+                    get_char_from_lisp_addr_t(*dst_addr), dst_plen);
+        }
     }
 
     return (result);
@@ -269,8 +274,13 @@ int del_rule(
     int result = BAD;
     result = modify_rule(afi, if_index, RTM_DELRULE, table,priority, type, src_addr, src_plen, dst_addr, dst_plen, flags);
     if (result == GOOD){
-        lispd_log_msg(LISP_LOG_DEBUG_1, "del_rule: Removed rule for source routing of src addr: %s",
-                get_char_from_lisp_addr_t(*src_addr));
+        if (src_addr != NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "del_rule: Removed rule for source routing of src addr: %s",
+                    get_char_from_lisp_addr_t(*src_addr));
+        }else if (dst_addr != NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "del_rule: Removed rule for dst addr: %s/%d",
+                    get_char_from_lisp_addr_t(*dst_addr), dst_plen);
+        }
     }
 
     return (result);
@@ -31,11 +31,28 @@
 #include "lispd_map_cache_db.h"
 #include "lispd_map_register.h"
 #include "lispd_map_request.h"
+#include "lispd_map_resolver.h"
 #include "lispd_smr.h"
 #include "lispd_external.h"
 #include "lispd_log.h"
 
 
+/********************************** Function declaration ********************************/
+
+static void smr_map_cache_entry(
+        lispd_map_cache_entry   *map_cache_entry,
+        lispd_mapping_elt       *smr_mapping,
+        map_request_opts        opts);
+static int get_map_cache_entries_by_activity(
+        patricia_tree_t         *map_cache_db,
+        lispd_map_cache_entry   ***entries);
+static int compare_map_cache_entry_activity(
+        const void  *entry1,
+        const void  *entry2);
+
+/****************************************************************************************/
+
+
 /*
  * Send a solicit map request for each rloc of all eids in the map cahce database
  */
@@ -46,16 +63,15 @@ void init_smr(
     lispd_iface_list_elt        *iface_list         = NULL;
     lispd_iface_mappings_list   *mappings_list      = NULL;
     patricia_tree_t             *map_cache_dbs [2]  = {NULL,NULL};
-    lispd_locators_list         *locators_lists[2]  = {NULL,NULL};
     lispd_mapping_elt           *mapping            = NULL;
     uint64_t                    nonce               = 0;
     patricia_node_t             *map_cache_node     = NULL;
     lispd_map_cache_entry       *map_cache_entry    = NULL;
-    lispd_locators_list         *locator_iterator   = NULL;
-    lispd_locator_elt           *locator            = NULL;
+    lispd_map_cache_entry       **entries           = NULL;
     lispd_mapping_elt           **mappings_to_smr   = NULL;
     lispd_addr_list_t           *pitr_elt           = NULL;
     int                         mappings_ctr        = 0;
+    int                         entries_ctr         = 0;
     int                         ctr=0,ctr1=0;
     int                         afi_db              = 0;
     map_request_opts            opts;
@@ -113,13 +129,15 @@ void init_smr(
      * Send map register and SMR request for each affected mapping
      */
 
+    /* Behind NAT, each interface registers its mappings through its RTR */
+    if (mappings_ctr != 0 && nat_aware == TRUE && nat_status != NO_NAT && nat_status != UNKNOWN){
+        map_register(NULL,NULL);
+    }
+
     for (ctr = 0 ; ctr < mappings_ctr ; ctr++){
         /* Send map register for the affected mapping */
         if (nat_aware == FALSE || nat_status == NO_NAT){
             build_and_send_map_register_msg(mappings_to_smr[ctr]);
-        }else if (nat_status != UNKNOWN){
-            // TODO : We suppose one EID and one interface. To be modified when multiple elements
-            map_register(NULL,NULL);
         }
 
         lispd_log_msg(LISP_LOG_DEBUG_1, "Start SMR for local EID %s/%d",
@@ -132,29 +150,20 @@ void init_smr(
         }else{
             afi_db = 1;
         }
-        PATRICIA_WALK(map_cache_dbs[afi_db]->head, map_cache_node) {
-            map_cache_entry = ((lispd_map_cache_entry *)(map_cache_node->data));
-            locators_lists[0] = map_cache_entry->mapping->head_v4_locators_list;
-            locators_lists[1] = map_cache_entry->mapping->head_v6_locators_list;
-            for (ctr1 = 0 ; ctr1 < 2 ; ctr1++){ /*For echa IPv4 and IPv6 locator*/
-
-                if (map_cache_entry->active && locators_lists[ctr1] != NULL){
-                    locator_iterator = locators_lists[ctr1];
-
-                    while (locator_iterator){
-                        locator = locator_iterator->locator;
-                        if (build_and_send_map_request_msg(map_cache_entry->mapping,&(mappings_to_smr[ctr]->eid_prefix),locator->locator_addr,opts,&nonce)==GOOD){
-                            lispd_log_msg(LISP_LOG_DEBUG_1, "  SMR'ing RLOC %s from EID %s/%d",
-                                    get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                                    get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
-                                    map_cache_entry->mapping->eid_prefix_length);
-                        }
-
-                        locator_iterator = locator_iterator->next;
-                    }
-                }
+        if (fast_handover == TRUE){
+            /* The peers that sent to us most recently are the first ones to know the new locators */
+            entries_ctr = get_map_cache_entries_by_activity(map_cache_dbs[afi_db], &entries);
+            for (ctr1 = 0 ; ctr1 < entries_ctr ; ctr1++){
+                smr_map_cache_entry(entries[ctr1], mappings_to_smr[ctr], opts);
             }
-        }PATRICIA_WALK_END;
+            free (entries);
+            entries = NULL;
+        }else{
+            PATRICIA_WALK(map_cache_dbs[afi_db]->head, map_cache_node) {
+                map_cache_entry = ((lispd_map_cache_entry *)(map_cache_node->data));
+                smr_map_cache_entry(map_cache_entry, mappings_to_smr[ctr], opts);
+            }PATRICIA_WALK_END;
+        }
         /* SMR proxy-itr */
         pitr_elt  = proxy_itrs;
 
@@ -178,6 +187,94 @@ void init_smr(
     lispd_log_msg(LISP_LOG_DEBUG_2,"*** Finish SMR notification ***");
 }
 
+/*
+ * Send a SMR to each locator of an active map cache entry
+ */
+static void smr_map_cache_entry(
+        lispd_map_cache_entry   *map_cache_entry,
+        lispd_mapping_elt       *smr_mapping,
+        map_request_opts        opts)
+{
+    lispd_locators_list         *locators_lists[2]  = {NULL,NULL};
+    lispd_locators_list         *locator_iterator   = NULL;
+    lispd_locator_elt           *locator            = NULL;
+    uint64_t                    nonce               = 0;
+    int                         ctr                 = 0;
+
+    if (!map_cache_entry->active){
+        return;
+    }
+    locators_lists[0] = map_cache_entry->mapping->head_v4_locators_list;
+    locators_lists[1] = map_cache_entry->mapping->head_v6_locators_list;
+    for (ctr = 0 ; ctr < 2 ; ctr++){ /*For echa IPv4 and IPv6 locator*/
+        locator_iterator = locators_lists[ctr];
+        while (locator_iterator){
+            locator = locator_iterator->locator;
+            if (build_and_send_map_request_msg(map_cache_entry->mapping,&(smr_mapping->eid_prefix),locator->locator_addr,opts,&nonce)==GOOD){
+                lispd_log_msg(LISP_LOG_DEBUG_1, "  SMR'ing RLOC %s from EID %s/%d",
+                        get_char_from_lisp_addr_t(*(locator->locator_addr)),
+                        get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
+                        map_cache_entry->mapping->eid_prefix_length);
+            }
+            locator_iterator = locator_iterator->next;
+        }
+    }
+}
+
+/*
+ * Return in entries the active map cache entries of the database sorted by the time of the
+ * last packet received from them (most recent first). Return the number of entries
+ */
+static int get_map_cache_entries_by_activity(
+        patricia_tree_t         *map_cache_db,
+        lispd_map_cache_entry   ***entries)
+{
+    patricia_node_t             *node               = NULL;
+    lispd_map_cache_entry       *map_cache_entry    = NULL;
+    lispd_map_cache_entry       **aux_entries       = NULL;
+    int                         entries_ctr         = 0;
+    int                         size                = 0;
+
+    *entries = NULL;
+    PATRICIA_WALK(map_cache_db->head, node) {
+        map_cache_entry = ((lispd_map_cache_entry *)(node->data));
+        if (map_cache_entry->active){
+            if (entries_ctr == size){
+                size = (size == 0) ? 64 : size * 2;
+                aux_entries = (lispd_map_cache_entry **)realloc(*entries, size * sizeof(lispd_map_cache_entry *));
+                if (aux_entries == NULL){
+                    lispd_log_msg(LISP_LOG_WARNING, "get_map_cache_entries_by_activity: Unable to allocate memory: %s", strerror(errno));
+                    break;
+                }
+                *entries = aux_entries;
+            }
+            (*entries)[entries_ctr] = map_cache_entry;
+            entries_ctr++;
+        }
+    }PATRICIA_WALK_END;
+
+    if (entries_ctr > 1){
+        qsort(*entries, entries_ctr, sizeof(lispd_map_cache_entry *), compare_map_cache_entry_activity);
+    }
+    return (entries_ctr);
+}
+
+static int compare_map_cache_entry_activity(
+        const void  *entry1,
+        const void  *entry2)
+{
+    time_t  activity1   = (*(lispd_map_cache_entry **)entry1)->last_activity;
+    time_t  activity2   = (*(lispd_map_cache_entry **)entry2)->last_activity;
+
+    if (activity1 > activity2){
+        return (-1);
+    }
+    if (activity1 < activity2){
+        return (1);
+    }
+    return (0);
+}
+
 
 int solicit_map_request_reply(
         timer *timer,
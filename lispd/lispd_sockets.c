@@ -28,6 +28,7 @@
 
 #include "lispd_sockets.h"
 #include "lispd_log.h"
+#include "lispd_stats.h"
 
 
 
@@ -417,6 +418,7 @@ int send_packet (
                 get_char_from_lisp_addr_t(pkt_src_addr),
                 get_char_from_lisp_addr_t(pkt_dst_addr),
                 sock);
+        stats.drops[STATS_DROP_SEND_ERROR]++;
         return (BAD);
     }
 
@@ -424,6 +426,144 @@ int send_packet (
 
 }
 
+/*
+ * Sends a batch of raw packets through the specified socket with a single system call
+ */
+
+int send_packet_batch (
+        int     sock,
+        uint8_t **packets,
+        int     *packet_lengths,
+        int     count)
+{
+    struct mmsghdr          msgs[MAX_SEND_BATCH];
+    struct iovec            iovs[MAX_SEND_BATCH];
+    struct sockaddr_in6     dst_addrs[MAX_SEND_BATCH]; /* Large enough for IPv4 and IPv6 */
+    struct sockaddr_in      *dst_addr4      = NULL;
+    struct iphdr            *iph            = NULL;
+    struct ip6_hdr          *ip6h           = NULL;
+    int                     sent            = 0;
+    int                     ctr             = 0;
+    int                     result          = GOOD;
+
+    if (count > MAX_SEND_BATCH){
+        count = MAX_SEND_BATCH;
+    }
+
+    memset (msgs, 0, count * sizeof(struct mmsghdr));
+    memset (dst_addrs, 0, count * sizeof(struct sockaddr_in6));
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        iph = ( struct iphdr * ) packets[ctr];
+        switch(iph->version){
+        case 4:
+            dst_addr4 = (struct sockaddr_in *)&(dst_addrs[ctr]);
+            dst_addr4->sin_family = AF_INET;
+            dst_addr4->sin_addr.s_addr = iph->daddr;
+            msgs[ctr].msg_hdr.msg_namelen = sizeof ( struct sockaddr_in );
+            break;
+        case 6:
+            ip6h = (struct ip6_hdr *) packets[ctr];
+            dst_addrs[ctr].sin6_family = AF_INET6;
+            dst_addrs[ctr].sin6_addr = ip6h->ip6_dst;
+            msgs[ctr].msg_hdr.msg_namelen = sizeof ( struct sockaddr_in6 );
+            break;
+        }
+        iovs[ctr].iov_base = packets[ctr];
+        iovs[ctr].iov_len = packet_lengths[ctr];
+        msgs[ctr].msg_hdr.msg_name = &(dst_addrs[ctr]);
+        msgs[ctr].msg_hdr.msg_iov = &(iovs[ctr]);
+        msgs[ctr].msg_hdr.msg_iovlen = 1;
+    }
+
+    sent = sendmmsg (sock, msgs, count, 0);
+    if (sent < 0){
+        sent = 0;
+    }
+
+    /* The packets not sent are retried one by one. send_packet logs the error of each one */
+    for (ctr = sent ; ctr < count ; ctr++){
+        if (send_packet (sock, packets[ctr], packet_lengths[ctr]) != GOOD){
+            result = BAD;
+        }
+    }
+
+    return (result);
+}
+
+/*
+ * Sends copies of a payload with a different header each one with a single system call. The
+ * payload is not copied: each message is composed of its header and the shared payload.
+ */
+
+int send_packet_replicas (
+        int     sock,
+        uint8_t **headers,
+        int     header_length,
+        uint8_t *payload,
+        int     payload_length,
+        int     count)
+{
+    struct mmsghdr          msgs[MAX_SEND_BATCH];
+    struct iovec            iovs[MAX_SEND_BATCH][2];
+    struct sockaddr_in6     dst_addrs[MAX_SEND_BATCH]; /* Large enough for IPv4 and IPv6 */
+    struct sockaddr_in      *dst_addr4      = NULL;
+    struct iphdr            *iph            = NULL;
+    struct ip6_hdr          *ip6h           = NULL;
+    int                     sent            = 0;
+    int                     ctr             = 0;
+    int                     result          = GOOD;
+
+    if (count > MAX_SEND_BATCH){
+        count = MAX_SEND_BATCH;
+    }
+
+    memset (msgs, 0, count * sizeof(struct mmsghdr));
+    memset (dst_addrs, 0, count * sizeof(struct sockaddr_in6));
+
+    for (ctr = 0 ; ctr < count ; ctr++){
+        iph = ( struct iphdr * ) headers[ctr];
+        switch(iph->version){
+        case 4:
+            dst_addr4 = (struct sockaddr_in *)&(dst_addrs[ctr]);
+            dst_addr4->sin_family = AF_INET;
+            dst_addr4->sin_addr.s_addr = iph->daddr;
+            msgs[ctr].msg_hdr.msg_namelen = sizeof ( struct sockaddr_in );
+            break;
+        case 6:
+            ip6h = (struct ip6_hdr *) headers[ctr];
+            dst_addrs[ctr].sin6_family = AF_INET6;
+            dst_addrs[ctr].sin6_addr = ip6h->ip6_dst;
+            msgs[ctr].msg_hdr.msg_namelen = sizeof ( struct sockaddr_in6 );
+            break;
+        }
+        iovs[ctr][0].iov_base = headers[ctr];
+        iovs[ctr][0].iov_len = header_length;
+        iovs[ctr][1].iov_base = payload;
+        iovs[ctr][1].iov_len = payload_length;
+        msgs[ctr].msg_hdr.msg_name = &(dst_addrs[ctr]);
+        msgs[ctr].msg_hdr.msg_iov = iovs[ctr];
+        msgs[ctr].msg_hdr.msg_iovlen = 2;
+    }
+
+    sent = sendmmsg (sock, msgs, count, 0);
+    if (sent < 0){
+        sent = 0;
+    }
+
+    /* The copies not sent are retried one by one */
+    for (ctr = sent ; ctr < count ; ctr++){
+        if (sendmsg (sock, &(msgs[ctr].msg_hdr), 0) != header_length + payload_length){
+            lispd_log_msg( LISP_LOG_DEBUG_2, "send_packet_replicas: send failed %s. Socket: %d",
+                    strerror ( errno ), sock);
+            stats.drops[STATS_DROP_SEND_ERROR]++;
+            result = BAD;
+        }
+    }
+
+    return (result);
+}
+
 /*
  * Get a packet from the socket. It also returns the destination addres and source port of the packet
  */
@@ -433,6 +573,7 @@ int get_packet_and_socket_inf (
         int             afi,
         uint8_t         *packet,
         lisp_addr_t     *local_rloc,
+        lisp_addr_t     *remote_rloc,
         uint16_t        *remote_port)
 {
     union control_data {
@@ -451,7 +592,7 @@ int get_packet_and_socket_inf (
     int                 nbytes      = 0;
 
     iov[0].iov_base = packet;
-    iov[0].iov_len = MAX_IP_PACKET;
+    iov[0].iov_len = max_ip_packet;
 
     memset(&msg, 0, sizeof msg);
     msg.msg_iov = iov;
@@ -481,6 +622,8 @@ int get_packet_and_socket_inf (
             }
         }
 
+        remote_rloc->afi = AF_INET;
+        remote_rloc->address.ip = s4.sin_addr;
         *remote_port = ntohs(s4.sin_port);
     }else {
         for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL; cmsgptr = CMSG_NXTHDR(&msg, cmsgptr)) {
@@ -492,6 +635,8 @@ int get_packet_and_socket_inf (
                 break;
             }
         }
+        remote_rloc->afi = AF_INET6;
+        remote_rloc->address.ipv6 = s6.sin6_addr;
         *remote_port = ntohs(s6.sin6_port);
     }
 
@@ -505,7 +650,8 @@ int get_data_packet (
     uint8_t         *packet,
     int             *length,
     uint8_t         *ttl,
-    uint8_t         *tos)
+    uint8_t         *tos,
+    lisp_addr_t     *src_rloc)
 {
 
     union control_data {
@@ -522,7 +668,7 @@ int get_data_packet (
     int                 nbytes      = 0;
     
     iov[0].iov_base = packet;
-    iov[0].iov_len = MAX_IP_PACKET;
+    iov[0].iov_len = IP_MAXPACKET;
     
     memset(&msg, 0, sizeof msg);
     msg.msg_iov = iov;
@@ -542,8 +688,20 @@ int get_data_packet (
         lispd_log_msg(LISP_LOG_WARNING, "read_packet: recvmsg error: %s", strerror(errno));
         return (BAD);
     }
+    if (msg.msg_flags & MSG_TRUNC){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "get_data_packet: Packet bigger than the receive buffer (%d bytes). Discarding it",
+                IP_MAXPACKET);
+        return (BAD);
+    }
 
     *length = nbytes;
+
+    src_rloc->afi = afi;
+    if (afi == AF_INET){
+        src_rloc->address.ip = s4.sin_addr;
+    }else{
+        src_rloc->address.ipv6 = s6.sin6_addr;
+    }
     
     if (afi == AF_INET){
         for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL; cmsgptr = CMSG_NXTHDR(&msg, cmsgptr)) {
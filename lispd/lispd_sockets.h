@@ -40,6 +40,8 @@
 #include "lispd_lib.h"
 #include "lispd_output.h"
 
+/* Max number of packets sent by send_packet_batch */
+#define MAX_SEND_BATCH      OUTPUT_BATCH_SIZE
 
 int open_device_binded_raw_socket(
     char *device,
@@ -65,8 +67,31 @@ int send_packet (
         int     packet_length );
 
 /*
- * Get a packet from the socket. It also returns the destination addres and source port of the packet.
- * Used for control packets
+ * Sends a batch of raw packets through the specified socket. Up to MAX_SEND_BATCH packets
+ */
+
+int send_packet_batch (
+        int     sock,
+        uint8_t **packets,
+        int     *packet_lengths,
+        int     count);
+
+/*
+ * Sends copies of the payload through the specified socket, each one after its own header of
+ * header_length bytes. The copies share the payload buffer. Up to MAX_SEND_BATCH copies
+ */
+
+int send_packet_replicas (
+        int     sock,
+        uint8_t **headers,
+        int     header_length,
+        uint8_t *payload,
+        int     payload_length,
+        int     count);
+
+/*
+ * Get a packet from the socket. It also returns the destination addres and the source address and
+ * port of the packet. Used for control packets
  */
 
 int get_packet_and_socket_inf (
@@ -74,14 +99,21 @@ int get_packet_and_socket_inf (
         int             afi,
         uint8_t         *packet,
         lisp_addr_t     *local_rloc,
+        lisp_addr_t     *remote_rloc,
         uint16_t        *remote_port);
 
+/*
+ * Get a data packet from the socket. It also returns the TTL, the TOS and the source RLOC of the packet.
+ * The packet buffer must have IP_MAXPACKET bytes
+ */
+
 int get_data_packet (
     int             sock,
     int             afi,
     uint8_t         *packet,
     int             *length,
     uint8_t         *ttl,
-    uint8_t         *tos);
+    uint8_t         *tos,
+    lisp_addr_t     *src_rloc);
 
 #endif /*LISPD_SOCKETS_H_*/
@@ -0,0 +1,508 @@
+/*
+ * lispd_stats.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Runtime counters and latency histograms of lispd.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <inttypes.h>
+#include "lispd_log.h"
+#include "lispd_map_cache_db.h"
+#include "lispd_map_resolver.h"
+#include "lispd_stats.h"
+#include "lispd_timers.h"
+
+
+lispd_stats     stats;
+
+static const char *drop_reason_names[STATS_DROP_REASONS] = {
+        "malformed",
+        "negative_mapping",
+        "no_locator",
+        "send_error",
+        "receive_error",
+        "tun_write"
+};
+
+/* Names of the control message types. NULL for the types not used by LISP */
+static const char *control_type_names[STATS_CONTROL_TYPES] = {
+        NULL,
+        "map_request",
+        "map_reply",
+        "map_register",
+        "map_notify",
+        NULL,
+        "map_referral",
+        "info_nat",
+        "encap_control"
+};
+
+#ifdef LISPD_LATENCY_STATS
+static const char *stage_names[STATS_STAGES] = {
+        "classify",
+        "lookup",
+        "select",
+        "encap",
+        "send",
+        "decap",
+        "tun_write",
+        "map_reply"
+};
+#endif
+
+
+/********************************** Function declaration ********************************/
+
+static int histogram_bucket(uint64_t value);
+static uint64_t histogram_bucket_limit(int bucket);
+static void write_histogram_json(
+        FILE                *out,
+        const char          *name,
+        lispd_histogram     *hist,
+        int                 last);
+static void write_histogram_prometheus(
+        FILE                *out,
+        const char          *name,
+        const char          *labels,
+        const char          *help,
+        lispd_histogram     *hist,
+        double              units_per_second);
+static void write_prometheus_metric(
+        FILE                *out,
+        const char          *name,
+        const char          *type,
+        const char          *help,
+        uint64_t            value);
+static void get_kernel_reassembly_stats(
+        uint64_t            *reassembled,
+        uint64_t            *failed);
+
+/****************************************************************************************/
+
+
+void histogram_record(
+        lispd_histogram     *hist,
+        uint64_t            value)
+{
+    histogram_record_n(hist, value, 1);
+}
+
+
+void histogram_record_n(
+        lispd_histogram     *hist,
+        uint64_t            value,
+        uint64_t            count)
+{
+    hist->buckets[histogram_bucket(value)] += count;
+    hist->count += count;
+    hist->sum += value * count;
+    if (value > hist->max){
+        hist->max = value;
+    }
+}
+
+
+uint64_t histogram_percentile(
+        lispd_histogram     *hist,
+        double              percentile)
+{
+    uint64_t    target      = 0;
+    uint64_t    accumulated = 0;
+    uint64_t    limit       = 0;
+    int         bucket      = 0;
+
+    if (hist->count == 0){
+        return (0);
+    }
+    target = (uint64_t)(hist->count * percentile / 100.0 + 0.5);
+    if (target == 0){
+        target = 1;
+    }
+    for (bucket = 0 ; bucket < HIST_BUCKETS ; bucket++){
+        accumulated += hist->buckets[bucket];
+        if (accumulated >= target){
+            break;
+        }
+    }
+    limit = histogram_bucket_limit(bucket);
+    return (limit < hist->max ? limit : hist->max);
+}
+
+
+#ifdef LISPD_LATENCY_STATS
+void stage_record(
+        int                 stage,
+        struct timespec     *start,
+        int                 count)
+{
+    struct timespec     now;
+    uint64_t            elapsed     = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000 + now.tv_nsec - start->tv_nsec;
+    if (count < 1){
+        count = 1;
+    }
+    histogram_record_n(&(stats.stage_latency[stage]), elapsed / count, count);
+    *start = now;
+}
+#endif
+
+
+const char *get_control_type_name(int type)
+{
+    if (type < 0 || type >= STATS_CONTROL_TYPES){
+        return (NULL);
+    }
+    return (control_type_names[type]);
+}
+
+
+void stats_write_json(FILE *out)
+{
+    uint64_t            reassembled         = 0;
+    uint64_t            reassembly_failed   = 0;
+    int                 map_cache_entries   = 0;
+    int                 map_cache_pending   = 0;
+    int                 map_cache_nonces    = 0;
+    int                 running_timers      = 0;
+    int                 expirations         = 0;
+    int                 ctr                 = 0;
+    int                 first               = TRUE;
+
+    get_map_cache_stats(&map_cache_entries, &map_cache_pending, &map_cache_nonces);
+    get_timer_wheel_stats(&running_timers, &expirations);
+    get_kernel_reassembly_stats(&reassembled, &reassembly_failed);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"data\": {\"encap_packets\": %"PRIu64", \"encap_bytes\": %"PRIu64", "
+            "\"decap_packets\": %"PRIu64", \"decap_bytes\": %"PRIu64", \"native_packets\": %"PRIu64"},\n",
+            stats.encap_packets, stats.encap_bytes, stats.decap_packets, stats.decap_bytes, stats.native_packets);
+
+    fprintf(out, "  \"drops\": {");
+    for (ctr = 0 ; ctr < STATS_DROP_REASONS ; ctr++){
+        fprintf(out, "%s\"%s\": %"PRIu64, ctr == 0 ? "" : ", ", drop_reason_names[ctr], stats.drops[ctr]);
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"map_cache\": {\"entries\": %d, \"pending\": %d, \"pending_nonces\": %d, \"hits\": %"PRIu64", "
+            "\"misses\": %"PRIu64", \"expirations\": %"PRIu64"},\n",
+            map_cache_entries, map_cache_pending, map_cache_nonces, stats.map_cache_hits, stats.map_cache_misses,
+            stats.map_cache_expirations);
+
+    fprintf(out, "  \"control\": {\"map_requests_sent\": %"PRIu64", \"map_request_timeouts\": %"PRIu64", "
+            "\"map_replies_sent\": %"PRIu64", \"rloc_probes_sent\": %"PRIu64", \"smrs_sent\": %"PRIu64", "
+            "\"map_registers_sent\": %"PRIu64", \"pending_map_requests\": %d, \"received\": {",
+            stats.map_requests_sent, stats.map_request_timeouts, stats.map_replies_sent,
+            stats.rloc_probes_sent, stats.smrs_sent, stats.map_registers_sent, get_pending_map_requests());
+    for (ctr = 0 ; ctr < STATS_CONTROL_TYPES ; ctr++){
+        if (control_type_names[ctr] == NULL){
+            continue;
+        }
+        fprintf(out, "%s\"%s\": %"PRIu64, first == TRUE ? "" : ", ", control_type_names[ctr], stats.control_received[ctr]);
+        first = FALSE;
+    }
+    fprintf(out, "}},\n");
+
+    fprintf(out, "  \"timers\": {\"running\": %d, \"expirations\": %d},\n", running_timers, expirations);
+
+    fprintf(out, "  \"kernel_reassembly\": {\"reassembled\": %"PRIu64", \"failed\": %"PRIu64"},\n",
+            reassembled, reassembly_failed);
+
+    fprintf(out, "  \"log\": {\"dropped\": %u},\n", get_log_dropped());
+
+    fprintf(out, "  \"histograms_us\": {\n");
+    write_histogram_json(out, "map_request_latency", &(stats.map_request_latency), TRUE);
+#ifdef LISPD_LATENCY_STATS
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"stages_ns\": {\n");
+    for (ctr = 0 ; ctr < STATS_STAGES ; ctr++){
+        write_histogram_json(out, stage_names[ctr], &(stats.stage_latency[ctr]), ctr == STATS_STAGES - 1);
+    }
+#endif
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+
+void stats_write_prometheus(FILE *out)
+{
+    uint64_t            reassembled         = 0;
+    uint64_t            reassembly_failed   = 0;
+    int                 map_cache_entries   = 0;
+    int                 map_cache_pending   = 0;
+    int                 map_cache_nonces    = 0;
+    int                 running_timers      = 0;
+    int                 expirations         = 0;
+    int                 ctr                 = 0;
+#ifdef LISPD_LATENCY_STATS
+    char                labels[64];
+#endif
+
+    get_map_cache_stats(&map_cache_entries, &map_cache_pending, &map_cache_nonces);
+    get_timer_wheel_stats(&running_timers, &expirations);
+    get_kernel_reassembly_stats(&reassembled, &reassembly_failed);
+
+    write_prometheus_metric(out, "lispd_encap_packets_total", "counter",
+            "Encapsulated packets sent", stats.encap_packets);
+    write_prometheus_metric(out, "lispd_encap_bytes_total", "counter",
+            "Bytes of the encapsulated packets sent", stats.encap_bytes);
+    write_prometheus_metric(out, "lispd_decap_packets_total", "counter",
+            "Decapsulated packets written to the tun interface", stats.decap_packets);
+    write_prometheus_metric(out, "lispd_decap_bytes_total", "counter",
+            "Bytes of the decapsulated packets", stats.decap_bytes);
+    write_prometheus_metric(out, "lispd_native_packets_total", "counter",
+            "Packets forwarded without encapsulation", stats.native_packets);
+
+    fprintf(out, "# HELP lispd_drops_total Packets dropped\n");
+    fprintf(out, "# TYPE lispd_drops_total counter\n");
+    for (ctr = 0 ; ctr < STATS_DROP_REASONS ; ctr++){
+        fprintf(out, "lispd_drops_total{reason=\"%s\"} %"PRIu64"\n", drop_reason_names[ctr], stats.drops[ctr]);
+    }
+
+    write_prometheus_metric(out, "lispd_map_cache_entries", "gauge",
+            "Entries of the map cache", map_cache_entries);
+    write_prometheus_metric(out, "lispd_map_cache_pending_entries", "gauge",
+            "Map cache entries waiting for a Map-Reply", map_cache_pending);
+    write_prometheus_metric(out, "lispd_map_cache_pending_nonces", "gauge",
+            "Nonces of the Map-Requests of the map cache entries waiting for a Map-Reply", map_cache_nonces);
+    write_prometheus_metric(out, "lispd_map_cache_hits_total", "counter",
+            "Map cache lookups of the output path that found an entry", stats.map_cache_hits);
+    write_prometheus_metric(out, "lispd_map_cache_misses_total", "counter",
+            "Map cache lookups of the output path without entry", stats.map_cache_misses);
+    write_prometheus_metric(out, "lispd_map_cache_expirations_total", "counter",
+            "Map cache entries removed when their TTL expired", stats.map_cache_expirations);
+
+    write_prometheus_metric(out, "lispd_map_requests_sent_total", "counter",
+            "Map-Requests sent", stats.map_requests_sent);
+    write_prometheus_metric(out, "lispd_map_request_timeouts_total", "counter",
+            "Map-Requests to Map Resolvers not answered on time", stats.map_request_timeouts);
+    write_prometheus_metric(out, "lispd_pending_map_requests", "gauge",
+            "Entries in use of the table of Map-Requests sent to Map Resolvers waiting for the Map-Reply",
+            get_pending_map_requests());
+    write_prometheus_metric(out, "lispd_map_replies_sent_total", "counter",
+            "Map-Replies sent", stats.map_replies_sent);
+    write_prometheus_metric(out, "lispd_rloc_probes_sent_total", "counter",
+            "RLOC probes sent", stats.rloc_probes_sent);
+    write_prometheus_metric(out, "lispd_smrs_sent_total", "counter",
+            "Solicit Map-Requests sent", stats.smrs_sent);
+    write_prometheus_metric(out, "lispd_map_registers_sent_total", "counter",
+            "Map-Registers sent", stats.map_registers_sent);
+
+    fprintf(out, "# HELP lispd_control_messages_received_total LISP control messages received\n");
+    fprintf(out, "# TYPE lispd_control_messages_received_total counter\n");
+    for (ctr = 0 ; ctr < STATS_CONTROL_TYPES ; ctr++){
+        if (control_type_names[ctr] != NULL){
+            fprintf(out, "lispd_control_messages_received_total{type=\"%s\"} %"PRIu64"\n",
+                    control_type_names[ctr], stats.control_received[ctr]);
+        }
+    }
+
+    write_prometheus_metric(out, "lispd_running_timers", "gauge",
+            "Timers of the timer wheel", running_timers);
+    write_prometheus_metric(out, "lispd_timer_expirations_total", "counter",
+            "Expired timers", expirations);
+
+    write_prometheus_metric(out, "lispd_kernel_reassembled_total", "counter",
+            "IPv4 and IPv6 datagrams reassembled by the kernel (all traffic of the host)", reassembled);
+    write_prometheus_metric(out, "lispd_kernel_reassembly_failures_total", "counter",
+            "IPv4 and IPv6 reassembly failures of the kernel (all traffic of the host)", reassembly_failed);
+
+    write_prometheus_metric(out, "lispd_log_dropped_total", "counter",
+            "Log messages dropped by the asynchronous logging", get_log_dropped());
+
+    write_histogram_prometheus(out, "lispd_map_request_latency_seconds", NULL,
+            "Time since a Map-Request is sent to a Map Resolver until its Map-Reply is received",
+            &(stats.map_request_latency), 1e6);
+#ifdef LISPD_LATENCY_STATS
+    for (ctr = 0 ; ctr < STATS_STAGES ; ctr++){
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", stage_names[ctr]);
+        write_histogram_prometheus(out, "lispd_stage_latency_seconds", labels,
+                ctr == 0 ? "Time per packet or message of each stage of the data and control paths" : NULL,
+                &(stats.stage_latency[ctr]), 1e9);
+    }
+#endif
+}
+
+
+/*
+ * Bucket of the value: the value itself below HIST_SUB_BUCKETS. Above, the power of 2 of the
+ * value selects the group of buckets and the next HIST_SUB_BUCKET_BITS bits the bucket.
+ */
+static int histogram_bucket(uint64_t value)
+{
+    int     msb     = 0;
+    int     shift   = 0;
+
+    if (value < HIST_SUB_BUCKETS){
+        return ((int)value);
+    }
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - HIST_SUB_BUCKET_BITS;
+    return (((shift + 1) << HIST_SUB_BUCKET_BITS) + (int)((value >> shift) - HIST_SUB_BUCKETS));
+}
+
+
+/*
+ * Highest value of the bucket
+ */
+static uint64_t histogram_bucket_limit(int bucket)
+{
+    uint64_t    sub_bucket  = 0;
+    int         shift       = 0;
+
+    if (bucket < HIST_SUB_BUCKETS){
+        return ((uint64_t)bucket);
+    }
+    shift = (bucket >> HIST_SUB_BUCKET_BITS) - 1;
+    sub_bucket = (bucket & (HIST_SUB_BUCKETS - 1)) + HIST_SUB_BUCKETS;
+    return (((sub_bucket + 1) << shift) - 1);
+}
+
+
+static void write_histogram_json(
+        FILE                *out,
+        const char          *name,
+        lispd_histogram     *hist,
+        int                 last)
+{
+    fprintf(out, "    \"%s\": {\"count\": %"PRIu64", \"sum\": %"PRIu64", \"max\": %"PRIu64", \"p50\": %"PRIu64", "
+            "\"p90\": %"PRIu64", \"p99\": %"PRIu64", \"p999\": %"PRIu64"}%s\n",
+            name, hist->count, hist->sum, hist->max,
+            histogram_percentile(hist, 50), histogram_percentile(hist, 90),
+            histogram_percentile(hist, 99), histogram_percentile(hist, 99.9),
+            last == TRUE ? "" : ",");
+}
+
+
+/*
+ * Histograms are exported as summaries in seconds. units_per_second is the unit of the values of
+ * the histogram (1e6 for microseconds). labels (can be NULL) distinguishes the histograms of the
+ * same metric: only the first one has help, the others use NULL.
+ */
+static void write_histogram_prometheus(
+        FILE                *out,
+        const char          *name,
+        const char          *labels,
+        const char          *help,
+        lispd_histogram     *hist,
+        double              units_per_second)
+{
+    const char  *sep    = (labels != NULL) ? "," : "";
+
+    if (labels == NULL){
+        labels = "";
+    }
+    if (help != NULL){
+        fprintf(out, "# HELP %s %s\n", name, help);
+        fprintf(out, "# TYPE %s summary\n", name);
+    }
+    fprintf(out, "%s{%s%squantile=\"0.5\"} %.9f\n", name, labels, sep, histogram_percentile(hist, 50) / units_per_second);
+    fprintf(out, "%s{%s%squantile=\"0.9\"} %.9f\n", name, labels, sep, histogram_percentile(hist, 90) / units_per_second);
+    fprintf(out, "%s{%s%squantile=\"0.99\"} %.9f\n", name, labels, sep, histogram_percentile(hist, 99) / units_per_second);
+    fprintf(out, "%s{%s%squantile=\"0.999\"} %.9f\n", name, labels, sep, histogram_percentile(hist, 99.9) / units_per_second);
+    if (*labels != '\0'){
+        fprintf(out, "%s_sum{%s} %.9f\n", name, labels, hist->sum / units_per_second);
+        fprintf(out, "%s_count{%s} %"PRIu64"\n", name, labels, hist->count);
+    }else{
+        fprintf(out, "%s_sum %.9f\n", name, hist->sum / units_per_second);
+        fprintf(out, "%s_count %"PRIu64"\n", name, hist->count);
+    }
+}
+
+
+static void write_prometheus_metric(
+        FILE                *out,
+        const char          *name,
+        const char          *type,
+        const char          *help,
+        uint64_t            value)
+{
+    fprintf(out, "# HELP %s %s\n", name, help);
+    fprintf(out, "# TYPE %s %s\n", name, type);
+    fprintf(out, "%s %"PRIu64"\n", name, value);
+}
+
+
+/*
+ * Datagrams reassembled by the kernel and reassembly failures, IPv4 plus IPv6. The outer
+ * fragments of encapsulated packets are reassembled by the kernel before lispd receives them,
+ * with the limits of the ipfrag_* sysctls. The counters are those of the whole host.
+ */
+static void get_kernel_reassembly_stats(
+        uint64_t            *reassembled,
+        uint64_t            *failed)
+{
+    FILE        *snmp       = NULL;
+    char        names[1024];
+    char        values[1024];
+    char        *name       = NULL;
+    char        *value      = NULL;
+    char        *name_ptr   = NULL;
+    char        *value_ptr  = NULL;
+    uint64_t    counter     = 0;
+
+    *reassembled = 0;
+    *failed = 0;
+
+    /* Pairs of lines: names of the counters of a protocol and their values */
+    if ((snmp = fopen("/proc/net/snmp", "r")) != NULL){
+        while (fgets(names, sizeof(names), snmp) != NULL && fgets(values, sizeof(values), snmp) != NULL){
+            if (strncmp(names, "Ip: ", 4) != 0){
+                continue;
+            }
+            strtok_r(names, " \n", &name_ptr);
+            strtok_r(values, " \n", &value_ptr);
+            while ((name = strtok_r(NULL, " \n", &name_ptr)) != NULL &&
+                    (value = strtok_r(NULL, " \n", &value_ptr)) != NULL){
+                if (strcmp(name, "ReasmOKs") == 0){
+                    *reassembled += strtoull(value, NULL, 10);
+                }else if (strcmp(name, "ReasmFails") == 0){
+                    *failed += strtoull(value, NULL, 10);
+                }
+            }
+            break;
+        }
+        fclose(snmp);
+    }
+
+    /* One counter per line */
+    if ((snmp = fopen("/proc/net/snmp6", "r")) != NULL){
+        while (fgets(names, sizeof(names), snmp) != NULL){
+            if (sscanf(names, "Ip6ReasmOKs %"SCNu64, &counter) == 1){
+                *reassembled += counter;
+            }else if (sscanf(names, "Ip6ReasmFails %"SCNu64, &counter) == 1){
+                *failed += counter;
+            }
+        }
+        fclose(snmp);
+    }
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
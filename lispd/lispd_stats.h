@@ -0,0 +1,173 @@
+/*
+ * lispd_stats.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Runtime counters and latency histograms of lispd.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_STATS_H_
+#define LISPD_STATS_H_
+
+#include <stdio.h>
+#include <time.h>
+#include "lispd.h"
+
+/* Reasons to drop a data packet */
+#define STATS_DROP_MALFORMED        0       /* Inner packet that can not be parsed */
+#define STATS_DROP_NEGATIVE_MAPPING 1       /* Negative map cache entry with drop action */
+#define STATS_DROP_NO_LOCATOR       2       /* No source or destination locator available */
+#define STATS_DROP_SEND_ERROR       3       /* Error sending the packet (data or control) */
+#define STATS_DROP_RECEIVE_ERROR    4       /* Error receiving an encapsulated packet */
+#define STATS_DROP_TUN_WRITE        5       /* Error writing a decapsulated packet to the tun */
+#define STATS_DROP_REASONS          6
+
+/* LISP control message types (4 bits) */
+#define STATS_CONTROL_TYPES         16
+
+/*
+ * Stages of the data and control paths. They are only timed when lispd is built with
+ * LISPD_LATENCY_STATS (make latency_stats=yes), as it adds two clock reads per stage.
+ * The output stages are timed per batch: each packet of the batch is accounted with the mean
+ * time of the batch.
+ */
+#define STATS_STAGE_CLASSIFY        0       /* Parse and classify the packets read from the tun */
+#define STATS_STAGE_LOOKUP          1       /* Map cache lookup */
+#define STATS_STAGE_SELECT          2       /* Locator selection */
+#define STATS_STAGE_ENCAP           3       /* Encapsulation and replication */
+#define STATS_STAGE_SEND            4       /* Transmission (including native, PETR and RTR) */
+#define STATS_STAGE_DECAP           5       /* Decapsulation of a received packet */
+#define STATS_STAGE_TUN_WRITE       6       /* Write of a decapsulated packet to the tun */
+#define STATS_STAGE_MAP_REPLY       7       /* Processing of a received Map-Reply */
+#define STATS_STAGES                8
+
+#ifdef LISPD_LATENCY_STATS
+#define STAGE_START(ts)             clock_gettime(CLOCK_MONOTONIC, &(ts))
+#define STAGE_END(stage, ts, count) stage_record(stage, &(ts), count)
+#else
+#define STAGE_START(ts)
+#define STAGE_END(stage, ts, count)
+#endif
+
+/*
+ * Log-linear histogram (HdrHistogram style). Values below 2^HIST_SUB_BUCKET_BITS are counted
+ * exactly. Above, each power of 2 is split in 2^HIST_SUB_BUCKET_BITS linear buckets, so the
+ * relative error of a value is less than 1 / 2^HIST_SUB_BUCKET_BITS (6%). Any 64 bits value
+ * fits in HIST_BUCKETS buckets.
+ */
+#define HIST_SUB_BUCKET_BITS        4
+#define HIST_SUB_BUCKETS            (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_BUCKETS                ((64 - HIST_SUB_BUCKET_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct lispd_histogram_ {
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    max;
+    uint64_t    buckets[HIST_BUCKETS];
+} lispd_histogram;
+
+/*
+ * Counters of lispd. The packets processed by the kernel fast path are not accounted.
+ */
+typedef struct lispd_stats_ {
+    uint64_t        encap_packets;          /* Encapsulated packets sent (including replicas) */
+    uint64_t        encap_bytes;
+    uint64_t        decap_packets;          /* Decapsulated packets written to the tun */
+    uint64_t        decap_bytes;
+    uint64_t        native_packets;         /* Packets forwarded without encapsulation */
+    uint64_t        drops[STATS_DROP_REASONS];
+    uint64_t        map_cache_hits;         /* Lookups of the output path */
+    uint64_t        map_cache_misses;
+    uint64_t        map_cache_expirations;  /* Entries removed when their TTL expired */
+    uint64_t        map_requests_sent;
+    uint64_t        map_request_timeouts;
+    uint64_t        map_replies_sent;
+    uint64_t        rloc_probes_sent;
+    uint64_t        smrs_sent;
+    uint64_t        map_registers_sent;     /* Including Encapsulated Map-Registers */
+    uint64_t        control_received[STATS_CONTROL_TYPES];
+    lispd_histogram map_request_latency;    /* Map-Request to Map-Reply (us) */
+#ifdef LISPD_LATENCY_STATS
+    lispd_histogram stage_latency[STATS_STAGES];    /* Time per packet or message of each stage (ns) */
+#endif
+} lispd_stats;
+
+extern lispd_stats  stats;
+
+
+/*
+ * Add a value to the histogram
+ */
+void histogram_record(
+        lispd_histogram     *hist,
+        uint64_t            value);
+
+/*
+ * Add count times the same value to the histogram
+ */
+void histogram_record_n(
+        lispd_histogram     *hist,
+        uint64_t            value,
+        uint64_t            count);
+
+/*
+ * Value below which are the percentile % of the values of the histogram. The value is the
+ * upper limit of its bucket.
+ */
+uint64_t histogram_percentile(
+        lispd_histogram     *hist,
+        double              percentile);
+
+#ifdef LISPD_LATENCY_STATS
+/*
+ * Account the time since start to the stage as count packets of the mean time, and restart
+ * start so the next stage can be timed from there
+ */
+void stage_record(
+        int                 stage,
+        struct timespec     *start,
+        int                 count);
+#endif
+
+/*
+ * Name of a LISP control message type. NULL if the type is not used
+ */
+const char *get_control_type_name(int type);
+
+/*
+ * Write the counters in JSON
+ */
+void stats_write_json(FILE *out);
+
+/*
+ * Write the counters in the Prometheus text exposition format
+ */
+void stats_write_prometheus(FILE *out);
+
+#endif /* LISPD_STATS_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
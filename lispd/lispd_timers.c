@@ -12,6 +12,7 @@
 #include <sys/time.h>
 
 #include "lispd.h"
+#include "lispd_flight_recorder.h"
 #include "lispd_iface_mgmt.h"
 #include "lispd_log.h"
 #include "lispd_map_request.h"
@@ -280,6 +281,7 @@ void handle_timers(void)
             timer_wheel.expirations++;
 
             callback = tptr->cb;
+            flight_record_timer(tptr->name);
             (*callback)(tptr, tptr->cb_argument);
         }
         // We can not use directly "next" as it could be released  in the callback function  previously to be used
@@ -303,11 +305,27 @@ int process_timer_signal(int timers_fd)
 
     if (sig == SIGRTMIN) {
         handle_timers();
+    }else if (sig == SIGUSR1) {
+        flight_recorder_dump();
     }
     return(0);
 }
 
 
+/*
+ * get_timer_wheel_stats()
+ *
+ * Number of timers running and number of expirations
+ */
+void get_timer_wheel_stats(
+    int                 *running_timers,
+    int                 *expirations)
+{
+    *running_timers = timer_wheel.running_timers;
+    *expirations = timer_wheel.expirations;
+}
+
+
 
 /*
  * event_sig_handler
@@ -359,5 +377,9 @@ int build_timers_event_socket(int *timers_fd)
     if (sigaction(SIGRTMIN, &sa, NULL) == -1) {
         lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: sigaction() failed %s", strerror(errno));
     }
+    /* SIGUSR1 dumps the flight recorder in the log */
+    if (sigaction(SIGUSR1, &sa, NULL) == -1) {
+        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: sigaction() failed %s", strerror(errno));
+    }
     return(GOOD);
 }
@@ -26,6 +26,8 @@
 #define SMR_TIMER                           "SMR_TIMER"
 #define SMR_INV_RETRY_TIMER                 "SMR_INV_RETRY_TIMER"
 #define INFO_REPLY_TTL_TIMER                "INFO_REPLY_TTL_TIMER"
+#define RTR_PROBING_TIMER                   "RTR_PROBING_TIMER"
+#define IFACE_EVENTS_TIMER                  "IFACE_EVENTS_TIMER"
 
 #define TIMER_NAME_LEN          64
 
@@ -62,6 +64,13 @@ void stop_timer(timer *);
 
 int process_timer_signal();
 
+/*
+ * Number of timers running and number of expirations since lispd started
+ */
+void get_timer_wheel_stats(
+    int                 *running_timers,
+    int                 *expirations);
+
 /*
  * build_timer_event_socket
  *
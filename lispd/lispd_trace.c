@@ -0,0 +1,243 @@
+/*
+ * lispd_trace.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Tracing of the packets and control messages of selected EIDs, RLOCs
+ * and control message types.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_nonce.h"
+#include "lispd_stats.h"
+#include "lispd_trace.h"
+
+
+typedef struct trace_selector_ {
+    int             type;
+    lisp_addr_t     addr;           /* EID prefix or RLOC */
+    int             prefix_length;
+    int             msg_type;
+} trace_selector;
+
+
+int                     trace_enabled   = FALSE;
+
+static trace_selector   selectors[TRACE_MAX_SELECTORS];
+static int              selector_count  = 0;
+
+
+/********************************** Function declaration ********************************/
+
+static int match_eid(lisp_addr_t *eid);
+static int match_rloc(lisp_addr_t *rloc);
+static int match_msg(int msg_type);
+static char *addr_or_dash(lisp_addr_t *addr);
+
+/****************************************************************************************/
+
+
+int trace_add_selector(
+        char    *type,
+        char    *value)
+{
+    trace_selector  selector;
+    int             msg_type    = 0;
+
+    if (selector_count == TRACE_MAX_SELECTORS){
+        return (BAD);
+    }
+    memset(&selector, 0, sizeof(trace_selector));
+
+    if (strcmp(type, "eid") == 0){
+        selector.type = TRACE_SEL_EID;
+        if (strchr(value, '/') != NULL){
+            if (get_lisp_addr_and_mask_from_char(value, &(selector.addr), &(selector.prefix_length)) != GOOD){
+                return (BAD);
+            }
+        }else{
+            if (get_lisp_addr_from_char(value, &(selector.addr)) != GOOD){
+                return (BAD);
+            }
+            selector.prefix_length = get_prefix_len(selector.addr.afi);
+        }
+    }else if (strcmp(type, "rloc") == 0){
+        selector.type = TRACE_SEL_RLOC;
+        if (get_lisp_addr_from_char(value, &(selector.addr)) != GOOD){
+            return (BAD);
+        }
+    }else if (strcmp(type, "msg") == 0){
+        selector.type = TRACE_SEL_MSG;
+        for (msg_type = 0 ; msg_type < STATS_CONTROL_TYPES ; msg_type++){
+            if (get_control_type_name(msg_type) != NULL && strcmp(get_control_type_name(msg_type), value) == 0){
+                break;
+            }
+        }
+        if (msg_type == STATS_CONTROL_TYPES){
+            return (BAD);
+        }
+        selector.msg_type = msg_type;
+    }else{
+        return (BAD);
+    }
+
+    selectors[selector_count] = selector;
+    selector_count++;
+    trace_enabled = TRUE;
+    lispd_log_msg(LISP_LOG_INFO, "Trace selector added: %s %s", type, value);
+
+    return (GOOD);
+}
+
+
+void trace_clear_selectors()
+{
+    selector_count = 0;
+    trace_enabled = FALSE;
+    lispd_log_msg(LISP_LOG_INFO, "Trace selectors removed");
+}
+
+
+void trace_write_selectors(FILE *out)
+{
+    int     ctr     = 0;
+
+    if (selector_count == 0){
+        fprintf(out, "No trace selectors\n");
+        return;
+    }
+    for (ctr = 0 ; ctr < selector_count ; ctr++){
+        switch (selectors[ctr].type){
+        case TRACE_SEL_EID:
+            fprintf(out, "eid %s/%d\n", get_char_from_lisp_addr_t(selectors[ctr].addr), selectors[ctr].prefix_length);
+            break;
+        case TRACE_SEL_RLOC:
+            fprintf(out, "rloc %s\n", get_char_from_lisp_addr_t(selectors[ctr].addr));
+            break;
+        case TRACE_SEL_MSG:
+            fprintf(out, "msg %s\n", get_control_type_name(selectors[ctr].msg_type));
+            break;
+        }
+    }
+}
+
+
+void trace_data_packet(
+        const char      *direction,
+        lisp_addr_t     *src_eid,
+        lisp_addr_t     *dst_eid,
+        lisp_addr_t     *src_rloc,
+        lisp_addr_t     *dst_rloc,
+        int             length,
+        const char      *result)
+{
+    if (match_eid(src_eid) == FALSE && match_eid(dst_eid) == FALSE &&
+            match_rloc(src_rloc) == FALSE && match_rloc(dst_rloc) == FALSE){
+        return;
+    }
+    lispd_log_msg(LISP_LOG_INFO, "TRACE %s: EID %s -> %s, RLOC %s -> %s, %d bytes: %s",
+            direction, addr_or_dash(src_eid), addr_or_dash(dst_eid),
+            addr_or_dash(src_rloc), addr_or_dash(dst_rloc), length, result);
+}
+
+
+void trace_control_msg(
+        const char      *direction,
+        int             type,
+        lisp_addr_t     *rloc,
+        lisp_addr_t     *eid,
+        uint64_t        nonce)
+{
+    const char  *type_name  = get_control_type_name(type);
+
+    if (match_msg(type) == FALSE && match_rloc(rloc) == FALSE && match_eid(eid) == FALSE){
+        return;
+    }
+    lispd_log_msg(LISP_LOG_INFO, "TRACE %s: %s, RLOC %s, EID %s, nonce %s",
+            direction, type_name != NULL ? type_name : "unknown", addr_or_dash(rloc), addr_or_dash(eid),
+            nonce != 0 ? get_char_from_nonce(nonce) : "-");
+}
+
+
+static int match_eid(lisp_addr_t *eid)
+{
+    int     ctr     = 0;
+
+    if (eid == NULL){
+        return (FALSE);
+    }
+    for (ctr = 0 ; ctr < selector_count ; ctr++){
+        if (selectors[ctr].type == TRACE_SEL_EID &&
+                is_prefix_b_part_of_a(selectors[ctr].addr, selectors[ctr].prefix_length,
+                        *eid, get_prefix_len(eid->afi)) == TRUE){
+            return (TRUE);
+        }
+    }
+    return (FALSE);
+}
+
+
+static int match_rloc(lisp_addr_t *rloc)
+{
+    int     ctr     = 0;
+
+    if (rloc == NULL){
+        return (FALSE);
+    }
+    for (ctr = 0 ; ctr < selector_count ; ctr++){
+        if (selectors[ctr].type == TRACE_SEL_RLOC && compare_lisp_addr_t(&(selectors[ctr].addr), rloc) == 0){
+            return (TRUE);
+        }
+    }
+    return (FALSE);
+}
+
+
+static int match_msg(int msg_type)
+{
+    int     ctr     = 0;
+
+    for (ctr = 0 ; ctr < selector_count ; ctr++){
+        if (selectors[ctr].type == TRACE_SEL_MSG && selectors[ctr].msg_type == msg_type){
+            return (TRUE);
+        }
+    }
+    return (FALSE);
+}
+
+
+static char *addr_or_dash(lisp_addr_t *addr)
+{
+    if (addr == NULL || (addr->afi != AF_INET && addr->afi != AF_INET6)){
+        return ("-");
+    }
+    return (get_char_from_lisp_addr_t(*addr));
+}
+
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
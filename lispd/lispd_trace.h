@@ -0,0 +1,98 @@
+/*
+ * lispd_trace.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Tracing of the packets and control messages of selected EIDs, RLOCs
+ * and control message types.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_TRACE_H_
+#define LISPD_TRACE_H_
+
+#include <stdio.h>
+#include "lispd.h"
+
+/*
+ * The selectors are set at runtime through the control socket. A packet or control message
+ * matching any selector is logged (LISP_LOG_INFO) whatever the debug level. Without selectors,
+ * trace_enabled is FALSE and the only cost in the data path is checking it.
+ */
+#define TRACE_MAX_SELECTORS     8
+
+#define TRACE_SEL_EID           1       /* Inner source or destination in the EID prefix */
+#define TRACE_SEL_RLOC          2       /* Outer source or destination RLOC */
+#define TRACE_SEL_MSG           3       /* Control message type */
+
+extern int  trace_enabled;
+
+
+/*
+ * Add a selector. type is "eid", "rloc" or "msg" and value an EID prefix, an RLOC address or
+ * a control message type name. Return BAD if they can not be parsed or there is no room.
+ */
+int trace_add_selector(
+        char    *type,
+        char    *value);
+
+/*
+ * Remove all the selectors
+ */
+void trace_clear_selectors();
+
+/*
+ * Write the list of selectors
+ */
+void trace_write_selectors(FILE *out);
+
+/*
+ * Trace a data packet if it matches a selector. direction is "IN" or "OUT", the RLOCs can be
+ * NULL and result describes what was done with the packet.
+ */
+void trace_data_packet(
+        const char      *direction,
+        lisp_addr_t     *src_eid,
+        lisp_addr_t     *dst_eid,
+        lisp_addr_t     *src_rloc,
+        lisp_addr_t     *dst_rloc,
+        int             length,
+        const char      *result);
+
+/*
+ * Trace a control message if it matches a selector. rloc is the peer and eid the EID prefix of
+ * the message. Both can be NULL and nonce 0.
+ */
+void trace_control_msg(
+        const char      *direction,
+        int             type,
+        lisp_addr_t     *rloc,
+        lisp_addr_t     *eid,
+        uint64_t        nonce);
+
+#endif /* LISPD_TRACE_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
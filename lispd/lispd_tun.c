@@ -29,11 +29,67 @@
  */
 
 #include "lispd_external.h"
+#include "lispd_local_db.h"
 #include "lispd_log.h"
 #include "lispd_routing_tables_lib.h"
 #include "lispd_tun.h"
 
 
+/*
+ * Calculate the underlay MTU, the tun MTU and the size of the receive buffers (max_ip_packet)
+ * from the configuration and the MTU of the RLOC interfaces
+ */
+void calculate_mtus()
+{
+    lispd_iface_list_elt    *iface_list     = NULL;
+    int                     iface_mtu       = 0;
+
+    /* Not configured: smallest MTU of the RLOC interfaces */
+    if (underlay_mtu == 0){
+        iface_list = get_head_interface_list();
+        while (iface_list != NULL){
+            iface_mtu = get_iface_mtu(iface_list->iface->iface_name);
+            if (iface_mtu != 0 && (underlay_mtu == 0 || iface_mtu < underlay_mtu)){
+                underlay_mtu = iface_mtu;
+            }
+            iface_list = iface_list->next;
+        }
+        if (underlay_mtu == 0){
+            underlay_mtu = DEFAULT_UNDERLAY_MTU;
+        }
+    }
+    if (underlay_mtu < MIN_UNDERLAY_MTU || underlay_mtu > MAX_UNDERLAY_MTU){
+        lispd_log_msg(LISP_LOG_WARNING, "Underlay MTU should be between %d and %d. Using %d",
+                MIN_UNDERLAY_MTU, MAX_UNDERLAY_MTU,
+                underlay_mtu < MIN_UNDERLAY_MTU ? MIN_UNDERLAY_MTU : MAX_UNDERLAY_MTU);
+        underlay_mtu = underlay_mtu < MIN_UNDERLAY_MTU ? MIN_UNDERLAY_MTU : MAX_UNDERLAY_MTU;
+    }
+
+    if (tun_mtu <= 0){
+        tun_mtu = underlay_mtu - LISP_ENCAP_OVERHEAD;
+    }else if (tun_mtu > underlay_mtu - LISP_ENCAP_OVERHEAD){
+        lispd_log_msg(LISP_LOG_WARNING, "The tun MTU (%d) is bigger than the underlay MTU (%d) minus the LISP overhead (%d). "
+                "Encapsulated packets will be fragmented", tun_mtu, underlay_mtu, LISP_ENCAP_OVERHEAD);
+    }
+    if (tun_mtu < MIN_IPV6_TUN_MTU && get_main_eid(AF_INET6) != NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "The tun MTU (%d) is smaller than the minimum MTU of IPv6 (%d). Using %d: "
+                "encapsulated packets bigger than the underlay MTU (%d) will be fragmented",
+                tun_mtu, MIN_IPV6_TUN_MTU, MIN_IPV6_TUN_MTU, underlay_mtu);
+        tun_mtu = MIN_IPV6_TUN_MTU;
+    }
+
+    max_ip_packet = underlay_mtu;
+    if (max_ip_packet < tun_mtu + LISP_ENCAP_OVERHEAD){
+        max_ip_packet = tun_mtu + LISP_ENCAP_OVERHEAD;
+    }
+    if (max_ip_packet < MIN_PACKET_BUF_SIZE){
+        max_ip_packet = MIN_PACKET_BUF_SIZE;
+    }
+
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Underlay MTU: %d, tun MTU: %d, receive buffers: %d bytes",
+            underlay_mtu, tun_mtu, max_ip_packet);
+}
+
 int create_tun(
     char                *tun_dev_name,
     unsigned int        tun_receive_size,
@@ -63,6 +119,12 @@ int create_tun(
         exit_cleanup();
     }
 
+    /* The output path reads all the available packets until the read would block */
+    if (fcntl(*tun_receive_fd, F_SETFL, fcntl(*tun_receive_fd, F_GETFL, 0) | O_NONBLOCK) < 0){
+        lispd_log_msg(LISP_LOG_CRIT, "TUN/TAP: Failed to set the tun device in non blocking mode: %s", strerror(errno));
+        exit_cleanup();
+    }
+
     memset(&ifr, 0, sizeof(ifr));
 
     ifr.ifr_flags = flags;
@@ -256,9 +318,13 @@ int set_tun_default_route_v4()
     lisp_addr_t gw;
     uint32_t prefix_len = 0;
     uint32_t metric = 0;
+    uint32_t table = RT_TABLE_MAIN;
 
     prefix_len = 1;
     metric = 0;
+    if (tun_policy_routing == TRUE){
+        table = TUN_ROUTING_TABLE;
+    }
     
     get_lisp_addr_from_char("0.0.0.0",&gw);
 
@@ -277,7 +343,7 @@ int set_tun_default_route_v4()
             NULL,
             prefix_len,
             metric,
-            RT_TABLE_MAIN);
+            table);
 
 
     get_lisp_addr_from_char("128.0.0.0",&dest);
@@ -289,7 +355,7 @@ int set_tun_default_route_v4()
             NULL,
             prefix_len,
             metric,
-            RT_TABLE_MAIN);
+            table);
     return(GOOD);
 }
 
@@ -306,9 +372,13 @@ int set_tun_default_route_v6()
     lisp_addr_t gw;
     uint32_t prefix_len = 0;
     uint32_t metric = 0;
+    uint32_t table = RT_TABLE_MAIN;
 
     prefix_len = 1;
     metric = 512;
+    if (tun_policy_routing == TRUE){
+        table = TUN_ROUTING_TABLE;
+    }
 
     get_lisp_addr_from_char("::",&gw);
 
@@ -327,7 +397,7 @@ int set_tun_default_route_v6()
             NULL,
             prefix_len,
             metric,
-            RT_TABLE_MAIN);
+            table);
 
     get_lisp_addr_from_char("8000::",&dest);
 
@@ -338,7 +408,7 @@ int set_tun_default_route_v6()
             NULL,
             prefix_len,
             metric,
-            RT_TABLE_MAIN);
+            table);
 
     return(GOOD);
 }
@@ -356,9 +426,13 @@ int del_tun_default_route_v6()
     lisp_addr_t gw;
     uint32_t prefix_len = 0;
     uint32_t metric = 0;
+    uint32_t table = RT_TABLE_MAIN;
 
     prefix_len = 1;
     metric = 512;
+    if (tun_policy_routing == TRUE){
+        table = TUN_ROUTING_TABLE;
+    }
 
     get_lisp_addr_from_char("::",&gw);
 
@@ -371,7 +445,7 @@ int del_tun_default_route_v6()
             NULL,
             prefix_len,
             metric,
-            RT_TABLE_MAIN);
+            table);
 
     get_lisp_addr_from_char("8000::",&dest);
 
@@ -382,12 +456,92 @@ int del_tun_default_route_v6()
             NULL,
             prefix_len,
             metric,
-            RT_TABLE_MAIN);
+            table);
 
     return(GOOD);
 }
 
 
+int add_tun_policy_rules(int afi)
+{
+    patricia_tree_t     *local_db       = get_local_db(afi);
+    patricia_node_t     *node           = NULL;
+    lispd_mapping_elt   *mapping        = NULL;
+
+    if (local_db == NULL){
+        return (BAD);
+    }
+    PATRICIA_WALK(local_db->head, node) {
+        mapping = ((lispd_mapping_elt *)(node->data));
+        /* Traffic inside the EID prefix is not encapsulated */
+        add_rule(afi,
+                0,
+                RT_TABLE_MAIN,
+                TUN_RULE_PRIORITY - 1,
+                RTN_UNICAST,
+                &(mapping->eid_prefix),
+                mapping->eid_prefix_length,
+                &(mapping->eid_prefix),
+                mapping->eid_prefix_length,
+                0);
+        add_rule(afi,
+                0,
+                TUN_ROUTING_TABLE,
+                TUN_RULE_PRIORITY,
+                RTN_UNICAST,
+                &(mapping->eid_prefix),
+                mapping->eid_prefix_length,
+                NULL,
+                0,
+                0);
+    } PATRICIA_WALK_END;
+
+    return (GOOD);
+}
+
+void del_tun_policy_rules()
+{
+    patricia_tree_t     *local_dbs[2]   = {NULL,NULL};
+    patricia_node_t     *node           = NULL;
+    lispd_mapping_elt   *mapping        = NULL;
+    int                 afi             = 0;
+    int                 ctr             = 0;
+
+    local_dbs[0] = get_local_db(AF_INET);
+    local_dbs[1] = get_local_db(AF_INET6);
+
+    for (ctr = 0 ; ctr < 2 ; ctr++){
+        if (local_dbs[ctr] == NULL){
+            continue;
+        }
+        afi = (ctr == 0) ? AF_INET : AF_INET6;
+        PATRICIA_WALK(local_dbs[ctr]->head, node) {
+            mapping = ((lispd_mapping_elt *)(node->data));
+            del_rule(afi,
+                    0,
+                    RT_TABLE_MAIN,
+                    TUN_RULE_PRIORITY - 1,
+                    RTN_UNICAST,
+                    &(mapping->eid_prefix),
+                    mapping->eid_prefix_length,
+                    &(mapping->eid_prefix),
+                    mapping->eid_prefix_length,
+                    0);
+            del_rule(afi,
+                    0,
+                    TUN_ROUTING_TABLE,
+                    TUN_RULE_PRIORITY,
+                    RTN_UNICAST,
+                    &(mapping->eid_prefix),
+                    mapping->eid_prefix_length,
+                    NULL,
+                    0,
+                    0);
+        } PATRICIA_WALK_END;
+    }
+}
+
+
 /*
  * Editor modelines
  *
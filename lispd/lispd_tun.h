@@ -46,8 +46,6 @@
 
 #define TUN_IFACE_NAME          "lispTun0"
 
-#define TUN_RECEIVE_SIZE        2048 // Should probably tune to match largest MTU
-
 /*
  * From section 5.4.1 of LISP RFC (6830)
  *
@@ -72,7 +70,19 @@
 
 /* H = 40 (IPv6 header) + 8 (UDP header) + 8 (LISP header) + 4 (extra/safety) = 60 */
 
-#define TUN_MTU                 1440 /* 1500 - 60 = 1440 */
+#define LISP_ENCAP_OVERHEAD     60
+
+/*
+ * L is the underlay MTU (underlay-mtu). By default it is the smallest MTU of the RLOC
+ * interfaces and the MTU of the tun interface is L - H (1440 in a 1500 bytes underlay)
+ */
+
+#define DEFAULT_UNDERLAY_MTU    1500
+#define MIN_UNDERLAY_MTU        576
+#define MAX_UNDERLAY_MTU        9216
+
+/* IPv6 requires a link MTU of at least 1280 bytes (RFC 2460) */
+#define MIN_IPV6_TUN_MTU        1280
 
 /* Local OpenWRT tun IPv4 address
  *
@@ -82,6 +92,16 @@
 #define TUN_LOCAL_V4_ADDR "127.0.0.127"
 #define TUN_LOCAL_V6_ADDR "::127"
 
+/*
+ * Policy routing mode (tun-policy-routing). The routes via the tun interface are
+ * installed in TUN_ROUTING_TABLE instead of the main table, and only the packets
+ * with a source address of a local EID prefix are looked up in it. The traffic between
+ * addresses of the same EID prefix keeps using the main table.
+ */
+
+#define TUN_ROUTING_TABLE       252
+#define TUN_RULE_PRIORITY       32000
+
 /* Tun MN variables */
 
 int tun_receive_fd;
@@ -90,6 +110,12 @@ uint8_t *tun_receive_buf;
 
 
 
+/*
+ * Calculate the underlay MTU, the tun MTU and the size of the receive buffers (max_ip_packet)
+ * from the configuration and the MTU of the RLOC interfaces
+ */
+void calculate_mtus();
+
 int create_tun(
     char                *tun_dev_name,
     unsigned int        tun_receive_size,
@@ -122,3 +148,13 @@ int tun_add_v6_eid_to_iface(
 int set_tun_default_route_v4();
 int set_tun_default_route_v6();
 int del_tun_default_route_v6();
+
+/*
+ * Add the source rules of the local EID prefixes of the afi to TUN_ROUTING_TABLE
+ */
+int add_tun_policy_rules(int afi);
+
+/*
+ * Remove the source rules to TUN_ROUTING_TABLE
+ */
+void del_tun_policy_rules();
@@ -0,0 +1,336 @@
+#!/bin/bash
+#
+# handover_bench.sh
+#
+# This file is part of LISP Mobile Node Implementation.
+# Mobility handover latency benchmark. Two lispd mobile nodes and the
+# Map-Server / Map-Resolver stand-in run in network namespaces connected
+# through a bridge. The RLOC of the first node is moved repeatedly and the
+# time since the kernel notifies the change through netlink until the first
+# packet sent after it reaches the other node is measured in both directions.
+#
+# Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+# Please send any bug reports or fixes you make to the email address(es):
+#    LISP-MN developers <devel@lispmob.org>
+#
+#
+# Usage: sudo ./handover_bench.sh [-n runs] [-m addr|link] [-w seconds] [-i ms] [-F] [-P] [-k]
+#
+#   -n runs     number of handovers (default 20)
+#   -m mode     addr: change the address of the interface of the node
+#               link: move the node to its second interface (link down/up)
+#   -w seconds  time to wait for the recovery of each handover (default 30)
+#   -i ms       interval between probe packets (default 10)
+#   -F          enable fast-handover in lispd
+#   -P          enable the eBPF fast path in lispd (make -C ../lispd fastpath)
+#   -k          keep the logs in the work directory
+#
+# Build lispd, lisp_ms_standin and handover_probe first:
+#   make -C ../lispd && make standin handover
+#
+# Topology (all the links attached to the bridge of lb-core):
+#
+#   lb-ms   10.254.0.1/24, 10.254.1.1/24   Map-Server / Map-Resolver, router
+#   lb-n1   eth0 10.254.0.11 | 10.254.0.12  EID 192.168.101.1  (moving node)
+#           eth1 10.254.1.11               (link mode only)
+#   lb-n2   eth0 10.254.0.21               EID 192.168.102.1
+#
+
+RUNS=20
+MODE=addr
+WAIT=30
+INTERVAL=10
+FAST_HANDOVER=off
+FAST_PATH=off
+KEEP=0
+
+LISPD=../lispd/lispd
+STANDIN=./lisp_ms_standin
+PROBE=./handover_probe
+FAST_PATH_OBJECT=$(readlink -f ../lispd/bpf/lisp_fastpath_kern.o)
+
+MS_ADDR=10.254.0.1
+N1_EID=192.168.101.1
+N2_EID=192.168.102.1
+N1_ADDRS=(10.254.0.11 10.254.0.12)
+N2_ADDR=10.254.0.21
+
+while getopts "n:m:w:i:FPk" opt; do
+    case $opt in
+    n) RUNS=$OPTARG ;;
+    m) MODE=$OPTARG ;;
+    w) WAIT=$OPTARG ;;
+    i) INTERVAL=$OPTARG ;;
+    F) FAST_HANDOVER=on ;;
+    P) FAST_PATH=on ;;
+    k) KEEP=1 ;;
+    *) sed -n '/^# Usage/,/^#   -k/p' $0 | cut -c3-; exit 1 ;;
+    esac
+done
+
+if [ "$MODE" != "addr" ] && [ "$MODE" != "link" ]; then
+    echo "Unknown mode: $MODE"
+    exit 1
+fi
+if [ $(id -u) -ne 0 ]; then
+    echo "Network namespaces require root"
+    exit 1
+fi
+for bin in $LISPD $STANDIN $PROBE; do
+    if [ ! -x $bin ]; then
+        echo "$bin not found. Build it first"
+        exit 1
+    fi
+done
+if [ "$FAST_PATH" = "on" ] && [ ! -f "$FAST_PATH_OBJECT" ]; then
+    echo "Fast path object not found. Build it first: make -C ../lispd fastpath"
+    exit 1
+fi
+
+WORKDIR=$(mktemp -d /tmp/handover_bench.XXXXXX)
+PIDS=""
+
+cleanup()
+{
+    for pid in $PIDS; do
+        kill $pid 2>/dev/null
+    done
+    wait 2>/dev/null
+    for ns in lb-n1 lb-n2 lb-ms lb-core; do
+        ip netns del $ns 2>/dev/null
+    done
+    if [ $KEEP -eq 1 ]; then
+        echo "Logs kept in $WORKDIR"
+    else
+        rm -rf $WORKDIR
+    fi
+}
+trap cleanup EXIT INT TERM
+
+# Connect interface $3 of namespace $1 to the bridge of lb-core. $2 is a unique tag
+add_link()
+{
+    ip link add $2 type veth peer name c-$2
+    ip link set c-$2 netns lb-core
+    ip -n lb-core link set c-$2 master br0 up
+    ip link set $2 netns $1
+    ip -n $1 link set $2 name $3
+    ip -n $1 link set $3 up
+}
+
+# lispd config for node $1 with EID $2. Remaining arguments are the interfaces
+write_config()
+{
+    local conf=$WORKDIR/$1.conf
+    local node=$1
+    local eid=$2
+    local priority=1
+    shift 2
+
+    cat > $conf <<EOF
+debug                  = 1
+map-request-retries    = 2
+fast-handover          = $FAST_HANDOVER
+fast-path              = $FAST_PATH
+fast-path-object       = "$FAST_PATH_OBJECT"
+
+rloc-probing {
+    rloc-probe-interval             = 0
+    rloc-probe-retries              = 0
+    rloc-probe-retries-interval     = 0
+}
+
+nat-traversal {
+        nat_aware   = off
+}
+
+map-resolver = {
+        $MS_ADDR
+}
+
+ddt-client             = off
+
+map-server {
+        address     = $MS_ADDR
+        key-type    = 1
+        key         = password
+        proxy-reply = on
+}
+EOF
+    for iface in "$@"; do
+        cat >> $conf <<EOF
+
+database-mapping {
+         eid-prefix     = $eid/32
+         interface      = $iface
+         priority_v4    = $priority
+         weight_v4      = 100
+         priority_v6    = -1
+         weight_v6      = 0
+}
+EOF
+        priority=$((priority + 1))
+    done
+}
+
+setup()
+{
+    for ns in lb-core lb-ms lb-n1 lb-n2; do
+        ip netns add $ns
+        ip -n $ns link set lo up
+    done
+    ip -n lb-core link add br0 type bridge
+    ip -n lb-core link set br0 up
+
+    add_link lb-ms lbms0 eth0
+    ip -n lb-ms addr add $MS_ADDR/24 dev eth0
+    ip -n lb-ms addr add 10.254.1.1/24 dev eth0
+    ip netns exec lb-ms sysctl -qw net.ipv4.ip_forward=1
+
+    add_link lb-n1 lbn1e0 eth0
+    ip -n lb-n1 addr add ${N1_ADDRS[0]}/24 dev eth0
+    ip -n lb-n1 route add default via $MS_ADDR
+    if [ "$MODE" = "link" ]; then
+        add_link lb-n1 lbn1e1 eth1
+        ip -n lb-n1 addr add 10.254.1.11/24 dev eth1
+        ip -n lb-n1 route add default via 10.254.1.1 metric 100
+        write_config n1 $N1_EID eth0 eth1
+    else
+        write_config n1 $N1_EID eth0
+    fi
+
+    add_link lb-n2 lbn2e0 eth0
+    ip -n lb-n2 addr add $N2_ADDR/24 dev eth0
+    ip -n lb-n2 route add default via $MS_ADDR
+    write_config n2 $N2_EID eth0
+
+    ip netns exec lb-ms $STANDIN -b $MS_ADDR -k password -t 1 > $WORKDIR/ms.log 2>&1 &
+    PIDS="$PIDS $!"
+    sleep 1
+    ip netns exec lb-n1 $LISPD -f $WORKDIR/n1.conf > $WORKDIR/lispd_n1.log 2>&1 &
+    PIDS="$PIDS $!"
+    ip netns exec lb-n2 $LISPD -f $WORKDIR/n2.conf > $WORKDIR/lispd_n2.log 2>&1 &
+    PIDS="$PIDS $!"
+
+    ip netns exec lb-n1 $PROBE -l $N1_EID -r $N2_EID -i $INTERVAL -n > $WORKDIR/rx_n1.log &
+    PIDS="$PIDS $!"
+    ip netns exec lb-n2 $PROBE -l $N2_EID -r $N1_EID -i $INTERVAL > $WORKDIR/rx_n2.log &
+    PIDS="$PIDS $!"
+}
+
+# Time in ms since $2 (ns) until the first packet sent after it is received, or -1
+recovery_ms()
+{
+    awk -v t0=$2 '$1 == "rx" && $3 >= t0 { printf "%.1f\n", ($4 - t0) / 1000000; found = 1; exit }
+            END { if (!found) print -1 }' $1
+}
+
+# Time (ns) of the first netlink notification of lb-n1 since $1 (ns). $1 if the
+# probe doesn't log any in one second
+netlink_ns()
+{
+    local t
+
+    for i in $(seq 10); do
+        t=$(awk -v t0=$1 '$1 == "nl" && $3 >= t0 { print $3; exit }' $WORKDIR/rx_n1.log)
+        if [ -n "$t" ]; then
+            echo $t
+            return
+        fi
+        sleep 0.1
+    done
+    echo $1
+}
+
+# Wait $1 seconds at most until both directions work with packets sent since $2 (ns, default now)
+wait_connectivity()
+{
+    local t0=${2:-$(date +%s%N)}
+    local deadline=$(( $(date +%s) + $1 ))
+
+    while [ $(date +%s) -lt $deadline ]; do
+        if [ "$(recovery_ms $WORKDIR/rx_n1.log $t0)" != "-1" ] && \
+                [ "$(recovery_ms $WORKDIR/rx_n2.log $t0)" != "-1" ]; then
+            return 0
+        fi
+        sleep 0.2
+    done
+    return 1
+}
+
+# Move the RLOC of lb-n1. Alternates between the two states on each call
+move_rloc()
+{
+    local run=$1
+    local old=$((run % 2))
+    local new=$(((run + 1) % 2))
+
+    if [ "$MODE" = "addr" ]; then
+        ip -n lb-n1 addr del ${N1_ADDRS[$old]}/24 dev eth0
+        ip -n lb-n1 addr add ${N1_ADDRS[$new]}/24 dev eth0
+        ip -n lb-n1 route replace default via $MS_ADDR
+    else
+        ip -n lb-n1 link set eth$new up
+        ip -n lb-n1 link set eth$old down
+    fi
+}
+
+# Print count, failures, min, mean, percentiles and max of the values of file $2
+report()
+{
+    sort -n $2 | awk -v name="$1" '
+        $1 < 0 { failed++; next }
+        { v[n++] = $1; sum += $1 }
+        END {
+            if (n == 0) { printf "%-16s runs %d  recovered 0\n", name, failed; exit }
+            printf "%-16s runs %d  failed %d  min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f ms\n",
+                name, n + failed, failed, v[0], sum / n, v[int(n * 0.5)], v[int(n * 0.9)],
+                v[int(n * 0.99)], v[n - 1]
+        }'
+}
+
+setup
+
+echo "Waiting for the initial connectivity between the EIDs..."
+if ! wait_connectivity 60; then
+    echo "No connectivity between $N1_EID and $N2_EID. Check the logs (-k)"
+    KEEP=1
+    exit 1
+fi
+
+echo "Running $RUNS handovers (mode $MODE, fast-handover $FAST_HANDOVER, fast-path $FAST_PATH)"
+: > $WORKDIR/n1_to_n2
+: > $WORKDIR/n2_to_n1
+for run in $(seq 0 $((RUNS - 1))); do
+    t0=$(date +%s%N)
+    move_rloc $run
+    # Measured from the event lispd reacts to, not from the start of the ip command
+    t0=$(netlink_ns $t0)
+    wait_connectivity $WAIT $t0
+    fwd=$(recovery_ms $WORKDIR/rx_n2.log $t0)
+    rev=$(recovery_ms $WORKDIR/rx_n1.log $t0)
+    echo $fwd >> $WORKDIR/n1_to_n2
+    echo $rev >> $WORKDIR/n2_to_n1
+    printf "run %3d: n1->n2 %8s ms  n2->n1 %8s ms\n" $run $fwd $rev
+    # Let the node settle before the next handover
+    sleep 2
+done
+
+echo
+report "n1 -> n2" $WORKDIR/n1_to_n2
+report "n2 -> n1" $WORKDIR/n2_to_n1
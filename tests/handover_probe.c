@@ -0,0 +1,230 @@
+/*
+ * handover_probe.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Bidirectional UDP probe used by handover_bench.sh to measure the time
+ * a mobile node is unreachable after a change of RLOC.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+/*
+ * Every instance sends a datagram with a sequence number and its send time
+ * to the peer every -i milliseconds, and prints a line for each datagram
+ * received from the peer:
+ *
+ *   rx <seq> <send time ns> <receive time ns>
+ *
+ * With -n it also prints a line for each link or address change notified
+ * by netlink in its network namespace, when the notification is received:
+ *
+ *   nl <netlink message type> <receive time ns>
+ *
+ * Times are CLOCK_REALTIME. All the network namespaces of the benchmark
+ * share the clock of the host, so one way delays can be computed.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define DEFAULT_PORT        5005
+#define DEFAULT_INTERVAL    10
+
+typedef struct probe_pkt_ {
+    uint32_t    seq;
+    uint64_t    send_ns;
+} __attribute__ ((__packed__)) probe_pkt;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static int fill_sockaddr(const char *addr, int port, struct sockaddr_storage *ss, socklen_t *len)
+{
+    struct sockaddr_in  *sin    = (struct sockaddr_in *)ss;
+    struct sockaddr_in6 *sin6   = (struct sockaddr_in6 *)ss;
+
+    memset(ss, 0, sizeof(struct sockaddr_storage));
+    if (inet_pton(AF_INET, addr, &(sin->sin_addr)) == 1) {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        *len = sizeof(struct sockaddr_in);
+        return (AF_INET);
+    }
+    if (inet_pton(AF_INET6, addr, &(sin6->sin6_addr)) == 1) {
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        *len = sizeof(struct sockaddr_in6);
+        return (AF_INET6);
+    }
+    return (AF_UNSPEC);
+}
+
+/* Netlink socket notified of the link and address changes */
+static int open_netlink()
+{
+    struct sockaddr_nl  addr;
+    int                 s = 0;
+
+    if ((s = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1) {
+        perror("netlink socket");
+        exit(EXIT_FAILURE);
+    }
+    memset(&addr, 0, sizeof(struct sockaddr_nl));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(s, (struct sockaddr *)&addr, sizeof(struct sockaddr_nl)) == -1) {
+        perror("netlink bind");
+        exit(EXIT_FAILURE);
+    }
+    return (s);
+}
+
+/* Print the time of the notifications received */
+static void read_netlink(int s)
+{
+    char            buf[8192];
+    struct nlmsghdr *nlh    = NULL;
+    uint64_t        now     = 0;
+    int             len     = 0;
+
+    if ((len = recv(s, buf, sizeof(buf), 0)) <= 0) {
+        return;
+    }
+    now = now_ns();
+    for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+        printf("nl %u %llu\n", nlh->nlmsg_type, (unsigned long long)now);
+    }
+    fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -l local-addr -r peer-addr [-p port] [-i interval-ms] [-n]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_storage local, peer;
+    socklen_t               local_len   = 0;
+    socklen_t               peer_len    = 0;
+    struct pollfd           pfd[2];
+    probe_pkt               pkt;
+    char                    *local_addr = NULL;
+    char                    *peer_addr  = NULL;
+    int                     port        = DEFAULT_PORT;
+    int                     interval    = DEFAULT_INTERVAL;
+    int                     afi         = AF_UNSPEC;
+    int                     s           = 0;
+    int                     nfds        = 1;
+    int                     netlink     = 0;
+    int                     opt         = 0;
+    int                     timeout     = 0;
+    uint32_t                seq         = 0;
+    uint64_t                next_send   = 0;
+    uint64_t                now         = 0;
+
+    while ((opt = getopt(argc, argv, "l:r:p:i:n")) != -1) {
+        switch (opt) {
+        case 'l': local_addr = optarg; break;
+        case 'r': peer_addr = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'i': interval = atoi(optarg); break;
+        case 'n': netlink = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (local_addr == NULL || peer_addr == NULL || interval <= 0) {
+        usage(argv[0]);
+    }
+    afi = fill_sockaddr(local_addr, port, &local, &local_len);
+    if (afi == AF_UNSPEC || fill_sockaddr(peer_addr, port, &peer, &peer_len) != afi) {
+        usage(argv[0]);
+    }
+
+    if ((s = socket(afi, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    /* The local EID could not be configured yet when the probe starts */
+    while (bind(s, (struct sockaddr *)&local, local_len) == -1) {
+        if (errno != EADDRNOTAVAIL) {
+            perror("bind");
+            exit(EXIT_FAILURE);
+        }
+        sleep(1);
+    }
+
+    pfd[0].fd = s;
+    pfd[0].events = POLLIN;
+    if (netlink) {
+        pfd[1].fd = open_netlink();
+        pfd[1].events = POLLIN;
+        nfds = 2;
+    }
+    next_send = now_ns();
+
+    while (1) {
+        now = now_ns();
+        if (now >= next_send) {
+            pkt.seq = htonl(seq++);
+            pkt.send_ns = now;
+            /* Errors are expected while the node has no route to the peer */
+            sendto(s, &pkt, sizeof(pkt), 0, (struct sockaddr *)&peer, peer_len);
+            next_send += (uint64_t)interval * 1000000ULL;
+            if (next_send < now) {
+                next_send = now + (uint64_t)interval * 1000000ULL;
+            }
+        }
+        timeout = (int)((next_send - now) / 1000000ULL);
+        if (poll(pfd, nfds, timeout) <= 0) {
+            continue;
+        }
+        if (nfds == 2 && (pfd[1].revents & POLLIN)) {
+            read_netlink(pfd[1].fd);
+        }
+        if (pfd[0].revents & POLLIN) {
+            if (recv(s, &pkt, sizeof(pkt), 0) == sizeof(pkt)) {
+                printf("rx %u %llu %llu\n", ntohl(pkt.seq), (unsigned long long)pkt.send_ns,
+                        (unsigned long long)now_ns());
+                fflush(stdout);
+            }
+        }
+    }
+    return (0);
+}
@@ -0,0 +1,1222 @@
+/*
+ * lisp_ms_standin.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Standalone Map-Server / Map-Resolver / DDT node stand-in used to
+ * load test lispd without a live mapping system.
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+/*
+ * The stand-in answers, over a plain UDP socket bound to the control port:
+ *
+ *   Map-Register              -> Map-Notify (when the M bit is set)
+ *   ECM Map-Request           -> Map-Reply (positive or negative)
+ *   ECM Map-Request + DDT bit -> Map-Referral (and Map-Reply on MS-ACK)
+ *   Info-Request              -> Info-Reply with NAT LCAF
+ *
+ * Prefixes are read from a file (-f) with one entry per line:
+ *
+ *   map <eid-prefix>/<len> <rloc>[:<priority>:<weight>] ... [split <len>]
+ *   ref <eid-prefix>/<len> <ddt-node> ...
+ *
+ * "split" answers every EID under the prefix with its own more specific
+ * mapping, which allows millions of synthetic EIDs from a single line.
+ * Map-Registers received are added to the same table, so the stand-in
+ * also works as a Map-Server for the registering xTRs.
+ *
+ * Statistics are printed on SIGUSR1, every -s seconds and on exit.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#define DEFAULT_PORT            4342
+#define MAX_PKT                 4096
+#define MAX_RLOCS               8
+#define MAX_RTRS                8
+#define AUTH_DATA_LEN           20
+
+#define LISP_MAP_REQUEST        1
+#define LISP_MAP_REPLY          2
+#define LISP_MAP_REGISTER       3
+#define LISP_MAP_NOTIFY         4
+#define LISP_MAP_REFERRAL       6
+#define LISP_INFO_NAT           7
+#define LISP_ENCAP_CONTROL      8
+
+#define LISP_AFI_NO_ADDR        0
+#define LISP_AFI_IP             1
+#define LISP_AFI_IPV6           2
+#define LISP_AFI_LCAF           16387
+#define LCAF_IID                2
+#define LCAF_NATT               7
+
+#define NODE_REFERRAL           0
+#define MS_ACK                  2
+#define DELEGATION_HOLE         4
+
+#define ENTRY_MAP               0
+#define ENTRY_REF               1
+
+#define QUEUE_SIZE              65536
+
+
+typedef struct {
+    int         afi;                /* AF_INET / AF_INET6 */
+    uint8_t     addr[16];
+} addr_t;
+
+typedef struct {
+    addr_t      addr;
+    uint8_t     priority;
+    uint8_t     weight;
+} rloc_t;
+
+typedef struct entry_ {
+    addr_t          eid;
+    int             plen;
+    int32_t         iid;
+    int             type;
+    int             split;
+    int             rloc_count;
+    rloc_t          rlocs[MAX_RLOCS];
+    struct entry_   *next;
+} entry_t;
+
+typedef struct {
+    struct timespec         due;
+    struct sockaddr_storage dst;
+    socklen_t               dst_len;
+    int                     len;
+    uint8_t                 *pkt;
+} queued_pkt_t;
+
+typedef struct {
+    unsigned long   rx[16];
+    unsigned long   tx[16];
+    unsigned long   lost;
+    unsigned long   rate_limited;
+    unsigned long   malformed;
+    unsigned long   auth_failed;
+    unsigned long   negative;
+    unsigned long   queue_full;
+    unsigned long   registered;
+} stats_t;
+
+
+/* Configuration */
+static char         *bind_addr_str  = "0.0.0.0";
+static int          port            = DEFAULT_PORT;
+static char         *key            = "password";
+static int          ddt_mode        = 0;
+static int          latency_ms      = 0;
+static int          jitter_ms       = 0;
+static double       loss_pct        = 0;
+static int          rate_limit      = 0;
+static int          ttl             = 15;
+static int          neg_plen_v4     = 24;
+static int          neg_plen_v6     = 48;
+static int          neg_action      = 1;
+static int          no_negative     = 0;
+static int          verbose         = 0;
+static int          sock_afi        = AF_INET;
+static int          stats_interval  = 0;
+static addr_t       global_rloc     = {.afi = AF_UNSPEC};
+static addr_t       ms_rloc         = {.afi = AF_UNSPEC};
+static addr_t       rtrs[MAX_RTRS];
+static int          rtr_count       = 0;
+
+/* State */
+static entry_t      **table         = NULL;
+static unsigned int table_size      = 0;
+static unsigned int table_count     = 0;
+static uint8_t      plen_present[2][129];
+static queued_pkt_t queue[QUEUE_SIZE];
+static int          queue_len       = 0;
+static double       tokens          = 0;
+static struct timespec last_refill;
+static stats_t      stats;
+static volatile sig_atomic_t dump_stats = 0;
+static volatile sig_atomic_t finish     = 0;
+
+
+/************************** Helpers **************************/
+
+static int addr_len(int afi)
+{
+    return (afi == AF_INET ? 4 : (afi == AF_INET6 ? 16 : 0));
+}
+
+/* Prefix length within the address length of a known AFI */
+static int valid_prefix(addr_t *a, int plen)
+{
+    return (addr_len(a->afi) != 0 && plen >= 0 && plen <= addr_len(a->afi) * 8);
+}
+
+static int lisp_afi(int afi)
+{
+    return (afi == AF_INET ? LISP_AFI_IP : (afi == AF_INET6 ? LISP_AFI_IPV6 : LISP_AFI_NO_ADDR));
+}
+
+static const char *addr_str(addr_t *a)
+{
+    static char buf[4][INET6_ADDRSTRLEN];
+    static int  i = 0;
+
+    i = (i + 1) % 4;
+    if (a->afi == AF_UNSPEC){
+        return ("-");
+    }
+    inet_ntop(a->afi, a->addr, buf[i], INET6_ADDRSTRLEN);
+    return (buf[i]);
+}
+
+static int parse_addr_str(const char *str, addr_t *a)
+{
+    memset(a, 0, sizeof(addr_t));
+    if (inet_pton(AF_INET, str, a->addr) == 1){
+        a->afi = AF_INET;
+        return (0);
+    }
+    if (inet_pton(AF_INET6, str, a->addr) == 1){
+        a->afi = AF_INET6;
+        return (0);
+    }
+    return (-1);
+}
+
+static void mask_addr(addr_t *a, int plen)
+{
+    int len = addr_len(a->afi);
+    int i;
+
+    for (i = 0; i < len; i++){
+        if (plen >= 8){
+            plen -= 8;
+        }else{
+            a->addr[i] &= (uint8_t)(0xff << (8 - plen));
+            plen = 0;
+        }
+    }
+}
+
+static double ts_diff_ms(struct timespec *a, struct timespec *b)
+{
+    return ((a->tv_sec - b->tv_sec) * 1000.0 + (a->tv_nsec - b->tv_nsec) / 1000000.0);
+}
+
+static void ts_add_ms(struct timespec *t, int ms)
+{
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (t->tv_nsec >= 1000000000){
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+/*
+ * Reads an AFI encoded address (plain or Instance ID LCAF). Returns the
+ * number of bytes consumed or -1 if the address can not be parsed.
+ */
+static int read_afi_addr(uint8_t *p, uint8_t *end, addr_t *a, int32_t *iid)
+{
+    uint16_t    afi;
+    int         len;
+
+    if (p + 2 > end){
+        return (-1);
+    }
+    afi = ntohs(*(uint16_t *)p);
+    memset(a, 0, sizeof(addr_t));
+    switch (afi){
+    case LISP_AFI_NO_ADDR:
+        a->afi = AF_UNSPEC;
+        return (2);
+    case LISP_AFI_IP:
+    case LISP_AFI_IPV6:
+        a->afi = (afi == LISP_AFI_IP) ? AF_INET : AF_INET6;
+        len = addr_len(a->afi);
+        if (p + 2 + len > end){
+            return (-1);
+        }
+        memcpy(a->addr, p + 2, len);
+        return (2 + len);
+    case LISP_AFI_LCAF:
+        if (p + 8 > end){
+            return (-1);
+        }
+        len = ntohs(*(uint16_t *)(p + 6));
+        if (p + 8 + len > end){
+            return (-1);
+        }
+        if (p[4] == LCAF_IID && len >= 6){
+            if (iid != NULL){
+                *iid = ntohl(*(uint32_t *)(p + 8));
+            }
+            if (read_afi_addr(p + 12, p + 8 + len, a, NULL) < 0){
+                return (-1);
+            }
+        }
+        return (8 + len);
+    default:
+        return (-1);
+    }
+}
+
+static uint8_t *write_afi_addr(uint8_t *p, addr_t *a, int32_t iid)
+{
+    int len = addr_len(a->afi);
+
+    if (iid > 0){
+        *(uint16_t *)p = htons(LISP_AFI_LCAF);
+        p[2] = 0;
+        p[3] = 0;
+        p[4] = LCAF_IID;
+        p[5] = 0;
+        *(uint16_t *)(p + 6) = htons(4 + 2 + len);
+        *(uint32_t *)(p + 8) = htonl(iid);
+        p += 12;
+    }
+    *(uint16_t *)p = htons(lisp_afi(a->afi));
+    memcpy(p + 2, a->addr, len);
+    return (p + 2 + len);
+}
+
+
+/************************** Prefix table **************************/
+
+static unsigned int entry_hash(addr_t *eid, int plen, int32_t iid)
+{
+    unsigned int    h = 2166136261u;
+    int             i;
+
+    for (i = 0; i < addr_len(eid->afi); i++){
+        h = (h ^ eid->addr[i]) * 16777619u;
+    }
+    h = (h ^ (unsigned int)plen) * 16777619u;
+    h = (h ^ (unsigned int)iid) * 16777619u;
+    return (h);
+}
+
+static void table_grow()
+{
+    entry_t         **old       = table;
+    unsigned int    old_size    = table_size;
+    entry_t         *e;
+    entry_t         *next;
+    unsigned int    i;
+    unsigned int    h;
+
+    table_size = (old_size == 0) ? 1024 : old_size * 2;
+    table = calloc(table_size, sizeof(entry_t *));
+    if (table == NULL){
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < old_size; i++){
+        for (e = old[i]; e != NULL; e = next){
+            next = e->next;
+            h = entry_hash(&e->eid, e->plen, e->iid) & (table_size - 1);
+            e->next = table[h];
+            table[h] = e;
+        }
+    }
+    free(old);
+}
+
+static entry_t *table_lookup_exact(addr_t *eid, int plen, int32_t iid)
+{
+    entry_t *e;
+
+    if (table_size == 0){
+        return (NULL);
+    }
+    for (e = table[entry_hash(eid, plen, iid) & (table_size - 1)]; e != NULL; e = e->next){
+        if (e->plen == plen && e->iid == iid && e->eid.afi == eid->afi &&
+                memcmp(e->eid.addr, eid->addr, addr_len(eid->afi)) == 0){
+            return (e);
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * Longest prefix match done as one exact lookup per prefix length that
+ * is present in the table.
+ */
+static entry_t *table_lookup(addr_t *eid, int32_t iid)
+{
+    entry_t *e;
+    addr_t  masked;
+    int     idx     = (eid->afi == AF_INET) ? 0 : 1;
+    int     plen;
+
+    for (plen = addr_len(eid->afi) * 8; plen >= 0; plen--){
+        if (plen_present[idx][plen] == 0){
+            continue;
+        }
+        masked = *eid;
+        mask_addr(&masked, plen);
+        if ((e = table_lookup_exact(&masked, plen, iid)) != NULL){
+            return (e);
+        }
+    }
+    return (NULL);
+}
+
+static entry_t *table_add(addr_t *eid, int plen, int32_t iid, int type)
+{
+    entry_t         *e;
+    unsigned int    h;
+
+    mask_addr(eid, plen);
+    if ((e = table_lookup_exact(eid, plen, iid)) != NULL){
+        e->type = type;
+        e->rloc_count = 0;
+        return (e);
+    }
+    if (table_count >= table_size){
+        table_grow();
+    }
+    if ((e = calloc(1, sizeof(entry_t))) == NULL){
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    e->eid = *eid;
+    e->plen = plen;
+    e->iid = iid;
+    e->type = type;
+    h = entry_hash(eid, plen, iid) & (table_size - 1);
+    e->next = table[h];
+    table[h] = e;
+    table_count++;
+    plen_present[eid->afi == AF_INET ? 0 : 1][plen] = 1;
+    return (e);
+}
+
+static int load_prefix_file(const char *file)
+{
+    FILE    *fp;
+    char    line[1024];
+    char    *tok;
+    char    *slash;
+    char    *colon;
+    addr_t  eid;
+    entry_t *e;
+    int     type;
+    int     lineno = 0;
+
+    if ((fp = fopen(file, "r")) == NULL){
+        perror(file);
+        return (-1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL){
+        lineno++;
+        if ((tok = strtok(line, " \t\r\n")) == NULL || tok[0] == '#'){
+            continue;
+        }
+        if (strcmp(tok, "map") == 0){
+            type = ENTRY_MAP;
+        }else if (strcmp(tok, "ref") == 0){
+            type = ENTRY_REF;
+        }else{
+            fprintf(stderr, "%s:%d: unknown entry type %s\n", file, lineno, tok);
+            continue;
+        }
+        if ((tok = strtok(NULL, " \t\r\n")) == NULL || (slash = strchr(tok, '/')) == NULL){
+            fprintf(stderr, "%s:%d: missing EID prefix\n", file, lineno);
+            continue;
+        }
+        *slash = '\0';
+        if (parse_addr_str(tok, &eid) != 0){
+            fprintf(stderr, "%s:%d: bad EID prefix %s\n", file, lineno, tok);
+            continue;
+        }
+        if (!valid_prefix(&eid, atoi(slash + 1))){
+            fprintf(stderr, "%s:%d: bad prefix length %s\n", file, lineno, slash + 1);
+            continue;
+        }
+        e = table_add(&eid, atoi(slash + 1), 0, type);
+        while ((tok = strtok(NULL, " \t\r\n")) != NULL){
+            if (strcmp(tok, "split") == 0){
+                if ((tok = strtok(NULL, " \t\r\n")) == NULL){
+                    fprintf(stderr, "%s:%d: missing split length\n", file, lineno);
+                    break;
+                }
+                /* More specific than the prefix and within the address */
+                if (!valid_prefix(&eid, atoi(tok)) || atoi(tok) <= e->plen){
+                    fprintf(stderr, "%s:%d: bad split length %s\n", file, lineno, tok);
+                    continue;
+                }
+                e->split = atoi(tok);
+                continue;
+            }
+            if (e->rloc_count == MAX_RLOCS){
+                fprintf(stderr, "%s:%d: too many RLOCs\n", file, lineno);
+                break;
+            }
+            e->rlocs[e->rloc_count].priority = 1;
+            e->rlocs[e->rloc_count].weight = 100;
+            /* IPv6 RLOCs use '#' as priority/weight separator */
+            if ((colon = strchr(tok, '#')) != NULL || (strchr(tok, '.') != NULL && (colon = strchr(tok, ':')) != NULL)){
+                *colon = '\0';
+                e->rlocs[e->rloc_count].priority = atoi(colon + 1);
+                if ((colon = strpbrk(colon + 1, ":#")) != NULL){
+                    e->rlocs[e->rloc_count].weight = atoi(colon + 1);
+                }
+            }
+            if (parse_addr_str(tok, &e->rlocs[e->rloc_count].addr) != 0){
+                fprintf(stderr, "%s:%d: bad RLOC %s\n", file, lineno, tok);
+                continue;
+            }
+            e->rloc_count++;
+        }
+    }
+    fclose(fp);
+    return (0);
+}
+
+
+/************************** Output queue **************************/
+
+static void queue_swap(int a, int b)
+{
+    queued_pkt_t tmp = queue[a];
+
+    queue[a] = queue[b];
+    queue[b] = tmp;
+}
+
+static void queue_push(queued_pkt_t *q)
+{
+    int i = queue_len++;
+
+    queue[i] = *q;
+    while (i > 0 && ts_diff_ms(&queue[(i - 1) / 2].due, &queue[i].due) > 0){
+        queue_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void queue_pop()
+{
+    int i = 0;
+    int c;
+
+    queue[0] = queue[--queue_len];
+    while ((c = 2 * i + 1) < queue_len){
+        if (c + 1 < queue_len && ts_diff_ms(&queue[c].due, &queue[c + 1].due) > 0){
+            c++;
+        }
+        if (ts_diff_ms(&queue[i].due, &queue[c].due) <= 0){
+            break;
+        }
+        queue_swap(i, c);
+        i = c;
+    }
+}
+
+static int rate_allowed()
+{
+    struct timespec now;
+
+    if (rate_limit == 0){
+        return (1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    tokens += ts_diff_ms(&now, &last_refill) * rate_limit / 1000.0;
+    if (tokens > rate_limit){
+        tokens = rate_limit;
+    }
+    last_refill = now;
+    if (tokens < 1){
+        return (0);
+    }
+    tokens -= 1;
+    return (1);
+}
+
+/*
+ * Applies loss, rate limit and latency to a reply before it leaves.
+ */
+static void send_reply(int sock, uint8_t *pkt, int len, struct sockaddr *dst, socklen_t dst_len)
+{
+    queued_pkt_t    q;
+    int             delay = latency_ms;
+
+    if (loss_pct > 0 && (rand() / (RAND_MAX + 1.0)) * 100 < loss_pct){
+        stats.lost++;
+        return;
+    }
+    if (rate_allowed() == 0){
+        stats.rate_limited++;
+        return;
+    }
+    stats.tx[pkt[0] >> 4]++;
+    if (jitter_ms > 0){
+        delay += rand() % (jitter_ms + 1);
+    }
+    if (delay == 0){
+        if (sendto(sock, pkt, len, 0, dst, dst_len) < 0 && verbose){
+            perror("sendto");
+        }
+        return;
+    }
+    if (queue_len == QUEUE_SIZE || (q.pkt = malloc(len)) == NULL){
+        stats.queue_full++;
+        return;
+    }
+    memcpy(q.pkt, pkt, len);
+    q.len = len;
+    memcpy(&q.dst, dst, dst_len);
+    q.dst_len = dst_len;
+    clock_gettime(CLOCK_MONOTONIC, &q.due);
+    ts_add_ms(&q.due, delay);
+    queue_push(&q);
+}
+
+/*
+ * Sends queued packets whose time has come. Returns the poll timeout
+ * until the next one.
+ */
+static int flush_queue(int sock)
+{
+    struct timespec now;
+    double          wait;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (queue_len > 0){
+        wait = ts_diff_ms(&queue[0].due, &now);
+        if (wait > 0){
+            return ((int)wait + 1);
+        }
+        sendto(sock, queue[0].pkt, queue[0].len, 0, (struct sockaddr *)&queue[0].dst, queue[0].dst_len);
+        free(queue[0].pkt);
+        queue_pop();
+    }
+    return (-1);
+}
+
+static socklen_t build_sockaddr(addr_t *a, uint16_t dport, struct sockaddr_storage *ss)
+{
+    struct sockaddr_in  *s4 = (struct sockaddr_in *)ss;
+    struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)ss;
+
+    memset(ss, 0, sizeof(struct sockaddr_storage));
+    if (a->afi == AF_INET && sock_afi == AF_INET6){
+        /* IPv4 destination reached through a dual stack socket */
+        s6->sin6_family = AF_INET6;
+        s6->sin6_port = htons(dport);
+        s6->sin6_addr.s6_addr[10] = 0xff;
+        s6->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&s6->sin6_addr.s6_addr[12], a->addr, 4);
+        return (sizeof(struct sockaddr_in6));
+    }
+    if (a->afi == AF_INET){
+        s4->sin_family = AF_INET;
+        s4->sin_port = htons(dport);
+        memcpy(&s4->sin_addr, a->addr, 4);
+        return (sizeof(struct sockaddr_in));
+    }
+    s6->sin6_family = AF_INET6;
+    s6->sin6_port = htons(dport);
+    memcpy(&s6->sin6_addr, a->addr, 16);
+    return (sizeof(struct sockaddr_in6));
+}
+
+static void sockaddr_to_addr(struct sockaddr_storage *ss, addr_t *a, uint16_t *sport)
+{
+    memset(a, 0, sizeof(addr_t));
+    if (ss->ss_family == AF_INET){
+        a->afi = AF_INET;
+        memcpy(a->addr, &((struct sockaddr_in *)ss)->sin_addr, 4);
+        *sport = ntohs(((struct sockaddr_in *)ss)->sin_port);
+    }else{
+        a->afi = AF_INET6;
+        /* v4 mapped addresses come from a dual stack socket */
+        if (IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *)ss)->sin6_addr)){
+            a->afi = AF_INET;
+            memcpy(a->addr, ((uint8_t *)&((struct sockaddr_in6 *)ss)->sin6_addr) + 12, 4);
+        }else{
+            memcpy(a->addr, &((struct sockaddr_in6 *)ss)->sin6_addr, 16);
+        }
+        *sport = ntohs(((struct sockaddr_in6 *)ss)->sin6_port);
+    }
+}
+
+
+/************************** Message processing **************************/
+
+static uint8_t *write_record_hdr(uint8_t *p, int rec_ttl, int loc_count, int plen, int act, int auth)
+{
+    *(uint32_t *)p = htonl(rec_ttl);
+    p[4] = loc_count;
+    p[5] = plen;
+    p[6] = (act << 5) | (auth ? 0x10 : 0);
+    p[7] = 0;
+    p[8] = 0;
+    p[9] = 0;
+    return (p + 10);
+}
+
+static uint8_t *write_locator(uint8_t *p, rloc_t *r)
+{
+    p[0] = r->priority;
+    p[1] = r->weight;
+    p[2] = 255;
+    p[3] = 0;
+    p[4] = 0;
+    p[5] = 0x01;        /* R bit */
+    return (write_afi_addr(p + 6, &r->addr, 0));
+}
+
+/*
+ * Resolves the EID against the prefix table and returns the prefix to be
+ * used in the answer. The entry is NULL for a negative answer.
+ */
+static entry_t *resolve(addr_t *eid, int32_t iid, addr_t *prefix, int *plen)
+{
+    entry_t *e = table_lookup(eid, iid);
+
+    *prefix = *eid;
+    if (e == NULL){
+        *plen = (eid->afi == AF_INET) ? neg_plen_v4 : neg_plen_v6;
+    }else if (e->split > e->plen){
+        *plen = e->split;
+    }else{
+        *plen = e->plen;
+    }
+    mask_addr(prefix, *plen);
+    return (e);
+}
+
+static void send_map_reply(int sock, uint8_t *nonce, addr_t *eid, int32_t iid,
+        addr_t *itr_rloc, uint16_t itr_port)
+{
+    uint8_t                 pkt[MAX_PKT];
+    uint8_t                 *p      = pkt;
+    struct sockaddr_storage dst;
+    addr_t                  prefix;
+    entry_t                 *e;
+    int                     plen;
+    int                     i;
+
+    e = resolve(eid, iid, &prefix, &plen);
+    if (e != NULL && e->type != ENTRY_MAP){
+        e = NULL;
+    }
+    if (e == NULL){
+        stats.negative++;
+        if (no_negative){
+            return;
+        }
+    }
+    memset(pkt, 0, 12);
+    pkt[0] = LISP_MAP_REPLY << 4;
+    pkt[3] = 1;
+    memcpy(pkt + 4, nonce, 8);
+    p = write_record_hdr(pkt + 12, ttl, e ? e->rloc_count : 0, plen, e ? 0 : neg_action, 1);
+    p = write_afi_addr(p, &prefix, iid);
+    for (i = 0; e != NULL && i < e->rloc_count; i++){
+        p = write_locator(p, &e->rlocs[i]);
+    }
+    send_reply(sock, pkt, p - pkt, (struct sockaddr *)&dst, build_sockaddr(itr_rloc, itr_port, &dst));
+    if (verbose){
+        printf("Map-Reply %s/%d (%d locators) to %s:%d\n", addr_str(&prefix), plen,
+                e ? e->rloc_count : 0, addr_str(itr_rloc), itr_port);
+    }
+}
+
+static void send_map_referral(int sock, uint8_t *nonce, addr_t *eid, int32_t iid,
+        struct sockaddr_storage *from, socklen_t from_len, int *is_ms_ack)
+{
+    uint8_t     pkt[MAX_PKT];
+    uint8_t     *p      = pkt;
+    addr_t      prefix;
+    entry_t     *e;
+    int         plen;
+    int         act;
+    int         i;
+
+    e = resolve(eid, iid, &prefix, &plen);
+    if (e == NULL){
+        act = DELEGATION_HOLE;
+        stats.negative++;
+    }else if (e->type == ENTRY_REF){
+        act = NODE_REFERRAL;
+    }else{
+        act = MS_ACK;
+    }
+    *is_ms_ack = (act == MS_ACK);
+
+    memset(pkt, 0, 12);
+    pkt[0] = LISP_MAP_REFERRAL << 4;
+    pkt[3] = 1;
+    memcpy(pkt + 4, nonce, 8);
+    p = write_record_hdr(pkt + 12, ttl, act == NODE_REFERRAL ? e->rloc_count : 0, plen, act, 1);
+    p = write_afi_addr(p, &prefix, iid);
+    for (i = 0; act == NODE_REFERRAL && i < e->rloc_count; i++){
+        p = write_locator(p, &e->rlocs[i]);
+    }
+    send_reply(sock, pkt, p - pkt, (struct sockaddr *)from, from_len);
+    if (verbose){
+        printf("Map-Referral %s/%d act %d\n", addr_str(&prefix), plen, act);
+    }
+}
+
+static void process_map_request(int sock, uint8_t *pkt, uint8_t *end, int ddt,
+        uint16_t inner_sport, struct sockaddr_storage *from, socklen_t from_len)
+{
+    uint8_t     nonce[8];
+    uint8_t     *p;
+    addr_t      src_eid;
+    addr_t      itr_rloc;
+    addr_t      chosen      = {.afi = AF_UNSPEC};
+    addr_t      eid;
+    int32_t     iid         = 0;
+    int         irc;
+    int         rec;
+    int         len;
+    int         ms_ack      = 0;
+    int         i;
+
+    if (pkt + 14 > end || (pkt[0] & 0x02) != 0){
+        /* RLOC probes are answered by the xTRs, not by the mapping system */
+        stats.malformed++;
+        return;
+    }
+    memcpy(nonce, pkt + 4, 8);
+    irc = (pkt[2] & 0x1f) + 1;
+    rec = pkt[3];
+    p = pkt + 12;
+    if ((len = read_afi_addr(p, end, &src_eid, NULL)) < 0){
+        stats.malformed++;
+        return;
+    }
+    p += len;
+    for (i = 0; i < irc; i++){
+        if ((len = read_afi_addr(p, end, &itr_rloc, NULL)) < 0){
+            stats.malformed++;
+            return;
+        }
+        if (chosen.afi == AF_UNSPEC || itr_rloc.afi == from->ss_family){
+            chosen = itr_rloc;
+        }
+        p += len;
+    }
+    for (i = 0; i < rec; i++){
+        if (p + 2 > end || (len = read_afi_addr(p + 2, end, &eid, &iid)) < 0){
+            stats.malformed++;
+            return;
+        }
+        p += 2 + len;
+        if (ddt){
+            send_map_referral(sock, nonce, &eid, iid, from, from_len, &ms_ack);
+        }
+        if (ddt == 0 || ms_ack){
+            send_map_reply(sock, nonce, &eid, iid, &chosen, inner_sport);
+        }
+    }
+}
+
+static void process_map_register(int sock, uint8_t *pkt, uint8_t *end,
+        struct sockaddr_storage *from, socklen_t from_len)
+{
+    uint8_t         auth[AUTH_DATA_LEN];
+    uint8_t         *p          = pkt + 36;
+    unsigned int    md_len      = 0;
+    addr_t          eid;
+    addr_t          rloc;
+    entry_t         *e;
+    int32_t         iid;
+    int             rec;
+    int             locs;
+    int             plen;
+    int             len;
+    int             i;
+    int             j;
+
+    if (p > end){
+        stats.malformed++;
+        return;
+    }
+    rec = pkt[3];
+    /* Auth data is computed with the auth field set to zero */
+    memcpy(auth, pkt + 16, AUTH_DATA_LEN);
+    memset(pkt + 16, 0, AUTH_DATA_LEN);
+    HMAC(EVP_sha1(), key, strlen(key), pkt, end - pkt, pkt + 16, &md_len);
+    if (memcmp(auth, pkt + 16, AUTH_DATA_LEN) != 0){
+        stats.auth_failed++;
+        if (verbose){
+            printf("Map-Register with wrong auth data\n");
+        }
+        return;
+    }
+    for (i = 0; i < rec; i++){
+        if (p + 10 > end){
+            stats.malformed++;
+            return;
+        }
+        locs = p[4];
+        plen = p[5];
+        iid = 0;
+        if ((len = read_afi_addr(p + 10, end, &eid, &iid)) < 0){
+            stats.malformed++;
+            return;
+        }
+        p += 10 + len;
+        if (!valid_prefix(&eid, plen)){
+            stats.malformed++;
+            return;
+        }
+        e = table_add(&eid, plen, iid, ENTRY_MAP);
+        for (j = 0; j < locs; j++){
+            if (p + 6 > end){
+                stats.malformed++;
+                return;
+            }
+            if ((len = read_afi_addr(p + 6, end, &rloc, NULL)) < 0){
+                stats.malformed++;
+                return;
+            }
+            if (e->rloc_count < MAX_RLOCS && rloc.afi != AF_UNSPEC){
+                e->rlocs[e->rloc_count].addr = rloc;
+                e->rlocs[e->rloc_count].priority = p[0];
+                e->rlocs[e->rloc_count].weight = p[1];
+                e->rloc_count++;
+            }
+            p += 6 + len;
+        }
+        stats.registered++;
+        if (verbose){
+            printf("Registered %s/%d with %d locators\n", addr_str(&e->eid), plen, e->rloc_count);
+        }
+    }
+    if ((pkt[2] & 0x01) == 0){
+        return;
+    }
+    /* Map-Notify is the Map-Register with a new header and auth data */
+    pkt[0] = (LISP_MAP_NOTIFY << 4) | ((pkt[0] & 0x02) ? 0x08 : 0);
+    pkt[1] = 0;
+    pkt[2] = 0;
+    memset(pkt + 16, 0, AUTH_DATA_LEN);
+    HMAC(EVP_sha1(), key, strlen(key), pkt, end - pkt, pkt + 16, &md_len);
+    send_reply(sock, pkt, end - pkt, (struct sockaddr *)from, from_len);
+}
+
+static void process_info_request(int sock, uint8_t *pkt, uint8_t *end,
+        struct sockaddr_storage *from, socklen_t from_len)
+{
+    uint8_t         reply[MAX_PKT];
+    uint8_t         *p;
+    uint8_t         *lcaf;
+    unsigned int    md_len  = 0;
+    addr_t          eid;
+    addr_t          src;
+    uint16_t        sport;
+    int             hdr_len;
+    int             len;
+    int             i;
+
+    if ((pkt[0] & 0x08) != 0 || pkt + 44 > end){
+        stats.malformed++;
+        return;
+    }
+    if ((len = read_afi_addr(pkt + 42, end, &eid, NULL)) < 0){
+        stats.malformed++;
+        return;
+    }
+    hdr_len = 42 + len;
+    sockaddr_to_addr(from, &src, &sport);
+
+    memcpy(reply, pkt, hdr_len);
+    reply[0] |= 0x08;           /* R bit */
+    *(uint16_t *)(reply + 14) = htons(AUTH_DATA_LEN);
+    memset(reply + 16, 0, AUTH_DATA_LEN);
+
+    lcaf = reply + hdr_len;
+    *(uint16_t *)lcaf = htons(LISP_AFI_LCAF);
+    lcaf[2] = 0;
+    lcaf[3] = 0;
+    lcaf[4] = LCAF_NATT;
+    lcaf[5] = 0;
+    *(uint16_t *)(lcaf + 8) = htons(port);
+    *(uint16_t *)(lcaf + 10) = htons(sport);
+    p = lcaf + 12;
+    p = write_afi_addr(p, global_rloc.afi != AF_UNSPEC ? &global_rloc : &src, 0);
+    p = write_afi_addr(p, ms_rloc.afi != AF_UNSPEC ? &ms_rloc : &src, 0);
+    p = write_afi_addr(p, &src, 0);
+    for (i = 0; i < rtr_count; i++){
+        p = write_afi_addr(p, &rtrs[i], 0);
+    }
+    *(uint16_t *)(lcaf + 6) = htons(p - lcaf - 8);
+
+    HMAC(EVP_sha1(), key, strlen(key), reply, p - reply, reply + 16, &md_len);
+    send_reply(sock, reply, p - reply, (struct sockaddr *)from, from_len);
+    if (verbose){
+        printf("Info-Reply for %s to %s:%d\n", addr_str(&eid), addr_str(&src), sport);
+    }
+}
+
+static void process_ecm(int sock, uint8_t *pkt, uint8_t *end,
+        struct sockaddr_storage *from, socklen_t from_len)
+{
+    uint8_t     *inner      = pkt + 4;
+    uint16_t    inner_sport;
+    int         ddt         = (pkt[0] & 0x04) != 0;
+    int         ip_len;
+
+    if (inner + 1 > end){
+        stats.malformed++;
+        return;
+    }
+    ip_len = ((inner[0] >> 4) == 4) ? (inner[0] & 0x0f) * 4 : 40;
+    if (inner + ip_len + 8 + 4 > end){
+        stats.malformed++;
+        return;
+    }
+    inner_sport = ntohs(*(uint16_t *)(inner + ip_len));
+    inner += ip_len + 8;
+    stats.rx[inner[0] >> 4]++;
+    switch (inner[0] >> 4){
+    case LISP_MAP_REQUEST:
+        process_map_request(sock, inner, end, ddt, inner_sport, from, from_len);
+        break;
+    case LISP_MAP_REGISTER:
+        process_map_register(sock, inner, end, from, from_len);
+        break;
+    default:
+        stats.malformed++;
+        break;
+    }
+}
+
+
+/************************** Main **************************/
+
+static void print_stats()
+{
+    static const char   *names[16] = {NULL, "map-request", "map-reply", "map-register", "map-notify",
+            NULL, "map-referral", "info-nat", "ecm"};
+    int                 i;
+
+    printf("---- stats ----\n");
+    for (i = 0; i < 16; i++){
+        if (names[i] != NULL && (stats.rx[i] != 0 || stats.tx[i] != 0)){
+            printf("%-14s rx %10lu  tx %10lu\n", names[i], stats.rx[i], stats.tx[i]);
+        }
+    }
+    printf("negative %lu  lost %lu  rate-limited %lu  queue-full %lu  malformed %lu  auth-failed %lu\n",
+            stats.negative, stats.lost, stats.rate_limited, stats.queue_full, stats.malformed, stats.auth_failed);
+    printf("registrations %lu  table entries %u  queued %d\n", stats.registered, table_count, queue_len);
+    fflush(stdout);
+}
+
+static void signal_handler(int sig)
+{
+    if (sig == SIGUSR1){
+        dump_stats = 1;
+    }else{
+        finish = 1;
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  -b addr      bind address (default 0.0.0.0)\n"
+            "  -p port      UDP port (default 4342)\n"
+            "  -k key       authentication key (default \"password\")\n"
+            "  -f file      prefix file (map/ref entries)\n"
+            "  -D           DDT node mode: answer with Map-Referrals\n"
+            "  -l ms        response latency\n"
+            "  -j ms        random jitter added to latency\n"
+            "  -L percent   reply loss percentage\n"
+            "  -r n         max replies per second (0 unlimited)\n"
+            "  -t min       record TTL in minutes (default 15)\n"
+            "  -4 len       negative reply prefix length for IPv4 (default 24)\n"
+            "  -6 len       negative reply prefix length for IPv6 (default 48)\n"
+            "  -A act       negative reply action (default 1, natively forward)\n"
+            "  -N           don't answer misses\n"
+            "  -g addr      global ETR RLOC announced in Info-Replies (NAT emulation)\n"
+            "  -m addr      MS RLOC announced in Info-Replies\n"
+            "  -R addr      RTR announced in Info-Replies (repeatable)\n"
+            "  -s sec       print statistics every sec seconds\n"
+            "  -v           verbose\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_storage local;
+    struct sockaddr_storage from;
+    socklen_t               from_len;
+    socklen_t               local_len;
+    struct pollfd           pfd;
+    struct timespec         now;
+    struct timespec         last_stats;
+    addr_t                  bind_addr;
+    uint8_t                 pkt[MAX_PKT];
+    int                     sock;
+    int                     opt;
+    int                     timeout;
+    int                     len;
+    int                     on      = 1;
+
+    while ((opt = getopt(argc, argv, "b:p:k:f:Dl:j:L:r:t:4:6:A:Ng:m:R:s:v")) != -1){
+        switch (opt){
+        case 'b': bind_addr_str = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'k': key = optarg; break;
+        case 'f':
+            if (load_prefix_file(optarg) != 0){
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D': ddt_mode = 1; break;
+        case 'l': latency_ms = atoi(optarg); break;
+        case 'j': jitter_ms = atoi(optarg); break;
+        case 'L': loss_pct = atof(optarg); break;
+        case 'r': rate_limit = atoi(optarg); break;
+        case 't': ttl = atoi(optarg); break;
+        case '4': neg_plen_v4 = atoi(optarg); break;
+        case '6': neg_plen_v6 = atoi(optarg); break;
+        case 'A': neg_action = atoi(optarg) & 0x07; break;
+        case 'N': no_negative = 1; break;
+        case 'g':
+            if (parse_addr_str(optarg, &global_rloc) != 0){
+                usage(argv[0]);
+            }
+            break;
+        case 'm':
+            if (parse_addr_str(optarg, &ms_rloc) != 0){
+                usage(argv[0]);
+            }
+            break;
+        case 'R':
+            if (rtr_count == MAX_RTRS || parse_addr_str(optarg, &rtrs[rtr_count++]) != 0){
+                usage(argv[0]);
+            }
+            break;
+        case 's': stats_interval = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (table_size == 0){
+        table_grow();
+    }
+    if (parse_addr_str(bind_addr_str, &bind_addr) != 0){
+        usage(argv[0]);
+    }
+
+    sock_afi = bind_addr.afi;
+    if ((sock = socket(bind_addr.afi, SOCK_DGRAM, IPPROTO_UDP)) < 0){
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    local_len = build_sockaddr(&bind_addr, port, &local);
+    if (bind(sock, (struct sockaddr *)&local, local_len) < 0){
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGUSR1, signal_handler);
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    srand(time(NULL));
+    clock_gettime(CLOCK_MONOTONIC, &last_refill);
+    last_stats = last_refill;
+    tokens = rate_limit;
+
+    printf("Mapping system stand-in listening on %s:%d (%s mode, %u prefixes)\n",
+            bind_addr_str, port, ddt_mode ? "DDT" : "MS/MR", table_count);
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    while (finish == 0){
+        timeout = flush_queue(sock);
+        if (stats_interval > 0 && (timeout < 0 || timeout > 1000)){
+            timeout = 1000;
+        }
+        if (poll(&pfd, 1, timeout) > 0){
+            from_len = sizeof(from);
+            len = recvfrom(sock, pkt, MAX_PKT, 0, (struct sockaddr *)&from, &from_len);
+            if (len > 0){
+                switch (pkt[0] >> 4){
+                case LISP_ENCAP_CONTROL:
+                    stats.rx[LISP_ENCAP_CONTROL]++;
+                    process_ecm(sock, pkt, pkt + len, &from, from_len);
+                    break;
+                case LISP_MAP_REGISTER:
+                    stats.rx[LISP_MAP_REGISTER]++;
+                    process_map_register(sock, pkt, pkt + len, &from, from_len);
+                    break;
+                case LISP_INFO_NAT:
+                    stats.rx[LISP_INFO_NAT]++;
+                    process_info_request(sock, pkt, pkt + len, &from, from_len);
+                    break;
+                default:
+                    stats.rx[pkt[0] >> 4]++;
+                    stats.malformed++;
+                    break;
+                }
+            }
+        }
+        if (stats_interval > 0){
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (ts_diff_ms(&now, &last_stats) >= stats_interval * 1000.0){
+                last_stats = now;
+                dump_stats = 1;
+            }
+        }
+        if (dump_stats){
+            dump_stats = 0;
+            print_stats();
+        }
+    }
+    print_stats();
+    close(sock);
+    return (0);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
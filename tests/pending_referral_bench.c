@@ -0,0 +1,175 @@
+/*
+ * pending_referral_bench.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Benchmark of the pending DDT referral table with many concurrent
+ * resolutions. Linked against the lispd objects (see Makefile).
+ *
+ * Copyright (C) 2011 Cisco Systems, Inc, 2011. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "lispd_external.h"
+#include "lispd_lib.h"
+#include "lispd_map_cache.h"
+#include "lispd_map_referral.h"
+#include "lispd_referral_cache.h"
+
+#define DEFAULT_PENDING     100000
+#define LINEAR_SAMPLES      1000
+
+extern lispd_pending_referral_cache_list *pening_referrals_list;
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    return ((end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec));
+}
+
+static lisp_addr_t get_eid(int index)
+{
+    lisp_addr_t eid;
+
+    memset(&eid, 0, sizeof(lisp_addr_t));
+    eid.afi = AF_INET;
+    eid.address.ip.s_addr = htonl(0x0A000000 + index);
+    return (eid);
+}
+
+/* Lookup as done before the pending referrals were indexed */
+static lispd_pending_referral_cache_entry *linear_lookup_by_eid(lisp_addr_t *eid, int eid_prefix_length)
+{
+    lispd_pending_referral_cache_list   *aux_list   = pening_referrals_list;
+    lispd_mapping_elt                   *mapping    = NULL;
+
+    while (aux_list != NULL){
+        mapping = aux_list->pending_referral_cache_entry->map_cache_entry->mapping;
+        if (compare_lisp_addr_t(&(mapping->eid_prefix), eid) == 0 && mapping->eid_prefix_length == eid_prefix_length){
+            return (aux_list->pending_referral_cache_entry);
+        }
+        aux_list = aux_list->next;
+    }
+    return (NULL);
+}
+
+int main(int argc, char **argv)
+{
+    lispd_pending_referral_cache_entry  **pending    = NULL;
+    lispd_map_cache_entry               **entries    = NULL;
+    lispd_referral_cache_entry          *root        = NULL;
+    lisp_addr_t                         eid;
+    struct timespec                     start, end;
+    int                                 count       = DEFAULT_PENDING;
+    int                                 errors      = 0;
+    int                                 samples     = 0;
+    int                                 i           = 0;
+
+    if (argc > 1) {
+        count = atoi(argv[1]);
+    }
+    if (count <= 0) {
+        printf("Usage: %s [pending resolutions]\n", argv[0]);
+        exit(1);
+    }
+
+    init_globales();
+    debug_level = 0;
+
+    pending = calloc(count, sizeof(lispd_pending_referral_cache_entry *));
+    entries = calloc(count, sizeof(lispd_map_cache_entry *));
+    eid = get_eid(0);
+    root = new_referral_cache_entry(new_mapping(eid, 0, 0), NODE_REFERRAL, 1440);
+    if (pending == NULL || entries == NULL || root == NULL) {
+        printf("Unable to allocate memory\n");
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        eid = get_eid(i);
+        entries[i] = new_map_cache_entry_no_db(eid, 32, DYNAMIC_MAP_CACHE_ENTRY, DEFAULT_DATA_CACHE_TTL);
+        pending[i] = new_pending_referral_cache_entry(entries[i], eid, root);
+        if (entries[i] == NULL || pending[i] == NULL ||
+                add_pending_referral_cache_entry_to_list(pending[i]) != GOOD) {
+            printf("Unable to add pending referral %d\n", i);
+            exit(1);
+        }
+        pending[i]->nonces = new_nonces_list();
+        pending[i]->nonces->nonce[0] = build_nonce(i);
+        add_nonce_to_pending_referral_cache_entry(pending[i], pending[i]->nonces->nonce[0], NULL);
+        pending[i]->nonces->retransmits = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("insert:              %8d entries  %10.1f ns/op\n", count, elapsed_ns(&start, &end) / count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        if (lookup_pending_referral_cache_entry_by_eid(get_eid(i), 32) != pending[i]) {
+            errors++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("lookup by eid:       %8d lookups  %10.1f ns/op\n", count, elapsed_ns(&start, &end) / count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        if (lookup_pending_referral_cache_entry_by_nonce(pending[i]->nonces->nonce[0]) != pending[i]) {
+            errors++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("lookup by nonce:     %8d lookups  %10.1f ns/op\n", count, elapsed_ns(&start, &end) / count);
+
+    samples = count < LINEAR_SAMPLES ? count : LINEAR_SAMPLES;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < samples; i++) {
+        eid = get_eid((int)(((long)i * count) / samples));
+        if (linear_lookup_by_eid(&eid, 32) == NULL) {
+            errors++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("linear scan by eid:  %8d lookups  %10.1f ns/op\n", samples, elapsed_ns(&start, &end) / samples);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        remove_pending_referral_cache_entry_from_list(pending[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("remove:              %8d entries  %10.1f ns/op\n", count, elapsed_ns(&start, &end) / count);
+
+    if (pening_referrals_list != NULL || lookup_pending_referral_cache_entry_by_eid(get_eid(0), 32) != NULL) {
+        errors++;
+    }
+    for (i = 0; i < count; i++) {
+        free_map_cache_entry(entries[i]);
+    }
+
+    if (errors != 0) {
+        printf("FAILED: %d errors\n", errors);
+        exit(1);
+    }
+    printf("OK\n");
+    return (0);
+}